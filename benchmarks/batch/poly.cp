@@ -0,0 +1,12 @@
+int n, k, s;
+double x, y;
+s = 0;
+y = 0.0;
+k = 0;
+while (k < 200) do
+    s = s + n * k % 13;
+    y = y * 0.5 + x;
+    k = k + 1;
+od;
+print s;
+print y
@@ -0,0 +1,13 @@
+int n, i, j, sum;
+n = 2000;
+sum = 0;
+i = n;
+while (i > 0) do
+    j = 0;
+    while (j < 10) do
+        if (j % 2 == 0) then sum = sum + i * 2; else sum = sum - j; fi;
+        j = j + 1;
+    od;
+    i = i - 1;
+od;
+print sum
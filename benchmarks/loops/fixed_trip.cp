@@ -0,0 +1,22 @@
+def int dot4(int a)
+    int k, acc;
+    k = 0;
+    acc = 0;
+    while (k < 4) do
+        acc = acc + a * k;
+        k = k + 1;
+    od;
+    return acc;
+fed;
+def int sum100(int a)
+    int k, acc;
+    k = 0;
+    acc = 0;
+    while (k < 100) do
+        acc = acc + a;
+        k = k + 1;
+    od;
+    return acc;
+fed;
+print dot4(5);
+print sum100(3)
@@ -0,0 +1,15 @@
+def int grid(int rows, int cols)
+    int i, j, total;
+    i = 0;
+    total = 0;
+    while (i < rows) do
+        j = 0;
+        while (j < cols) do
+            total = total + i * 64 + j * 4;
+            j = j + 1;
+        od;
+        i = i + 1;
+    od;
+    return total;
+fed;
+print grid(300, 300)
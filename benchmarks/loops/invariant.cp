@@ -0,0 +1,12 @@
+def int scale(int n, int a, int b)
+    int i, s, t;
+    i = 0;
+    s = 0;
+    while (i < n) do
+        t = a * b + 7;
+        s = s + t * 3 - a / 2;
+        i = i + 1;
+    od;
+    return s;
+fed;
+print scale(100000, 3, 4)
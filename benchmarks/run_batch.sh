@@ -0,0 +1,37 @@
+#!/bin/sh
+# Runs every program in benchmarks/batch over 100000 generated input rows, in lockstep and row by row on the
+# scalar VM
+set -e
+root=$(cd "$(dirname "$0")/.." && pwd)
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+gcc -O2 -o "$work/lockstep" "$root/compiler.c"
+gcc -O2 -DVM_BATCH_SCALAR -o "$work/scalar" "$root/compiler.c"
+
+# Input rows for each program
+awk 'BEGIN { print "n x"; for (i = 1; i <= 100000; i++) printf "%d %.3f\n", i, i / 7 }' > "$work/poly.txt"
+awk 'BEGIN { print "n"; for (i = 1; i <= 100000; i++) print i }' > "$work/collatz.txt"
+
+# Steps, running time and throughput of the last run
+report() {
+    awk '
+        /^Executed:/   { executed = $2 }
+        /^Time:/       { time = $2 }
+        /^Throughput:/ { throughput = $2 }
+        END            { printf "%12s dispatches %10s s %10s rows/s\n", executed, time, throughput }
+    ' vm_report.txt
+}
+
+for program in "$root"/benchmarks/batch/*.cp; do
+    name=$(basename "$program" .cp)
+    echo "== $name"
+    for mode in scalar lockstep; do
+        for flags in "" "-O"; do
+            mkdir -p "$work/$name/$mode$flags"
+            cd "$work/$name/$mode$flags"
+            "$work/$mode" $flags -b "$work/$name.txt" "$program"
+            printf "%-8s %-3s %s\n" "$mode" "$flags" "$(report)"
+        done
+    done
+    cmp -s "$work/$name/scalar/batch_output.txt" "$work/$name/lockstep/batch_output.txt" || echo "outputs differ"
+done
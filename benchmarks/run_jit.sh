@@ -0,0 +1,29 @@
+#!/bin/sh
+# Runs every program in benchmarks/vm on the VM alone and with the JIT (-j) at two thresholds, with and without
+# -O, checks that all print the same and reports the speedup and compile time of the JIT
+set -e
+root=$(cd "$(dirname "$0")/.." && pwd)
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+gcc -O2 -o "$work/compiler" "$root/compiler.c"
+
+for program in "$root"/benchmarks/vm/*.cp; do
+    name=$(basename "$program" .cp)
+    echo "== $name"
+    for flags in "" "-O"; do
+        mkdir -p "$work/$name$flags"
+        cd "$work/$name$flags"
+        "$work/compiler" $flags -r "$program" > vm_output.txt
+        vm=$(awk '/^Time:/ { print $2 }' vm_report.txt)
+        for threshold in 1 100; do
+            "$work/compiler" $flags -j $threshold "$program" > jit_output.txt
+            cmp -s vm_output.txt jit_output.txt || echo "outputs differ"
+            awk -v flags="$flags" -v threshold=$threshold -v vm="$vm" '
+                /^Time:/ { time = $2 }
+                /^JIT:/  { compiled = $5; total = $7; bytes = $11; micros = $14 }
+                END      { printf "%-3s -j %-3s vm %9s s  jit %9s s  %6.1fx  %s of %s functions, %5s bytes in %6s us\n",
+                                  flags, threshold, vm, time, vm / time, compiled, total, bytes, micros }
+            ' vm_report.txt
+        done
+    done
+done
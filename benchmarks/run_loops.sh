@@ -0,0 +1,26 @@
+#!/bin/sh
+# Compiles every program in benchmarks/loops with and without -O and reports the loop passes
+set -e
+root=$(cd "$(dirname "$0")/.." && pwd)
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+gcc -O2 -o "$work/compiler" "$root/compiler.c"
+
+# Instructions between each loop header label and the Goto back to it, summed over the loops of the file
+loop_instrs() {
+    awk '
+        /^L[0-9]+$/          { pos[$1] = n }
+        /^    Goto L[0-9]+$/ { if ($2 in pos) total += n - pos[$2] }
+        /^    /              { n++ }
+        END                  { print total + 0 }
+    ' "$1"
+}
+
+for program in "$root"/benchmarks/loops/*.cp; do
+    name=$(basename "$program" .cp)
+    mkdir -p "$work/$name/plain" "$work/$name/opt"
+    (cd "$work/$name/plain" && "$work/compiler" "$program" > /dev/null)
+    (cd "$work/$name/opt" && "$work/compiler" -O "$program" > /dev/null)
+    echo "== $name: loop instructions $(loop_instrs "$work/$name/plain/tac.txt") -> $(loop_instrs "$work/$name/opt/tac.txt")"
+    grep -E '^Function|Loops:' "$work/$name/opt/opt_report.txt"
+done
@@ -0,0 +1,30 @@
+#!/bin/sh
+# Runs every program in benchmarks/vm on the VM and as a native executable (-S), with and without -O, checks
+# that both print the same and reports the speedup of the native code
+set -e
+root=$(cd "$(dirname "$0")/.." && pwd)
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+gcc -O2 -o "$work/compiler" "$root/compiler.c"
+
+# Wall clock seconds of a command
+seconds() {
+    start=$(date +%s%N)
+    "$@" > native_output.txt
+    end=$(date +%s%N)
+    echo "$start $end" | awk '{ printf "%.6f", ($2 - $1) / 1e9 }'
+}
+
+for program in "$root"/benchmarks/vm/*.cp; do
+    name=$(basename "$program" .cp)
+    echo "== $name"
+    for flags in "" "-O"; do
+        mkdir -p "$work/$name$flags"
+        cd "$work/$name$flags"
+        "$work/compiler" $flags -r -S "$program" > vm_output.txt
+        vm=$(awk '/^Time:/ { print $2 }' vm_report.txt)
+        native=$(seconds ./program)
+        cmp -s vm_output.txt native_output.txt || echo "outputs differ"
+        echo "$vm $native" | awk -v flags="$flags" '{ printf "%-3s vm %10s s  native %10s s  %6.1fx\n", flags, $1, $2, $1 / $2 }'
+    done
+done
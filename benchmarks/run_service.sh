@@ -0,0 +1,36 @@
+#!/bin/sh
+# Runs every program in benchmarks/batch over 100000 generated input rows on the execution service with 1, 2
+# and 4 workers. Throughput only scales up to the number of cores
+set -e
+root=$(cd "$(dirname "$0")/.." && pwd)
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+gcc -O2 -pthread -o "$work/compiler" "$root/compiler.c"
+echo "cores: $(nproc)"
+
+# Input rows for each program
+awk 'BEGIN { print "n x"; for (i = 1; i <= 100000; i++) printf "%d %.3f\n", i, i / 7 }' > "$work/poly.txt"
+awk 'BEGIN { print "n"; for (i = 1; i <= 100000; i++) print i }' > "$work/collatz.txt"
+
+# Throughput and latency of the last run
+report() {
+    awk '
+        /^Time:/                  { time = $2 }
+        /^Throughput:/            { throughput = $2 }
+        /^Latency:.*from submit/  { submit = $3 "/" $6 }
+        /^Latency:.*running/      { running = $3 "/" $6 }
+        END { printf "%10s s %10s rows/s  p50/p99 us: %16s submitted %12s running\n", time, throughput, submit, running }
+    ' vm_report.txt
+}
+
+for program in "$root"/benchmarks/batch/*.cp; do
+    name=$(basename "$program" .cp)
+    echo "== $name"
+    for workers in 1 2 4; do
+        mkdir -p "$work/$name/$workers"
+        cd "$work/$name/$workers"
+        "$work/compiler" -O -w $workers -b "$work/$name.txt" "$program"
+        printf "%d workers %s\n" $workers "$(report)"
+    done
+    cmp -s "$work/$name/1/batch_output.txt" "$work/$name/4/batch_output.txt" || echo "outputs differ"
+done
@@ -0,0 +1,33 @@
+#!/bin/sh
+# Runs every program in benchmarks/vm on the VM, with and without -O, under both dispatch loops and with
+# superinstructions turned off
+set -e
+root=$(cd "$(dirname "$0")/.." && pwd)
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+gcc -O2 -o "$work/goto" "$root/compiler.c"
+gcc -O2 -DVM_SWITCH_DISPATCH -o "$work/switch" "$root/compiler.c"
+gcc -O2 -DVM_NO_SUPERINSTRUCTIONS -o "$work/unfused" "$root/compiler.c"
+
+# Dispatches, time and speed of the last run
+report() {
+    awk '
+        /^Executed:/ { executed = $2 }
+        /^Time:/     { time = $2 }
+        /^Speed:/    { speed = $2 }
+        END          { printf "%12s dispatches %10s s %8s M/s\n", executed, time, speed }
+    ' vm_report.txt
+}
+
+for program in "$root"/benchmarks/vm/*.cp; do
+    name=$(basename "$program" .cp)
+    echo "== $name"
+    for dispatch in unfused goto switch; do
+        for flags in "" "-O"; do
+            mkdir -p "$work/$name/$dispatch$flags"
+            cd "$work/$name/$dispatch$flags"
+            "$work/$dispatch" $flags -r "$program" > output.txt
+            printf "%-7s %-3s %s\n" "$dispatch" "$flags" "$(report)"
+        done
+    done
+done
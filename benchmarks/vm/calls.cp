@@ -0,0 +1,31 @@
+def int square(int v)
+    return v * v;
+fed;
+def int sumsq(int a, int b)
+    int p, q;
+    p = square(a);
+    q = square(b);
+    return p + q;
+fed;
+def int spread(int k)
+    int j, m, r;
+    j = k % 1000;
+    m = j + 1;
+    r = sumsq(j, m);
+    return r % 1000;
+fed;
+def int walk(int n)
+    int i, t, v;
+    i = 0;
+    t = 0;
+    while (i < n) do
+        v = spread(i);
+        t = t + v;
+        i = i + 1;
+    od;
+    return t;
+fed;
+int total, n;
+n = 1000000;
+total = walk(n);
+print total
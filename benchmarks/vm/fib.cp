@@ -0,0 +1,12 @@
+def int fib(int n)
+    int a, b, m;
+    if (n < 2) then return n fi;
+    m = n - 1;
+    a = fib(m);
+    m = n - 2;
+    b = fib(m);
+    return a + b;
+fed;
+int n;
+n = 30;
+print fib(n)
@@ -0,0 +1,16 @@
+int i, j, s;
+double x;
+s = 0;
+x = 0.0;
+i = 0;
+while (i < 2000) do
+    j = 0;
+    while (j < 2000) do
+        s = s + i * j % 7;
+        x = x + 0.5;
+        j = j + 1;
+    od;
+    i = i + 1;
+od;
+print s;
+print x
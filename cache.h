@@ -0,0 +1,417 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdint.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+// Compilation cache: an on-disk store of the outputs of whole compilations, keyed by a hash of the source bytes,
+// the cache format version and the options that change the outputs. Each entry is one file holding the status and
+// every in-memory output of compiler_compile, written under a temporary name and renamed into place so readers
+// never see half an entry. A hit sets the entry's modification time, which makes the cache least recently used:
+// once the entries pass the size cap the oldest are deleted. Hit, miss and size counters live in a stats file
+// that every process updates under a lock on the cache directory.
+
+/******************************** Cache Definitions ********************************/
+#define CACHE_MAGIC         0x31485043           // "CPH1", first word of every entry
+#define CACHE_DEFAULT_BYTES (256LL << 20)        // Size cap unless given
+#define CACHE_PATH_SIZE     4096                 //
+#define CACHE_KEY_SIZE      33                   // 32 hex digits and the terminator
+
+// Version of the entries, which salts every key. Bump it whenever the entry layout or the outputs the compiler
+// writes for a source change, so the entries of older builds become misses
+#define CACHE_VERSION       1
+
+// XXH64 primes
+#define CACHE_P1 11400714785074694791ULL
+#define CACHE_P2 14029467366897019727ULL
+#define CACHE_P3 1609587929392839161ULL
+#define CACHE_P4 9650029242287828579ULL
+#define CACHE_P5 2870177450012600261ULL
+
+/******************************** Struct Definitions ********************************/
+struct cache{
+    const char* dir;                 // Directory holding the entries
+    long long max_bytes;             // Size cap of all entries together
+};
+
+// Written at the start of an entry, followed by the outputs in order
+struct cache_header{
+    uint32_t magic;                  // CACHE_MAGIC
+    uint32_t status;                 // What compiler_compile returned
+    uint64_t lengths[COMPILER_NUM_OUTPUTS];
+};
+
+// An entry read back, texts point into data
+struct cache_entry{
+    int status;                      //
+    char* data;                      // Whole entry file
+    const char* texts[COMPILER_NUM_OUTPUTS];
+    size_t lengths[COMPILER_NUM_OUTPUTS];
+};
+
+// Counters of the stats file
+struct cache_stats{
+    long long hits;                  //
+    long long misses;                //
+    long long stores;                // Entries written
+    long long evictions;             // Entries deleted by the size cap
+    long long bytes;                 // Size of all entries, refreshed whenever the cap is checked
+};
+
+/******************************** Hashing ********************************/
+// XXH64 of length bytes with seed, reading bytes little endian so keys match on every host
+uint64_t cache_rotl(uint64_t x, int r){
+    return (x << r) | (x >> (64 - r));
+}
+
+uint64_t cache_read64(const unsigned char* p){
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--) {
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
+uint64_t cache_read32(const unsigned char* p){
+    return (uint64_t)p[0] | ((uint64_t)p[1] << 8) | ((uint64_t)p[2] << 16) | ((uint64_t)p[3] << 24);
+}
+
+uint64_t cache_round(uint64_t acc, uint64_t input){
+    acc += input * CACHE_P2;
+    acc = cache_rotl(acc, 31);
+    return acc * CACHE_P1;
+}
+
+uint64_t cache_merge(uint64_t acc, uint64_t value){
+    acc ^= cache_round(0, value);
+    return acc * CACHE_P1 + CACHE_P4;
+}
+
+uint64_t cache_hash(const void* input, size_t length, uint64_t seed){
+    const unsigned char* p = input;
+    const unsigned char* end = p + length;
+    uint64_t h;
+    if (length >= 32) {
+        uint64_t v1 = seed + CACHE_P1 + CACHE_P2;
+        uint64_t v2 = seed + CACHE_P2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - CACHE_P1;
+        for (; p + 32 <= end; p += 32) {
+            v1 = cache_round(v1, cache_read64(p));
+            v2 = cache_round(v2, cache_read64(p + 8));
+            v3 = cache_round(v3, cache_read64(p + 16));
+            v4 = cache_round(v4, cache_read64(p + 24));
+        }
+        h = cache_rotl(v1, 1) + cache_rotl(v2, 7) + cache_rotl(v3, 12) + cache_rotl(v4, 18);
+        h = cache_merge(h, v1);
+        h = cache_merge(h, v2);
+        h = cache_merge(h, v3);
+        h = cache_merge(h, v4);
+    }
+    else {
+        h = seed + CACHE_P5;
+    }
+    h += length;
+    for (; p + 8 <= end; p += 8) {
+        h ^= cache_round(0, cache_read64(p));
+        h = cache_rotl(h, 27) * CACHE_P1 + CACHE_P4;
+    }
+    if (p + 4 <= end) {
+        h ^= cache_read32(p) * CACHE_P1;
+        h = cache_rotl(h, 23) * CACHE_P2 + CACHE_P3;
+        p += 4;
+    }
+    for (; p < end; p++) {
+        h ^= *p * CACHE_P5;
+        h = cache_rotl(h, 11) * CACHE_P1;
+    }
+    h ^= h >> 33;
+    h *= CACHE_P2;
+    h ^= h >> 29;
+    h *= CACHE_P3;
+    h ^= h >> 32;
+    return h;
+}
+
+// Writes the 128 bit key of source compiled with options as hex into key. The version and the options seed
+// two hashes of the source
+void cache_key(const char* source, size_t length, struct compiler_options* options, char* key){
+    char salt[128];
+    int salt_length = snprintf(salt, sizeof(salt), "cp471 version=%d optimize=%d batch=%d", CACHE_VERSION,
+                               options->optimize, options->batch_name != NULL);
+    uint64_t seed = cache_hash(salt, salt_length, 0);
+    uint64_t high = cache_hash(source, length, seed);
+    uint64_t low = cache_hash(source, length, seed ^ CACHE_P3);
+    snprintf(key, CACHE_KEY_SIZE, "%016llx%016llx", (unsigned long long)high, (unsigned long long)low);
+}
+
+/******************************** Stats ********************************/
+// Locks the cache directory against other processes and threads, returns the lock to pass to cache_unlock or -1
+int cache_lock(struct cache* cache){
+    char path[CACHE_PATH_SIZE];
+    snprintf(path, CACHE_PATH_SIZE, "%s/lock", cache->dir);
+    int fd = open(path, O_RDWR | O_CREAT, 0666);
+    if (fd < 0) {
+        return -1;
+    }
+    while (flock(fd, LOCK_EX) != 0) {
+        if (errno != EINTR) {
+            close(fd);
+            return -1;
+        }
+    }
+    return fd;
+}
+
+void cache_unlock(int fd){
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+// Reads the stats file, all zero if it doesn't exist yet. Call with the lock held
+void cache_read_stats(struct cache* cache, struct cache_stats* stats){
+    char path[CACHE_PATH_SIZE];
+    snprintf(path, CACHE_PATH_SIZE, "%s/stats", cache->dir);
+    struct cache_stats zero = {0, 0, 0, 0, 0};
+    *stats = zero;
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        return;
+    }
+    if (fscanf(file, "hits %lld misses %lld stores %lld evictions %lld bytes %lld", &stats->hits, &stats->misses,
+               &stats->stores, &stats->evictions, &stats->bytes) != 5) {
+        *stats = zero;
+    }
+    fclose(file);
+}
+
+// Replaces the stats file. Call with the lock held
+void cache_write_stats(struct cache* cache, struct cache_stats* stats){
+    char path[CACHE_PATH_SIZE];
+    char temporary[CACHE_PATH_SIZE];
+    snprintf(path, CACHE_PATH_SIZE, "%s/stats", cache->dir);
+    snprintf(temporary, CACHE_PATH_SIZE, "%s/stats.tmp", cache->dir);
+    FILE* file = fopen(temporary, "w");
+    if (!file) {
+        return;
+    }
+    fprintf(file, "hits %lld\nmisses %lld\nstores %lld\nevictions %lld\nbytes %lld\n", stats->hits, stats->misses,
+            stats->stores, stats->evictions, stats->bytes);
+    fclose(file);
+    rename(temporary, path);
+}
+
+// Adds to the counters of the stats file
+void cache_count(struct cache* cache, long long hits, long long misses){
+    int lock = cache_lock(cache);
+    if (lock < 0) {
+        return;
+    }
+    struct cache_stats stats;
+    cache_read_stats(cache, &stats);
+    stats.hits += hits;
+    stats.misses += misses;
+    cache_write_stats(cache, &stats);
+    cache_unlock(lock);
+}
+
+void cache_print_stats(struct cache* cache, FILE* out){
+    int lock = cache_lock(cache);
+    struct cache_stats stats;
+    cache_read_stats(cache, &stats);
+    cache_unlock(lock);
+    long long lookups = stats.hits + stats.misses;
+    fprintf(out, "Cache %s: %lld hits, %lld misses, %.1f%% hit rate\n", cache->dir, stats.hits, stats.misses,
+            lookups > 0 ? 100.0 * stats.hits / lookups : 0.0);
+    fprintf(out, "Cache %s: %lld stores, %lld evictions, %.2f of %.2f MB\n", cache->dir, stats.stores, stats.evictions,
+            stats.bytes / (1024.0 * 1024.0), cache->max_bytes / (1024.0 * 1024.0));
+}
+
+/******************************** Entries ********************************/
+// Creates the cache directory if needed, returns 0 or 1 after writing an error
+int cache_open(struct cache* cache, const char* dir, long long max_bytes){
+    cache->dir = dir;
+    cache->max_bytes = max_bytes;
+    if (mkdir(dir, 0777) != 0 && errno != EEXIST) {
+        perror("Error creating cache directory");
+        return 1;
+    }
+    return 0;
+}
+
+// Reads the entry of key into entry and marks it recently used. Returns 1 for a hit, 0 for a miss, which an entry
+// that can't be read or whose lengths don't add up to its size also is. Counts the lookup in the stats
+int cache_lookup(struct cache* cache, const char* key, struct cache_entry* entry){
+    char path[CACHE_PATH_SIZE];
+    snprintf(path, CACHE_PATH_SIZE, "%s/%s.entry", cache->dir, key);
+    entry->data = NULL;
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        cache_count(cache, 0, 1);
+        return 0;
+    }
+    struct stat info;
+    int hit = 0;
+    struct cache_header header;
+    if (fstat(fileno(file), &info) == 0 && info.st_size >= (off_t)sizeof(header)) {
+        size_t size = info.st_size;
+        entry->data = malloc(size);
+        if (entry->data != NULL && fread(entry->data, 1, size, file) == size) {
+            struct cache_header* stored = (struct cache_header*)entry->data;
+            size_t offset = sizeof(header);
+            hit = (stored->magic == CACHE_MAGIC);
+            // Compared with what is left rather than summed, so no length can wrap the offset around
+            for (int i = 0; i < COMPILER_NUM_OUTPUTS && hit; i++) {
+                hit = (stored->lengths[i] <= size - offset);
+                if (hit) {
+                    entry->texts[i] = entry->data + offset;
+                    entry->lengths[i] = stored->lengths[i];
+                    offset += stored->lengths[i];
+                }
+            }
+            hit = hit && (offset == size);
+            entry->status = stored->status;
+        }
+    }
+    fclose(file);
+    if (!hit) {
+        free(entry->data);
+        entry->data = NULL;
+        cache_count(cache, 0, 1);
+        return 0;
+    }
+    utimensat(AT_FDCWD, path, NULL, 0);
+    cache_count(cache, 1, 0);
+    return 1;
+}
+
+void cache_free_entry(struct cache_entry* entry){
+    free(entry->data);
+    entry->data = NULL;
+}
+
+// An entry found when measuring the cache
+struct cache_file{
+    char name[CACHE_KEY_SIZE + 8];   // Key and ".entry"
+    long long bytes;                 //
+    struct timespec used;            // Modification time, the last hit or store
+};
+
+// Orders entries by modification time, oldest first, used with qsort
+int cache_compare_used(const void* a, const void* b){
+    const struct cache_file* x = a;
+    const struct cache_file* y = b;
+    if (x->used.tv_sec != y->used.tv_sec) {
+        return (x->used.tv_sec < y->used.tv_sec) ? -1 : 1;
+    }
+    if (x->used.tv_nsec != y->used.tv_nsec) {
+        return (x->used.tv_nsec < y->used.tv_nsec) ? -1 : 1;
+    }
+    return 0;
+}
+
+// Measures every entry and, if they pass the size cap, deletes the least recently used until they fill 90% of
+// it. Call with the lock held
+void cache_evict(struct cache* cache, struct cache_stats* stats){
+    DIR* directory = opendir(cache->dir);
+    if (directory == NULL) {
+        return;
+    }
+    struct cache_file* files = NULL;
+    long long num_files = 0;
+    long long capacity = 0;
+    long long bytes = 0;
+    char path[CACHE_PATH_SIZE];
+    struct dirent* item;
+    while ((item = readdir(directory)) != NULL) {
+        int length = 0;
+        while (item->d_name[length] != '\0') {
+            length++;
+        }
+        if (length != CACHE_KEY_SIZE - 1 + 6 || compare_strings(item->d_name + CACHE_KEY_SIZE - 1, ".entry") != 0) {
+            continue;
+        }
+        struct stat info;
+        snprintf(path, CACHE_PATH_SIZE, "%s/%s", cache->dir, item->d_name);
+        if (stat(path, &info) != 0) {
+            continue;
+        }
+        if (num_files == capacity) {
+            capacity = (capacity == 0) ? 256 : capacity * 2;
+            files = realloc(files, sizeof(struct cache_file) * capacity);
+        }
+        for (int i = 0; i <= length; i++) {
+            files[num_files].name[i] = item->d_name[i];
+        }
+        files[num_files].bytes = info.st_size;
+        files[num_files].used = info.st_mtim;
+        bytes += info.st_size;
+        num_files++;
+    }
+    closedir(directory);
+
+    if (bytes > cache->max_bytes) {
+        qsort(files, num_files, sizeof(struct cache_file), cache_compare_used);
+        for (long long i = 0; i < num_files && bytes > cache->max_bytes / 10 * 9; i++) {
+            snprintf(path, CACHE_PATH_SIZE, "%s/%s", cache->dir, files[i].name);
+            if (unlink(path) == 0) {
+                bytes -= files[i].bytes;
+                stats->evictions++;
+            }
+        }
+    }
+    stats->bytes = bytes;
+    free(files);
+}
+
+// Stores the outputs of a compilation under key, replacing the entry atomically, then holds the cache to its
+// size cap
+void cache_store(struct cache* cache, const char* key, int status, const char** texts, size_t* lengths){
+    static atomic_llong stores = 0;
+    char path[CACHE_PATH_SIZE];
+    char temporary[CACHE_PATH_SIZE];
+    snprintf(path, CACHE_PATH_SIZE, "%s/%s.entry", cache->dir, key);
+    snprintf(temporary, CACHE_PATH_SIZE, "%s/%s.%ld.%lld.tmp", cache->dir, key, (long)getpid(), atomic_fetch_add(&stores, 1));
+    FILE* file = fopen(temporary, "wb");
+    if (!file) {
+        return;
+    }
+    struct cache_header header;
+    header.magic = CACHE_MAGIC;
+    header.status = status;
+    long long bytes = sizeof(header);
+    for (int i = 0; i < COMPILER_NUM_OUTPUTS; i++) {
+        header.lengths[i] = lengths[i];
+        bytes += lengths[i];
+    }
+    int failed = (fwrite(&header, sizeof(header), 1, file) != 1);
+    for (int i = 0; i < COMPILER_NUM_OUTPUTS; i++) {
+        failed |= (fwrite(texts[i], 1, lengths[i], file) != lengths[i]);
+    }
+    failed |= (fclose(file) != 0);
+    if (failed || rename(temporary, path) != 0) {
+        unlink(temporary);
+        return;
+    }
+
+    int lock = cache_lock(cache);
+    if (lock < 0) {
+        return;
+    }
+    struct cache_stats stats;
+    cache_read_stats(cache, &stats);
+    stats.stores++;
+    stats.bytes += bytes;
+    if (stats.bytes > cache->max_bytes) {
+        cache_evict(cache, &stats);
+    }
+    cache_write_stats(cache, &stats);
+    cache_unlock(lock);
+}
+
+#endif // CACHE_H
@@ -0,0 +1,427 @@
+#ifndef CGEN_H
+#define CGEN_H
+
+// C backend: translates the VM lowering of a program into one standalone C translation unit and builds it with
+// the host C compiler, which can then optimize and vectorize it. Every VM register becomes a typed local named
+// after its variable, constants become literals and jumps become gotos. Prints, int wrap-around, division and
+// the VM's frame and register limits are reproduced exactly, so the program prints what -r prints and stops with
+// the same runtime errors. Registers are typed with x86_operand_types.
+
+/******************************** C Backend Definitions ********************************/
+#define CGEN_CC          "cc -O2"    // Compiler building the generated source
+
+// C operator of each TAC relop (TAC_LT to TAC_NE) and arithmetic op (TAC_ADD to TAC_MOD)
+static const char* cgen_relops[6] = {"<", ">", "==", "<=", ">=", "!="};
+static const char* cgen_ops[5] = {"+", "-", "*", "/", "%"};
+
+/******************************** Struct Definitions ********************************/
+struct cgen_emitter{
+    FILE* out;                       //
+    struct vm_program* vm;           //
+    int f;                           // Index of the function
+    struct vm_function* function;    //
+    int* types;                      // Type every instruction uses each register with, -1 if unused or X86_MIXED
+    int* push_types;                 // Type of the param each PUSH fills
+    int* push_slots;                 // Argument local each PUSH writes
+    char* targets;                   // True(1) for every pc a jump lands on
+    int max_pending;                 // Most arguments waiting for their calls at once
+    char* used_slots;                // True(1) for each argument local of each type (slot * 2 + type) written
+};
+
+/******************************** Frame Layout ********************************/
+// Types every register and matches PUSHes to their calls. Returns 0 on success or 1 after writing an error.
+int cgen_plan_function(struct cgen_emitter* em){
+    struct vm_function* function = em->function;
+    int n = function->num_code;
+    em->types = malloc(sizeof(int) * (function->num_regs + 1));
+    em->push_types = malloc(sizeof(int) * (n + 1));
+    em->push_slots = malloc(sizeof(int) * (n + 1));
+    em->targets = calloc(n + 2, 1);
+    for (int r = 0; r < function->num_regs; r++) {
+        em->types[r] = -1;
+    }
+    for (int p = 0; p < function->num_params; p++) {
+        x86_merge_type(em->types, p, function->param_types[p]);
+    }
+    for (int pc = 0; pc < n; pc++) {
+        if (function->code[pc].op >= VM_JMP && function->code[pc].op <= VM_JNE_D) {
+            em->targets[function->code[pc].c] = 1;
+        }
+    }
+
+    // PushParam follows a stack discipline in code order, the same one call_arguments relies on
+    int* stack = malloc(sizeof(int) * (n + 1));
+    int top = 0;
+    int error = 0;
+    em->max_pending = 0;
+    for (int pc = 0; pc < n && !error; pc++) {
+        struct vm_instr* instr = &function->code[pc];
+        em->push_types[pc] = -1;
+        if (top > 0 && (em->targets[pc] || (instr->op >= VM_JMP && instr->op <= VM_JNE_D))) {
+            fprintf(stderr, "C backend error: %s branches between a PushParam and its call\n", function->name);
+            error = 1;
+        }
+        else if (instr->op == VM_PUSH) {
+            em->push_slots[pc] = top;
+            stack[top++] = pc;
+            em->max_pending = (top > em->max_pending) ? top : em->max_pending;
+        }
+        else if (instr->op == VM_CALL || instr->op == VM_TAILCALL) {
+            struct vm_function* callee = &em->vm->functions[instr->b];
+            if (instr->c > top) {
+                fprintf(stderr, "C backend error: %s calls %s with too few arguments\n", function->name, callee->name);
+                error = 1;
+                break;
+            }
+            // The last PUSH fills the first param
+            for (int p = 0; p < instr->c; p++) {
+                em->push_types[stack[top - 1 - p]] = callee->param_types[p];
+            }
+            top -= instr->c;
+        }
+    }
+    free(stack);
+    if (error) {
+        return 1;
+    }
+
+    em->used_slots = calloc(2 * em->max_pending + 1, 1);
+    for (int pc = 0; pc < n; pc++) {
+        struct vm_instr* instr = &function->code[pc];
+        int types[3];
+        x86_operand_types(em->vm, function, instr, types);
+        if (instr->op == VM_PUSH) {
+            types[0] = em->push_types[pc];
+            em->used_slots[2 * em->push_slots[pc] + em->push_types[pc]] = 1;
+        }
+        int regs[3] = {instr->a, instr->b, instr->c};
+        for (int o = 0; o < 3; o++) {
+            if (types[o] >= 0 && regs[o] < function->first_constant) {
+                x86_merge_type(em->types, regs[o], types[o]);
+            }
+        }
+    }
+    return 0;
+}
+
+/******************************** Operands ********************************/
+// Name of register r: the variable it holds, or t and its number for temps
+void cgen_name(struct cgen_emitter* em, int r, char* text, int size){
+    if (r < em->function->num_vars) {
+        snprintf(text, size, "v_%s", em->function->vars[r]);
+    }
+    else {
+        snprintf(text, size, "t%d", r);
+    }
+}
+
+const char* cgen_type_name(int type){
+    return (type == 1) ? "int" : (type == 0) ? "double" : "union cp_value";
+}
+
+// Register r read or written as type: a literal for constants, the union member for mixed registers
+void cgen_operand(struct cgen_emitter* em, int r, int type, char* text, int size){
+    if (r >= em->function->first_constant) {
+        union vm_value value = em->function->constants[r - em->function->first_constant];
+        if (type == 1 && value.i == -2147483647 - 1) {
+            snprintf(text, size, "(-2147483647 - 1)");
+        }
+        else if (type == 1) {
+            snprintf(text, size, (value.i < 0) ? "(%d)" : "%d", value.i);
+        }
+        else if (value.d - value.d == 0) {
+            // Finite doubles are written in hex so they read back to the same bits
+            snprintf(text, size, (value.d < 0) ? "(%a)" : "%a", value.d);
+        }
+        else {
+            union {
+                double d;
+                unsigned long long bits;
+            } bits = {value.d};
+            snprintf(text, size, "cp_double(0x%llxULL)", bits.bits);
+        }
+        return;
+    }
+    char name[128];
+    cgen_name(em, r, name, sizeof(name));
+    if (em->types[r] == X86_MIXED) {
+        snprintf(text, size, "%s.%c", name, (type == 1) ? 'i' : 'd');
+    }
+    else {
+        snprintf(text, size, "%s", name);
+    }
+}
+
+// C name of a function
+void cgen_symbol(struct vm_program* vm, int f, char* text, int size){
+    snprintf(text, size, "cp_%s", vm->functions[f].name);
+}
+
+// Arguments of the innermost call, the local of the last PUSH fills the first param
+void cgen_arguments(struct cgen_emitter* em, int pending, struct vm_function* callee){
+    for (int p = 0; p < callee->num_params; p++) {
+        fprintf(em->out, "%sa%c%d", (p == 0) ? "" : ", ", (callee->param_types[p] == 1) ? 'i' : 'd', pending - 1 - p);
+    }
+}
+
+/******************************** Code Generation ********************************/
+// Writes the signature of a function, params whose register is mixed arrive as p and their number
+void cgen_signature(struct vm_program* vm, int f, int* types, FILE* out){
+    struct vm_function* function = &vm->functions[f];
+    char symbol[128];
+    cgen_symbol(vm, f, symbol, sizeof(symbol));
+    fprintf(out, "static %s %s(", cgen_type_name(function->return_type), symbol);
+    if (function->num_params == 0) {
+        fprintf(out, "void");
+    }
+    for (int p = 0; p < function->num_params; p++) {
+        char name[128];
+        if (types != NULL && types[p] == X86_MIXED) {
+            snprintf(name, sizeof(name), "p%d", p);
+        }
+        else {
+            snprintf(name, sizeof(name), "v_%s", function->vars[p]);
+        }
+        fprintf(out, "%s%s %s", (p == 0) ? "" : ", ", cgen_type_name(function->param_types[p]), name);
+    }
+    fprintf(out, ")");
+}
+
+// Emits one function, returns 0 on success or 1 after writing an error
+int cgen_emit_function(struct vm_program* vm, int f, FILE* out){
+    struct vm_function* function = &vm->functions[f];
+    struct cgen_emitter em = {out, vm, f, function, NULL, NULL, NULL, NULL, 0, NULL};
+    int error = cgen_plan_function(&em);
+    int is_main = (f == vm->main);
+    int pending = 0;
+    char a[160];
+    char b[160];
+    char c[160];
+    char symbol[128];
+    if (error) {
+        goto done;
+    }
+
+    fprintf(out, "\n");
+    if (is_main) {
+        fprintf(out, "int main(void)");
+    }
+    else {
+        cgen_signature(vm, f, em.types, out);
+    }
+    fprintf(out, "{\n");
+    for (int r = 0; r < function->first_constant; r++) {
+        if (em.types[r] < 0 || (r < function->num_params && em.types[r] != X86_MIXED)) {
+            continue;
+        }
+        cgen_name(&em, r, a, sizeof(a));
+        if (r < function->num_params) {
+            fprintf(out, "    union cp_value %s;\n", a);
+            fprintf(out, "    %s.%c = p%d;\n", a, (function->param_types[r] == 1) ? 'i' : 'd', r);
+        }
+        else {
+            fprintf(out, "    %s %s = %s;\n", cgen_type_name(em.types[r]), a, (em.types[r] == X86_MIXED) ? "{0}" : "0");
+        }
+    }
+    for (int k = 0; k < em.max_pending; k++) {
+        for (int type = 1; type >= 0; type--) {
+            if (em.used_slots[2 * k + type]) {
+                fprintf(out, "    %s a%c%d;\n", cgen_type_name(type), (type == 1) ? 'i' : 'd', k);
+            }
+        }
+    }
+    // Registers in use up to the end of this frame, restored after each call like the VM pops its frame
+    for (int pc = 0; pc < function->num_code; pc++) {
+        if (function->code[pc].op == VM_CALL) {
+            fprintf(out, "    int top = cp_top;\n");
+            break;
+        }
+    }
+
+    for (int pc = 0; pc < function->num_code; pc++) {
+        struct vm_instr* instr = &function->code[pc];
+        int op = instr->op;
+        int types[3];
+        x86_operand_types(vm, function, instr, types);
+        if (em.targets[pc]) {
+            fprintf(out, "L%d:\n", pc);
+        }
+        if (types[0] >= 0) {
+            cgen_operand(&em, instr->a, types[0], a, sizeof(a));
+        }
+        if (types[1] >= 0) {
+            cgen_operand(&em, instr->b, types[1], b, sizeof(b));
+        }
+        if (types[2] >= 0) {
+            cgen_operand(&em, instr->c, types[2], c, sizeof(c));
+        }
+        if (op == VM_MOV) {
+            fprintf(out, "    %s = %s;\n", a, b);
+        }
+        else if (op == VM_I2D) {
+            fprintf(out, "    %s = (double)%s;\n", a, b);
+        }
+        else if (op == VM_D2I) {
+            fprintf(out, "    %s = (int)%s;\n", a, b);
+        }
+        else if (op == VM_ADD_I || op == VM_SUB_I || op == VM_MUL_I) {
+            // Wraps like VM_WRAP
+            fprintf(out, "    %s = (int)((unsigned)%s %s (unsigned)%s);\n", a, b, cgen_ops[op - VM_ADD_I], c);
+        }
+        else if (op == VM_DIV_I || op == VM_MOD_I) {
+            fprintf(out, "    %s = cp_%s(%s, %s, \"%s\");\n", a, (op == VM_DIV_I) ? "div" : "mod", b, c, function->name);
+        }
+        else if (op >= VM_ADD_D && op <= VM_DIV_D) {
+            fprintf(out, "    %s = %s %s %s;\n", a, b, cgen_ops[op - VM_ADD_D], c);
+        }
+        else if (op >= VM_LT_I && op <= VM_NE_D) {
+            fprintf(out, "    %s = %s %s %s;\n", a, b, cgen_relops[(op - VM_LT_I) % 6], c);
+        }
+        else if (op == VM_NOT_I) {
+            fprintf(out, "    %s = !%s;\n", a, b);
+        }
+        else if (op == VM_OR_I) {
+            fprintf(out, "    %s = %s || %s;\n", a, b, c);
+        }
+        else if (op == VM_JMP) {
+            fprintf(out, "    goto L%d;\n", instr->c);
+        }
+        else if (op == VM_JZ_I || op == VM_JZ_D) {
+            fprintf(out, "    if (%s == 0) goto L%d;\n", b, instr->c);
+        }
+        else if (op >= VM_JLT_I && op <= VM_JNE_D) {
+            fprintf(out, "    if (%s %s %s) goto L%d;\n", a, cgen_relops[(op - VM_JLT_I) % 6], b, instr->c);
+        }
+        else if (op == VM_PRINT_I || op == VM_PRINT_D) {
+            fprintf(out, "    printf(\"%s\\n\", %s);\n", (op == VM_PRINT_I) ? "%d" : "%f", a);
+        }
+        else if (op == VM_PUSH) {
+            cgen_operand(&em, instr->a, em.push_types[pc], a, sizeof(a));
+            fprintf(out, "    a%c%d = %s;\n", (em.push_types[pc] == 1) ? 'i' : 'd', em.push_slots[pc], a);
+            pending++;
+        }
+        else if (op == VM_CALL) {
+            struct vm_function* callee = &vm->functions[instr->b];
+            cgen_symbol(vm, instr->b, symbol, sizeof(symbol));
+            fprintf(out, "    cp_call(%d, \"%s\");\n", callee->num_regs, function->name);
+            fprintf(out, "    %s = %s(", a, symbol);
+            cgen_arguments(&em, pending, callee);
+            fprintf(out, ");\n");
+            fprintf(out, "    cp_frames--;\n");
+            fprintf(out, "    cp_top = top;\n");
+            pending -= instr->c;
+        }
+        else if (op == VM_TAILCALL) {
+            struct vm_function* callee = &vm->functions[instr->b];
+            cgen_symbol(vm, instr->b, symbol, sizeof(symbol));
+            fprintf(out, "    cp_tail(%d, %d, \"%s\");\n", function->num_regs, callee->num_regs, function->name);
+            fprintf(out, "    return %s(", symbol);
+            cgen_arguments(&em, pending, callee);
+            fprintf(out, ");\n");
+            pending -= instr->c;
+        }
+        else if (op == VM_RET) {
+            fprintf(out, "    return %s;\n", a);
+        }
+        else if (op == VM_HALT) {
+            fprintf(out, "    return 0;\n");
+        }
+        else {
+            fprintf(stderr, "C backend error: %s uses unknown opcode %d\n", function->name, op);
+            error = 1;
+            break;
+        }
+    }
+    if (em.targets[function->num_code]) {
+        fprintf(out, "L%d:;\n", function->num_code);
+    }
+    fprintf(out, "}\n");
+
+done:
+    free(em.types);
+    free(em.push_types);
+    free(em.push_slots);
+    free(em.targets);
+    free(em.used_slots);
+    return error;
+}
+
+/******************************** Driver ********************************/
+// Writes the program as C source to out, returns 0 on success or 1 after writing an error
+int cgen_write_program(struct tac_program* program, FILE* out){
+    struct vm_program vm;
+    if (vm_lower_program(program, &vm)) {
+        free_vm_program(&vm);
+        return 1;
+    }
+    for (int f = 0; f < vm.num_functions; f++) {
+        vm_rotate_loops(&vm.functions[f]);
+    }
+
+    // Runtime, with the limits and error messages of the VM
+    fprintf(out, "// Generated from the three address code by the C backend\n");
+    fprintf(out, "#include <stdio.h>\n");
+    fprintf(out, "#include <stdlib.h>\n");
+    fprintf(out, "\n");
+    fprintf(out, "#define CP_MAX_FRAMES %d\n", VM_MAX_FRAMES);
+    fprintf(out, "#define CP_STACK_SIZE %d\n", VM_STACK_SIZE);
+    fprintf(out, "\n");
+    fprintf(out, "union cp_value{\n    int i;\n    double d;\n};\n");
+    fprintf(out, "\n");
+    fprintf(out, "static int cp_frames = 1;\n");
+    fprintf(out, "static int cp_top = %d;\n", (vm.main >= 0) ? vm.functions[vm.main].num_regs : 0);
+    fprintf(out, "\n");
+    fprintf(out, "static double cp_double(unsigned long long bits){\n");
+    fprintf(out, "    union{\n        unsigned long long bits;\n        double d;\n    } value = {bits};\n");
+    fprintf(out, "    return value.d;\n}\n");
+    fprintf(out, "\n");
+    fprintf(out, "__attribute__((noreturn, cold)) static void cp_error(const char* function, const char* error){\n");
+    fprintf(out, "    fflush(stdout);\n");
+    fprintf(out, "    fprintf(stderr, \"Runtime error in %%s: %%s\\n\", function, error);\n");
+    fprintf(out, "    exit(1);\n}\n");
+    fprintf(out, "\n");
+    fprintf(out, "static inline void cp_call(int regs, const char* function){\n");
+    fprintf(out, "    if (cp_frames == CP_MAX_FRAMES || cp_top + regs > CP_STACK_SIZE) {\n");
+    fprintf(out, "        cp_error(function, \"stack overflow\");\n    }\n");
+    fprintf(out, "    cp_frames++;\n    cp_top += regs;\n}\n");
+    fprintf(out, "\n");
+    fprintf(out, "static inline void cp_tail(int own, int regs, const char* function){\n");
+    fprintf(out, "    if (cp_top - own + regs > CP_STACK_SIZE) {\n");
+    fprintf(out, "        cp_error(function, \"stack overflow\");\n    }\n");
+    fprintf(out, "    cp_top += regs - own;\n}\n");
+    fprintf(out, "\n");
+    fprintf(out, "static inline int cp_div(int x, int y, const char* function){\n");
+    fprintf(out, "    if (y == 0) {\n        cp_error(function, \"division by zero\");\n    }\n");
+    fprintf(out, "    return (y == -1) ? (int)(0u - (unsigned)x) : x / y;\n}\n");
+    fprintf(out, "\n");
+    fprintf(out, "static inline int cp_mod(int x, int y, const char* function){\n");
+    fprintf(out, "    if (y == 0) {\n        cp_error(function, \"modulo by zero\");\n    }\n");
+    fprintf(out, "    return (y == -1) ? 0 : x %% y;\n}\n");
+    fprintf(out, "\n");
+    for (int f = 0; f < vm.num_functions; f++) {
+        if (f != vm.main) {
+            cgen_signature(&vm, f, NULL, out);
+            fprintf(out, ";\n");
+        }
+    }
+
+    int error = 0;
+    for (int f = 0; f < vm.num_functions && !error; f++) {
+        error = cgen_emit_function(&vm, f, out);
+    }
+    free_vm_program(&vm);
+    return error;
+}
+
+// Builds the generated source into an executable with the host C compiler, returns 0 on success
+int cgen_compile(const char* source, const char* executable){
+    char command[512];
+    snprintf(command, sizeof(command), "%s -o %s %s", CGEN_CC, executable, source);
+    if (system(command) != 0) {
+        fprintf(stderr, "C backend error: %s failed\n", command);
+        return 1;
+    }
+    return 0;
+}
+
+#endif // CGEN_H
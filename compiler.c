@@ -13,58 +13,183 @@
 * - symbol_table_syn.txt: Contains production information
 * - symbol_table_sem.txt: Contains scope information
 * - tac.txt:              Contains the three adress code transaltion of the source code
+* - opt_report.txt:       Contains what each optimization pass did to each function (only with -O)
+* - vm_report.txt:        Contains the instruction count and speed of the run (only with -r, -p, -j or -b), and what the
+*                         JIT compiled (only with -j)
+* - batch_output.txt:     Contains main's final variables and prints for each row of the batch input (only with -b)
+* - program.s, program:   Contain the x86-64 assembly of the program and the executable linked from it (only with -S)
+* - program.c, program_c: Contain the C translation of the program and the executable built from it (only with -C)
 * - error.txt: Records lexical, syntactical, and semantic errors encountered
 *
+* Options:
+* - -O: Optimizes the three address code (peephole rules, constant propagation, dead store, unreachable code and
+*        unused label elimination, loop invariant code motion, induction variable strength reduction, loop unrolling,
+*        self tail call elimination, inlining of small non-recursive functions, constant param specialization,
+*        constant return propagation, dead function elimination and temp slot allocation)
+* - -r: Runs the program on the built-in register VM after writing tac.txt, its prints go to stdout
+* - -p: Runs the program like -r without superinstructions, profiling which opcode pairs run most often
+* - -b batchFile: Runs main once per row of batchFile, many rows at a time in lockstep. Its first line names
+*        variables of main, each following line gives them values for one run
+* - -w workers: Runs the -b rows as independent jobs on an execution service of that many threads instead
+* - -S: Compiles the program to x86-64 assembly and links it into a native executable with the system C compiler
+* - -j threshold: Runs the program like -r with a JIT that compiles each function to machine code in memory once it
+*        has been called threshold times, 1 compiles the whole program before main starts
+* - -C: Translates the program to C and builds it into a native executable with the system C compiler at -O2
+* - -m inputs -o outputDir: Compiles every .cp file of the directory inputs, or every file listed one per line in
+*        the file inputs, on -w worker threads (default one per CPU). The outputs of name.cp go to outputDir/name/ and
+*        the files/sec and MB/sec of the whole batch are printed
+* - -T: Streams the TAC, writing each function to tac.txt as soon as it is checked and freeing its part of the tree,
+*        so only the largest function has to fit in memory rather than the whole source. Not with -O or a backend
+* - -P: Lexes on a thread of its own, which hands the tokens to the parser in batches through a lock-free ring, so
+*        lexing a large source overlaps with parsing it. Also applies to -m and -T, the outputs are the same
+* - -F workers: Parses and checks the def ... fed blocks on that many threads before the source is analyzed in order,
+*        which replays the blocks the threads checked without errors and checks the rest in place. Also applies to
+*        -m and -L, the outputs are the same
+* - -k cacheDir: Looks the compilation up in the cache at cacheDir and stores it there after, so compiling the same
+*        source with the same options again only copies its outputs out. Also speeds up -m. Alone it prints the cache's
+*        hit, miss and size stats
+* - -K megabytes: Caps the cache of -k at that size (default 256), deleting the least recently used entries past it
+* - -I megabytes: With -m, -D or -L, keeps a per-function cache of up to that size in each worker or document, so a
+*        def ... fed block compiled before, in this file or an earlier version of it, is replayed instead of analyzed
+*        and generated again
+* - -D socket: Runs as a compile server on the Unix domain socket path, with -w worker threads (default one per CPU),
+*        replying to each source sent with its TAC and diagnostics
+* - -L: Runs as a language server on stdin and stdout, publishing the errors of each open document as diagnostics
+*        and answering go-to-definition, then prints the latency histogram of each kind of request to stderr on exit
+* - -s socket inputFile: Compiles inputFile on the server at socket, printing the TAC to stdout and the diagnostics
+*        to stderr. With -n requests it instead sends inputFile that many times over -w connections (default 1) and
+*        prints the requests/sec and latency percentiles
+*
 * Author: Jacob Harper, 201830230
 *
 * Date: April 22 2025
 *
 * Dependencies:
+* - compiler.h (contains the library interface, which compiles in-memory source to in-memory TAC and diagnostics on a
+*        compiler_context of its own; build with -DCOMPILER_LIBRARY to leave out main)
 * - functions.h (contains structure and function definintions that can be stored separately from global variables and other header files)
 * - resources.h (contains tables required by this program including state machine and LL1 table, as well as several which hold imporant variable names)
+* - tac.h (contains the three address code instruction structures and printing)
+* - optimize.h (contains the control flow graph, liveness analysis and the TAC optimization passes)
+* - deque.h (contains the work stealing deque the threads of the execution service and of -F take work from)
+* - vm.h (contains the bytecode lowering, the register VM that runs it, batch mode and the execution service, which
+*        uses POSIX threads: add -pthread when building against a libc older than glibc 2.34)
+* - x86.h (contains the native backend, which emits x86-64 assembly from the VM lowering)
+* - jit.h (contains the tiered JIT, which compiles hot VM functions to x86-64 machine code while they run)
+* - cgen.h (contains the C backend, which translates the VM lowering to a standalone C source file)
+* - cache.h (contains the compilation cache, which stores the outputs of whole compilations on disk keyed by a hash
+*        of the source and options)
+* - server.h (contains the compile server, which compiles source sent over a Unix domain socket, its client and
+*        its load generator)
+* - incremental.h (contains the per-function cache, which keeps the checked subtree, symbol table text and TAC of
+*        every def ... fed block of a context's compilations to replay the unchanged ones, and where the blocks lie
+*        so compiler_edit looks at only the ones around an edit)
+* - lsp.h (contains the language server, which keeps the open documents of an editor compiled as they change)
+* - pipeline.h (contains the ring of token batches the lexer thread hands tokens to the parser through with -P)
+* - parallel.h (contains how the blocks are dealt to the threads of -F, and the scan of a block's header for its
+*        signature)
 */
 /******************************** Header Imports ********************************/
 #include <stdio.h>
 #include <stdlib.h>
+#include <dirent.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "compiler.h"
 #include "resources.h"
 #include "functions.h"
-
-/******************************** Global Variables ********************************/
-/**************** Lexical ****************/
-//Flags
-int pushback_char = -1;                      // Pushback flag is for rereading a char at the end of a token
-int checkNegativeFlag = 0;                   // Check Negative flag is for checking the difference between a leading +- and the operators +,-
-
-// Global Variables
+#include "tac.h"
+#include "optimize.h"
+#include "deque.h"
+#include "vm.h"
+#include "x86.h"
+#include "jit.h"
+#include "cgen.h"
+#include "cache.h"
+#include "incremental.h"
+#include "server.h"
+#include "lsp.h"
+#include "pipeline.h"
+#include "parallel.h"
+
+/******************************** Compiler Context ********************************/
 #define BUFFER_SIZE 2048
 #define LEXEME_SIZE 256
 
-// Double Buffer System Variables
-char buffer1[BUFFER_SIZE];
-char buffer2[BUFFER_SIZE];
-int current_buffer = 1;                                // Buffer number flag
-size_t index_buffer = 0;                               // Index in current buffer
-size_t size_buffer1 = 0;                               // Chars remaining unread in buffer1
-size_t size_buffer2 = 0;                               // Chars remaining unread in buffer2
-
-/**************** Syntax ****************/
-// Initialize node pointers for AST Traversal
-struct node* root;                                     // Points to current node of AST
-struct node* next;                                     // Points to next node when traversing down AST
-
-/**************** Semantic ****************/
-// Flags
-int function_flag = 0;                                 // Tracking where the program is in the function definititon process
-int type_flag = -1;                                    // Tracks the current type for type checking
-int var_type = -1;                                     // Tracks the initializing type for creating local variables
-
-// Global Variables
-int type_depth = 0;                                    // Tracks the current depth on the AST ffrom the start of a type check
-char* hold_lexeme;                                     // <id> held until we can disambiguate a var from a function call
-
-// Instantiate global structs
-struct global global_scope;                            // Holds lowest level scope and also pointers to all function definitions
-struct check_functions* function_call_stack = NULL;    // Struct for type checking params when a function call is passed as a param of a function
+// Everything one compilation reads and writes, so compilations on different threads share nothing
+struct compiler_context{
+    /**************** Options ****************/
+    struct compiler_options options;                   // Flags the compilation was started with
+
+    /**************** Lexical ****************/
+    FILE* input;                                       // Source being compiled
+    const char* source;                                // In-memory source read instead of input, NULL to read input
+    size_t source_index;                               // Next char of source to read
+    size_t source_end;                                 // End of the range of source being read
+    int line_number;                                   // Line of the char being read
+    //Flags
+    int pushback_char;                                 // Pushback flag is for rereading a char at the end of a token
+    int checkNegativeFlag;                             // Check Negative flag is for checking the difference between a leading +- and the operators +,-
+
+    // Double Buffer System Variables
+    char buffer1[BUFFER_SIZE];                         //
+    char buffer2[BUFFER_SIZE];                         //
+    int current_buffer;                                // Buffer number flag
+    size_t index_buffer;                               // Index in current buffer
+    size_t size_buffer1;                               // Chars remaining unread in buffer1
+    size_t size_buffer2;                               // Chars remaining unread in buffer2
+
+    // Pipeline
+    struct token_ring* ring;                           // Ring the lexer thread hands records to the parser through, NULL
+                                                       // when each token is parsed as soon as it is lexed
+    struct token_batch* batch;                         // Batch of the ring the lexer is filling
+
+    /**************** Syntax ****************/
+    // Node pointers for AST Traversal
+    struct node* root;                                 // Points to current node of AST
+    struct node* next;                                 // Points to next node when traversing down AST
+
+    /**************** Semantic ****************/
+    // Flags
+    int function_flag;                                 // Tracking where the program is in the function definititon process
+    int type_flag;                                     // Tracks the current type for type checking
+    int var_type;                                      // Tracks the initializing type for creating local variables
+
+    int type_depth;                                    // Tracks the current depth on the AST ffrom the start of a type check
+    char* hold_lexeme;                                 // <id> held until we can disambiguate a var from a function call
+    struct global global_scope;                        // Holds lowest level scope and also pointers to all function definitions
+    struct check_functions* function_call_stack;       // Struct for type checking params when a function call is passed as a param of a function
+    struct function undeclared;                        // Stands in on the function call stack for a call to a function
+                                                       // that isn't declared
+    struct scope* scope;                               // Scope of main once the source has been analyzed
+    struct scope* current_scope;                       // Innermost scope of the code being analyzed
+    struct function* current_function;                 // Function being defined, NULL outside a definition
+
+    /**************** Outputs ****************/
+    FILE* symbol_table_lex;                            // Recognized tokens and their types
+    FILE* symbol_table_syn;                            // Production information
+    FILE* symbol_table_sem;                            // Scope information
+    FILE* error_doc;                                   // Lexical, syntactical and semantic errors
+    FILE* tac_table;                                   // Three address code
+    FILE* opt_report;                                  // What each optimization pass did, only written with the optimize option
+    char* texts[COMPILER_NUM_OUTPUTS];                 // In-memory outputs of compiler_compile
+    size_t lengths[COMPILER_NUM_OUTPUTS];              //
+
+    /**************** TAC ****************/
+    struct tac_program program;                        // TAC of the source
+    int has_program;                                   // True(1) once program holds TAC
+
+    /**************** Incremental ****************/
+    struct incremental_cache* incremental;             // Per-function cache kept across compilations, NULL without one
+    size_t lexed_bytes;                                // Source bytes the last compilation lexed
+    double analyze_seconds;                            // Time its analysis took
+    double seconds;                                    // Time all of it took
+
+    /**************** Streaming ****************/
+    struct tac_context* stream;                        // TAC generation carried from one function to the next when each is
+                                                       // generated as soon as it is checked, NULL to generate after analysis
+};
 
 /******************************** Function Definitions ********************************/
 // These cannot be moved to the functions header file as they rely on stdlib or some global value defined in this file
@@ -93,8 +218,22 @@ void create_new_scope(
             line_number, start_lexeme);
 }
 
+// Appends a function to the end of global_scope.functions
+void add_global_function(struct compiler_context* compiler, struct function function){
+    int count = compiler->global_scope.num_functions;
+    compiler->global_scope.num_functions++;
+
+    // Double the array when it is full so adding n functions copies O(n)
+    if (count == compiler->global_scope.capacity) {
+        compiler->global_scope.capacity = (count == 0) ? 1 : count * 2;
+        compiler->global_scope.functions = realloc(compiler->global_scope.functions, sizeof(struct function) * compiler->global_scope.capacity);
+    }
+    // Add the new function at the end
+    compiler->global_scope.functions[count] = function;
+}
+
 // Generates a new function
-void new_function(int line_number, struct function** new_funct, struct scope** current_scope, FILE* symbol_table){
+void new_function(struct compiler_context* compiler, int line_number, struct function** new_funct, struct scope** current_scope, FILE* symbol_table){
     // Create new function
     *new_funct = malloc(sizeof(struct function));
     (*new_funct)->line = line_number;
@@ -104,28 +243,30 @@ void new_function(int line_number, struct function** new_funct, struct scope** c
     (*new_funct)->param_types = NULL;
     create_new_scope(current_scope, line_number, "fed", symbol_table);
     (*new_funct)->my_scope = *current_scope;
+    add_global_function(compiler, **new_funct);
+}
 
-    // Append new function to the end of global_scope.functions
-    struct function *temp;
-    global_scope.num_functions++;
-
-    // Allocate memory for the updated array of functions
-    if (global_scope.num_functions == 1) {
-        // First function - initial allocation
-        temp = malloc(sizeof(struct function));
-    } else {
-        // Subsequent functions - reallocation preserving existing functions
-        temp = malloc(sizeof(struct function) * global_scope.num_functions);
-        // Copy existing functions to the new memory location
-        for (int i = 0; i < global_scope.num_functions - 1; i++) {
-            temp[i] = global_scope.functions[i];
-        }
-        // Free the old memory to prevent memory leaks
-        free(global_scope.functions);
+/**************** "Destructors" ****************/
+// Frees a scope and the names of its variables
+void free_scope(struct scope* scope){
+    if (scope == NULL) {
+        return;
     }
-    // Add the new function at the end
-    temp[global_scope.num_functions - 1] = (**new_funct);
-    global_scope.functions = temp;
+    for (int i = 0; i < scope->num_vars; i++) {
+        free(scope->local_vars[i].lexeme);
+    }
+    free(scope->local_vars);
+    free(scope);
+}
+
+// Frees what a function the checker defined holds: its name, parameter types and scope
+void free_function(struct function* function){
+    free(function->lexeme);
+    free(function->param_types);
+    free_scope(function->my_scope);
+    function->lexeme = NULL;
+    function->param_types = NULL;
+    function->my_scope = NULL;
 }
 
 /**************** Struct editing functions ****************/
@@ -135,7 +276,7 @@ void add_param(struct function** this_funct, int type){
     (*this_funct)->num_params++;
     int* temp;
     if((*this_funct)->num_params == 1){
-        temp = malloc(sizeof(char));
+        temp = malloc(sizeof(int));
     }else{
         temp = malloc(sizeof(int) * (*this_funct)->num_params);
         for(int i = 0; i < (*this_funct)->num_params - 1; i++){
@@ -265,6 +406,7 @@ void insert(int* vals, struct node* root){
         temp->index = 0;
         temp->parent = root;
         temp->children = NULL;
+        temp->lexeme = NULL;
         root->children[i-1] = temp;
     }
 
@@ -285,9 +427,11 @@ void delete_tree(struct node* root) {
                 delete_tree(root->children[i]);
             }
         }
-        root->children = NULL;
         free(root->children);
+        root->children = NULL;
     }
+    free(root->lexeme);
+    root->lexeme = NULL;
 
     
     // Reset all remaining values of root
@@ -306,8 +450,6 @@ void delete_tree(struct node* root) {
 /******************************************** EXPERIMENTAL, TAC PRINTING ********************************************/
 
 
-char tac_buffer[4096];
-int tac_buffer_index = 0;
 
 struct tac_context{
     int memory;
@@ -315,189 +457,214 @@ struct tac_context{
     int label_counter;
     int stack_mem;
     int tac_type;
+    struct tac_program* program;           // Program being generated
+    struct tac_function* function;         // Function currently receiving instructions
+    struct scope* scope;                   // Scope of the function being generated, for variable types
+    struct global* global_scope;           // Functions of the program, for their scopes and params
+    int batch;                             // True(1) when main's final variables are an output, as in batch mode
+    struct incremental_cache* incremental; // Per-function cache the TAC of functions is copied from and into, or NULL
 };
 
-struct tac_context* tacc;
-
-char* gen_bool_exp(char* l, int bool_type, char* r, struct tac_context** tacc){
-
-    char* str = "";
-    char* temp1 = "";
-    char* temp2 = "";
-    int write;
-    switch (bool_type) {
-        case 14:
-
-            temp1 = malloc(sizeof(char) * 10);
-            snprintf(temp1, 10, "t%d", (*tacc)->temp_counter++);
-            write = snprintf((tac_buffer + tac_buffer_index), (sizeof(tac_buffer) - tac_buffer_index),  "    %s = %s > %s\n", temp1, l, r);
-
-
-            tac_buffer_index += write;
-
-            temp2 = malloc(sizeof(char) * 10);
-            snprintf(temp2, 10, "t%d", (*tacc)->temp_counter++);
-            write = snprintf((tac_buffer + tac_buffer_index), (sizeof(tac_buffer) - tac_buffer_index),  "    %s = %s == %s\n", temp2, l, r);
-
-            tac_buffer_index += write;
-
-            str = malloc(sizeof(char) * 10);
-            snprintf(str, 10, "t%d", (*tacc)->temp_counter++);
-            write = snprintf((tac_buffer + tac_buffer_index), (sizeof(tac_buffer) - tac_buffer_index),  "    %s = %s || %s\n", str, l, r);
-
-            tac_buffer_index += write;
-
-            if ((*tacc)->tac_type == 1) {
-                (*tacc)->memory += 12;
-            }
-            else if ((*tacc)->tac_type == 0){
-                (*tacc)->memory += 24;
-            }
+// Returns a new temp of the current tac_type and reserves memory for it in the frame
+struct tac_operand gen_temp(struct tac_context** tacc){
+    if ((*tacc)->tac_type == 1) {
+        (*tacc)->memory += 4;
+    }
+    else if ((*tacc)->tac_type == 0){
+        (*tacc)->memory += 8;
+    }
+    return tac_temp((*tacc)->temp_counter++, (*tacc)->tac_type);
+}
 
+// Emits dest = l op r into the current function
+void gen_binary(int op, struct tac_operand dest, struct tac_operand l, struct tac_operand r, struct tac_context** tacc){
+    tac_emit((*tacc)->function, tac_instr_new(op, dest, l, r));
+}
 
-            break;
-        case 17:
-            str = malloc(sizeof(char) * 10);
-            snprintf(str, 10, "t%d", (*tacc)->temp_counter++);
-            write = snprintf((tac_buffer + tac_buffer_index), (sizeof(tac_buffer) - tac_buffer_index),  "    %s = %s > %s\n", str, l, r);
+// Emits a label, goto or IFZ into the current function
+void gen_jump(int op, struct tac_operand cond, int label, struct tac_context** tacc){
+    struct tac_instr instr = tac_instr_new(op, tac_none(), cond, tac_none());
+    instr.label = label;
+    tac_emit((*tacc)->function, instr);
+}
 
-            tac_buffer_index += write;
-            
-            if ((*tacc)->tac_type == 1) {
-                (*tacc)->memory += 4;
-            }
-            else if ((*tacc)->tac_type == 0){
-                (*tacc)->memory += 8;
-            }
+// Returns a new int temp for the result of a comparison or boolean operator
+struct tac_operand gen_bool_temp(struct tac_context** tacc){
+    (*tacc)->tac_type = 1;
+    return gen_temp(tacc);
+}
 
-            break;
-        
-        case 16:
-            temp1 = malloc(sizeof(char) * 10);
-            snprintf(temp1, 10, "t%d", (*tacc)->temp_counter++);
-            write = snprintf((tac_buffer + tac_buffer_index), (sizeof(tac_buffer) - tac_buffer_index),  "    %s = %s > %s\n", temp1, l, r);
+// Comparisons lower to a single instruction producing 1 or 0
+struct tac_operand gen_bool_exp(struct tac_operand l, int bool_type, struct tac_operand r, struct tac_context** tacc){
+    struct tac_operand str = gen_bool_temp(tacc);
+    gen_binary(tac_relop(bool_type), str, l, r, tacc);
+    return str;
+}
 
-            tac_buffer_index += write;
 
-            temp2 = malloc(sizeof(char) * 10);
-            snprintf(temp2, 10, "t%d", (*tacc)->temp_counter++);
-            write = snprintf((tac_buffer + tac_buffer_index), (sizeof(tac_buffer) - tac_buffer_index),  "    %s = %s < %s\n", temp2, l, r);
+struct tac_operand gen_constant(struct node* root, struct tac_context** tacc){
+    int type = (root->value == 27) ? 1 : 0;
+    struct tac_operand str = tac_temp((*tacc)->temp_counter++, type);
 
-            tac_buffer_index += write;
+    gen_binary(TAC_ASSIGN, str, tac_const(root->lexeme, type), tac_none(), tacc);
 
-            str = malloc(sizeof(char) * 10);
-            snprintf(str, 10, "t%d", (*tacc)->temp_counter++);
-            write = snprintf((tac_buffer + tac_buffer_index), (sizeof(tac_buffer) - tac_buffer_index),  "    %s = %s || %s\n", str, l, r);
+    if (root->value == 27) {
+        (*tacc)->memory += 4;
+        (*tacc)->tac_type = 1;
 
-            tac_buffer_index += write;
+    }
+    else if (root->value == 28) {
+        (*tacc)->memory += 8;
+        (*tacc)->tac_type = 0;
+    }
+    return str;
+}
 
-            if ((*tacc)->tac_type == 1) {
-                (*tacc)->memory += 12;
+// Declared type of a variable, searching the scope and then the scopes around it
+int lookup_var_type(struct scope* scope, const char* name, int fallback){
+    for (; scope != NULL; scope = scope->parent_scope) {
+        for (int i = 0; i < scope->num_vars; i++) {
+            if (compare_strings(scope->local_vars[i].lexeme, name) == 0) {
+                return scope->local_vars[i].variable_type;
             }
-            else if ((*tacc)->tac_type == 0){
-                (*tacc)->memory += 24;
-            }
-
-            break;
-        
-        case 15:
-            temp1 = malloc(sizeof(char) * 10);
-            snprintf(temp1, 10, "t%d", (*tacc)->temp_counter++);
-            write = snprintf((tac_buffer + tac_buffer_index), (sizeof(tac_buffer) - tac_buffer_index),  "    %s = %s < %s\n", temp1, l, r);
+        }
+    }
+    return fallback;
+}
 
-            tac_buffer_index += write;
+// Declared return type of a function, fallback if it isn't one of the functions looked up
+int lookup_return_type(struct global* global_scope, const char* name, int fallback){
+    for (int i = 0; i < global_scope->num_functions; i++) {
+        if (global_scope->functions[i].lexeme != NULL && compare_strings(global_scope->functions[i].lexeme, name) == 0) {
+            return global_scope->functions[i].return_type;
+        }
+    }
+    return fallback;
+}
 
-            temp2 = malloc(sizeof(char) * 10);
-            snprintf(temp2, 10, "t%d", (*tacc)->temp_counter++);
-            write = snprintf((tac_buffer + tac_buffer_index), (sizeof(tac_buffer) - tac_buffer_index),  "    %s = %s == %s\n", temp2, l, r);
+// ????
+struct tac_operand gen_id(struct node* root, struct tac_context** tacc){
+    (*tacc)->tac_type = root->type;
+    return tac_var(root->lexeme, lookup_var_type((*tacc)->scope, root->lexeme, root->type));
+}
 
-            tac_buffer_index += write;
+struct tac_operand gen_expr(struct node* root, struct tac_context** tacc);
+void gen_cond(struct node* root, int label, int sense, struct tac_context** tacc);
 
-            str = malloc(sizeof(char) * 10);
-            snprintf(str, 10, "t%d", (*tacc)->temp_counter++);
-            write = snprintf((tac_buffer + tac_buffer_index), (sizeof(tac_buffer) - tac_buffer_index),  "    %s = %s || %s\n", str, l, r);
+// Lowers a chain of <bterm>s joined by and (<expr>) or of <comp_expr>s joined by or (<bterm>) as jumping code
+void gen_cond_chain(struct node* root, int is_and, int label, int sense, struct tac_context** tacc){
+    // Collect the operands of the chain
+    int num_operands = 1;
+    for (struct node* rest = root->children[1]; rest->size > 1; rest = rest->children[2]) {
+        num_operands++;
+    }
+    struct node** operands = malloc(sizeof(struct node*) * num_operands);
+    operands[0] = root->children[0];
+    int i = 1;
+    for (struct node* rest = root->children[1]; rest->size > 1; rest = rest->children[2]) {
+        operands[i++] = rest->children[1];
+    }
 
-            tac_buffer_index += write;
+    if (num_operands == 1 || sense == !is_and) {
+        // A false operand of and, or a true operand of or, decides the chain on its own
+        for (i = 0; i < num_operands; i++) {
+            gen_cond(operands[i], label, sense, tacc);
+        }
+    }
+    else {
+        // Every operand but the last can only rule the jump out, skip past the chain when one does
+        int skip = (*tacc)->label_counter++;
+        for (i = 0; i < num_operands - 1; i++) {
+            gen_cond(operands[i], skip, !sense, tacc);
+        }
+        gen_cond(operands[num_operands - 1], label, sense, tacc);
+        gen_jump(TAC_LABEL, tac_none(), skip, tacc);
+    }
+    free(operands);
+}
 
-            if ((*tacc)->tac_type == 1) {
-                (*tacc)->memory += 12;
+// Short circuit lowering of a condition, jumps to label when the condition equals sense and falls through otherwise
+void gen_cond(struct node* root, int label, int sense, struct tac_context** tacc){
+    struct tac_operand l, r;
+    struct tac_instr instr;
+    switch (root->value) {
+        case 27:    // not <expr>, or <bterm>s joined by and
+            if (root->children[0]->terminal_flag == 1 && root->children[0]->value == 36) {
+                gen_cond(root->children[1], label, !sense, tacc);
             }
-            else if ((*tacc)->tac_type == 0){
-                (*tacc)->memory += 24;
+            else {
+                gen_cond_chain(root, 1, label, sense, tacc);
             }
-
-            break;
-
-        case 18:
-            str = malloc(sizeof(char) * 10);
-            snprintf(str, 10, "t%d", (*tacc)->temp_counter++);
-            write = snprintf((tac_buffer + tac_buffer_index), (sizeof(tac_buffer) - tac_buffer_index),  "    %s = %s < %s\n", str, l, r);
-
-            tac_buffer_index += write;
-            
-            if ((*tacc)->tac_type == 1) {
-                (*tacc)->memory += 4;
+            return;
+        case 25:    // <comp_expr>s joined by or
+            gen_cond_chain(root, 0, label, sense, tacc);
+            return;
+        case 23:    // Comparisons jump directly
+            if (root->children[1]->size > 1) {
+                l = gen_expr(root->children[0], tacc);
+                int relop = tac_relop(root->children[1]->children[0]->children[0]->value);
+                r = gen_expr(root->children[1], tacc);
+                instr = tac_instr_new(TAC_IF, tac_none(), l, r);
+                instr.relop = relop;
+                instr.label = label;
+                if (!sense && l.type == 1 && r.type == 1) {
+                    instr.relop = tac_invert_relop(relop);
+                }
+                else if (!sense) {
+                    // A double may be NaN, which fails the comparison and its inverse alike: jump over the jump
+                    instr.label = (*tacc)->label_counter++;
+                    tac_emit((*tacc)->function, instr);
+                    gen_jump(TAC_GOTO, tac_none(), label, tacc);
+                    gen_jump(TAC_LABEL, tac_none(), instr.label, tacc);
+                    return;
+                }
+                tac_emit((*tacc)->function, instr);
+                return;
             }
-            else if ((*tacc)->tac_type == 0){
-                (*tacc)->memory += 8;
+            gen_cond(root->children[0], label, sense, tacc);
+            return;
+        case 19:    // Look through arithmetic levels with no operator
+        case 21:
+            if (root->children[1]->size == 1) {
+                gen_cond(root->children[0], label, sense, tacc);
+                return;
             }
-
             break;
-        
-        case 19:
-            str = malloc(sizeof(char) * 10);
-            snprintf(str, 10, "t%d", (*tacc)->temp_counter++);
-            write = snprintf((tac_buffer + tac_buffer_index), (sizeof(tac_buffer) - tac_buffer_index),  "    %s = %s == %s\n", str, l, r);
-
-            tac_buffer_index += write;
-            
-            if ((*tacc)->tac_type == 1) {
-                (*tacc)->memory += 4;
-            }
-            else if ((*tacc)->tac_type == 0){
-                (*tacc)->memory += 8;
+        case 17:    // ( <expr> )
+            if (root->size == 3) {
+                gen_cond(root->children[1], label, sense, tacc);
+                return;
             }
-
             break;
     }
-    return str;
-}
-
-
-char* gen_constant(struct node* root, struct tac_context** tacc){
-    char* str;
-    str = malloc(sizeof(char) * 10);
-    snprintf(str, sizeof(str), "t%d", (*tacc)->temp_counter++);
-
-    int write = snprintf((tac_buffer + tac_buffer_index), (sizeof(tac_buffer) - tac_buffer_index), "    %s = %s\n", str, root->lexeme);
-    tac_buffer_index += write;
-
-
-
-    if (root->value == 27) {
-        (*tacc)->memory += 4;
-        (*tacc)->tac_type = 1;
 
+    // Any other value is true when it is not zero
+    l = gen_expr(root, tacc);
+    if (sense) {
+        instr = tac_instr_new(TAC_IF, tac_none(), l, tac_const("0", l.type));
+        instr.relop = TAC_NE;
+        instr.label = label;
+        tac_emit((*tacc)->function, instr);
     }
-    else if (root->value == 28) {
-        (*tacc)->memory += 8;
-        (*tacc)->tac_type = 0;
+    else {
+        gen_jump(TAC_IFZ, l, label, tacc);
     }
-    return str;
 }
 
-// ????
-char* gen_id(struct node* root, struct tac_context** tacc){
-    char* value;
-    value = copy_string(root->lexeme);
-    (*tacc)->tac_type = root->type;
-    return value;
+// Boolean operators used as values (print, assignment, params) produce 1 or 0 through the same jumping code
+struct tac_operand gen_bool_value(struct node* root, struct tac_context** tacc){
+    int skip = (*tacc)->label_counter++;
+    struct tac_operand str = gen_bool_temp(tacc);
+    gen_binary(TAC_ASSIGN, str, tac_const("0", 1), tac_none(), tacc);
+    gen_cond(root, skip, 0, tacc);
+    gen_binary(TAC_ASSIGN, str, tac_const("1", 1), tac_none(), tacc);
+    gen_jump(TAC_LABEL, tac_none(), skip, tacc);
+    return str;
 }
 
-char* gen_expr(struct node* root, struct tac_context** tacc){
-    char* str = "";
-    char* temp;
-    const char* empty = "";
+struct tac_operand gen_expr(struct node* root, struct tac_context** tacc){
+    struct tac_operand str = tac_none();
+    struct tac_operand temp;
     if (!root->children || root->terminal_flag == 1){
         if (root->value == 2) {
             str = gen_id(root, tacc);
@@ -508,71 +675,55 @@ char* gen_expr(struct node* root, struct tac_context** tacc){
         return str;
     }
 
-    char *l, *r, *op, *label;
+    struct tac_operand l, r;
+    struct tac_instr instr;
+    int op, label;
     int bool_type;
-    int write, temp_stack_mem;
+    int temp_stack_mem;
 
     switch (root->value) {
         case 13:
             switch (root->children[0]->value) {
                 case 5:     // if statement
-                    l = gen_expr(root->children[2], tacc);
-                    label = malloc(sizeof(char) * 10);
-                    snprintf(label, 10, "L%d", (*tacc)->label_counter++);
-                    write = snprintf((tac_buffer + tac_buffer_index), (sizeof(tac_buffer) - tac_buffer_index), "    IFZ  %s Goto %s\n", l, label);
-                    tac_buffer_index += write;
-
+                    label = (*tacc)->label_counter++;
+                    gen_cond(root->children[2], label, 0, tacc);
 
                     r = gen_expr(root->children[5], tacc);
 
                     if (root->children[6]->size > 1) {
-                        write = snprintf((tac_buffer + tac_buffer_index), (sizeof(tac_buffer) - tac_buffer_index), "    Goto L%d\n",(*tacc)->label_counter);
-                        tac_buffer_index += write;
-                    }
-
-
-                    write = snprintf((tac_buffer + tac_buffer_index), (sizeof(tac_buffer) - tac_buffer_index), "%s\n", label);
-                    tac_buffer_index += write;
-                    
-                    if (root->children[6]->size > 1) {
+                        // Else branch, the then branch jumps over it
+                        int end_label = (*tacc)->label_counter++;
+                        gen_jump(TAC_GOTO, tac_none(), end_label, tacc);
+                        gen_jump(TAC_LABEL, tac_none(), label, tacc);
                         r = gen_expr(root->children[6], tacc);
-                        write = snprintf((tac_buffer + tac_buffer_index), (sizeof(tac_buffer) - tac_buffer_index), "L%d\n",(*tacc)->label_counter);
-                        tac_buffer_index += write;
+                        gen_jump(TAC_LABEL, tac_none(), end_label, tacc);
+                    }
+                    else {
+                        gen_jump(TAC_LABEL, tac_none(), label, tacc);
                     }
-
 
                 break;
-                case 9:
-                    l = gen_expr(root->children[2], tacc);
-                    label = malloc(sizeof(char) * 10);
-                    snprintf(label, 10, "L%d", (*tacc)->label_counter++);
-
-                    write = snprintf((tac_buffer + tac_buffer_index), (sizeof(tac_buffer) - tac_buffer_index), "L%d\n", (*tacc)->label_counter);
-                    tac_buffer_index += write;
+                case 9:     // while statement, the condition is tested at the top of every iteration
+                    label = (*tacc)->label_counter++;
+                    int exit_label = (*tacc)->label_counter++;
 
-                    write = snprintf((tac_buffer + tac_buffer_index), (sizeof(tac_buffer) - tac_buffer_index), "    IFZ  %s Goto %s\n", l, label);
-                    tac_buffer_index += write;
-                    
+                    gen_jump(TAC_LABEL, tac_none(), label, tacc);
+                    gen_cond(root->children[2], exit_label, 0, tacc);
 
                     r = gen_expr(root->children[5], tacc);
 
-                    write = snprintf((tac_buffer + tac_buffer_index), (sizeof(tac_buffer) - tac_buffer_index), "    Goto L%d\n", (*tacc)->label_counter);
-                    tac_buffer_index += write;
-
-                    write = snprintf((tac_buffer + tac_buffer_index), (sizeof(tac_buffer) - tac_buffer_index), "%s\n", label);
-                    tac_buffer_index += write;
+                    gen_jump(TAC_GOTO, tac_none(), label, tacc);
+                    gen_jump(TAC_LABEL, tac_none(), exit_label, tacc);
 
                     break;
 
                 case 12:
                     str = gen_expr(root->children[1], tacc);
-                    write = snprintf((tac_buffer + tac_buffer_index), (sizeof(tac_buffer) - tac_buffer_index), "    Print %s\n", str);
-                    tac_buffer_index += write;
+                    tac_emit((*tacc)->function, tac_instr_new(TAC_PRINT, tac_none(), str, tac_none()));
                     break;
                 case 13:
                     str = gen_expr(root->children[1], tacc);
-                    write = snprintf((tac_buffer + tac_buffer_index), (sizeof(tac_buffer) - tac_buffer_index), "    Return %s\n", str);
-                    tac_buffer_index += write;
+                    tac_emit((*tacc)->function, tac_instr_new(TAC_RETURN, tac_none(), str, tac_none()));
                 
                     break;
                 case 30:    // Assignment <var> = <expression>
@@ -580,8 +731,7 @@ char* gen_expr(struct node* root, struct tac_context** tacc){
                     l = gen_expr(root->children[0], tacc);
                     r = gen_expr(root->children[2], tacc);
 
-                    write = snprintf((tac_buffer + tac_buffer_index), (sizeof(tac_buffer) - tac_buffer_index), "    %s = %s\n", l, r);
-                    tac_buffer_index += write;
+                    gen_binary(TAC_ASSIGN, l, r, tac_none(), tacc);
 
 
                     break;
@@ -592,48 +742,18 @@ char* gen_expr(struct node* root, struct tac_context** tacc){
                 
             }
             break;
-        case 15:
-            if (root->size > 1) {
-                if (root->children[1]->size > 1) {
-                    r = gen_expr(root->children[1], tacc);
-                    if (!compare_strings(r, empty) == 0) {
-                        write = snprintf((tac_buffer + tac_buffer_index), (sizeof(tac_buffer) - tac_buffer_index),  "    PushParam %s\n", r);
-                        tac_buffer_index += write;
-
-                        (*tacc)->stack_mem += 4;
-                    }
-
-                }
-
-                l = gen_expr(root->children[0], tacc);
-                if (!compare_strings(l, empty) == 0) {
-                    write = snprintf((tac_buffer + tac_buffer_index), (sizeof(tac_buffer) - tac_buffer_index),  "    PushParam %s\n", l);
-                    tac_buffer_index += write;
-
-                    (*tacc)->stack_mem += 4;
-                }   
-
-            }
-
-            break;
-        
-        case 16:
+        case 15:    // <expr> <expr_seq'>, arguments are pushed last to first
+        case 16:    // , <expr> <expr_seq'>
             if (root->size > 1) {
-                if (root->children[1]->size > 1) {
-                    r = gen_expr(root->children[1], tacc);
-                    if (!compare_strings(r, empty) == 0) {
-                        write = snprintf((tac_buffer + tac_buffer_index), (sizeof(tac_buffer) - tac_buffer_index),  "    PushParam %s\n", r);
-                        tac_buffer_index += write;
-
-                        (*tacc)->stack_mem += 4;
-                    }
-
+                struct node* first = (root->value == 15) ? root->children[0] : root->children[1];
+                struct node* rest = (root->value == 15) ? root->children[1] : root->children[2];
+                if (rest->size > 1) {
+                    gen_expr(rest, tacc);
                 }
 
-                l = gen_expr(root->children[0], tacc);
-                if (!compare_strings(l, empty) == 0) {
-                    write = snprintf((tac_buffer + tac_buffer_index), (sizeof(tac_buffer) - tac_buffer_index),  "    PushParam %s\n", l);
-                    tac_buffer_index += write;
+                l = gen_expr(first, tacc);
+                if (l.kind != TAC_NONE) {
+                    tac_emit((*tacc)->function, tac_instr_new(TAC_PUSH_PARAM, tac_none(), l, tac_none()));
 
                     (*tacc)->stack_mem += 4;
                 }   
@@ -644,149 +764,51 @@ char* gen_expr(struct node* root, struct tac_context** tacc){
         case 17:
             if (root->size == 2){
                 if (root->children[1]->size == 1) {
-                    str = root->children[0]->lexeme;
-                    (*tacc)->tac_type = root->children[0]->type;
+                    str = gen_id(root->children[0], tacc);
                 }
                 else {
                     temp_stack_mem = (*tacc)->stack_mem;
                     l = gen_expr(root->children[1], tacc);
-                    str = malloc(sizeof(char) * 10);
-                    snprintf(str, 10,  "t%d", (*tacc)->temp_counter++);
-
-                    write = snprintf((tac_buffer + tac_buffer_index), (sizeof(tac_buffer) - tac_buffer_index),  "    %s = LCall %s\n", str, root->children[0]->lexeme);
-                    tac_buffer_index += write;
 
                     (*tacc)->tac_type = root->children[0]->type;
-
-                    if ((*tacc)->tac_type == 1) {
-                        (*tacc)->memory += 4;
-                    }
-                    else if ((*tacc)->tac_type == 0){
-                        (*tacc)->memory += 8;
+                    str = gen_temp(tacc);
+                    // Outside an assignment the checker leaves a call untyped, the callee's signature has the
+                    // type of the value it returns. The frame size counts the temp as before
+                    if (str.type == -1) {
+                        str.type = lookup_return_type((*tacc)->global_scope, root->children[0]->lexeme, -1);
                     }
+
+                    instr = tac_instr_new(TAC_LCALL, str, tac_none(), tac_none());
+                    instr.callee = root->children[0]->lexeme;
+                    tac_emit((*tacc)->function, instr);
                     
                     int num = ((*tacc)->stack_mem - temp_stack_mem);
-                    write = snprintf((tac_buffer + tac_buffer_index), (sizeof(tac_buffer) - tac_buffer_index),  "    PopParams %d\n", num);
-                    tac_buffer_index += write;
+                    instr = tac_instr_new(TAC_POP_PARAMS, tac_none(), tac_none(), tac_none());
+                    instr.count = num;
+                    tac_emit((*tacc)->function, instr);
 
                     (*tacc)->stack_mem -= num;
                 }
             }
-            else{
-                for (int i = 0; i < root->size; i++){
-                    str = gen_expr(root->children[i], tacc);
-                }
-            }
-            break;
-            
-        case 19:   // <Term> (*, /, %) operators
-
-            if (root->children[1]->size > 1){
-                l = gen_expr(root->children[0], tacc);
-                op = root->children[1]->children[0]->lexeme;
-                
-                r = gen_expr(root->children[1], tacc);
-                
-
-                str = malloc(sizeof(char) * 10);
-                snprintf(str, 10, "t%d", (*tacc)->temp_counter++);
-                write = snprintf((tac_buffer + tac_buffer_index), (sizeof(tac_buffer) - tac_buffer_index),  "    %s = %s %s %s\n", str, l, op, r);
-
-                tac_buffer_index += write;
-                
-                if ((*tacc)->tac_type == 1) {
-                    (*tacc)->memory += 4;
-                }
-                else if ((*tacc)->tac_type == 0){
-                    (*tacc)->memory += 8;
-                }
-
+            else if (root->size == 3){
+                // ( <expr> )
+                str = gen_expr(root->children[1], tacc);
             }
             else{
                 str = gen_expr(root->children[0], tacc);
             }
-            
-            break;
-
-        case 20:
-            l = gen_expr(root->children[1], tacc);
-
-            if (root->children[2]->size > 1){
-
-                str = malloc(sizeof(char) * 10);
-                snprintf(str, 10, "t%d", (*tacc)->temp_counter++);
-
-                r = gen_expr(root->children[2], tacc);
-                op = root->children[2]->children[0]->lexeme;
-
-                write = snprintf((tac_buffer + tac_buffer_index), (sizeof(tac_buffer) - tac_buffer_index),  "    %s = %s %s %s\n", str, l, op, r);
-                tac_buffer_index += write;
-                
-                if ((*tacc)->tac_type == 1) {
-                    (*tacc)->memory += 4;
-                }
-                else if ((*tacc)->tac_type == 0){
-                    (*tacc)->memory += 8;
-                }
-
-            }
-            else{
-                str = malloc(sizeof(char) * 10);
-                snprintf(str, 10, "%s", l);
-            }
             break;
-
-        case 21:    // plus/minus expressions
-            if (root->children[1]->size > 1){
-                l = gen_expr(root->children[0], tacc);
-                op = root->children[1]->children[0]->lexeme;
-                r = gen_expr(root->children[1], tacc);
-
-                str = malloc(sizeof(char) * 10);
-                snprintf(str, 10, "t%d", (*tacc)->temp_counter++);
-                write = snprintf((tac_buffer + tac_buffer_index), (sizeof(tac_buffer) - tac_buffer_index),  "    %s = %s %s %s\n", str, l, op, r);
-
-                tac_buffer_index += write;
-                
-                if ((*tacc)->tac_type == 1) {
-                    (*tacc)->memory += 4;
-                }
-                else if ((*tacc)->tac_type == 0){
-                    (*tacc)->memory += 8;
-                }
-
-            }
-            else{
-                str = gen_expr(root->children[0], tacc);
-            }
             
-            break;
-
-        case 22:
-            l = gen_expr(root->children[1], tacc);
-
-            if (root->children[2]->size > 1){
-                str = malloc(sizeof(char) * 10);
-                snprintf(str, 10, "t%d", (*tacc)->temp_counter++);
-
-                r = gen_expr(root->children[2], tacc);
-                op = root->children[2]->children[0]->lexeme;
-                write = snprintf((tac_buffer + tac_buffer_index), (sizeof(tac_buffer) - tac_buffer_index),  "    %s = %s %s %s\n", str, l, op, r);
-
-                tac_buffer_index += write;
-
-                if ((*tacc)->tac_type == 1) {
-                    (*tacc)->memory += 4;
-                }
-                else if ((*tacc)->tac_type == 0){
-                    (*tacc)->memory += 8;
-                }
-                
+        case 19:   // <Term> (*, /, %) operators
+        case 21:    // plus/minus expressions, both chains are evaluated left to right so a - b - c is (a - b) - c
+            str = gen_expr(root->children[0], tacc);
+            for (struct node* rest = root->children[1]; rest->size > 1; rest = rest->children[2]) {
+                l = str;
+                op = tac_binary_op(rest->children[0]->lexeme);
+                r = gen_expr(rest->children[1], tacc);
 
-            }
-            else{
-                str = malloc(sizeof(char) * 10);
-                snprintf(str, 10, "%s", l);
+                str = gen_temp(tacc);
+                gen_binary(op, str, l, r, tacc);
             }
             break;
 
@@ -810,18 +832,24 @@ char* gen_expr(struct node* root, struct tac_context** tacc){
             break;
 
         case 30:
-            str = root->children[0]->lexeme;
-            (*tacc)->tac_type = root->children[0]->type;
+            str = gen_id(root->children[0], tacc);
             break;
 
-        case 27:    // Expression node
-            str = gen_expr(root->children[0], tacc);
+        case 25:    // <comp_expr>s joined by or
             if (root->children[1]->size > 1) {
-                char* temp = malloc(sizeof(char) * 10);
-                snprintf(temp, 10, "t%d", (*tacc)->temp_counter++);
-                write = snprintf((tac_buffer + tac_buffer_index), (sizeof(tac_buffer) - tac_buffer_index), "    %s = !%s\n", temp, str);
-                tac_buffer_index += write;
-                str = temp;
+                str = gen_bool_value(root, tacc);
+            }
+            else {
+                str = gen_expr(root->children[0], tacc);
+            }
+            break;
+
+        case 27:    // Expression node, not <expr> or <bterm>s joined by and
+            if (root->children[0]->terminal_flag == 1 || root->children[1]->size > 1) {
+                str = gen_bool_value(root, tacc);
+            }
+            else {
+                str = gen_expr(root->children[0], tacc);
             }
             break;
 
@@ -829,7 +857,7 @@ char* gen_expr(struct node* root, struct tac_context** tacc){
             for (int i = 0; i < root->size; i++){
                 temp = gen_expr(root->children[i], tacc);
 
-                if (!compare_strings(temp, empty) == 0) {
+                if (temp.kind != TAC_NONE) {
                     str = temp;
                 }
             }
@@ -839,6 +867,15 @@ char* gen_expr(struct node* root, struct tac_context** tacc){
 
 }
 
+// Records the params and locals of a function so TAC passes can tell them apart from globals
+void gen_locals(struct tac_function* function, struct scope* function_scope){
+    function->num_locals = function_scope->num_vars;
+    function->locals = malloc(sizeof(char*) * (function_scope->num_vars + 1));
+    for (int i = 0; i < function_scope->num_vars; i++) {
+        function->locals[i] = function_scope->local_vars[i].lexeme;
+    }
+}
+
 void print_tac_main_aux(struct node* root, struct tac_context** tacc){
     struct node* right;
     // Handle non-terminal nodes
@@ -877,13 +914,61 @@ void print_tac_main_aux(struct node* root, struct tac_context** tacc){
     }
 }
 
-void print_tac_function_aux(struct node* root, struct tac_context** tacc, FILE* tac_table) {  
+void print_tac_function_aux(struct node* root, struct tac_context** tacc);
+
+// Generates the function of an <fdecls> node. When its block used a per-function cache entry that holds TAC
+// generated from the same state, the TAC is copied out with its temps and labels renumbered, otherwise it is
+// generated and stored in the entry
+void gen_function(struct node* fdecls, struct tac_context** tacc){
+    struct incremental_cache* cache = (*tacc)->incremental;
+    struct incremental_entry* entry = NULL;
+    if (cache->next_use < cache->num_uses && cache->uses[cache->next_use].fdecls == fdecls) {
+        entry = cache->uses[cache->next_use++].entry;
+    }
+    if (entry != NULL && entry->has_tac && entry->tac_type_in == (*tacc)->tac_type && entry->stack_mem_in == (*tacc)->stack_mem) {
+        (*tacc)->function = incremental_copy_tac(entry, (*tacc)->temp_counter, (*tacc)->label_counter);
+        tac_add_function((*tacc)->program, (*tacc)->function);
+        (*tacc)->scope = entry->function.my_scope;
+        (*tacc)->temp_counter += entry->temps;
+        (*tacc)->label_counter += entry->labels;
+        (*tacc)->tac_type = entry->tac_type_out;
+        (*tacc)->stack_mem = entry->stack_mem_out;
+        (*tacc)->memory = entry->memory_out;
+        return;
+    }
+
+    int temp_base = (*tacc)->temp_counter;
+    int label_base = (*tacc)->label_counter;
+    int tac_type = (*tacc)->tac_type;
+    int stack_mem = (*tacc)->stack_mem;
+    int num_functions = (*tacc)->program->num_functions;
+    print_tac_function_aux(fdecls->children[0], tacc);
+    if (entry == NULL || (*tacc)->program->num_functions != num_functions + 1) {
+        return;
+    }
+    if (incremental_capture_tac(cache, entry, (*tacc)->program->functions[num_functions], temp_base,
+                                (*tacc)->temp_counter - temp_base, label_base, (*tacc)->label_counter - label_base) == 0) {
+        entry->tac_type_in = tac_type;
+        entry->stack_mem_in = stack_mem;
+        entry->tac_type_out = (*tacc)->tac_type;
+        entry->stack_mem_out = (*tacc)->stack_mem;
+        entry->memory_out = (*tacc)->memory;
+    }
+}
+
+void print_tac_function_aux(struct node* root, struct tac_context** tacc) {  
     struct node* right;
     // Handle non-terminal nodes
     if (root->terminal_flag == 0) {
         switch (root->value) {
             case 1:
                 (*tacc)->memory = 0;
+                // With a per-function cache the function under it is generated through the cache
+                if ((*tacc)->incremental != NULL && root->size == 3) {
+                    gen_function(root, tacc);
+                    print_tac_function_aux(root->children[2], tacc);
+                    return;
+                }
                 break;
             case 3:
                 if (root->children && root->children[0]->children) {
@@ -897,7 +982,18 @@ void print_tac_function_aux(struct node* root, struct tac_context** tacc, FILE*
                 }
                 break;
             case 5:
-                fprintf(tac_table, "%s:\n", root->children[0]->lexeme);
+                // Start a new function in the program
+                (*tacc)->function = new_tac_function(root->children[0]->lexeme);
+                tac_add_function((*tacc)->program, (*tacc)->function);
+                for (int i = 0; i < (*tacc)->global_scope->num_functions; i++) {
+                    struct function* function = &(*tacc)->global_scope->functions[i];
+                    if (compare_strings(function->lexeme, root->children[0]->lexeme) == 0) {
+                        gen_locals((*tacc)->function, function->my_scope);
+                        (*tacc)->function->num_params = function->num_params;
+                        (*tacc)->scope = function->my_scope;
+                        break;
+                    }
+                }
                 break;
             case 7:
                 right = root->children[1];
@@ -922,45 +1018,62 @@ void print_tac_function_aux(struct node* root, struct tac_context** tacc, FILE*
                 }
                 break;
             case 11:
+                (*tacc)->function->var_memory = (*tacc)->memory;
                 gen_expr(root, tacc);
-                fprintf(tac_table, "    BeginFunc %d:\n", (*tacc)->memory);
-                fprintf(tac_table, "%s", tac_buffer);
-                fprintf(tac_table, "    EndFunc:\n");
-                // Empty tac_buffer
-                for (int i = 0; i < 4096; i++) {
-                    tac_buffer[i] = '\0';
-                }
-                tac_buffer_index = 0;
+                (*tacc)->function->memory = (*tacc)->memory;
                 return;
         }
         
         // Process all children
         for (int i = 0; i < root->size; i++) {
-            print_tac_function_aux(root->children[i], tacc, tac_table);
+            print_tac_function_aux(root->children[i], tacc);
         }
     }
 }
 
 
-// Prints the start of a function definition in TAC
-void print_tac(struct node* root, struct tac_context** tacc, FILE* tac_table){
-    
+// Generates the TAC of the whole program into program, optimizes it if requested and prints it to the tac file
+void print_tac(struct node* root, struct tac_context** tacc, struct tac_program* program, int optimize, FILE* report, FILE* tac_table){
+    struct scope* main_scope = (*tacc)->scope;
+    (*tacc)->program = program;
 
-    // Print functions to tac file
-    print_tac_function_aux(root->children[0], tacc, tac_table);
+    // Generate functions
+    print_tac_function_aux(root->children[0], tacc);
 
 
     (*tacc)->memory = 0;
-    // Print main to tac file
-    fprintf(tac_table, "main:\n");
+    (*tacc)->scope = main_scope;
+    // Generate main
+    (*tacc)->function = new_tac_function("main");
+    (*tacc)->function->is_main = 1;
+    (*tacc)->function->keeps_vars = (*tacc)->batch;
+    // Batch mode reads and writes the variables main declares, whichever of them the optimizer keeps
+    program->main_vars = malloc(sizeof(char*) * (main_scope->num_vars + 1));
+    program->main_var_types = malloc(sizeof(int) * (main_scope->num_vars + 1));
+    for (int v = 0; v < main_scope->num_vars; v++) {
+        program->main_vars[v] = tac_own(program, copy_string(main_scope->local_vars[v].lexeme));
+        program->main_var_types[v] = main_scope->local_vars[v].variable_type;
+    }
+    program->num_main_vars = main_scope->num_vars;
+    tac_add_function(program, (*tacc)->function);
     print_tac_main_aux(root->children[1], tacc);
+    (*tacc)->function->var_memory = (*tacc)->memory;
     gen_expr(root->children[2], tacc);
-    fprintf(tac_table, "    BeginFunc %d:\n", (*tacc)->memory);
-    fprintf(tac_table, "%s", tac_buffer);
-    fprintf(tac_table, "    EndFunc:\n");
+    (*tacc)->function->memory = (*tacc)->memory;
+    program->next_temp = (*tacc)->temp_counter;
+    program->next_label = (*tacc)->label_counter;
 
-}
+    // Optimize
+    if (optimize && report != NULL) {
+        optimize_program(program, report);
+    }
 
+    // Print functions and main to tac file
+    print_tac_program(program, tac_table);
+    fflush(tac_table);
+    (*tacc)->program = NULL;
+    (*tacc)->function = NULL;
+}
 
 /******************************************** EXPERIMENTAL, TAC PRINTING ********************************************/
 
@@ -1017,55 +1130,53 @@ void print_values(struct node* root, FILE* symbol_table){
 
 /**************** Type checking functions ****************/
 // Checks if a function call has a return type that is correct for the current context
-void function_check(char* funct_name, int line_number, int* type_flag, struct node** root, FILE* error) {
-    // Check all functions saved to global scope to see if funct_name exists
-    for (int i = 0; i < global_scope.num_functions; i++){
-        if (compare_strings(global_scope.functions[i].lexeme, funct_name) == 0) {
+void function_check(struct compiler_context* compiler, char* funct_name, int line_number, int* type_flag, struct node** root, FILE* error) {
+    // Check all functions saved to global scope to see if funct_name exists, one whose header had an error has no name
+    for (int i = 0; i < compiler->global_scope.num_functions; i++){
+        if (compiler->global_scope.functions[i].lexeme != NULL && compare_strings(compiler->global_scope.functions[i].lexeme, funct_name) == 0) {
             // Variable found, handle type checking
             if (*type_flag == -1) {
-                (*type_flag) = global_scope.functions[i].return_type;
-            } else if (*type_flag != global_scope.functions[i].return_type) {
+                (*type_flag) = compiler->global_scope.functions[i].return_type;
+            } else if (*type_flag != compiler->global_scope.functions[i].return_type) {
                 // Type mismatch
                 fprintf(error, "Error: Type mismatch, Line: %d, Function '%s' return type doesn't match expression type\n", line_number, funct_name);
             }
 
-            add_function(&(global_scope.functions[i]), function_call_stack);
-            (*root)->type = global_scope.functions[i].return_type;
+            add_function(&(compiler->global_scope.functions[i]), compiler->function_call_stack);
+            (*root)->type = compiler->global_scope.functions[i].return_type;
+            incremental_note(compiler->incremental, &compiler->global_scope, funct_name, i);
             return; // Function found
         }
     } 
 
-    struct function* null_function;
-    null_function = malloc(sizeof(struct function));
-    null_function->num_params = 0;
-    add_function(null_function, function_call_stack);
+    add_function(&compiler->undeclared, compiler->function_call_stack);
+    incremental_note(compiler->incremental, &compiler->global_scope, funct_name, -1);
 
     // If not found Undeclared function
     fprintf(error, "Error: Undeclared function, Line %d: '%s' has been called but not declared\n", line_number, funct_name);
 }
 
 // Checks if a param matches the expected value for a function call
-void param_check(int is_funct, char* param_name, struct scope **current_scope, int line_number, int param_type, FILE* error){
-    function_call_stack->indeces[function_call_stack->num_functions - 1] += 1;
+void param_check(struct compiler_context* compiler, int is_funct, char* param_name, struct scope **current_scope, int line_number, int param_type, FILE* error){
+    compiler->function_call_stack->indeces[compiler->function_call_stack->num_functions - 1] += 1;
     // Param checking for a function
     if (is_funct == 1) {
         // Check all function names in the global scope
-        for (int i = 0; i < global_scope.num_functions; i++) {
-            if (compare_strings(global_scope.functions[i].lexeme, param_name) == 0) {
+        for (int i = 0; i < compiler->global_scope.num_functions; i++) {
+            if (compiler->global_scope.functions[i].lexeme != NULL && compare_strings(compiler->global_scope.functions[i].lexeme, param_name) == 0) {
                 // Variable found, handle type checking
-                if (param_type != global_scope.functions[i].return_type) {
+                if (param_type != compiler->global_scope.functions[i].return_type) {
                     // Type mismatch
                     fprintf(error, "Error: Parameter type mismatch, Line: %d, Function '%s' retturn type doesn't match parameter type\n", line_number, param_name);
                 }
-                add_function(&(global_scope.functions[i]), function_call_stack);
+                add_function(&(compiler->global_scope.functions[i]), compiler->function_call_stack);
+                incremental_note(compiler->incremental, &compiler->global_scope, param_name, i);
                 return; // Variable found, no need to continue searching
             }
         }
 
-        struct function* null_function;
-        null_function = malloc(sizeof(struct function));
-        null_function->num_params = 0;
-        add_function(null_function, function_call_stack);
+        add_function(&compiler->undeclared, compiler->function_call_stack);
+        incremental_note(compiler->incremental, &compiler->global_scope, param_name, -1);
 
         // If function not found in any global scope
         fprintf(error, "Error: Uninitialized function, Line %d: '%s' has been referenced but not declared\n", line_number, param_name);
@@ -1133,6 +1244,7 @@ void scope_check(char* variable_name, struct scope** current_scope, int line_num
 
 // Handles scope variables and function params
 void scope_handling(
+    struct compiler_context* compiler,
     int terminal, 
     int line_number, 
     struct function** current_funct, 
@@ -1142,15 +1254,18 @@ void scope_handling(
 ) {
     switch(terminal) {
         case 1:  // Handle end of function scope
-            if(function_flag == 0) {
+            if(compiler->function_flag == 0) {
                 print_vars(**current_scope, symbol_table_sem);
                 *current_scope = (*current_scope)->parent_scope;
                 fprintf(symbol_table_sem, "End Lexeme: fed\n");
             }
+            // global_scope.functions holds the function now. A header an error cut short ends here too
+            free(*current_funct);
             (*current_funct) = NULL;
+            compiler->function_flag = 0;
             break;
         case 2:
-            if (function_flag == 2) {
+            if (compiler->function_flag == 2) {
                 if ((*current_funct)->num_params > 0) {
                     char* variable_str = tl.my_lexeme;
                 int length2 = 0;
@@ -1165,6 +1280,7 @@ void scope_handling(
                 current_var->line = line_number;
                 current_var->variable_type = (*current_funct)->param_types[(*current_funct)->num_params - 1];
                 add_var(current_scope, *current_var);
+                free(current_var);
                 }
                 
             }
@@ -1172,15 +1288,15 @@ void scope_handling(
         case 3:   // int type
         case 4:   // double type
             // Function return type
-            if (function_flag == 1){
+            if (compiler->function_flag == 1){
                 (*current_funct)->return_type = (terminal == 3) ? 1 : 0;
             }
             break;
 
         case 24:  // Right bracket ')'
-            if(function_flag == 2) {
+            if(compiler->function_flag == 2) {
                 print_function(**current_funct, symbol_table_sem);
-                function_flag = 0;
+                compiler->function_flag = 0;
                 fprintf(symbol_table_sem, "Line: %d, Start Lexeme: def\n", line_number);
             }
             break;
@@ -1193,6 +1309,7 @@ void scope_handling(
 
 // Type checking function
 void semantic_check(
+    struct compiler_context* compiler,
     int prod,
     int line_number,
     int* type_depth,
@@ -1209,13 +1326,17 @@ void semantic_check(
     }
     switch (prod) {
         case 3:     // Produce <fdec> creates a new function
-            new_function(line_number, current_funct, current_scope, symbol_table);
-            function_flag = 1;
+            // global_scope.functions holds a function an error left without its fed
+            free(*current_funct);
+            new_function(compiler, line_number, current_funct, current_scope, symbol_table);
+            compiler->function_flag = 1;
             break;
 
         case 4:
-            add_param(current_funct, var_type);
-            global_scope.functions[global_scope.num_functions - 1] = **current_funct;
+            if ((*current_funct) != NULL) {
+                add_param(current_funct, compiler->var_type);
+                compiler->global_scope.functions[compiler->global_scope.num_functions - 1] = **current_funct;
+            }
             break;
 
         case 8:
@@ -1231,15 +1352,15 @@ void semantic_check(
                     (*current_funct)->lexeme[i] = function_str[i];
                 }
                 (*current_funct)->lexeme[length1] = '\0';
-                global_scope.functions[global_scope.num_functions - 1] = **current_funct;
-                function_flag = 2;
+                compiler->global_scope.functions[compiler->global_scope.num_functions - 1] = **current_funct;
+                compiler->function_flag = 2;
             }
             break;
         case 12: 
-            var_type = 1;
+            compiler->var_type = 1;
             break;
         case 13:
-            var_type = 0;
+            compiler->var_type = 0;
             break;
         case 14: // Variable declarations
             // Manual string length calculation
@@ -1254,12 +1375,13 @@ void semantic_check(
             }
             current_var->lexeme[length2] = '\0';
             current_var->line = line_number;
-            current_var->variable_type = var_type;
+            current_var->variable_type = compiler->var_type;
             add_var(current_scope, *current_var);
+            free(current_var);
             break;
 
         case 16:
-            var_type = -1;
+            compiler->var_type = -1;
             break;
         
         case 21:    // Produce <var> = <expr> increments depth by two (must be two not one due to how the language works) and scope checks the <id>
@@ -1270,15 +1392,15 @@ void semantic_check(
             break;
         case 29:
         case 31:    // <exp_seq> or <exp_seq'> Produces epsilon, when a function call exists removes a function from the function call stack.
-            if (function_call_stack->num_functions > 0) {
-                remove_function(function_call_stack);
+            if (compiler->function_call_stack->num_functions > 0) {
+                remove_function(compiler->function_call_stack);
             }
             break;
 
         case 32:    // Produce <var><factor'> saves lexeme to either scope check or function check depending on next input
             // Free any previously allocated memory
-            if (hold_lexeme != NULL) {
-                free(hold_lexeme);
+            if (compiler->hold_lexeme != NULL) {
+                free(compiler->hold_lexeme);
             }
 
             // Calculate length of the lexeme
@@ -1288,55 +1410,55 @@ void semantic_check(
             }
             
             // Allocate memory for the new lexeme copy
-            hold_lexeme = (char *)malloc(len + 1);
-            if (hold_lexeme != NULL) {
+            compiler->hold_lexeme = (char *)malloc(len + 1);
+            if (compiler->hold_lexeme != NULL) {
                 // Copy the lexeme character by character
                 for (int i = 0; i < len; i++) {
-                    hold_lexeme[i] = tl.my_lexeme[i];
+                    compiler->hold_lexeme[i] = tl.my_lexeme[i];
                 }
-                hold_lexeme[len] = '\0'; // Ensure null termination
+                compiler->hold_lexeme[len] = '\0'; // Ensure null termination
             }
             break;
 
         case 35:    // From <factor'> produce (<exp_seq>), this is a function call perform function checking
 
             // Write some comments
-            if (function_call_stack->num_functions > 0) {
-                int index = function_call_stack->indeces[function_call_stack->num_functions - 1];
-                if (index >= function_call_stack->functions[function_call_stack->num_functions - 1]->num_params){
-                    fprintf(error, "Error: Extra param '%s' for function call at line %d\n", hold_lexeme, line_number);
+            if (compiler->function_call_stack->num_functions > 0) {
+                int index = compiler->function_call_stack->indeces[compiler->function_call_stack->num_functions - 1];
+                if (index >= compiler->function_call_stack->functions[compiler->function_call_stack->num_functions - 1]->num_params){
+                    fprintf(error, "Error: Extra param '%s' for function call at line %d\n", compiler->hold_lexeme, line_number);
                 }
                 else{
-                    int type = function_call_stack->functions[function_call_stack->num_functions - 1]->param_types[index];
-                    param_check(1, hold_lexeme, current_scope, line_number, type, error);
+                    int type = compiler->function_call_stack->functions[compiler->function_call_stack->num_functions - 1]->param_types[index];
+                    param_check(compiler, 1, compiler->hold_lexeme, current_scope, line_number, type, error);
                 }
-                free(hold_lexeme);
-                hold_lexeme = NULL;
+                free(compiler->hold_lexeme);
+                compiler->hold_lexeme = NULL;
                 break;
             }
             
-            function_check(hold_lexeme, line_number, type_flag, &root, error);
-            free(hold_lexeme);
-            hold_lexeme = NULL;
+            function_check(compiler, compiler->hold_lexeme, line_number, type_flag, &compiler->root, error);
+            free(compiler->hold_lexeme);
+            compiler->hold_lexeme = NULL;
             break;
 
         case 36:    // From <factor'> produce epsilon, this is a variable perform scope checking
-            if (function_call_stack->num_functions > 0) {
-                int index = function_call_stack->indeces[function_call_stack->num_functions - 1];
-                if (index >= function_call_stack->functions[function_call_stack->num_functions - 1]->num_params){
-                    fprintf(error, "Error: Extra param '%s' for function call at line %d\n", hold_lexeme, line_number);
+            if (compiler->function_call_stack->num_functions > 0) {
+                int index = compiler->function_call_stack->indeces[compiler->function_call_stack->num_functions - 1];
+                if (index >= compiler->function_call_stack->functions[compiler->function_call_stack->num_functions - 1]->num_params){
+                    fprintf(error, "Error: Extra param '%s' for function call at line %d\n", compiler->hold_lexeme, line_number);
                 }
                 else{
-                    int type = function_call_stack->functions[function_call_stack->num_functions - 1]->param_types[index];
-                    param_check(0, hold_lexeme, current_scope, line_number, type, error);
+                    int type = compiler->function_call_stack->functions[compiler->function_call_stack->num_functions - 1]->param_types[index];
+                    param_check(compiler, 0, compiler->hold_lexeme, current_scope, line_number, type, error);
                 }
-                free(hold_lexeme);
-                hold_lexeme = NULL;
+                free(compiler->hold_lexeme);
+                compiler->hold_lexeme = NULL;
                 break;
             }
-            scope_check(hold_lexeme, current_scope, line_number, type_flag, error);
-            free(hold_lexeme);
-            hold_lexeme = NULL;
+            scope_check(compiler->hold_lexeme, current_scope, line_number, type_flag, error);
+            free(compiler->hold_lexeme);
+            compiler->hold_lexeme = NULL;
             break;
 
         case 42:
@@ -1445,13 +1567,13 @@ struct node* traverse_up(struct node* root, int* type_depth, int* type_flag) {
 
 // Tree traversal function
 struct node* traverse(
+    struct compiler_context* compiler,
     struct node* root,
     struct node* next,
     struct token_lexeme tl,
     int line_number,
     struct function** current_funct,
     struct scope** current_scope,
-    struct variable** current_var,
     FILE* symbol_table,
     FILE* symbol_table_sem,
     FILE* error
@@ -1468,7 +1590,7 @@ struct node* traverse(
     // Traverse tree
     while(1){
         // Check if current production is valid or if root node has children which could produce a valid production with terminal
-        if(prod >= 0 || root->index < root->size){
+        if(prod >= 0 || (root->children != NULL && root->index < root->size)){
             // Root children is empty, generate production nodes
             if(!root->children){
                 insert(productions[prod], root);
@@ -1484,10 +1606,10 @@ struct node* traverse(
 
                 /**************** Semantic check ****************/
                 if (root->parent->index > 0){ // Semantic check is designed to only perform actions on the first node of a production. For all other nodes treat prod as -1
-                    semantic_check(-1, line_number, &type_depth, &type_flag, tl, current_funct, current_scope, symbol_table_sem, error);
+                    semantic_check(compiler, -1, line_number, &compiler->type_depth, &compiler->type_flag, tl, current_funct, current_scope, symbol_table_sem, error);
                 }
                 else{
-                    semantic_check(prod, line_number, &type_depth, &type_flag, tl, current_funct, current_scope, symbol_table_sem, error);
+                    semantic_check(compiler, prod, line_number, &compiler->type_depth, &compiler->type_flag, tl, current_funct, current_scope, symbol_table_sem, error);
                 }
                 /**************** Semantic check ****************/
                 
@@ -1500,7 +1622,7 @@ struct node* traverse(
             if(root->terminal_flag == 1){
                 if (root->value == 37){                     // In the case of an epsilon production node
                     // Return to lowest node that still has child productions
-                    root = traverse_up(root, &type_depth, &type_flag);
+                    root = traverse_up(root, &compiler->type_depth, &compiler->type_flag);
 
                     // End of file checking
                     if(terminal == 37 && root->value == 0 && root->index >= root->size){
@@ -1519,14 +1641,14 @@ struct node* traverse(
 
                     // Copy tl my lexeme and type flag to node. Used for generating TAC file
                     root->lexeme = copy_string(tl.my_lexeme);
-                    root->type = type_flag;
+                    root->type = compiler->type_flag;
 
 
                     // Return to lowest node that still has child productions
-                    root = traverse_up(root, &type_depth, &type_flag);
+                    root = traverse_up(root, &compiler->type_depth, &compiler->type_flag);
 
                     /**************** Semantic check ****************/
-                    scope_handling(terminal, line_number, current_funct, current_scope, tl, symbol_table_sem);
+                    scope_handling(compiler, terminal, line_number, current_funct, current_scope, tl, symbol_table_sem);
 
 
                     
@@ -1537,7 +1659,7 @@ struct node* traverse(
                     fprintf(error, "Error: expected %s, received %s, at line %d\n", prod_term[terminal], prod_term[root->value], line_number);
                     
                     // Return to lowest node that still has child productions
-                    root = traverse_up(root, &type_depth, &type_flag);
+                    root = traverse_up(root, &compiler->type_depth, &compiler->type_flag);
 
                     // Function returns root
                     return root;
@@ -1577,40 +1699,50 @@ struct node* traverse(
 
 /**************** File read for lex function ****************/
 // The next character function for the lexical analyzer
-int get_next_char(FILE *fp){
+int get_next_char(struct compiler_context* compiler){
     int c;
 
     // Reread char flaged as pushback
-    if (pushback_char != -1) {
-        c = pushback_char;
-        pushback_char = -1;
+    if (compiler->pushback_char != -1) {
+        c = compiler->pushback_char;
+        compiler->pushback_char = -1;
         return c;
     }
 
-    // Read char from the current buffer.
-    if (current_buffer == 1) {
-        if (index_buffer >= size_buffer1) {
-            // Buffer1 is exhausted, load buffer2.
-            size_buffer2 = fread(buffer2, sizeof(char), BUFFER_SIZE, fp);
-            if (size_buffer2 == 0) {
+    // Read char from the in-memory source
+    if (compiler->source != NULL) {
+        if (compiler->source_index >= compiler->source_end) {
+            return EOF;
+        }
+        return compiler->source[compiler->source_index++];
+    }
+
+    // Read char from the current buffer.
+    if (compiler->current_buffer == 1) {
+        if (compiler->index_buffer >= compiler->size_buffer1) {
+            // Buffer1 is exhausted, load buffer2.
+            compiler->size_buffer2 = fread(compiler->buffer2, sizeof(char), BUFFER_SIZE, compiler->input);
+            if (compiler->size_buffer2 == 0) {
                 return EOF;   // No more input.
             }
-            current_buffer = 2;
-            index_buffer = 0;
+            compiler->current_buffer = 2;
+            compiler->index_buffer = 0;
+            return compiler->buffer2[compiler->index_buffer++];
         }
-        c = buffer1[index_buffer++];
+        c = compiler->buffer1[compiler->index_buffer++];
         return c;
     } else {  // current buffer == 2
-        if (index_buffer >= size_buffer2) {
+        if (compiler->index_buffer >= compiler->size_buffer2) {
             // Buffer2 is exhausted, load buffer1.
-            size_buffer1 = fread(buffer1, sizeof(char), BUFFER_SIZE, fp);
-            if (size_buffer1 == 0) {
+            compiler->size_buffer1 = fread(compiler->buffer1, sizeof(char), BUFFER_SIZE, compiler->input);
+            if (compiler->size_buffer1 == 0) {
                 return EOF;   // No more input.
             }
-            current_buffer = 1;
-            index_buffer = 0;
+            compiler->current_buffer = 1;
+            compiler->index_buffer = 0;
+            return compiler->buffer1[compiler->index_buffer++];
         }
-        c = buffer2[index_buffer++];
+        c = compiler->buffer2[compiler->index_buffer++];
         return c;
     }
 
@@ -1618,78 +1750,70 @@ int get_next_char(FILE *fp){
 }
 
 
-/******************************** MAIN ********************************/
-int main(int argc, char *argv[]){
+/******************************** Library ********************************/
+void stream_function(struct compiler_context* compiler);
 
-    // Error handling for invalid use of function
-    if (argc < 2) {
-        fprintf(stderr, "Usage: %s inputFile\n", argv[0]);
-        return 1;
+// Does what the parser does with a record of the lexer: writes a lexical error, or parses and checks a token
+void parse_token(struct compiler_context* compiler, struct lex_token* token, const char* lexeme){
+    switch (token->kind) {
+        case LEX_ERROR_ASCII:
+            fprintf(compiler->error_doc, "Error at line %d: Non-ASCII character encountered (%d)\n", token->line, token->value);
+            return;
+        case LEX_ERROR_LEXEME:
+            fprintf(compiler->error_doc, "Error at line %d: Lexical error for lexeme '%s'\n", token->line, lexeme);
+            return;
+        case LEX_ERROR_LENGTH:
+            fprintf(compiler->error_doc, "Error at line %d: Token length exceeded buffer size\n", token->line);
+            return;
+        default:
+            break;
     }
 
-    /******************************** Open Files ********************************/
-    // Open the input file 
-    FILE *input = fopen(argv[1], "r");
-    if (!input) {
-        perror("Error opening input file");
-        return 1;
-    }
+    // Rebuild the token lexeme pair, set_tl_nums already ran on the lexer's side
+    struct token_lexeme tl;
+    tl.my_token = "";
+    tl.my_token_num = token->token_num;
+    tl.my_lexeme = (char*)lexeme;
+    tl.my_lexeme_num = token->lexeme_num;
+    tl.is_int_flag = token->is_int_flag;
 
-    // Open/Create the error file
-    FILE *error_doc = fopen("error.txt", "w");
-    if (!error_doc) {
-        fclose(input);             // Close input file
-        perror("Error opening error output file");
-        return 1;
-    }
+    // Traverse abstract syntax tree
+    compiler->root = traverse(compiler, compiler->root, compiler->next, tl, token->line, &compiler->current_function, &compiler->current_scope, compiler->symbol_table_syn, compiler->symbol_table_sem, compiler->error_doc);
 
-    // Open/Create the output file (lex)
-    FILE *symbol_table_lex = fopen("symbol_table_lex.txt", "w");
-    if (!symbol_table_lex) {
-        fclose(input);             // Close input file
-        fclose(error_doc);         // Close error log file
-        perror("Error opening lexical output file");
-        return 1;
+    // Hand a function the parser just finished to the stream
+    if (compiler->stream != NULL) {
+        stream_function(compiler);
     }
+}
 
-    // Open/create the output file (syntax)
-    FILE *symbol_table_syn = fopen("symbol_table_syn.txt", "w");
-    if (!symbol_table_syn) {
-        fclose(input);             // Close input file
-        fclose(error_doc);         // Close error file
-        fclose(symbol_table_lex);  // Close lexical output file
-        perror("Error opening syntax output file");
+// Hands a record to the parser, straight away or through the ring when the lexer runs on a thread of its own
+void lex_emit(struct compiler_context* compiler, struct lex_token token, const char* lexeme){
+    if (compiler->ring == NULL) {
+        parse_token(compiler, &token, lexeme);
+        return;
     }
-
-    // Open/create the output file (Semantic)
-    FILE *symbol_table_sem = fopen("symbol_table_sem.txt", "w");
-    if (!symbol_table_sem) {
-        fclose(input);             // Close input file
-        fclose(error_doc);         // Close error file
-        fclose(symbol_table_lex);  // Close lexical output file
-        fclose(symbol_table_syn);  // Close Syntax output file
-        perror("Error opening semantic output file");
+    int length = 0;
+    while (lexeme[length] != '\0') length++;
+    if (pipeline_full(compiler->batch, length)) {
+        pipeline_publish(compiler->ring);
+        compiler->batch = pipeline_claim(compiler->ring);
     }
+    pipeline_add(compiler->batch, token, lexeme, length);
+}
 
-
-    /******************************** Initialize Values ********************************/
-    // Initialize buffer1
-    size_buffer1 = fread(buffer1, sizeof(char), BUFFER_SIZE, input);
-    if (size_buffer1 == 0) {
-        // If file is empty end program
-        fclose(input);
-        fclose(error_doc);
-        fclose(symbol_table_lex);
-        fclose(symbol_table_syn);
-        return 0;
+// Lexes the chars get_next_char returns up to EOF and then the token left at EOF, handing each token and lexical
+// error to lex_emit. Lines count on from compiler->line_number, so the source can be lexed a range at a time when
+// every range starts and ends between tokens
+void compiler_lex(struct compiler_context* compiler){
+    FILE* symbol_table_lex = compiler->symbol_table_lex;
+    if (compiler->source != NULL) {
+        compiler->lexed_bytes += compiler->source_end - compiler->source_index;
     }
-    current_buffer = 1;                                              //
-    index_buffer = 0;                                                //
 
     // Initialize the state variables and lexeme storage
     int previous_state = 0;                                          //
     int new_state;                                                   //
-    int line_number = 1;                                             //
+    int line_number = compiler->line_number;                         //
     char lexeme[LEXEME_SIZE];                                        //
     int lexeme_index = 0;                                            //
     int c;                                                           // Tracks current Character read from file
@@ -1699,43 +1823,20 @@ int main(int argc, char *argv[]){
     tl.is_int_flag = -1;                                             //
     tl.my_token = "";                                                //
     tl.my_lexeme = "";                                               //
-    int terminal;                                                    //
-
-    // Initialize root node
-    root = malloc(sizeof(struct node));                              //
-    root->children = NULL;                                           //
-    root->value = 0;                                                 //
-    root->size = 1;                                                  //
-    root->terminal_flag = 0;                                         //
-    root->index = 0;                                                 //
-
-    // Initialize global scope
-    struct scope* current_scope;                                     //
-    current_scope = malloc(sizeof(struct scope));                    //
-    current_scope->parent_scope = NULL;                              //
-
-    struct global global_scope;                                      //
-    global_scope.my_scope = *current_scope;                          //
-    global_scope.num_functions = 0;                                  //
-
-    // Other semantic values
-    struct variable* current_variable;                               //
-    struct function* current_function;                               //
-    current_function = NULL;                                         //
-    function_call_stack = malloc(sizeof(struct check_functions));    //
 
     /******************************** Primary Loop ********************************/
-    while ((c = get_next_char(input)) != EOF) {
+    while ((c = get_next_char(compiler)) != EOF) {
 
         // Check for non-ASCII chars
         int ascii_val = (int)c;
         if (ascii_val < 0 || ascii_val >= 128) {
-            fprintf(error_doc, "Error at line %d: Non-ASCII character encountered (%d)\n", line_number, ascii_val);
+            struct lex_token error = {LEX_ERROR_ASCII, line_number, -1, -1, -1, ascii_val, 0};
+            lex_emit(compiler, error, "");
             continue;
         }
 
         // Disambiguates leading +/- uncertainty
-        if(checkNegativeFlag != 0 && previous_state == 0 && (ascii_val == 43 || ascii_val == 45)){
+        if(compiler->checkNegativeFlag != 0 && previous_state == 0 && (ascii_val == 43 || ascii_val == 45)){
             new_state = 8;
         }else{
             // Get new state from transition table
@@ -1749,7 +1850,8 @@ int main(int argc, char *argv[]){
                 lexeme_index++;
             }
             lexeme[lexeme_index] = '\0';
-            fprintf(error_doc, "Error at line %d: Lexical error for lexeme '%s'\n", line_number, lexeme);
+            struct lex_token error = {LEX_ERROR_LEXEME, line_number, -1, -1, -1, 0, 0};
+            lex_emit(compiler, error, lexeme);
             // Reset the state and clear the lexeme buffer
             previous_state = 0;
             lexeme_index = 0;
@@ -1798,8 +1900,9 @@ int main(int argc, char *argv[]){
 
             // Helper function to get token and lexeme as integer values so we can find terminal using a switch case function
             set_tl_nums(&tl);
-            // Traverse abstract syntax tree
-            root = traverse(root, next, tl, line_number, &current_function, &current_scope, &current_variable, symbol_table_syn, symbol_table_sem, error_doc);
+            // Hand the token to the parser
+            struct lex_token record = {LEX_TOKEN, line_number, tl.my_token_num, tl.my_lexeme_num, tl.is_int_flag, 0, 0};
+            lex_emit(compiler, record, lexeme);
 
             /**************** Syntax Analysis ****************/
 
@@ -1808,9 +1911,9 @@ int main(int argc, char *argv[]){
 
             // Check negative flag used to disambiguate numbers with leading +- from the + and - operators
             if(compare_strings(token, "ID") == 0 || compare_strings(token, "NUMBER") == 0){
-                checkNegativeFlag = 1;
+                compiler->checkNegativeFlag = 1;
             }else{
-                checkNegativeFlag = 0;
+                compiler->checkNegativeFlag = 0;
             }
             
             // Reset lexeme buffer
@@ -1818,7 +1921,7 @@ int main(int argc, char *argv[]){
 
             // In case new char is the start of a new token we pushback c to be re-read
             if(c != '\n'){
-                pushback_char = c;
+                compiler->pushback_char = c;
             }
 
             // Reset the state for the next token
@@ -1831,7 +1934,8 @@ int main(int argc, char *argv[]){
             if (lexeme_index < LEXEME_SIZE - 1) {
                 lexeme[lexeme_index++] = c;
             } else {
-                fprintf(error_doc, "Error at line %d: Token length exceeded buffer size\n", line_number);
+                struct lex_token error = {LEX_ERROR_LENGTH, line_number, -1, -1, -1, 0, 0};
+                lex_emit(compiler, error, "");
                 lexeme_index = 0;
                 previous_state = 0;
                 continue;
@@ -1846,7 +1950,8 @@ int main(int argc, char *argv[]){
     if (lexeme_index > 0 && previous_state != 0) {
         int cmp = compare_strings(state_tokens[previous_state], "N/A");
         if(cmp == 0){
-            fprintf(error_doc, "Error at line %d: Lexical error for lexeme '%s'\n", line_number, lexeme);
+            struct lex_token error = {LEX_ERROR_LEXEME, line_number, -1, -1, -1, 0, 0};
+            lex_emit(compiler, error, lexeme);
         }else{
             // Disambiguate integer & double
             if(previous_state == 12){
@@ -1878,72 +1983,1940 @@ int main(int argc, char *argv[]){
             /**************** Syntax Analysis ****************/
             // Helper function to get token and lexeme as integer values so we can find terminal using a switch case function
             set_tl_nums(&tl);
-            // Traverse abstract syntax tree
-            root = traverse(root, next, tl, line_number, &current_function, &current_scope, &current_variable, symbol_table_syn, symbol_table_sem, error_doc);
+            // Hand the token to the parser
+            struct lex_token record = {LEX_TOKEN, line_number, tl.my_token_num, tl.my_lexeme_num, tl.is_int_flag, 0, 0};
+            lex_emit(compiler, record, lexeme);
             
             // Reset tl for next terminal
             clear_tl(&tl);
         }
     }
 
-    // At EOF perform epsilon production on AST to check for syntax errors
-    while(root->parent != NULL || root->index < root->size -1){
-        tl.my_token_num = 1000;
-        root = traverse(root, next, tl, line_number, &current_function, &current_scope, &current_variable, symbol_table_syn, symbol_table_sem, error_doc);
+    compiler->line_number = line_number;
+}
+
+/**************** Incremental analysis ****************/
+// True(1) if the keyword starts at source[i]
+int incremental_keyword(const char* source, size_t length, size_t i, const char* keyword){
+    if (i + 3 > length || source[i] != keyword[0] || source[i + 1] != keyword[1] || source[i + 2] != keyword[2]) {
+        return 0;
     }
+    return (i == 0 || !incremental_word(source[i - 1])) && (i + 3 == length || !incremental_word(source[i + 3]));
+}
 
+// Finds the first def ... fed ; block of source starting at or after position, which lies between tokens, and
+// stores where it starts. Returns where it ends, 0 if there is none. A block starts at a def the lexer reaches with
+// no token pending and ends after the ; that ends its fed, taking the newline after the ; along, so it lexes alone
+// exactly as it does inside the whole source
+size_t incremental_next_block(const char* source, size_t length, size_t position, size_t* start){
+    for (size_t i = position; i + 3 <= length; i++) {
+        if (!incremental_keyword(source, length, i, "def") || (i > position && !incremental_space(source[i - 1]))) {
+            continue;
+        }
+        size_t end = i + 3;
+        while (end + 3 <= length && !incremental_keyword(source, length, end, "fed")) {
+            end++;
+        }
+        if (end + 3 > length) {
+            return 0;
+        }
+        end += 3;
+        while (end < length && (source[end] == ' ' || source[end] == '\t' || source[end] == '\n')) {
+            end++;
+        }
+        if (end == length || source[end] != ';') {
+            i = end - 1;
+            continue;
+        }
+        end++;
+        // The char after the ; must end its token without an error
+        if (end < length && source[end] == '\n') {
+            end++;
+        }
+        else if (end < length && ((unsigned char)source[end] >= 128 || transition_table[(int)source[end]][8] != 0)) {
+            i = end - 1;
+            continue;
+        }
+        *start = i;
+        return end;
+    }
+    return 0;
+}
 
-    // Close Files
-    fclose(input);
-    fclose(error_doc);
-    fclose(symbol_table_lex);
-    fclose(symbol_table_syn);
-    fclose(symbol_table_sem);
-    /**************** TAC generation ****************/
-    
+// True(1) if the analysis rests between blocks, with nothing pending that a block could see, storing its state
+int incremental_resting(struct compiler_context* compiler, struct incremental_state* state){
+    struct node* root = compiler->root;
+    if (compiler->hold_lexeme != NULL || compiler->function_call_stack->num_functions != 0 || compiler->current_function != NULL ||
+        compiler->function_flag != 0 || compiler->current_scope->parent_scope != NULL || compiler->current_scope->num_vars != 0) {
+        return 0;
+    }
+    if (root->parent == NULL && root->value == 0 && root->children == NULL) {
+        state->position = INCREMENTAL_AT_START;
+    }
+    else if (root->terminal_flag == 0 && root->value == 1 && root->size == 3 && root->index == 2 && root->children[2]->children == NULL) {
+        state->position = INCREMENTAL_AFTER_FDEC;
+    }
+    else {
+        return 0;
+    }
+    state->var_type = compiler->var_type;
+    state->type_flag = compiler->type_flag;
+    state->type_depth = compiler->type_depth;
+    state->check_negative = compiler->checkNegativeFlag;
+    return 1;
+}
 
-    // Open/Create the error file
-    error_doc = fopen("error.txt", "r");
-    if (!error_doc) {
-        perror("Error: opening error output file\n");
+// Does what analyzing the entry's block did, writing its symbol table text and hanging its subtree where the parser is
+void incremental_replay(struct compiler_context* compiler, struct incremental_entry* entry){
+    struct incremental_cache* cache = compiler->incremental;
+    if (entry->line != compiler->line_number) {
+        incremental_relocate(cache, entry, compiler->line_number);
+    }
+    fwrite(entry->texts[0], 1, entry->lengths[0], compiler->symbol_table_lex);
+    fwrite(entry->texts[1], 1, entry->lengths[1], compiler->symbol_table_syn);
+    fwrite(entry->texts[2], 1, entry->lengths[2], compiler->symbol_table_sem);
+
+    // Expand the <fdecls> the block belongs to with the entry's <fdec> and a matched ;
+    struct node* fdecls;
+    if (entry->state.position == INCREMENTAL_AT_START) {
+        insert(productions[0], compiler->root);
+        fdecls = compiler->root->children[0];
+    }
+    else {
+        fdecls = compiler->root->children[2];
+    }
+    insert(productions[1], fdecls);
+    free(fdecls->children[0]);
+    fdecls->children[0] = entry->fdec;
+    entry->fdec->parent = fdecls;
+    fdecls->children[1]->lexeme = copy_string(";");
+    fdecls->children[1]->type = entry->semicolon_type;
+    fdecls->index = 2;
+    compiler->root = fdecls;
+
+    entry->function.my_scope->parent_scope = compiler->current_scope;
+    add_global_function(compiler, entry->function);
+    compiler->line_number += entry->newlines;
+    compiler->var_type = entry->out.var_type;
+    compiler->type_flag = entry->out.type_flag;
+    compiler->type_depth = entry->out.type_depth;
+    compiler->checkNegativeFlag = entry->out.check_negative;
+    cache->reused_nodes += entry->nodes;
+    incremental_use(cache, fdecls, entry, compiler->global_scope.num_functions - 1);
+}
+
+// Analyzes the block source[start, end), replaying it from the per-function cache when an entry for it is still
+// valid. Otherwise it is lexed, and stored when it checked without errors from a resting state. hint is the entry
+// the block had in the latest compilation when an edit left its text alone, NULL to look it up by its text.
+// Returns the entry replayed or stored, NULL if neither
+struct incremental_entry* incremental_block(struct compiler_context* compiler, size_t start, size_t end, struct incremental_entry* hint){
+    struct incremental_cache* cache = compiler->incremental;
+    const char* text = compiler->source + start;
+    size_t length = end - start;
+    struct incremental_state state;
+    int resting = incremental_resting(compiler, &state);
+    struct node* root = compiler->root;
+    uint64_t hash = 0;
+    struct incremental_entry* entry = NULL;
+    if (resting) {
+        if (hint != NULL && incremental_same_state(&hint->state, &state)) {
+            entry = hint;
+            hash = hint->hash;
+        }
+        else {
+            hash = incremental_hash(text, length, &state);
+            entry = incremental_find(cache, text, length, &state, hash);
+        }
+        if (entry != NULL && entry->used != cache->generation && incremental_valid(cache, entry, &compiler->global_scope)) {
+            incremental_replay(compiler, entry);
+            cache->hits++;
+            return entry;
+        }
+    }
+    cache->misses++;
+
+    // Lex the block, noting the functions it looks up
+    FILE* outputs[4] = {compiler->symbol_table_lex, compiler->symbol_table_syn, compiler->symbol_table_sem, compiler->error_doc};
+    size_t before[4];
+    for (int i = 0; i < 4; i++) {
+        fflush(outputs[i]);
+        before[i] = compiler->lengths[i];
+    }
+    int line = compiler->line_number;
+    int num_functions = compiler->global_scope.num_functions;
+    cache->recording = resting;
+    cache->lookup_base = num_functions;
+    cache->num_deps = 0;
+    compiler->source_index = start;
+    compiler->source_end = end;
+    compiler_lex(compiler);
+    cache->recording = 0;
+    // The ; ended the block at EOF, which leaves the flag as a token after it finds it
+    if (compiler->source[end - 1] == ';') {
+        compiler->checkNegativeFlag = 0;
+    }
+
+    // Store the block if it defined one function without errors, unless an entry this compilation uses has its text
+    for (int i = 0; i < 4; i++) {
+        fflush(outputs[i]);
+    }
+    struct incremental_state out;
+    int stored = resting && (entry == NULL || entry->used != cache->generation) &&
+                 compiler->lengths[COMPILER_OUT_ERRORS] == before[COMPILER_OUT_ERRORS] &&
+                 incremental_resting(compiler, &out) && out.position == INCREMENTAL_AFTER_FDEC &&
+                 compiler->root == root->children[state.position == INCREMENTAL_AT_START ? 0 : 2] &&
+                 compiler->global_scope.num_functions == num_functions + 1;
+    // TAC generation finds a function by its name, so only the first function of a name is stored
+    struct function* function = &compiler->global_scope.functions[num_functions];
+    for (int i = 0; stored && i < num_functions; i++) {
+        if (compiler->global_scope.functions[i].lexeme != NULL && compare_strings(compiler->global_scope.functions[i].lexeme, function->lexeme) == 0) {
+            stored = 0;
+        }
+    }
+    if (!stored) {
+        incremental_free_deps(cache->deps, cache->num_deps);
+        cache->num_deps = 0;
+        return NULL;
+    }
+    if (entry != NULL) {
+        incremental_forget(cache, entry);
+        incremental_remove(cache, entry);
+    }
+    cache->recording = 1;
+    incremental_note(cache, &compiler->global_scope, function->lexeme, -1);
+    cache->recording = 0;
+
+    entry = calloc(1, sizeof(struct incremental_entry));
+    entry->hash = hash;
+    entry->text = malloc(length);
+    for (size_t i = 0; i < length; i++) {
+        entry->text[i] = text[i];
+    }
+    entry->length = length;
+    entry->state = state;
+    entry->deps = cache->deps;
+    entry->num_deps = cache->num_deps;
+    cache->deps = NULL;
+    cache->num_deps = 0;
+    cache->deps_capacity = 0;
+    entry->line = line;
+    entry->newlines = compiler->line_number - line;
+    entry->bytes = sizeof(struct incremental_entry) + length;
+    for (int i = 0; i < INCREMENTAL_NUM_OUTPUTS; i++) {
+        entry->lengths[i] = compiler->lengths[i] - before[i];
+        entry->texts[i] = malloc(entry->lengths[i] + 1);
+        for (size_t k = 0; k < entry->lengths[i]; k++) {
+            entry->texts[i][k] = compiler->texts[i][before[i] + k];
+        }
+        entry->bytes += entry->lengths[i];
+    }
+    entry->fdec = compiler->root->children[0];
+    entry->semicolon_type = compiler->root->children[1]->type;
+    entry->function = *function;
+    entry->out = out;
+    entry->nodes = incremental_count_nodes(entry->fdec);
+    entry->bytes += entry->nodes * (long long)sizeof(struct node);
+    incremental_insert(cache, entry);
+    incremental_use(cache, compiler->root, entry, num_functions);
+    return entry;
+}
+
+// Analyzes in-memory source a def ... fed ; block at a time through the per-function cache, lexing what lies
+// between the blocks as it comes. The blocks are looked for unless an edit already moved the spans to them
+void incremental_analyze(struct compiler_context* compiler){
+    struct incremental_cache* cache = compiler->incremental;
+    size_t length = compiler->source_end;
+    size_t position = 0;
+    if (!cache->spans_known) {
+        size_t start;
+        size_t end;
+        cache->num_spans = 0;
+        while ((end = incremental_next_block(compiler->source, length, position, &start)) != 0) {
+            incremental_add_span(cache, start, end, NULL);
+            position = end;
+        }
+        position = 0;
+    }
+    for (int i = 0; i < cache->num_spans; i++) {
+        struct incremental_span* span = &cache->spans[i];
+        compiler->source_index = position;
+        compiler->source_end = span->start;
+        compiler_lex(compiler);
+        span->entry = incremental_block(compiler, span->start, span->end, span->entry);
+        position = span->end;
+    }
+    compiler->source_index = position;
+    compiler->source_end = length;
+    compiler_lex(compiler);
+    cache->spans_known = 0;
+}
+
+// Applies an edit to the kept source and moves the spans of the latest compilation along. Blocks ending before
+// the edit stay and blocks starting after it shift, except that blocks are looked for again from the last one that
+// stays until one starts where a shifted block does, from which on the rest are the same. Returns 1 if out of memory
+int incremental_edit(struct incremental_cache* cache, size_t offset, size_t removed, const char* text, size_t length){
+    if (incremental_splice(cache, offset, removed, text, length)) {
         return 1;
     }
+    long long delta = (long long)length - (long long)removed;
+    int kept = 0;
+    while (kept < cache->num_spans && cache->spans[kept].end < offset) {
+        kept++;
+    }
+    int next = kept;
+    while (next < cache->num_spans && cache->spans[next].start <= offset + removed) {
+        next++;
+    }
 
-    // Check if the file is empty
-    int first_char = fgetc(error_doc);
-    if (first_char == EOF && feof(error_doc)) {
-        // error.txt file is empty therefore source code has no errors
-        tacc = malloc(sizeof(struct tac_context*));
-        //(*tacc) = malloc(sizeof(struct tac_context));
+    struct incremental_span* found = NULL;
+    int num_found = 0;
+    int capacity = 0;
+    size_t position = (kept > 0) ? cache->spans[kept - 1].end : 0;
+    size_t start;
+    size_t end;
+    while ((end = incremental_next_block(cache->source, cache->length, position, &start)) != 0) {
+        while (next < cache->num_spans && (size_t)((long long)cache->spans[next].start + delta) < start) {
+            next++;
+        }
+        if (next < cache->num_spans && (size_t)((long long)cache->spans[next].start + delta) == start) {
+            break;
+        }
+        if (num_found == capacity) {
+            capacity = (capacity == 0) ? 8 : capacity * 2;
+            found = realloc(found, sizeof(struct incremental_span) * capacity);
+        }
+        found[num_found].start = start;
+        found[num_found].end = end;
+        found[num_found].entry = NULL;
+        num_found++;
+        position = end;
+    }
+    if (end == 0) {
+        next = cache->num_spans;
+    }
+
+    // Shift the blocks after the edit into place behind the ones found
+    int shifted = cache->num_spans - next;
+    int num_spans = kept + num_found + shifted;
+    if (num_spans > cache->spans_capacity) {
+        cache->spans_capacity = num_spans * 2;
+        cache->spans = realloc(cache->spans, sizeof(struct incremental_span) * cache->spans_capacity);
+    }
+    struct incremental_span* from = cache->spans + next;
+    struct incremental_span* to = cache->spans + kept + num_found;
+    if (to < from) {
+        for (int i = 0; i < shifted; i++) {
+            to[i] = from[i];
+        }
+    }
+    else {
+        for (int i = shifted; i > 0; i--) {
+            to[i - 1] = from[i - 1];
+        }
+    }
+    for (int i = 0; i < shifted; i++) {
+        to[i].start = (size_t)((long long)to[i].start + delta);
+        to[i].end = (size_t)((long long)to[i].end + delta);
+    }
+    for (int i = 0; i < num_found; i++) {
+        cache->spans[kept + i] = found[i];
+    }
+    free(found);
+    cache->num_spans = num_spans;
+    cache->spans_known = 1;
+    return 0;
+}
+
+/**************** Streaming ****************/
+// Makes the analysis print the TAC of each function to compiler->tac_table as soon as the function is checked and
+// free its subtree and scope, so only one function's tree is held at a time and memory doesn't grow with the source.
+// compiler_generate then only adds main. The optimize option doesn't apply, its passes need the whole program.
+// Returns 0, or 1 if out of memory
+int compiler_stream(struct compiler_context* compiler){
+    compiler->stream = calloc(1, sizeof(struct tac_context));
+    if (compiler->stream == NULL) {
+        return 1;
+    }
+    compiler->stream->tac_type = -1;
+    return 0;
+}
+
+// When the parser rests after the ; of a def ... fed block, prints the TAC of its function if the source had no
+// errors so far and frees the block's subtree and the function's scope, leaving only its signature. A block kept
+// in the tree keeps the ones after it too, so the functions are printed in order
+void stream_function(struct compiler_context* compiler){
+    struct node* fdecls = compiler->root;
+    if (fdecls->terminal_flag != 0 || fdecls->value != 1 || fdecls->size != 3 || fdecls->index != 2 ||
+        fdecls->children[2]->children != NULL || fdecls->parent->parent != NULL) {
+        return;
+    }
+    // Nothing the checker holds may point into the block, the lexer's flags aren't looked at as it may be on
+    // another thread
+    if (compiler->hold_lexeme != NULL || compiler->function_call_stack->num_functions != 0 || compiler->current_function != NULL ||
+        compiler->function_flag != 0 || compiler->current_scope->parent_scope != NULL || compiler->current_scope->num_vars != 0) {
+        return;
+    }
+
+    // The block added the last function
+    struct function* function = NULL;
+    if (compiler->global_scope.num_functions > 0) {
+        function = &compiler->global_scope.functions[compiler->global_scope.num_functions - 1];
+    }
+    if (function != NULL && function->my_scope != NULL && ftell(compiler->error_doc) == 0) {
+        // Generate it alone, looking only its own signature up
+        struct tac_context* tacc = compiler->stream;
+        struct tac_program program = {0, 0, NULL, 0, 0, NULL, 0, 0, NULL, 0, NULL, NULL, 0};
+        struct global signature = {.functions = function, .num_functions = 1};
+        tacc->program = &program;
+        tacc->global_scope = &signature;
         tacc->memory = 0;
-        tacc->temp_counter = 0;
-        tacc->label_counter = 0;
-        tacc->stack_mem = 0;
-        tacc->tac_type = -1;
-        // Open/create the output file (Three Address Code)
-        FILE* tac_table = fopen("tac.txt", "w");
-        if (!tac_table) {
-            fclose(error_doc);         // Close error file
-            perror("Error opening tac file");
-            return 1;
+        print_tac_function_aux(fdecls->children[0], &tacc);
+        print_tac_program(&program, compiler->tac_table);
+        free_tac_program(&program);
+        tacc->program = NULL;
+        tacc->function = NULL;
+        tacc->scope = NULL;
+        tacc->global_scope = NULL;
+    }
+    if (function != NULL) {
+        free_scope(function->my_scope);
+        function->my_scope = NULL;
+    }
+
+    // Hang the <fdecls> after the block where the block's <fdecls> was, the parser goes on into it from <progs>
+    struct node* progs = fdecls->parent;
+    struct node* rest = fdecls->children[2];
+    delete_tree(fdecls->children[0]);
+    delete_tree(fdecls->children[1]);
+    progs->children[progs->index] = rest;
+    rest->parent = progs;
+    free(fdecls->children);
+    free(fdecls->lexeme);
+    free(fdecls);
+    compiler->root = progs;
+}
+
+/**************** Pipeline ****************/
+// Lexes the source on a thread of its own, handing the records to the parser a batch at a time
+void* pipeline_lexer(void* argument){
+    struct compiler_context* compiler = argument;
+    compiler->batch = pipeline_claim(compiler->ring);
+    compiler_lex(compiler);
+    compiler->batch->last = 1;
+    pipeline_publish(compiler->ring);
+    return NULL;
+}
+
+// Lexes the source on a second thread while this one parses and checks the tokens, writing the same outputs as
+// compiler_lex. Returns 0, or 1 without lexing anything if the ring or the thread can't be made
+int compiler_pipeline(struct compiler_context* compiler){
+    struct token_ring* ring = malloc(sizeof(struct token_ring));
+    if (ring == NULL) {
+        return 1;
+    }
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    compiler->ring = ring;
+    pthread_t lexer;
+    if (pthread_create(&lexer, NULL, pipeline_lexer, compiler) != 0) {
+        compiler->ring = NULL;
+        free(ring);
+        return 1;
+    }
+
+    // Parse each batch the lexer hands over, until the last
+    int last = 0;
+    while (!last) {
+        struct token_batch* batch = pipeline_next(ring);
+        for (int i = 0; i < batch->count; i++) {
+            parse_token(compiler, &batch->tokens[i], batch->text + batch->tokens[i].text);
         }
+        last = batch->last;
+        pipeline_release(ring);
+    }
 
-        // TAC functions
-        print_tac(root, &tacc, tac_table);
+    pthread_join(lexer, NULL);
+    compiler->ring = NULL;
+    compiler->batch = NULL;
+    free(ring);
+    return 0;
+}
 
+/**************** Parallel analysis ****************/
+// Checks block i on a worker's context from the state the parser rests in between blocks, with the signatures of
+// the blocks before it as the functions defined so far, and keeps the entry it stored
+void parallel_block(struct parallel_worker* worker, int i){
+    struct parallel_work* work = worker->work;
+    struct compiler_context* compiler = worker->compiler;
+    FILE** outputs[4] = {&compiler->symbol_table_lex, &compiler->symbol_table_syn, &compiler->symbol_table_sem, &compiler->error_doc};
+    int opened = 1;
+    for (int k = 0; k < 4; k++) {
+        *outputs[k] = open_memstream(&compiler->texts[k], &compiler->lengths[k]);
+        opened = opened && *outputs[k] != NULL;
+    }
 
-        fclose(tac_table);
+    // Rest at <progs> for the first block, at the <fdecls> of a block before with its ; matched for the others
+    struct node* progs = malloc(sizeof(struct node));
+    progs->children = NULL;
+    progs->value = 0;
+    progs->size = 1;
+    progs->terminal_flag = 0;
+    progs->index = 0;
+    progs->parent = NULL;
+    progs->lexeme = NULL;
+    compiler->root = progs;
+    if (i > 0) {
+        insert(productions[0], progs);
+        insert(productions[1], progs->children[0]);
+        progs->children[0]->index = 2;
+        compiler->root = progs->children[0];
     }
-    else {
-        ungetc(first_char, error_doc); // Return the character to the stream
-        printf("Please resolve all errors in error.txt to generate TAC\n");
+    // A block that went wrong may have left variables in main's scope
+    for (int k = 0; k < worker->global->num_vars; k++) {
+        free(worker->global->local_vars[k].lexeme);
+    }
+    free(worker->global->local_vars);
+    worker->global->local_vars = NULL;
+    worker->global->num_vars = 0;
+    compiler->line_number = work->lines[i];
+    compiler->pushback_char = -1;
+    compiler->checkNegativeFlag = 0;
+    compiler->function_flag = 0;
+    compiler->type_flag = -1;
+    compiler->var_type = -1;
+    compiler->type_depth = 0;
+    compiler->current_scope = worker->global;
+    compiler->current_function = NULL;
+    compiler->function_call_stack->num_functions = 0;
+    compiler->global_scope.num_functions = i;
+
+    if (opened) {
+        struct incremental_entry* entry = incremental_block(compiler, work->spans[i].start, work->spans[i].end, NULL);
+        if (entry != NULL) {
+            // The entry and its subtree move to the compilation's own cache
+            incremental_take(compiler->incremental, entry);
+            entry->used = 0;
+            work->entries[i] = entry;
+        }
+    }
+    for (int k = 0; k < compiler->incremental->num_uses; k++) {
+        compiler->incremental->uses[k].fdecls->children[0] = NULL;
     }
+    compiler->incremental->num_uses = 0;
+    delete_tree(progs);
+    compiler->root = NULL;
+    free(compiler->hold_lexeme);
+    compiler->hold_lexeme = NULL;
+
+    // Free the functions the block defined, except the one its entry holds, and put back the signatures they took
+    // the place of
+    for (int k = (work->entries[i] != NULL) ? i + 1 : i; k < compiler->global_scope.num_functions; k++) {
+        free_function(&compiler->global_scope.functions[k]);
+    }
+    free(compiler->current_function);
+    compiler->current_function = NULL;
+    int defined = compiler->global_scope.num_functions < work->num_blocks ? compiler->global_scope.num_functions : work->num_blocks;
+    for (int k = i; k < defined; k++) {
+        compiler->global_scope.functions[k] = work->signatures[k];
+    }
+    for (int k = 0; k < 4; k++) {
+        if (*outputs[k] != NULL) {
+            fclose(*outputs[k]);
+            *outputs[k] = NULL;
+        }
+        free(compiler->texts[k]);
+        compiler->texts[k] = NULL;
+        compiler->lengths[k] = 0;
+    }
+}
 
-    // Close error doc
-    fclose(error_doc);
-    
-    // Delete abstract syntax tree
-    delete_tree(root);
+// Checks the worker's own blocks, newest first, then steals from the others until every deque is empty
+void* parallel_worker_main(void* argument){
+    struct parallel_worker* worker = argument;
+    struct parallel_work* work = worker->work;
+    for (;;) {
+        struct incremental_span* span = deque_pop(&worker->deque);
+        if (span != NULL) {
+            parallel_block(worker, (int)(span - work->spans));
+            continue;
+        }
+        int pending = 0;
+        int start = rand_r(&worker->seed) % work->num_workers;
+        for (int k = 0; k < work->num_workers && span == NULL; k++) {
+            struct parallel_worker* victim = &work->workers[(start + k) % work->num_workers];
+            if (victim == worker) {
+                continue;
+            }
+            span = deque_steal(&victim->deque);
+            pending = pending || deque_pending(&victim->deque);
+        }
+        if (span != NULL) {
+            parallel_block(worker, (int)(span - work->spans));
+        }
+        else if (!pending) {
+            return NULL;
+        }
+        else {
+            // Lost the race for a block, others are left
+            sched_yield();
+        }
+    }
+}
 
+// Gives a worker a context of its own to check blocks on, seeing the signatures of work. Returns 0, or 1 if out of
+// memory
+int parallel_worker_new(struct parallel_worker* worker, struct parallel_work* work, struct compiler_options options){
+    options.incremental = 0;
+    options.pipeline = 0;
+    options.parallel = 0;
+    worker->work = work;
+    worker->compiler = compiler_new(options);
+    worker->global = calloc(1, sizeof(struct scope));
+    if (worker->compiler == NULL || worker->global == NULL) {
+        return 1;
+    }
+    struct compiler_context* compiler = worker->compiler;
+    compiler->incremental = incremental_new(0);
+    compiler->function_call_stack = calloc(1, sizeof(struct check_functions));
+    compiler->global_scope.functions = malloc(sizeof(struct function) * (work->num_blocks + 1));
+    if (compiler->incremental == NULL || compiler->function_call_stack == NULL || compiler->global_scope.functions == NULL) {
+        return 1;
+    }
+    // Room for every block's function and one more, so adding a function never moves the signatures
+    for (int i = 0; i < work->num_blocks; i++) {
+        compiler->global_scope.functions[i] = work->signatures[i];
+    }
+    compiler->global_scope.capacity = work->num_blocks + 1;
+    compiler->global_scope.my_scope = *worker->global;
+    compiler->source = work->source;
     return 0;
-}
\ No newline at end of file
+}
+
+void parallel_worker_free(struct parallel_worker* worker){
+    if (worker->compiler != NULL) {
+        // The signatures and main's scope aren't the context's
+        worker->compiler->current_scope = NULL;
+        worker->compiler->global_scope.num_functions = 0;
+        compiler_free(worker->compiler);
+    }
+    free(worker->global);
+    deque_free(&worker->deque);
+}
+
+// Checks the blocks of the source the per-function cache has no entry for on options.parallel threads before the
+// compilation analyzes it, storing an entry for each that checked without errors from the state it was guessed to
+// start in. The analysis that follows replays the entries that hold and checks the rest in place
+void parallel_analyze(struct compiler_context* compiler){
+    struct incremental_cache* cache = compiler->incremental;
+    if (!cache->spans_known) {
+        size_t position = 0;
+        size_t start;
+        size_t end;
+        cache->num_spans = 0;
+        while ((end = incremental_next_block(compiler->source, compiler->source_end, position, &start)) != 0) {
+            incremental_add_span(cache, start, end, NULL);
+            position = end;
+        }
+        cache->spans_known = 1;
+    }
+    struct parallel_work work;
+    work.source = compiler->source;
+    work.spans = cache->spans;
+    work.num_blocks = cache->num_spans;
+    if (work.num_blocks < 2) {
+        return;
+    }
+    work.lines = malloc(sizeof(int) * work.num_blocks);
+    work.signatures = malloc(sizeof(struct function) * work.num_blocks);
+    work.entries = calloc(work.num_blocks, sizeof(struct incremental_entry*));
+    int* queued = malloc(sizeof(int) * work.num_blocks);
+    if (work.lines == NULL || work.signatures == NULL || work.entries == NULL || queued == NULL) {
+        free(work.lines);
+        free(work.signatures);
+        free(work.entries);
+        free(queued);
+        return;
+    }
+
+    // Lines and signatures of the blocks, and which of them the cache can't already replay
+    int num_queued = 0;
+    int line = 1;
+    size_t position = 0;
+    for (int i = 0; i < work.num_blocks; i++) {
+        struct incremental_span* span = &work.spans[i];
+        for (; position < span->start; position++) {
+            line += (work.source[position] == '\n');
+        }
+        work.lines[i] = line;
+        if (parallel_signature(work.source + span->start, span->end - span->start, &work.signatures[i])) {
+            work.signatures[i].lexeme = copy_string("");
+        }
+        if (span->entry == NULL) {
+            struct incremental_state state = {i == 0 ? INCREMENTAL_AT_START : INCREMENTAL_AFTER_FDEC, -1, -1, 0, 0};
+            uint64_t hash = incremental_hash(work.source + span->start, span->end - span->start, &state);
+            span->entry = incremental_find(cache, work.source + span->start, span->end - span->start, &state, hash);
+            if (span->entry == NULL) {
+                queued[num_queued++] = i;
+            }
+        }
+    }
+
+    // Deal the blocks out in contiguous runs, this thread checking the first run itself
+    int num_workers = compiler->options.parallel;
+    num_workers = num_workers > PARALLEL_MAX_WORKERS ? PARALLEL_MAX_WORKERS : num_workers;
+    num_workers = num_workers > num_queued ? num_queued : num_workers;
+    struct parallel_worker* workers = (num_workers > 1) ? calloc(num_workers, sizeof(struct parallel_worker)) : NULL;
+    int ready = workers != NULL;
+    work.workers = workers;
+    work.num_workers = num_workers;
+    for (int w = 0; ready && w < num_workers; w++) {
+        struct parallel_worker* worker = &workers[w];
+        long long first = (long long)num_queued * w / num_workers;
+        long long last = (long long)num_queued * (w + 1) / num_workers;
+        if (deque_init(&worker->deque, last - first) || parallel_worker_new(worker, &work, compiler->options)) {
+            ready = 0;
+            break;
+        }
+        for (long long k = first; k < last; k++) {
+            deque_push(&worker->deque, &work.spans[queued[k]]);
+        }
+        worker->seed = w + 1;
+    }
+    if (ready) {
+        pthread_t* threads = malloc(sizeof(pthread_t) * num_workers);
+        int* started = calloc(num_workers, sizeof(int));
+        // A worker whose thread can't start leaves its blocks to be stolen
+        for (int w = 1; threads != NULL && started != NULL && w < num_workers; w++) {
+            started[w] = pthread_create(&threads[w], NULL, parallel_worker_main, &workers[w]) == 0;
+        }
+        parallel_worker_main(&workers[0]);
+        for (int w = 1; threads != NULL && started != NULL && w < num_workers; w++) {
+            if (started[w]) {
+                pthread_join(threads[w], NULL);
+            }
+        }
+        free(threads);
+        free(started);
+    }
+
+    // Hand the entries to the compilation's cache, as hints for the blocks they were checked from
+    for (int k = 0; k < num_queued; k++) {
+        int i = queued[k];
+        struct incremental_entry* entry = work.entries[i];
+        if (entry == NULL) {
+            continue;
+        }
+        if (incremental_find(cache, entry->text, entry->length, &entry->state, entry->hash) != NULL) {
+            incremental_free_entry(entry);
+            continue;
+        }
+        incremental_insert(cache, entry);
+        work.spans[i].entry = entry;
+    }
+
+    for (int w = 0; workers != NULL && w < num_workers; w++) {
+        parallel_worker_free(&workers[w]);
+    }
+    free(workers);
+    for (int i = 0; i < work.num_blocks; i++) {
+        free(work.signatures[i].lexeme);
+        free(work.signatures[i].param_types);
+    }
+    free(work.lines);
+    free(work.signatures);
+    free(work.entries);
+    free(queued);
+}
+
+// Lexes, parses and checks the source in compiler->input, or compiler->source when it is set, writing the symbol
+// tables and errors to the context's files. Returns 0, or 1 if the source is empty or only whitespace.
+int compiler_analyze(struct compiler_context* compiler){
+    /******************************** Initialize Values ********************************/
+    if (compiler->source == NULL) {
+        // Initialize buffer1
+        compiler->size_buffer1 = fread(compiler->buffer1, sizeof(char), BUFFER_SIZE, compiler->input);
+        if (compiler->size_buffer1 == 0) {
+            // If file is empty there is nothing to analyze
+            return 1;
+        }
+        compiler->current_buffer = 1;                                //
+        compiler->index_buffer = 0;                                  //
+    }
+    else if (compiler->source_end == 0) {
+        return 1;
+    }
+    compiler->line_number = 1;                                       //
+
+    // Initialize root node
+    struct node* root = malloc(sizeof(struct node));                 //
+    root->children = NULL;                                           //
+    root->value = 0;                                                 //
+    root->size = 1;                                                  //
+    root->terminal_flag = 0;                                         //
+    root->index = 0;                                                 //
+    root->parent = NULL;                                             //
+    root->lexeme = NULL;                                             //
+    compiler->root = root;                                           //
+
+    // Initialize global scope
+    struct scope* current_scope;                                     //
+    current_scope = malloc(sizeof(struct scope));                    //
+    current_scope->parent_scope = NULL;                              //
+    current_scope->local_vars = NULL;                                //
+    current_scope->num_vars = 0;                                     //
+    compiler->current_scope = current_scope;                         //
+
+    compiler->global_scope.my_scope = *current_scope;                //
+    compiler->global_scope.functions = NULL;                         //
+    compiler->global_scope.num_functions = 0;                        //
+    compiler->global_scope.capacity = 0;                             //
+
+    // Other semantic values
+    compiler->current_function = NULL;                               //
+    compiler->function_call_stack = calloc(1, sizeof(struct check_functions));
+
+    if (compiler->incremental != NULL && compiler->source != NULL) {
+        if (compiler->options.parallel > 1) {
+            parallel_analyze(compiler);
+        }
+        incremental_analyze(compiler);
+    }
+    else if (!compiler->options.pipeline || compiler_pipeline(compiler) != 0) {
+        compiler_lex(compiler);
+    }
+
+    // At EOF perform epsilon production on AST to check for syntax errors
+    struct token_lexeme tl;
+    clear_tl(&tl);
+    while(compiler->root->parent != NULL || compiler->root->index < compiler->root->size -1){
+        tl.my_token_num = 1000;
+        struct node* before = compiler->root;
+        int index = before->index;
+        compiler->root = traverse(compiler, compiler->root, compiler->next, tl, compiler->line_number, &compiler->current_function, &compiler->current_scope, compiler->symbol_table_syn, compiler->symbol_table_sem, compiler->error_doc);
+        // EOF the tree can't recover with leaves it where it was, the syntax error is already reported. Climb
+        // back to <progs> so the whole tree is freed
+        if (compiler->root == before && before->index == index) {
+            while (compiler->root->parent != NULL) {
+                compiler->root = compiler->root->parent;
+            }
+            break;
+        }
+    }
+
+    compiler->scope = compiler->current_scope;
+    // Only whitespace: no token reached the parser, so there is no tree to generate TAC from
+    if (compiler->root->children == NULL && ftell(compiler->error_doc) == 0) {
+        return 1;
+    }
+    return 0;
+}
+
+// Generates the TAC of the analyzed source into compiler->program, optimizing it with the optimize option. After
+// compiler_stream it holds only main and the functions the analysis couldn't stream
+void compiler_generate(struct compiler_context* compiler){
+    struct tac_context context;
+    struct tac_context* tacc = &context;
+    tacc->memory = 0;
+    tacc->temp_counter = 0;
+    tacc->label_counter = 0;
+    tacc->stack_mem = 0;
+    tacc->tac_type = -1;
+    tacc->program = NULL;
+    tacc->function = NULL;
+    tacc->scope = compiler->scope;
+    tacc->global_scope = &compiler->global_scope;
+    tacc->batch = compiler->options.batch_name != NULL;
+    tacc->incremental = compiler->incremental;
+    if (compiler->incremental != NULL) {
+        compiler->incremental->next_use = 0;
+    }
+    if (compiler->stream != NULL) {
+        // Number on after the functions already streamed
+        tacc->temp_counter = compiler->stream->temp_counter;
+        tacc->label_counter = compiler->stream->label_counter;
+        tacc->stack_mem = compiler->stream->stack_mem;
+        tacc->tac_type = compiler->stream->tac_type;
+    }
+
+    struct tac_program program = {0, 0, NULL, 0, 0, NULL, 0, 0, NULL, 0, NULL, NULL, 0};
+    compiler->program = program;
+    print_tac(compiler->root, &tacc, &compiler->program, compiler->options.optimize, compiler->opt_report, compiler->tac_table);
+    compiler->has_program = 1;
+}
+
+// Frees what the last compilation left in the context and resets it for the next one
+void compiler_reset(struct compiler_context* compiler){
+    if (compiler->has_program) {
+        free_tac_program(&compiler->program);
+        compiler->has_program = 0;
+    }
+    if (compiler->incremental != NULL) {
+        // The subtrees and functions of the blocks that used the per-function cache belong to it
+        for (int i = 0; i < compiler->incremental->num_uses; i++) {
+            struct function* function = &compiler->global_scope.functions[compiler->incremental->uses[i].function];
+            function->lexeme = NULL;
+            function->param_types = NULL;
+            function->my_scope = NULL;
+            compiler->incremental->uses[i].fdecls->children[0] = NULL;
+        }
+        compiler->incremental->num_uses = 0;
+        compiler->incremental->reused_nodes = 0;
+        incremental_clear_names(compiler->incremental);
+    }
+    if (compiler->root != NULL) {
+        delete_tree(compiler->root);
+        compiler->root = NULL;
+    }
+    // Main's scope is the outermost, the others are the scopes of the functions
+    struct scope* main_scope = compiler->current_scope;
+    while (main_scope != NULL && main_scope->parent_scope != NULL) {
+        main_scope = main_scope->parent_scope;
+    }
+    free_scope(main_scope);
+    for (int i = 0; i < compiler->global_scope.num_functions; i++) {
+        free_function(&compiler->global_scope.functions[i]);
+    }
+    free(compiler->current_function);
+    free(compiler->global_scope.functions);
+    compiler->global_scope.functions = NULL;
+    compiler->global_scope.num_functions = 0;
+    compiler->global_scope.capacity = 0;
+    if (compiler->function_call_stack != NULL) {
+        free(compiler->function_call_stack->functions);
+        free(compiler->function_call_stack->indeces);
+        free(compiler->function_call_stack);
+        compiler->function_call_stack = NULL;
+    }
+    free(compiler->hold_lexeme);
+    compiler->hold_lexeme = NULL;
+    for (int i = 0; i < COMPILER_NUM_OUTPUTS; i++) {
+        free(compiler->texts[i]);
+        compiler->texts[i] = NULL;
+        compiler->lengths[i] = 0;
+    }
+
+    compiler->input = NULL;
+    compiler->source = NULL;
+    compiler->source_index = 0;
+    compiler->source_end = 0;
+    compiler->line_number = 1;
+    compiler->pushback_char = -1;
+    compiler->checkNegativeFlag = 0;
+    compiler->current_buffer = 1;
+    compiler->index_buffer = 0;
+    compiler->size_buffer1 = 0;
+    compiler->size_buffer2 = 0;
+    compiler->next = NULL;
+    compiler->function_flag = 0;
+    compiler->type_flag = -1;
+    compiler->var_type = -1;
+    compiler->type_depth = 0;
+    compiler->scope = NULL;
+    compiler->current_scope = NULL;
+    compiler->current_function = NULL;
+    compiler->lexed_bytes = 0;
+    compiler->analyze_seconds = 0;
+    compiler->seconds = 0;
+}
+
+struct compiler_context* compiler_new(struct compiler_options options){
+    struct compiler_context* compiler = calloc(1, sizeof(struct compiler_context));
+    if (compiler == NULL) {
+        return NULL;
+    }
+    compiler->options = options;
+    // The parallel front end hands what its workers checked to the compilation through the per-function cache
+    if (options.incremental > 0 || options.parallel > 1) {
+        compiler->incremental = incremental_new(options.incremental);
+        if (compiler->incremental == NULL) {
+            free(compiler);
+            return NULL;
+        }
+    }
+    compiler_reset(compiler);
+    return compiler;
+}
+
+// Compiles length bytes of source, what compiler_compile and compiler_edit share
+int compiler_run(struct compiler_context* compiler, const char* source, size_t length){
+    double start = vm_now();
+    compiler_reset(compiler);
+    if (compiler->incremental != NULL) {
+        compiler->incremental->generation++;
+    }
+
+    // Read the source and write the outputs in memory
+    FILE** outputs[COMPILER_NUM_OUTPUTS] = {
+        &compiler->symbol_table_lex, &compiler->symbol_table_syn, &compiler->symbol_table_sem,
+        &compiler->error_doc, &compiler->tac_table, &compiler->opt_report
+    };
+    int status = 0;
+    compiler->source = source;
+    compiler->source_end = length;
+    for (int i = 0; i < COMPILER_NUM_OUTPUTS; i++) {
+        *outputs[i] = open_memstream(&compiler->texts[i], &compiler->lengths[i]);
+        if (*outputs[i] == NULL) {
+            status = 1;
+        }
+    }
+
+    if (status == 0) {
+        status = compiler_analyze(compiler);
+        compiler->analyze_seconds = vm_now() - start;
+        fflush(compiler->error_doc);
+        if (status == 0 && compiler->lengths[COMPILER_OUT_ERRORS] > 0) {
+            status = 1;
+        }
+        if (status == 0) {
+            compiler_generate(compiler);
+        }
+    }
+
+    compiler->source = NULL;
+    for (int i = 0; i < COMPILER_NUM_OUTPUTS; i++) {
+        if (*outputs[i] != NULL) {
+            fclose(*outputs[i]);
+            *outputs[i] = NULL;
+        }
+    }
+    if (compiler->incremental != NULL) {
+        // Spans an edit left are used up, and spans of an analysis that didn't run don't match the source
+        if (compiler->incremental->spans_known) {
+            compiler->incremental->num_spans = 0;
+            compiler->incremental->spans_known = 0;
+        }
+        incremental_evict(compiler->incremental);
+    }
+    compiler->seconds = vm_now() - start;
+    return status;
+}
+
+int compiler_compile(struct compiler_context* compiler, const char* source, size_t length){
+    struct incremental_cache* cache = compiler->incremental;
+    if (cache == NULL) {
+        return compiler_run(compiler, source, length);
+    }
+    // Keep the source for the edits that follow
+    cache->spans_known = 0;
+    cache->num_spans = 0;
+    if (incremental_splice(cache, 0, cache->length, source, length)) {
+        cache->length = 0;
+        cache->num_spans = 0;
+        return 1;
+    }
+    return compiler_run(compiler, cache->source, cache->length);
+}
+
+int compiler_edit(struct compiler_context* compiler, size_t offset, size_t removed, const char* text, size_t length){
+    struct incremental_cache* cache = compiler->incremental;
+    if (cache == NULL || offset > cache->length || removed > cache->length - offset) {
+        return -1;
+    }
+    if (incremental_edit(cache, offset, removed, text, length)) {
+        return -1;
+    }
+    return compiler_run(compiler, cache->source, cache->length);
+}
+
+void compiler_stats(struct compiler_context* compiler, struct compiler_stats* stats){
+    stats->nodes = (compiler->root != NULL) ? incremental_count_nodes(compiler->root) : 0;
+    stats->reused_nodes = (compiler->incremental != NULL) ? compiler->incremental->reused_nodes : 0;
+    stats->lexed_bytes = compiler->lexed_bytes;
+    stats->analyze_seconds = compiler->analyze_seconds;
+    stats->seconds = compiler->seconds;
+}
+
+// Column of the first whole word name on the line starting at source[start], 0 if it isn't there
+int definition_column(const char* source, size_t length, size_t start, const char* name){
+    for (size_t i = start; i < length && source[i] != '\n'; i++) {
+        size_t k = incremental_match(source + i, length - i, name);
+        if (k > 0 && (i == 0 || !incremental_word(source[i - 1])) && (i + k == length || !incremental_word(source[i + k]))) {
+            return (int)(i - start);
+        }
+    }
+    return 0;
+}
+
+int compiler_definition(struct compiler_context* compiler, int line, int column, int* def_line, int* def_column){
+    struct incremental_cache* cache = compiler->incremental;
+    if (cache == NULL || compiler->scope == NULL || line < 0 || column < 0) {
+        return 1;
+    }
+    const char* source = cache->source;
+    size_t length = cache->length;
+
+    // Find the position, then the letters of the id around it
+    size_t position = 0;
+    for (int l = 0; l < line && position < length; position++) {
+        if (source[position] == '\n') {
+            l++;
+        }
+    }
+    for (int c = 0; c < column && position < length && source[position] != '\n'; c++) {
+        position++;
+    }
+    if ((position == length || !incremental_word(source[position])) && position > 0 && incremental_word(source[position - 1])) {
+        position--;
+    }
+    size_t start = position;
+    size_t end = position;
+    while (start > 0 && incremental_word(source[start - 1])) {
+        start--;
+    }
+    while (end < length && incremental_word(source[end])) {
+        end++;
+    }
+    char name[LEXEME_SIZE];
+    if (end == start || end - start >= LEXEME_SIZE || source[start] < 'A') {
+        return 1;
+    }
+    for (size_t i = start; i < end; i++) {
+        name[i - start] = source[i];
+    }
+    name[end - start] = '\0';
+    if (binary_search(keywords, name, 14) >= 0) {
+        return 1;
+    }
+
+    // Inside a def ... fed the id is looked up in the function's scope first, outside in main's
+    struct scope* scope = compiler->scope;
+    size_t back = start;
+    while (back > 0 && !incremental_keyword(source, length, back - 1, "def") && !incremental_keyword(source, length, back - 1, "fed")) {
+        back--;
+    }
+    if (back > 0 && incremental_keyword(source, length, back - 1, "def")) {
+        struct function* enclosing = NULL;
+        for (int i = 0; i < compiler->global_scope.num_functions; i++) {
+            struct function* function = &compiler->global_scope.functions[i];
+            if (function->line <= line + 1 && (enclosing == NULL || function->line > enclosing->line)) {
+                enclosing = function;
+            }
+        }
+        if (enclosing != NULL && enclosing->my_scope != NULL) {
+            scope = enclosing->my_scope;
+        }
+    }
+
+    // A call names a function, anything else a variable first
+    size_t after = end;
+    while (after < length && incremental_space(source[after])) {
+        after++;
+    }
+    int found = -1;
+    if (after == length || source[after] != '(') {
+        for (; scope != NULL && found < 0; scope = scope->parent_scope) {
+            for (int i = 0; i < scope->num_vars; i++) {
+                if (compare_strings(scope->local_vars[i].lexeme, name) == 0) {
+                    found = scope->local_vars[i].line;
+                    break;
+                }
+            }
+        }
+    }
+    for (int i = 0; found < 0 && i < compiler->global_scope.num_functions; i++) {
+        struct function* function = &compiler->global_scope.functions[i];
+        if (function->lexeme != NULL && compare_strings(function->lexeme, name) == 0) {
+            found = function->line;
+        }
+    }
+    if (found < 1) {
+        return 1;
+    }
+
+    *def_line = found - 1;
+    size_t line_start = 0;
+    for (int l = 1; l < found && line_start < length; line_start++) {
+        if (source[line_start] == '\n') {
+            l++;
+        }
+    }
+    *def_column = definition_column(source, length, line_start, name);
+    return 0;
+}
+
+const char* compiler_output(struct compiler_context* compiler, int which, size_t* length){
+    if (which < 0 || which >= COMPILER_NUM_OUTPUTS || compiler->texts[which] == NULL) {
+        if (length != NULL) {
+            *length = 0;
+        }
+        return "";
+    }
+    if (length != NULL) {
+        *length = compiler->lengths[which];
+    }
+    return compiler->texts[which];
+}
+
+struct tac_program* compiler_program(struct compiler_context* compiler){
+    return compiler->has_program ? &compiler->program : NULL;
+}
+
+void compiler_free(struct compiler_context* compiler){
+    if (compiler == NULL) {
+        return;
+    }
+    compiler_reset(compiler);
+    incremental_free(compiler->incremental);
+    free(compiler->stream);
+    free(compiler);
+}
+
+#ifndef COMPILER_LIBRARY
+/******************************** Batch Compilation ********************************/
+// Compiles many source files on a pool of threads. Each worker owns a compiler_context and claims the next
+// file from a shared counter, so files are handed out one at a time and a slow one holds up only its worker.
+// The outputs of input dir/name.cp go to output_dir/name/, named like the files of a single compilation.
+#define BATCH_PATH_SIZE 4096
+
+struct batch_compile{
+    struct compiler_options options; //
+    char** inputs;                   // Paths of the files to compile
+    int num_inputs;                  //
+    const char* output_dir;          //
+    atomic_int next;                 // Next input to claim
+    atomic_int compiled;             // Files that produced TAC
+    atomic_int with_errors;          // Files with errors in their error.txt
+    atomic_int failed;               // Files that couldn't be read or written
+    atomic_int cached;               // Files whose outputs came from the cache
+    struct cache* cache;             // Cache to look files up in and store them to, NULL for none
+    atomic_llong bytes;              // Source bytes read
+};
+
+// Adds path to the end of the batch's inputs
+void batch_add_input(struct batch_compile* batch, int* capacity, const char* path){
+    if (batch->num_inputs == *capacity) {
+        *capacity = (*capacity == 0) ? 256 : *capacity * 2;
+        batch->inputs = realloc(batch->inputs, sizeof(char*) * *capacity);
+    }
+    batch->inputs[batch->num_inputs++] = copy_string(path);
+}
+
+// Fills the batch's inputs from a directory, every .cp file in it, or from a list with one path per line.
+// Returns 0, or 1 after writing an error
+int batch_read_inputs(struct batch_compile* batch, const char* name){
+    int capacity = 0;
+    char path[BATCH_PATH_SIZE];
+    DIR* directory = opendir(name);
+    if (directory != NULL) {
+        struct dirent* entry;
+        while ((entry = readdir(directory)) != NULL) {
+            int length = 0;
+            while (entry->d_name[length] != '\0') {
+                length++;
+            }
+            if (length > 3 && compare_strings(entry->d_name + length - 3, ".cp") == 0) {
+                snprintf(path, BATCH_PATH_SIZE, "%s/%s", name, entry->d_name);
+                batch_add_input(batch, &capacity, path);
+            }
+        }
+        closedir(directory);
+        return 0;
+    }
+
+    FILE* list = fopen(name, "r");
+    if (!list) {
+        perror("Error opening compile list");
+        return 1;
+    }
+    while (fgets(path, BATCH_PATH_SIZE, list) != NULL) {
+        int length = 0;
+        while (path[length] != '\0') {
+            length++;
+        }
+        while (length > 0 && (path[length - 1] == '\n' || path[length - 1] == '\r' || path[length - 1] == ' ')) {
+            path[--length] = '\0';
+        }
+        if (length > 0) {
+            batch_add_input(batch, &capacity, path);
+        }
+    }
+    fclose(list);
+    return 0;
+}
+
+// Writes length bytes of text to directory/name, returns 0 or 1 after writing an error
+int batch_write_output(const char* directory, const char* name, const char* text, size_t length){
+    char path[BATCH_PATH_SIZE];
+    snprintf(path, BATCH_PATH_SIZE, "%s/%s", directory, name);
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        perror(path);
+        return 1;
+    }
+    fwrite(text, 1, length, file);
+    fclose(file);
+    return 0;
+}
+
+// Writes the outputs of a compilation into directory under the names the command line uses. TAC and the
+// optimization report are only written for a source that compiled. Returns 0 or 1 if a file couldn't be written
+int write_outputs(const char* directory, const char** texts, size_t* lengths, int status, int optimize){
+    const char* names[COMPILER_NUM_OUTPUTS] = {
+        "symbol_table_lex.txt", "symbol_table_syn.txt", "symbol_table_sem.txt", "error.txt", "tac.txt", "opt_report.txt"
+    };
+    int failed = 0;
+    for (int i = 0; i < COMPILER_NUM_OUTPUTS; i++) {
+        if ((i == COMPILER_OUT_TAC && status != 0) || (i == COMPILER_OUT_REPORT && (status != 0 || !optimize))) {
+            continue;
+        }
+        failed |= batch_write_output(directory, names[i], texts[i], lengths[i]);
+    }
+    return failed;
+}
+
+// Compiles one input into its own output directory, returns 0 or 1 if it couldn't be read or written
+int batch_compile_file(struct batch_compile* batch, struct compiler_context* compiler, const char* input, char** source, size_t* capacity){
+    FILE* file = fopen(input, "rb");
+    if (!file) {
+        perror(input);
+        return 1;
+    }
+    size_t length = 0;
+    for (;;) {
+        if (length == *capacity) {
+            *capacity = (*capacity == 0) ? 65536 : *capacity * 2;
+            *source = realloc(*source, *capacity);
+        }
+        size_t read = fread(*source + length, 1, *capacity - length, file);
+        length += read;
+        if (read == 0) {
+            break;
+        }
+    }
+    fclose(file);
+    atomic_fetch_add(&batch->bytes, (long long)length);
+
+    // Output directory named after the input without its directory and extension
+    const char* base = input;
+    for (const char* c = input; *c != '\0'; c++) {
+        if (*c == '/') {
+            base = c + 1;
+        }
+    }
+    int base_length = 0;
+    while (base[base_length] != '\0') {
+        base_length++;
+    }
+    if (base_length > 3 && compare_strings(base + base_length - 3, ".cp") == 0) {
+        base_length -= 3;
+    }
+    char directory[BATCH_PATH_SIZE];
+    snprintf(directory, BATCH_PATH_SIZE, "%s/%.*s", batch->output_dir, base_length, base);
+    if (mkdir(directory, 0777) != 0 && errno != EEXIST) {
+        perror(directory);
+        return 1;
+    }
+
+    // A cache hit is written out as stored, a miss is compiled and stored
+    char key[CACHE_KEY_SIZE];
+    struct cache_entry entry;
+    const char* texts[COMPILER_NUM_OUTPUTS];
+    size_t lengths[COMPILER_NUM_OUTPUTS];
+    int status;
+    int hit = 0;
+    if (batch->cache != NULL) {
+        cache_key(*source, length, &batch->options, key);
+        hit = cache_lookup(batch->cache, key, &entry);
+    }
+    if (hit) {
+        status = entry.status;
+        for (int i = 0; i < COMPILER_NUM_OUTPUTS; i++) {
+            texts[i] = entry.texts[i];
+            lengths[i] = entry.lengths[i];
+        }
+        atomic_fetch_add(&batch->cached, 1);
+    }
+    else {
+        status = compiler_compile(compiler, *source, length);
+        for (int i = 0; i < COMPILER_NUM_OUTPUTS; i++) {
+            texts[i] = compiler_output(compiler, i, &lengths[i]);
+        }
+        if (batch->cache != NULL) {
+            cache_store(batch->cache, key, status, texts, lengths);
+        }
+    }
+    if (status == 0) {
+        atomic_fetch_add(&batch->compiled, 1);
+    }
+    else if (lengths[COMPILER_OUT_ERRORS] > 0) {
+        atomic_fetch_add(&batch->with_errors, 1);
+    }
+
+    int failed = write_outputs(directory, texts, lengths, status, batch->options.optimize);
+    if (hit) {
+        cache_free_entry(&entry);
+    }
+    return failed;
+}
+
+void* batch_compile_worker(void* argument){
+    struct batch_compile* batch = argument;
+    struct compiler_context* compiler = compiler_new(batch->options);
+    if (compiler == NULL) {
+        fprintf(stderr, "Error: out of memory\n");
+        return NULL;
+    }
+    char* source = NULL;
+    size_t capacity = 0;
+    for (;;) {
+        int i = atomic_fetch_add(&batch->next, 1);
+        if (i >= batch->num_inputs) {
+            break;
+        }
+        if (batch_compile_file(batch, compiler, batch->inputs[i], &source, &capacity)) {
+            atomic_fetch_add(&batch->failed, 1);
+        }
+    }
+    free(source);
+    compiler_free(compiler);
+    return NULL;
+}
+
+// Compiles every file named by inputs, a directory or a list file, on workers threads and prints the
+// throughput. Files are looked up in and stored to cache unless it is NULL. Returns 0 if every file was compiled
+// and its outputs written, otherwise 1
+int batch_compile_files(struct compiler_options* options, struct cache* cache, const char* inputs, const char* output_dir, int workers){
+    struct batch_compile batch;
+    batch.options = *options;
+    batch.inputs = NULL;
+    batch.num_inputs = 0;
+    batch.output_dir = output_dir;
+    atomic_init(&batch.next, 0);
+    atomic_init(&batch.compiled, 0);
+    atomic_init(&batch.with_errors, 0);
+    atomic_init(&batch.failed, 0);
+    atomic_init(&batch.bytes, 0);
+    atomic_init(&batch.cached, 0);
+    batch.cache = cache;
+    if (batch_read_inputs(&batch, inputs)) {
+        return 1;
+    }
+    if (mkdir(output_dir, 0777) != 0 && errno != EEXIST) {
+        perror("Error creating output directory");
+        for (int i = 0; i < batch.num_inputs; i++) {
+            free(batch.inputs[i]);
+        }
+        free(batch.inputs);
+        return 1;
+    }
+    if (workers > batch.num_inputs) {
+        workers = (batch.num_inputs > 0) ? batch.num_inputs : 1;
+    }
+
+    double start = vm_now();
+    pthread_t* threads = malloc(sizeof(pthread_t) * workers);
+    for (int w = 0; w < workers; w++) {
+        pthread_create(&threads[w], NULL, batch_compile_worker, &batch);
+    }
+    for (int w = 0; w < workers; w++) {
+        pthread_join(threads[w], NULL);
+    }
+    double seconds = vm_now() - start;
+    free(threads);
+
+    long long bytes = atomic_load(&batch.bytes);
+    int failed = atomic_load(&batch.failed);
+    if (seconds <= 0) {
+        seconds = 1e-9;
+    }
+    printf("Compiled %d files on %d workers: %d to TAC, %d with errors, %d failed\n",
+           batch.num_inputs, workers, atomic_load(&batch.compiled), atomic_load(&batch.with_errors), failed);
+    printf("Time: %.3f s, %.1f files/sec, %.2f MB/sec\n",
+           seconds, batch.num_inputs / seconds, bytes / seconds / (1024.0 * 1024.0));
+    if (cache != NULL) {
+        printf("Cache: %d of %d files hit\n", atomic_load(&batch.cached), batch.num_inputs);
+    }
+
+    for (int i = 0; i < batch.num_inputs; i++) {
+        free(batch.inputs[i]);
+    }
+    free(batch.inputs);
+    return failed > 0;
+}
+
+/******************************** Backends ********************************/
+// Does what the command line options ask for with the TAC: builds executables and runs it
+void run_backends(struct compiler_options* options, struct tac_program* program){
+    // Compile to a native executable
+    if (options->native) {
+        FILE* assembly = fopen("program.s", "w");
+        if (!assembly) {
+            perror("Error opening assembly output file");
+        }
+        else {
+            int status = x86_write_program(program, assembly);
+            fclose(assembly);
+            if (status == 0) {
+                x86_link("program.s", "program");
+            }
+        }
+    }
+
+    // Translate to C and build it
+    if (options->c) {
+        FILE* source = fopen("program.c", "w");
+        if (!source) {
+            perror("Error opening C output file");
+        }
+        else {
+            int status = cgen_write_program(program, source);
+            fclose(source);
+            if (status == 0) {
+                cgen_compile("program.c", "program_c");
+            }
+        }
+    }
+
+    // Run
+    if (options->run || options->jit_threshold > 0 || options->batch_name != NULL) {
+        FILE* report = fopen("vm_report.txt", "w");
+        if (!report) {
+            perror("Error opening VM report file");
+        }
+        else {
+            if (options->jit_threshold > 0) {
+                jit_run_program(program, report, options->jit_threshold);
+            }
+            else if (options->run) {
+                vm_run_program(program, report, options->profile);
+            }
+            if (options->batch_name != NULL) {
+                FILE* batch_input = fopen(options->batch_name, "r");
+                FILE* batch_output = fopen("batch_output.txt", "w");
+                if (!batch_input) {
+                    perror("Error opening batch input file");
+                }
+                else if (!batch_output) {
+                    perror("Error opening batch output file");
+                }
+                else {
+                    vm_run_batch(program, batch_input, batch_output, report, options->workers);
+                }
+                if (batch_input) {
+                    fclose(batch_input);
+                }
+                if (batch_output) {
+                    fclose(batch_output);
+                }
+            }
+            fclose(report);
+        }
+    }
+}
+
+/******************************** Cached Compilation ********************************/
+// Compiles input_name like main does, but looks it up in the cache first and stores it after. When the options
+// ask for a backend the program has to be compiled for it, so only the store is done. A NULL cache only compiles
+// it, through the library as the parallel front end needs. Returns like main
+int compile_cached(struct compiler_options* options, struct cache* cache, const char* input_name){
+    size_t length;
+    char* source = server_read_file(input_name, &length);
+    if (source == NULL) {
+        return 1;
+    }
+    int backends = options->run || options->native || options->c || options->jit_threshold > 0 || options->batch_name != NULL;
+    char key[CACHE_KEY_SIZE];
+    if (cache != NULL) {
+        cache_key(source, length, options, key);
+    }
+
+    struct cache_entry entry;
+    if (cache != NULL && !backends && cache_lookup(cache, key, &entry)) {
+        write_outputs(".", entry.texts, entry.lengths, entry.status, options->optimize);
+        if (entry.status != 0 && entry.lengths[COMPILER_OUT_ERRORS] > 0) {
+            printf("Please resolve all errors in error.txt to generate TAC\n");
+        }
+        cache_free_entry(&entry);
+        free(source);
+        return 0;
+    }
+
+    struct compiler_context* compiler = compiler_new(*options);
+    if (compiler == NULL) {
+        fprintf(stderr, "Error: out of memory\n");
+        free(source);
+        return 1;
+    }
+    int status = compiler_compile(compiler, source, length);
+    const char* texts[COMPILER_NUM_OUTPUTS];
+    size_t lengths[COMPILER_NUM_OUTPUTS];
+    for (int i = 0; i < COMPILER_NUM_OUTPUTS; i++) {
+        texts[i] = compiler_output(compiler, i, &lengths[i]);
+    }
+    write_outputs(".", texts, lengths, status, options->optimize);
+    if (cache != NULL) {
+        cache_store(cache, key, status, texts, lengths);
+    }
+    if (status == 0) {
+        run_backends(options, compiler_program(compiler));
+    }
+    else if (lengths[COMPILER_OUT_ERRORS] > 0) {
+        printf("Please resolve all errors in error.txt to generate TAC\n");
+    }
+    compiler_free(compiler);
+    free(source);
+    return 0;
+}
+
+/******************************** MAIN ********************************/
+int main(int argc, char *argv[]){
+    struct compiler_options options = {0, 0, 0, NULL, 0, 0, 0, 0, 0, 0, 0};
+
+    // Read options, the last non option argument is the input file
+    char* input_name = NULL;
+    char* compile_list = NULL;
+    char* output_dir = NULL;
+    char* serve_path = NULL;
+    char* server_path = NULL;
+    int language_server = 0;
+    int stream = 0;
+    long long requests = 0;
+    char* cache_dir = NULL;
+    long long cache_bytes = CACHE_DEFAULT_BYTES;
+    for (int i = 1; i < argc; i++) {
+        if (compare_strings(argv[i], "-O") == 0) {
+            options.optimize = 1;
+        }
+        else if (compare_strings(argv[i], "-r") == 0) {
+            options.run = 1;
+        }
+        else if (compare_strings(argv[i], "-p") == 0) {
+            options.run = 1;
+            options.profile = 1;
+        }
+        else if (compare_strings(argv[i], "-S") == 0) {
+            options.native = 1;
+        }
+        else if (compare_strings(argv[i], "-C") == 0) {
+            options.c = 1;
+        }
+        else if (compare_strings(argv[i], "-j") == 0 && i + 1 < argc) {
+            options.jit_threshold = atoll(argv[++i]);
+            if (options.jit_threshold < 1) {
+                fprintf(stderr, "-j needs a threshold of at least 1 call\n");
+                return 1;
+            }
+        }
+        else if (compare_strings(argv[i], "-b") == 0 && i + 1 < argc) {
+            options.batch_name = argv[++i];
+        }
+        else if (compare_strings(argv[i], "-m") == 0 && i + 1 < argc) {
+            compile_list = argv[++i];
+        }
+        else if (compare_strings(argv[i], "-o") == 0 && i + 1 < argc) {
+            output_dir = argv[++i];
+        }
+        else if (compare_strings(argv[i], "-k") == 0 && i + 1 < argc) {
+            cache_dir = argv[++i];
+        }
+        else if (compare_strings(argv[i], "-K") == 0 && i + 1 < argc) {
+            cache_bytes = atoll(argv[++i]) << 20;
+            if (cache_bytes < 1) {
+                fprintf(stderr, "-K needs a cap of at least 1 MB\n");
+                return 1;
+            }
+        }
+        else if (compare_strings(argv[i], "-I") == 0 && i + 1 < argc) {
+            options.incremental = atoll(argv[++i]) << 20;
+            if (options.incremental < 1) {
+                fprintf(stderr, "-I needs a cap of at least 1 MB\n");
+                return 1;
+            }
+        }
+        else if (compare_strings(argv[i], "-D") == 0 && i + 1 < argc) {
+            serve_path = argv[++i];
+        }
+        else if (compare_strings(argv[i], "-L") == 0) {
+            language_server = 1;
+        }
+        else if (compare_strings(argv[i], "-T") == 0) {
+            stream = 1;
+        }
+        else if (compare_strings(argv[i], "-P") == 0) {
+            options.pipeline = 1;
+        }
+        else if (compare_strings(argv[i], "-F") == 0 && i + 1 < argc) {
+            options.parallel = atoi(argv[++i]);
+            if (options.parallel < 1) {
+                fprintf(stderr, "-F needs at least 1 worker\n");
+                return 1;
+            }
+        }
+        else if (compare_strings(argv[i], "-s") == 0 && i + 1 < argc) {
+            server_path = argv[++i];
+        }
+        else if (compare_strings(argv[i], "-n") == 0 && i + 1 < argc) {
+            requests = atoll(argv[++i]);
+            if (requests < 1) {
+                fprintf(stderr, "-n needs at least 1 request\n");
+                return 1;
+            }
+        }
+        else if (compare_strings(argv[i], "-w") == 0 && i + 1 < argc) {
+            options.workers = atoi(argv[++i]);
+            if (options.workers < 1) {
+                fprintf(stderr, "-w needs at least 1 worker\n");
+                return 1;
+            }
+        }
+        else if (argv[i][0] == '-') {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+        else {
+            input_name = argv[i];
+        }
+    }
+
+    // The per-function cache pays off across the compilations of a long lived context
+    if (options.incremental > 0 && serve_path == NULL && compile_list == NULL && !language_server) {
+        fprintf(stderr, "-I only applies to -m, -D and -L\n");
+        return 1;
+    }
+
+    // Streaming never holds the whole program, which the optimizer, the backends and the other modes need
+    if (stream && (options.optimize || options.run || options.native || options.c || options.jit_threshold > 0 ||
+                   options.batch_name != NULL || compile_list != NULL || cache_dir != NULL || serve_path != NULL ||
+                   server_path != NULL || language_server || options.parallel > 1)) {
+        fprintf(stderr, "-T only compiles one file to TAC, it can't be combined with -O, -r, -p, -S, -C, -j, -b, -m, -k, -F, -D, -s or -L\n");
+        return 1;
+    }
+
+    // Serve an editor
+    if (language_server) {
+        return lsp_run(options);
+    }
+
+    // Serve compiles over a socket
+    if (serve_path != NULL) {
+        int workers = options.workers;
+        if (workers < 1) {
+            workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+            workers = (workers < 1) ? 1 : workers;
+        }
+        return server_run(serve_path, workers, options.incremental);
+    }
+
+    // Compile on a server
+    if (server_path != NULL) {
+        if (input_name == NULL) {
+            fprintf(stderr, "Usage: %s [-O] -s socket [-n requests [-w connections]] inputFile\n", argv[0]);
+            return 1;
+        }
+        if (requests > 0) {
+            return server_load_test(server_path, input_name, options.optimize, requests, options.workers < 1 ? 1 : options.workers);
+        }
+        return server_compile_remote(server_path, input_name, options.optimize);
+    }
+
+    // Open the cache, alone -k prints its stats
+    struct cache cache;
+    if (cache_dir != NULL) {
+        if (cache_open(&cache, cache_dir, cache_bytes)) {
+            return 1;
+        }
+        if (input_name == NULL && compile_list == NULL) {
+            cache_print_stats(&cache, stdout);
+            return 0;
+        }
+    }
+
+    // Compile many files instead of one
+    if (compile_list != NULL) {
+        if (output_dir == NULL || input_name != NULL) {
+            fprintf(stderr, "Usage: %s [-O] [-k cacheDir [-K megabytes]] [-I megabytes] [-F workers] -m inputDirOrList -o outputDir [-w workers]\n", argv[0]);
+            return 1;
+        }
+        if (options.run || options.native || options.c || options.jit_threshold > 0 || options.batch_name != NULL) {
+            fprintf(stderr, "-m only compiles to TAC, it can't be combined with -r, -p, -S, -C, -j or -b\n");
+            return 1;
+        }
+        int workers = options.workers;
+        if (workers < 1) {
+            workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+            workers = (workers < 1) ? 1 : workers;
+        }
+        return batch_compile_files(&options, cache_dir != NULL ? &cache : NULL, compile_list, output_dir, workers);
+    }
+
+    // Error handling for invalid use of function
+    if (input_name == NULL) {
+        fprintf(stderr, "Usage: %s [-O] [-P] [-F workers] [-r] [-p] [-S] [-C] [-j threshold] [-b batchFile [-w workers]] [-k cacheDir [-K megabytes]] inputFile\n", argv[0]);
+        fprintf(stderr, "       %s [-O] [-P] [-F workers] [-I megabytes] -m inputDirOrList -o outputDir [-w workers]\n", argv[0]);
+        fprintf(stderr, "       %s [-P] -T inputFile\n", argv[0]);
+        fprintf(stderr, "       %s -k cacheDir\n", argv[0]);
+        fprintf(stderr, "       %s [-I megabytes] -D socket [-w workers]\n", argv[0]);
+        fprintf(stderr, "       %s [-O] [-I megabytes] -L\n", argv[0]);
+        fprintf(stderr, "       %s [-O] -s socket [-n requests [-w connections]] inputFile\n", argv[0]);
+        return 1;
+    }
+
+    // Compile through the cache, or through the library for the parallel front end
+    if (cache_dir != NULL || options.parallel > 1) {
+        return compile_cached(&options, cache_dir != NULL ? &cache : NULL, input_name);
+    }
+
+    /******************************** Open Files ********************************/
+    // Open the input file 
+    FILE *input = fopen(input_name, "r");
+    if (!input) {
+        perror("Error opening input file");
+        return 1;
+    }
+
+    // Open/Create the error file
+    FILE *error_doc = fopen("error.txt", "w");
+    if (!error_doc) {
+        fclose(input);             // Close input file
+        perror("Error opening error output file");
+        return 1;
+    }
+
+    // Open/Create the output file (lex)
+    FILE *symbol_table_lex = fopen("symbol_table_lex.txt", "w");
+    if (!symbol_table_lex) {
+        fclose(input);             // Close input file
+        fclose(error_doc);         // Close error log file
+        perror("Error opening lexical output file");
+        return 1;
+    }
+
+    // Open/create the output file (syntax)
+    FILE *symbol_table_syn = fopen("symbol_table_syn.txt", "w");
+    if (!symbol_table_syn) {
+        fclose(input);             // Close input file
+        fclose(error_doc);         // Close error file
+        fclose(symbol_table_lex);  // Close lexical output file
+        perror("Error opening syntax output file");
+    }
+
+    // Open/create the output file (Semantic)
+    FILE *symbol_table_sem = fopen("symbol_table_sem.txt", "w");
+    if (!symbol_table_sem) {
+        fclose(input);             // Close input file
+        fclose(error_doc);         // Close error file
+        fclose(symbol_table_lex);  // Close lexical output file
+        fclose(symbol_table_syn);  // Close Syntax output file
+        perror("Error opening semantic output file");
+    }
+
+    // Open/create the output file (Three Address Code) before the analysis when it streams functions to it
+    FILE* tac_stream = NULL;
+    if (stream) {
+        tac_stream = fopen("tac.txt", "w");
+        if (!tac_stream) {
+            fclose(input);             // Close input file
+            fclose(error_doc);         // Close error file
+            fclose(symbol_table_lex);  // Close lexical output file
+            fclose(symbol_table_syn);  // Close Syntax output file
+            fclose(symbol_table_sem);  // Close Semantic output file
+            perror("Error opening tac file");
+            return 1;
+        }
+    }
+
+    struct compiler_context* compiler = compiler_new(options);
+    if (compiler == NULL || (stream && compiler_stream(compiler))) {
+        fprintf(stderr, "Error: out of memory\n");
+        return 1;
+    }
+    compiler->tac_table = tac_stream;
+    compiler->input = input;
+    compiler->error_doc = error_doc;
+    compiler->symbol_table_lex = symbol_table_lex;
+    compiler->symbol_table_syn = symbol_table_syn;
+    compiler->symbol_table_sem = symbol_table_sem;
+
+    /******************************** Analysis ********************************/
+    if (compiler_analyze(compiler) != 0) {
+        // If file is empty end program
+        fclose(input);
+        fclose(error_doc);
+        fclose(symbol_table_lex);
+        fclose(symbol_table_syn);
+        fclose(symbol_table_sem);
+        if (tac_stream) {
+            fclose(tac_stream);
+        }
+        compiler_free(compiler);
+        return 0;
+    }
+
+    // Close Files
+    fclose(input);
+    fclose(error_doc);
+    fclose(symbol_table_lex);
+    fclose(symbol_table_syn);
+    fclose(symbol_table_sem);
+    compiler->input = NULL;
+    compiler->error_doc = NULL;
+    compiler->symbol_table_lex = NULL;
+    compiler->symbol_table_syn = NULL;
+    compiler->symbol_table_sem = NULL;
+    /**************** TAC generation ****************/
+    
+
+    // Open/Create the error file
+    error_doc = fopen("error.txt", "r");
+    if (!error_doc) {
+        perror("Error: opening error output file\n");
+        compiler_free(compiler);
+        return 1;
+    }
+
+    // Check if the file is empty
+    int first_char = fgetc(error_doc);
+    if (first_char == EOF && feof(error_doc)) {
+        // error.txt file is empty therefore source code has no errors
+        // Open/create the output file (Three Address Code), unless the functions are already streaming to it
+        FILE* tac_table = tac_stream ? tac_stream : fopen("tac.txt", "w");
+        if (!tac_table) {
+            fclose(error_doc);         // Close error file
+            perror("Error opening tac file");
+            compiler_free(compiler);
+            return 1;
+        }
+        compiler->tac_table = tac_table;
+
+        // Open/create the optimization report
+        if (options.optimize) {
+            compiler->opt_report = fopen("opt_report.txt", "w");
+            if (!compiler->opt_report) {
+                perror("Error opening optimization report file");
+            }
+        }
+
+        // TAC functions
+        compiler_generate(compiler);
+        if (compiler->opt_report) {
+            fclose(compiler->opt_report);
+            compiler->opt_report = NULL;
+        }
+        fclose(tac_table);
+        compiler->tac_table = NULL;
+
+        run_backends(&options, compiler_program(compiler));
+    }
+    else {
+        ungetc(first_char, error_doc); // Return the character to the stream
+        printf("Please resolve all errors in error.txt to generate TAC\n");
+
+        // The functions streamed before the first error don't translate the source, empty tac.txt of them
+        if (tac_stream) {
+            tac_stream = freopen("tac.txt", "w", tac_stream);
+            if (tac_stream) {
+                fclose(tac_stream);
+            }
+            compiler->tac_table = NULL;
+        }
+    }
+
+    // Close error doc
+    fclose(error_doc);
+    
+    // Delete abstract syntax tree and the TAC
+    compiler_free(compiler);
+
+    return 0;
+}
+#endif // COMPILER_LIBRARY
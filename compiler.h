@@ -0,0 +1,84 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include <stddef.h>
+
+// Library interface of the compiler. A compilation keeps all its state in its own compiler_context, so
+// compilations on different threads run concurrently in one process. Build compiler.c with -DCOMPILER_LIBRARY
+// to leave out the command line main and link it into the embedding program.
+
+/******************************** Library Definitions ********************************/
+// In-memory outputs of compiler_compile, each holds what the command line writes to the file named
+#define COMPILER_OUT_LEX     0       // symbol_table_lex.txt
+#define COMPILER_OUT_SYN     1       // symbol_table_syn.txt
+#define COMPILER_OUT_SEM     2       // symbol_table_sem.txt
+#define COMPILER_OUT_ERRORS  3       // error.txt, the diagnostics
+#define COMPILER_OUT_TAC     4       // tac.txt
+#define COMPILER_OUT_REPORT  5       // opt_report.txt
+#define COMPILER_NUM_OUTPUTS 6
+
+/******************************** Struct Definitions ********************************/
+// Options of a compilation, the command line flags. Only optimize changes what compiler_compile produces,
+// incremental, pipeline and parallel how fast it does, the rest select what the command line does with the TAC afterwards.
+struct compiler_options{
+    int optimize;                    // -O: run the TAC optimization passes
+    int run;                         // -r: execute the program on the VM
+    int profile;                     // -p: execute the program with opcode pair counts
+    char* batch_name;                // -b: batch input file, NULL if not batch running
+    int workers;                     // -w: worker threads to run the batch rows on, 0 for lockstep
+    int native;                      // -S: compile the program to an x86-64 executable
+    int c;                           // -C: translate the program to C and build it
+    long long jit_threshold;         // -j: calls after which the JIT compiles a function, 0 for no JIT
+    long long incremental;           // -I: bytes of per-function cache the context keeps across compilations, 0
+                                     // for none. With it a compilation replays the def ... fed blocks it has seen
+    int pipeline;                    // -P: lex on a second thread that hands tokens to the parser through a ring.
+                                     // Not with incremental, whose blocks are lexed and parsed in step
+    int parallel;                    // -F: threads to parse and check the def ... fed blocks on before the
+                                     // compilation analyzes the source in order, 0 or 1 for none
+};
+
+// How much of the last compilation was redone, and how long it took
+struct compiler_stats{
+    long long nodes;                 // Nodes of the syntax tree
+    long long reused_nodes;          // Of them, nodes of the <fdec> subtrees replayed from the per-function cache
+    size_t lexed_bytes;              // Source bytes lexed and parsed, the rest was replayed
+    double analyze_seconds;          // Time lexing, parsing and checking took
+    double seconds;                  // Time the whole compilation took, TAC included
+};
+
+struct compiler_context;
+struct tac_program;
+
+/******************************** Functions ********************************/
+// A context for compilations with options, NULL if out of memory
+struct compiler_context* compiler_new(struct compiler_options options);
+
+// Compiles length bytes of source into TAC, replacing what the context held. Returns 0 when the TAC was
+// generated, or 1 when the source is empty or has errors, which the COMPILER_OUT_ERRORS output lists. With the
+// incremental option the outputs are the same as without it, only unchanged functions take less time.
+int compiler_compile(struct compiler_context* compiler, const char* source, size_t length);
+
+// Replaces removed bytes at offset of the source the context compiled last with length bytes of text and compiles
+// the result, as compiler_compile would. Needs the incremental option: only the blocks around the edit are looked
+// at again, the rest are replayed where they are. Returns -1 without compiling when the context has no
+// per-function cache, the range isn't inside the source or memory runs out
+int compiler_edit(struct compiler_context* compiler, size_t offset, size_t removed, const char* text, size_t length);
+
+// Text of one of the outputs of the last compilation, "" before the first. Stores its length when length is
+// not NULL. The text belongs to the context.
+const char* compiler_output(struct compiler_context* compiler, int which, size_t* length);
+
+// TAC of the last compilation, NULL when it had errors. The program belongs to the context.
+struct tac_program* compiler_program(struct compiler_context* compiler);
+
+// Finds where the id at 0-based line and column of the last compiled source is declared, from the scope tables of
+// its functions and of main, storing the 0-based line and column of the declaration. Needs the incremental option,
+// which keeps the source. Returns 0, or 1 if there is no id there or it isn't declared
+int compiler_definition(struct compiler_context* compiler, int line, int column, int* def_line, int* def_column);
+
+// Stores what the last compilation reused and how long it took
+void compiler_stats(struct compiler_context* compiler, struct compiler_stats* stats);
+
+void compiler_free(struct compiler_context* compiler);
+
+#endif // COMPILER_H
@@ -0,0 +1,91 @@
+#ifndef DEQUE_H
+#define DEQUE_H
+
+#include <stdatomic.h>
+
+// Chase-Lev work stealing deque of pointers, shared by the execution service's workers and the threads of the
+// parallel front end. Only the owner pushes and pops at the bottom, any thread steals at the top. The items sit in
+// a ring of a fixed power of 2 size, so a push onto a full deque fails instead of growing it. NULL is never an
+// item: pop and steal return it when they got nothing.
+
+/******************************** Struct Definitions ********************************/
+struct deque{
+    atomic_llong top;                // Next item to steal
+    atomic_llong bottom;             // One past the owner's last item
+    _Atomic(void*)* items;           // Ring of capacity items
+    long long capacity;              // A power of 2
+};
+
+/******************************** Functions ********************************/
+// Makes an empty deque with room for at least capacity items, returns 0 or 1 if out of memory
+int deque_init(struct deque* deque, long long capacity){
+    deque->capacity = 1;
+    while (deque->capacity < capacity) {
+        deque->capacity *= 2;
+    }
+    deque->items = malloc(sizeof(_Atomic(void*)) * deque->capacity);
+    atomic_init(&deque->top, 0);
+    atomic_init(&deque->bottom, 0);
+    return deque->items == NULL;
+}
+
+void deque_free(struct deque* deque){
+    free(deque->items);
+    deque->items = NULL;
+}
+
+// Owner end: push returns 0 when the deque is full
+int deque_push(struct deque* deque, void* item){
+    long long bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+    long long top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    if (bottom - top >= deque->capacity) {
+        return 0;
+    }
+    atomic_store_explicit(&deque->items[bottom & (deque->capacity - 1)], item, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    return 1;
+}
+
+// Owner end: takes the newest item, NULL if empty or a thief won the last one
+void* deque_pop(struct deque* deque){
+    long long bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long long top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+    if (top > bottom) {
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+        return NULL;
+    }
+    void* item = atomic_load_explicit(&deque->items[bottom & (deque->capacity - 1)], memory_order_relaxed);
+    if (top == bottom) {
+        // Last item, race the thieves for it
+        if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed)) {
+            item = NULL;
+        }
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    }
+    return item;
+}
+
+// Thief end: takes the oldest item, NULL if empty or another thief or the owner got it first
+void* deque_steal(struct deque* deque){
+    long long top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long long bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+    if (top >= bottom) {
+        return NULL;
+    }
+    void* item = atomic_load_explicit(&deque->items[top & (deque->capacity - 1)], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed)) {
+        return NULL;
+    }
+    return item;
+}
+
+// True(1) if the deque looked non-empty, a hint that can be stale by the time it returns
+int deque_pending(struct deque* deque){
+    return atomic_load_explicit(&deque->top, memory_order_relaxed) < atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+}
+
+#endif // DEQUE_H
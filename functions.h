@@ -56,6 +56,7 @@ struct function{
 struct global{
     struct function *functions;     //
     int num_functions;              //
+    int capacity;                   // Functions the array has room for
     struct scope my_scope;          //
 };
 
@@ -0,0 +1,675 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include <stdint.h>
+
+// Per-function cache: kept by a compiler_context across compilations, it holds what analyzing and generating each
+// def ... fed ; block that checked without errors did. An entry is found by the block's source text and the parser
+// and semantic state it started in, and is only used while every function the block looked up by name (its calls
+// and its own name) still resolves to the same signature. Using an entry replays the block instead of lexing it:
+// its symbol table text, its <fdec> subtree, its function and scope and the flags it left behind, with line
+// numbers moved to where the block now starts. Its TAC is reused the same way with temps and labels renumbered, so
+// a compilation that reuses entries writes the same outputs as one that starts cold. Subtrees and scopes belong
+// to the cache, which lends them to the compilations that use them. Once the entries pass the size cap, the ones
+// not used by the latest compilation are freed, least recently used first.
+//
+// The cache also keeps the source of the latest compilation and where its blocks lie, so an edit to a byte range
+// of it looks for blocks again only from the block before the edit until the blocks line up with the old ones
+// shifted past it. The blocks outside that stretch go straight to their entries without hashing their text.
+
+/******************************** Incremental Definitions ********************************/
+// Where the parser is when a block starts
+#define INCREMENTAL_AT_START     1   // At <progs>, the block is the first thing in the source
+#define INCREMENTAL_AFTER_FDEC   2   // At the <fdecls> of the block before, with its ; matched
+
+#define INCREMENTAL_NUM_OUTPUTS  3   // Symbol tables a block writes to: lex, syn and sem
+#define INCREMENTAL_MIN_BUCKETS  256 //
+
+/******************************** Struct Definitions ********************************/
+// Parser position and semantic flags between blocks
+struct incremental_state{
+    int position;                    // INCREMENTAL_AT_START or INCREMENTAL_AFTER_FDEC
+    int var_type;                    //
+    int type_flag;                   //
+    int type_depth;                  //
+    int check_negative;              //
+};
+
+// A function looked up by name while a block was checked, and what the lookup found
+struct incremental_dep{
+    char* name;                      //
+    int found;                       // True(1) if a function defined before the block had the name
+    int return_type;                 // Signature of the function found
+    int num_params;                  //
+    int* param_types;                //
+};
+
+// What analyzing and generating one block did
+struct incremental_entry{
+    uint64_t hash;                   // Hash of text and state
+    struct incremental_entry* next;  // Next entry of the same bucket
+    char* text;                      // Source of the block, def up to its ; and the newline after it
+    size_t length;                   //
+    struct incremental_state state;  // State the block started in
+    struct incremental_dep* deps;    // Functions it looked up
+    int num_deps;                    //
+    long long used;                  // Last compilation that used the entry
+    long long bytes;                 // Memory held, for the size cap
+
+    // Analysis
+    int line;                        // Line the block started on, which texts and function hold
+    int newlines;                    // Lines the block spans
+    char* texts[INCREMENTAL_NUM_OUTPUTS];
+    size_t lengths[INCREMENTAL_NUM_OUTPUTS];
+    struct node* fdec;               // <fdec> subtree
+    long long nodes;                 // Nodes of the subtree
+    int semicolon_type;              // Type the ; after it was matched with
+    struct function function;        // Function the block defines, with its scope
+    struct incremental_state out;    // Flags the block left behind
+
+    // TAC
+    int has_tac;                     // True(1) once tac holds the TAC of the function
+    struct tac_function tac;         // Temps numbered from temp_base and labels from label_base
+    int temp_base;                   //
+    int temps;                       // Temps the function took
+    int label_base;                  //
+    int labels;                      // Labels the function took
+    int tac_type_in;                 // Generation state the function started in
+    int stack_mem_in;                //
+    int tac_type_out;                // Generation state it left behind
+    int stack_mem_out;               //
+    int memory_out;                  //
+};
+
+// Where a block of the latest compilation lies in its source, with the entry it replayed or stored, NULL if none
+struct incremental_span{
+    size_t start;                    //
+    size_t end;                      //
+    struct incremental_entry* entry; //
+};
+
+// A block of the current compilation that replayed or stored an entry, with the <fdecls> node it hangs from
+struct incremental_use{
+    struct node* fdecls;             //
+    struct incremental_entry* entry; //
+    int function;                    // Index in global_scope.functions of the entry's function
+};
+
+struct incremental_cache{
+    long long max_bytes;             // Size cap of all entries together
+    long long bytes;                 //
+    struct incremental_entry** buckets;
+    int num_buckets;                 // Power of two
+    int num_entries;                 //
+    long long generation;            // Compilations started, stamps the entries each uses
+    struct incremental_use* uses;    // Blocks of the current compilation using an entry, in source order
+    int num_uses;                    //
+    int capacity;                    //
+    int next_use;                    // Use TAC generation reaches next
+
+    // Lookups of the block being analyzed
+    int recording;                   // True(1) while the block is analyzed to be stored
+    int lookup_base;                 // Functions defined before the block
+    struct incremental_dep* deps;    //
+    int num_deps;                    //
+    int deps_capacity;               //
+    int* names;                      // First global function of each name, an open addressing table of their
+                                     // indices with -1 for empty slots, so checking a dep doesn't scan them all
+    int names_capacity;              // Power of two
+    int num_indexed;                 // Global functions added to names so far
+
+    // Edits
+    char* source;                    // Source of the latest compilation, which edits apply to
+    size_t length;                   //
+    size_t source_capacity;          //
+    struct incremental_span* spans;  // Blocks of the latest compilation, in source order
+    int num_spans;                   //
+    int spans_capacity;              //
+    int spans_known;                 // True(1) when an edit left spans matching source, so they aren't looked for
+
+    long long hits;                  // Blocks replayed from an entry
+    long long misses;                // Blocks analyzed
+    long long reused_nodes;          // Nodes of the subtrees the current compilation replayed
+};
+
+/******************************** Entries ********************************/
+uint64_t incremental_hash(const char* text, size_t length, struct incremental_state* state){
+    uint64_t hash = cache_hash(text, length, 0);
+    hash = cache_merge(hash, (uint64_t)state->position);
+    hash = cache_merge(hash, (uint64_t)state->var_type);
+    hash = cache_merge(hash, (uint64_t)state->type_flag);
+    hash = cache_merge(hash, (uint64_t)state->type_depth);
+    return cache_merge(hash, (uint64_t)state->check_negative);
+}
+
+int incremental_same_state(struct incremental_state* a, struct incremental_state* b){
+    return a->position == b->position && a->var_type == b->var_type && a->type_flag == b->type_flag &&
+           a->type_depth == b->type_depth && a->check_negative == b->check_negative;
+}
+
+struct incremental_cache* incremental_new(long long max_bytes){
+    struct incremental_cache* cache = calloc(1, sizeof(struct incremental_cache));
+    if (cache == NULL) {
+        return NULL;
+    }
+    cache->max_bytes = max_bytes;
+    cache->num_buckets = INCREMENTAL_MIN_BUCKETS;
+    cache->buckets = calloc(cache->num_buckets, sizeof(struct incremental_entry*));
+    if (cache->buckets == NULL) {
+        free(cache);
+        return NULL;
+    }
+    return cache;
+}
+
+// Entry for the block text started in state, NULL if there is none
+struct incremental_entry* incremental_find(struct incremental_cache* cache, const char* text, size_t length, struct incremental_state* state, uint64_t hash){
+    struct incremental_entry* entry = cache->buckets[hash & (cache->num_buckets - 1)];
+    for (; entry != NULL; entry = entry->next) {
+        if (entry->hash != hash || entry->length != length || !incremental_same_state(&entry->state, state)) {
+            continue;
+        }
+        size_t i = 0;
+        while (i < length && entry->text[i] == text[i]) {
+            i++;
+        }
+        if (i == length) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+uint64_t incremental_name_hash(const char* name){
+    size_t length = 0;
+    while (name[length] != '\0') {
+        length++;
+    }
+    return cache_hash(name, length, 0);
+}
+
+// Empties the table of names for the next compilation
+void incremental_clear_names(struct incremental_cache* cache){
+    for (int i = 0; i < cache->names_capacity; i++) {
+        cache->names[i] = -1;
+    }
+    cache->num_indexed = 0;
+}
+
+// Adds the functions global defined since the last call to the table of names. Only called between blocks, where
+// every function of global has its name
+void incremental_index(struct incremental_cache* cache, struct global* global){
+    if (cache->names == NULL || global->num_functions * 2 > cache->names_capacity) {
+        int capacity = (cache->names_capacity == 0) ? INCREMENTAL_MIN_BUCKETS : cache->names_capacity;
+        while (global->num_functions * 2 > capacity) {
+            capacity *= 2;
+        }
+        int* names = realloc(cache->names, sizeof(int) * capacity);
+        if (names == NULL) {
+            return;
+        }
+        cache->names = names;
+        cache->names_capacity = capacity;
+        incremental_clear_names(cache);
+    }
+    int mask = cache->names_capacity - 1;
+    for (; cache->num_indexed < global->num_functions; cache->num_indexed++) {
+        const char* name = global->functions[cache->num_indexed].lexeme;
+        if (name == NULL) {
+            continue;
+        }
+        int slot = (int)(incremental_name_hash(name) & mask);
+        while (cache->names[slot] != -1 && compare_strings(global->functions[cache->names[slot]].lexeme, name) != 0) {
+            slot = (slot + 1) & mask;
+        }
+        if (cache->names[slot] == -1) {
+            cache->names[slot] = cache->num_indexed;
+        }
+    }
+}
+
+// First function of global named name, NULL if there is none
+struct function* incremental_lookup(struct incremental_cache* cache, struct global* global, const char* name){
+    if (cache->names == NULL || cache->num_indexed < global->num_functions) {
+        // Out of memory for the table, scan
+        for (int i = 0; i < global->num_functions; i++) {
+            if (global->functions[i].lexeme != NULL && compare_strings(global->functions[i].lexeme, name) == 0) {
+                return &global->functions[i];
+            }
+        }
+        return NULL;
+    }
+    int mask = cache->names_capacity - 1;
+    int slot = (int)(incremental_name_hash(name) & mask);
+    while (cache->names[slot] != -1) {
+        if (compare_strings(global->functions[cache->names[slot]].lexeme, name) == 0) {
+            return &global->functions[cache->names[slot]];
+        }
+        slot = (slot + 1) & mask;
+    }
+    return NULL;
+}
+
+// True(1) if every function the entry's block looked up resolves in global as it did when the block was checked
+int incremental_valid(struct incremental_cache* cache, struct incremental_entry* entry, struct global* global){
+    incremental_index(cache, global);
+    for (int i = 0; i < entry->num_deps; i++) {
+        struct incremental_dep* dep = &entry->deps[i];
+        struct function* function = incremental_lookup(cache, global, dep->name);
+        if (function == NULL || !dep->found) {
+            if (function != NULL || dep->found) {
+                return 0;
+            }
+            continue;
+        }
+        if (function->return_type != dep->return_type || function->num_params != dep->num_params) {
+            return 0;
+        }
+        for (int p = 0; p < dep->num_params; p++) {
+            if (function->param_types[p] != dep->param_types[p]) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+// Notes that the block being analyzed looked name up and found global->functions[index], -1 if it found nothing.
+// The function the block defines counts as nothing, as the entry is only used where it is the first of its name
+void incremental_note(struct incremental_cache* cache, struct global* global, const char* name, int index){
+    if (cache == NULL || !cache->recording) {
+        return;
+    }
+    if (cache->num_deps == cache->deps_capacity) {
+        cache->deps_capacity = (cache->deps_capacity == 0) ? 8 : cache->deps_capacity * 2;
+        cache->deps = realloc(cache->deps, sizeof(struct incremental_dep) * cache->deps_capacity);
+    }
+    struct incremental_dep* dep = &cache->deps[cache->num_deps++];
+    dep->name = copy_string(name);
+    dep->found = (index >= 0 && index < cache->lookup_base);
+    dep->return_type = -1;
+    dep->num_params = 0;
+    dep->param_types = NULL;
+    if (dep->found) {
+        struct function* function = &global->functions[index];
+        dep->return_type = function->return_type;
+        dep->num_params = function->num_params;
+        dep->param_types = malloc(sizeof(int) * (function->num_params + 1));
+        for (int p = 0; p < function->num_params; p++) {
+            dep->param_types[p] = function->param_types[p];
+        }
+    }
+}
+
+void incremental_free_deps(struct incremental_dep* deps, int num_deps){
+    for (int i = 0; i < num_deps; i++) {
+        free(deps[i].name);
+        free(deps[i].param_types);
+    }
+}
+
+// Counts the nodes of a subtree
+long long incremental_count_nodes(struct node* root){
+    long long count = 1;
+    if (root->children != NULL) {
+        for (int i = 0; i < root->size; i++) {
+            count += incremental_count_nodes(root->children[i]);
+        }
+    }
+    return count;
+}
+
+void incremental_free_tree(struct node* root){
+    if (root->children != NULL) {
+        for (int i = 0; i < root->size; i++) {
+            incremental_free_tree(root->children[i]);
+        }
+        free(root->children);
+    }
+    free(root->lexeme);
+    free(root);
+}
+
+void incremental_free_entry(struct incremental_entry* entry){
+    free(entry->text);
+    incremental_free_deps(entry->deps, entry->num_deps);
+    free(entry->deps);
+    for (int i = 0; i < INCREMENTAL_NUM_OUTPUTS; i++) {
+        free(entry->texts[i]);
+    }
+    if (entry->fdec != NULL) {
+        incremental_free_tree(entry->fdec);
+    }
+    struct scope* scope = entry->function.my_scope;
+    if (scope != NULL) {
+        for (int i = 0; i < scope->num_vars; i++) {
+            free(scope->local_vars[i].lexeme);
+        }
+        free(scope->local_vars);
+        free(scope);
+    }
+    free(entry->function.lexeme);
+    free(entry->function.param_types);
+    free(entry->tac.instrs);
+    free(entry->tac.locals);
+    free(entry);
+}
+
+// Unlinks an entry, which then belongs to the caller
+void incremental_take(struct incremental_cache* cache, struct incremental_entry* entry){
+    struct incremental_entry** link = &cache->buckets[entry->hash & (cache->num_buckets - 1)];
+    while (*link != entry) {
+        link = &(*link)->next;
+    }
+    *link = entry->next;
+    entry->next = NULL;
+    cache->bytes -= entry->bytes;
+    cache->num_entries--;
+}
+
+// Unlinks an entry and frees it
+void incremental_remove(struct incremental_cache* cache, struct incremental_entry* entry){
+    incremental_take(cache, entry);
+    incremental_free_entry(entry);
+}
+
+// Adds an entry, which no other entry has the text and state of
+void incremental_insert(struct incremental_cache* cache, struct incremental_entry* entry){
+    if (cache->num_entries >= cache->num_buckets) {
+        // Double the buckets once they average an entry each
+        int num_buckets = cache->num_buckets * 2;
+        struct incremental_entry** buckets = calloc(num_buckets, sizeof(struct incremental_entry*));
+        if (buckets != NULL) {
+            for (int b = 0; b < cache->num_buckets; b++) {
+                struct incremental_entry* moved = cache->buckets[b];
+                while (moved != NULL) {
+                    struct incremental_entry* next = moved->next;
+                    moved->next = buckets[moved->hash & (num_buckets - 1)];
+                    buckets[moved->hash & (num_buckets - 1)] = moved;
+                    moved = next;
+                }
+            }
+            free(cache->buckets);
+            cache->buckets = buckets;
+            cache->num_buckets = num_buckets;
+        }
+    }
+    struct incremental_entry** bucket = &cache->buckets[entry->hash & (cache->num_buckets - 1)];
+    entry->next = *bucket;
+    *bucket = entry;
+    cache->bytes += entry->bytes;
+    cache->num_entries++;
+}
+
+// Records that the block under fdecls uses entry in the current compilation, defining global function number function
+void incremental_use(struct incremental_cache* cache, struct node* fdecls, struct incremental_entry* entry, int function){
+    if (cache->num_uses == cache->capacity) {
+        cache->capacity = (cache->capacity == 0) ? 64 : cache->capacity * 2;
+        cache->uses = realloc(cache->uses, sizeof(struct incremental_use) * cache->capacity);
+    }
+    cache->uses[cache->num_uses].fdecls = fdecls;
+    cache->uses[cache->num_uses].entry = entry;
+    cache->uses[cache->num_uses].function = function;
+    cache->num_uses++;
+    entry->used = cache->generation;
+}
+
+// True(1) for the chars the lexer skips between tokens
+int incremental_space(int c){
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// True(1) for the chars of keywords and ids
+int incremental_word(int c){
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+}
+
+// Length of prefix if text starts with it, otherwise 0
+size_t incremental_match(const char* text, size_t length, const char* prefix){
+    size_t i = 0;
+    while (prefix[i] != '\0') {
+        if (i >= length || text[i] != prefix[i]) {
+            return 0;
+        }
+        i++;
+    }
+    return i;
+}
+
+// Moves the line numbers of an entry to a block starting on line. The sem table prints lines only after "Line: "
+// and "Line Number: ", which no lexeme can contain
+void incremental_relocate(struct incremental_cache* cache, struct incremental_entry* entry, int line){
+    int delta = line - entry->line;
+    const char* text = entry->texts[2];
+    size_t length = entry->lengths[2];
+    char* moved = malloc(length * 2 + 64);
+    size_t size = 0;
+    for (size_t i = 0; i < length;) {
+        size_t skip = incremental_match(text + i, length - i, "Line: ");
+        if (skip == 0) {
+            skip = incremental_match(text + i, length - i, "Line Number: ");
+        }
+        if (skip == 0 || i + skip >= length || text[i + skip] < '0' || text[i + skip] > '9') {
+            moved[size++] = text[i++];
+            continue;
+        }
+        for (size_t k = 0; k < skip; k++) {
+            moved[size++] = text[i++];
+        }
+        int number = 0;
+        while (i < length && text[i] >= '0' && text[i] <= '9') {
+            number = number * 10 + (text[i++] - '0');
+        }
+        size += snprintf(moved + size, 24, "%d", number + delta);
+    }
+    free(entry->texts[2]);
+    entry->texts[2] = moved;
+    cache->bytes += (long long)size - (long long)entry->lengths[2];
+    entry->bytes += (long long)size - (long long)entry->lengths[2];
+    entry->lengths[2] = size;
+
+    entry->function.line += delta;
+    struct scope* scope = entry->function.my_scope;
+    for (int i = 0; i < scope->num_vars; i++) {
+        scope->local_vars[i].line += delta;
+    }
+    entry->line = line;
+}
+
+// Frees the least recently used entries not used by the current compilation until the cache is back under its cap
+void incremental_evict(struct incremental_cache* cache){
+    if (cache->bytes <= cache->max_bytes) {
+        return;
+    }
+    while (cache->bytes > cache->max_bytes) {
+        struct incremental_entry** oldest = NULL;
+        for (int b = 0; b < cache->num_buckets; b++) {
+            for (struct incremental_entry** link = &cache->buckets[b]; *link != NULL; link = &(*link)->next) {
+                if ((*link)->used < cache->generation && (oldest == NULL || (*link)->used < (*oldest)->used)) {
+                    oldest = link;
+                }
+            }
+        }
+        if (oldest == NULL) {
+            return;
+        }
+        // Free every entry last used by that compilation in one pass
+        long long used = (*oldest)->used;
+        for (int b = 0; b < cache->num_buckets; b++) {
+            struct incremental_entry** link = &cache->buckets[b];
+            while (*link != NULL) {
+                struct incremental_entry* entry = *link;
+                if (entry->used == used) {
+                    *link = entry->next;
+                    cache->bytes -= entry->bytes;
+                    cache->num_entries--;
+                    incremental_free_entry(entry);
+                }
+                else {
+                    link = &entry->next;
+                }
+            }
+        }
+    }
+}
+
+void incremental_free(struct incremental_cache* cache){
+    if (cache == NULL) {
+        return;
+    }
+    for (int b = 0; b < cache->num_buckets; b++) {
+        struct incremental_entry* entry = cache->buckets[b];
+        while (entry != NULL) {
+            struct incremental_entry* next = entry->next;
+            incremental_free_entry(entry);
+            entry = next;
+        }
+    }
+    free(cache->buckets);
+    free(cache->uses);
+    free(cache->names);
+    free(cache->source);
+    free(cache->spans);
+    incremental_free_deps(cache->deps, cache->num_deps);
+    free(cache->deps);
+    free(cache);
+}
+
+/******************************** Edits ********************************/
+// Replaces removed bytes of the kept source at offset with length bytes of text. Returns 1 if out of memory
+int incremental_splice(struct incremental_cache* cache, size_t offset, size_t removed, const char* text, size_t length){
+    size_t new_length = cache->length - removed + length;
+    if (new_length + 1 > cache->source_capacity) {
+        size_t capacity = (cache->source_capacity == 0) ? 4096 : cache->source_capacity;
+        while (capacity < new_length + 1) {
+            capacity *= 2;
+        }
+        char* source = realloc(cache->source, capacity);
+        if (source == NULL) {
+            return 1;
+        }
+        cache->source = source;
+        cache->source_capacity = capacity;
+    }
+    // Move the tail after the removed bytes to where the text ends, then write the text
+    size_t tail = cache->length - offset - removed;
+    if (length != removed && tail > 0) {
+        char* from = cache->source + offset + removed;
+        char* to = cache->source + offset + length;
+        if (to < from) {
+            for (size_t i = 0; i < tail; i++) {
+                to[i] = from[i];
+            }
+        }
+        else {
+            for (size_t i = tail; i > 0; i--) {
+                to[i - 1] = from[i - 1];
+            }
+        }
+    }
+    for (size_t i = 0; i < length; i++) {
+        cache->source[offset + i] = text[i];
+    }
+    cache->length = new_length;
+    cache->source[new_length] = '\0';
+    return 0;
+}
+
+// Adds a block to the end of the spans
+void incremental_add_span(struct incremental_cache* cache, size_t start, size_t end, struct incremental_entry* entry){
+    if (cache->num_spans == cache->spans_capacity) {
+        cache->spans_capacity = (cache->spans_capacity == 0) ? 64 : cache->spans_capacity * 2;
+        cache->spans = realloc(cache->spans, sizeof(struct incremental_span) * cache->spans_capacity);
+    }
+    cache->spans[cache->num_spans].start = start;
+    cache->spans[cache->num_spans].end = end;
+    cache->spans[cache->num_spans].entry = entry;
+    cache->num_spans++;
+}
+
+// Clears the spans that point at an entry about to be freed
+void incremental_forget(struct incremental_cache* cache, struct incremental_entry* entry){
+    for (int i = 0; i < cache->num_spans; i++) {
+        if (cache->spans[i].entry == entry) {
+            cache->spans[i].entry = NULL;
+        }
+    }
+}
+
+/******************************** TAC ********************************/
+// True(1) if the instruction's label field holds a label
+int incremental_has_label(int op){
+    return op == TAC_LABEL || op == TAC_GOTO || op == TAC_IFZ || op == TAC_IF;
+}
+
+// Stores a copy of the TAC generated for the entry's function, which took the temps and labels from temp_base and
+// label_base on. Returns 1 without storing if it uses any outside them
+int incremental_capture_tac(struct incremental_cache* cache, struct incremental_entry* entry, struct tac_function* function, int temp_base, int temps, int label_base, int labels){
+    for (int i = 0; i < function->num_instrs; i++) {
+        struct tac_instr* instr = &function->instrs[i];
+        struct tac_operand* operands[3] = {&instr->dest, &instr->arg1, &instr->arg2};
+        for (int o = 0; o < 3; o++) {
+            if (operands[o]->kind == TAC_TEMP && (operands[o]->temp < temp_base || operands[o]->temp >= temp_base + temps)) {
+                return 1;
+            }
+        }
+        if (incremental_has_label(instr->op) && (instr->label < label_base || instr->label >= label_base + labels)) {
+            return 1;
+        }
+    }
+    free(entry->tac.instrs);
+    free(entry->tac.locals);
+    entry->tac = *function;
+    entry->tac.capacity = function->num_instrs;
+    entry->tac.instrs = malloc(sizeof(struct tac_instr) * (function->num_instrs + 1));
+    for (int i = 0; i < function->num_instrs; i++) {
+        entry->tac.instrs[i] = function->instrs[i];
+    }
+    if (function->locals != NULL) {
+        entry->tac.locals = malloc(sizeof(char*) * (function->num_locals + 1));
+        for (int i = 0; i < function->num_locals; i++) {
+            entry->tac.locals[i] = function->locals[i];
+        }
+    }
+    long long bytes = sizeof(struct tac_instr) * (long long)function->num_instrs + sizeof(char*) * (long long)function->num_locals;
+    if (entry->has_tac) {
+        bytes -= sizeof(struct tac_instr) * (long long)entry->tac.num_instrs + sizeof(char*) * (long long)entry->tac.num_locals;
+    }
+    entry->bytes += bytes;
+    cache->bytes += bytes;
+    entry->has_tac = 1;
+    entry->temp_base = temp_base;
+    entry->temps = temps;
+    entry->label_base = label_base;
+    entry->labels = labels;
+    return 0;
+}
+
+// A new TAC function holding the entry's TAC with its temps numbered from temp_base and labels from label_base
+struct tac_function* incremental_copy_tac(struct incremental_entry* entry, int temp_base, int label_base){
+    struct tac_function* function = new_tac_function(entry->tac.name);
+    *function = entry->tac;
+    function->instrs = malloc(sizeof(struct tac_instr) * (entry->tac.num_instrs + 1));
+    for (int i = 0; i < entry->tac.num_instrs; i++) {
+        struct tac_instr instr = entry->tac.instrs[i];
+        struct tac_operand* operands[3] = {&instr.dest, &instr.arg1, &instr.arg2};
+        for (int o = 0; o < 3; o++) {
+            if (operands[o]->kind == TAC_TEMP) {
+                operands[o]->temp += temp_base - entry->temp_base;
+            }
+        }
+        if (incremental_has_label(instr.op)) {
+            instr.label += label_base - entry->label_base;
+        }
+        function->instrs[i] = instr;
+    }
+    if (entry->tac.locals != NULL) {
+        function->locals = malloc(sizeof(char*) * (entry->tac.num_locals + 1));
+        for (int i = 0; i < entry->tac.num_locals; i++) {
+            function->locals[i] = entry->tac.locals[i];
+        }
+    }
+    return function;
+}
+
+#endif // INCREMENTAL_H
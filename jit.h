@@ -0,0 +1,914 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <setjmp.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// JIT: compiles the bytecode of hot functions straight into x86-64 machine code in an mmap'd buffer while the
+// VM runs. Compiled code works on the same register frames as the interpreter, with the frame in %rbx and the
+// jit_context of the run in %r13, so a function can switch tiers between any two calls. Once a function has
+// been called jit_threshold times it is compiled along with every function it can reach, so compiled code only
+// ever calls compiled code, through call sites patched with the entries of their callees.
+
+/******************************** JIT Definitions ********************************/
+#define JIT_BUFFER_SIZE  (16 << 20)  // Bytes of machine code the JIT holds
+#define JIT_INSTR_ROOM   256         // Most bytes one VM instruction compiles to
+
+// Machine registers by their encoding
+#define JIT_RAX          0           //
+#define JIT_RCX          1           //
+#define JIT_RDX          2           //
+#define JIT_RBX          3           // Registers of the running frame
+#define JIT_RBP          5           //
+#define JIT_RSI          6           //
+#define JIT_RDI          7           //
+#define JIT_R13          13          // jit_context of the run
+#define JIT_XMM0         0           //
+#define JIT_XMM1         1           //
+
+// Condition codes
+#define JIT_B            0x2         //
+#define JIT_AE           0x3         //
+#define JIT_E            0x4         //
+#define JIT_NE           0x5         //
+#define JIT_A            0x7         //
+#define JIT_P            0xA         //
+#define JIT_NP           0xB         //
+#define JIT_L            0xC         //
+#define JIT_GE           0xD         //
+#define JIT_LE           0xE         //
+#define JIT_G            0xF         //
+
+// Condition code of each int comparison, in the order of TAC_LT to TAC_NE
+static const int jit_int_conditions[6] = {JIT_L, JIT_G, JIT_E, JIT_LE, JIT_GE, JIT_NE};
+
+/******************************** Struct Definitions ********************************/
+// What compiled code reaches through %r13
+struct jit_context{
+    union vm_value* stack_end;       // End of the register stack
+    long long frames_left;           // Calls that may still nest before stack overflow
+    struct vm_output* output;        // Where Print writes
+    const char* error;               // Runtime error that stopped the compiled code
+    char* error_function;            // Function it happened in
+    jmp_buf jump;                    // Where a runtime error returns to
+};
+
+// A rel32 in the buffer waiting for the code it reaches
+struct jit_patch{
+    int site;                        // Offset of the rel32
+    int target;                      // Function called, or pc jumped to within a function
+};
+
+struct jit{
+    unsigned char* code;             // mmap'd buffer, writable only while compiling
+    int size;                        // Bytes in use
+    int enter;                       // Offset of the thunk entering compiled code from C
+    int* entries;                    // Offset of each function's code, -1 until compiled
+    int* lengths;                    // Bytes of each function's code
+    double* seconds;                 // Time spent compiling each function
+    long long* tier_calls;           // Calls of each function when it was compiled
+    int* failed;                     // True(1) for functions that stay interpreted
+    int* order;                      // Functions in the order they were compiled
+    int num_compiled;                //
+    struct jit_patch* calls;         // Call sites of the functions being compiled
+    int num_calls;                   //
+    int call_capacity;               //
+};
+
+// Argument pushed for a call that has not been compiled yet
+struct jit_pending{
+    int reg;                         // VM register pushed
+    int type;                        // Type of the param it fills
+    int saved;                       // True(1) once the register was overwritten and its value moved to an argument slot
+};
+
+// State used while compiling one function
+struct jit_compiler{
+    struct jit* jit;                 //
+    struct vm_program* vm;           //
+    int f;                           // Index of the function
+    struct vm_function* function;    //
+    int* offsets;                    // Code offset of each pc
+    struct jit_patch* jumps;         // Jumps to resolve once every pc has its offset
+    int num_jumps;                   //
+    int* push_types;                 // Type of the param each PUSH fills
+    struct jit_pending* pending;     // Arguments waiting for their calls, innermost call last
+    int num_pending;                 //
+    int max_pending;                 // Most arguments waiting at once, each has a slot after the VM registers
+    int frame;                       // Registers of a compiled frame: the VM's, then the argument slots
+};
+
+/******************************** Encoding ********************************/
+void jit_byte(struct jit* jit, int value){
+    jit->code[jit->size++] = (unsigned char)value;
+}
+
+void jit_int32(struct jit* jit, int value){
+    for (int k = 0; k < 4; k++) {
+        jit_byte(jit, (value >> (8 * k)) & 0xFF);
+    }
+}
+
+void jit_int64(struct jit* jit, unsigned long long value){
+    for (int k = 0; k < 8; k++) {
+        jit_byte(jit, (int)((value >> (8 * k)) & 0xFF));
+    }
+}
+
+// Writes a rel32 at site reaching offset target
+void jit_patch32(struct jit* jit, int site, int target){
+    int relative = target - (site + 4);
+    for (int k = 0; k < 4; k++) {
+        jit->code[site + k] = (unsigned char)((relative >> (8 * k)) & 0xFF);
+    }
+}
+
+// Legacy prefix (0 for none), REX (when w is set or a register is r8 or above) and the opcode, 0x0Fxx for two bytes
+void jit_opcode(struct jit* jit, int prefix, int w, int opcode, int reg, int rm){
+    if (prefix != 0) {
+        jit_byte(jit, prefix);
+    }
+    if (w || reg >= 8 || rm >= 8) {
+        jit_byte(jit, 0x40 | (w << 3) | ((reg >> 3) << 2) | (rm >> 3));
+    }
+    if (opcode > 0xFF) {
+        jit_byte(jit, opcode >> 8);
+    }
+    jit_byte(jit, opcode & 0xFF);
+}
+
+// Instruction with a register (or opcode extension) and the memory operand [base + disp32]. The base is never
+// %rsp or %r12, which would need a SIB byte.
+void jit_mem(struct jit* jit, int prefix, int w, int opcode, int reg, int base, int disp){
+    jit_opcode(jit, prefix, w, opcode, reg, base);
+    jit_byte(jit, 0x80 | ((reg & 7) << 3) | (base & 7));
+    jit_int32(jit, disp);
+}
+
+// Instruction with two register operands, or a register and an opcode extension
+void jit_reg(struct jit* jit, int prefix, int w, int opcode, int reg, int rm){
+    jit_opcode(jit, prefix, w, opcode, reg, rm);
+    jit_byte(jit, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+void jit_mov_imm64(struct jit* jit, int reg, unsigned long long value){
+    jit_opcode(jit, 0, 1, 0xB8 + (reg & 7), 0, reg);
+    jit_int64(jit, value);
+}
+
+// Forward jump over code emitted next, returns the site to land
+int jit_skip(struct jit* jit, int condition){
+    jit_byte(jit, (condition < 0) ? 0xEB : 0x70 + condition);
+    jit_byte(jit, 0);
+    return jit->size - 1;
+}
+
+void jit_land(struct jit* jit, int site){
+    jit->code[site] = (unsigned char)(jit->size - (site + 1));
+}
+
+/******************************** Runtime ********************************/
+// Records a runtime error of compiled code and returns to jit_call_native
+void jit_fail(struct jit_context* context, const char* error, char* function){
+    context->error = error;
+    context->error_function = function;
+    longjmp(context->jump, 1);
+}
+
+// Calls the C function at address, the arguments are already in place
+void jit_call_c(struct jit* jit, void* address){
+    jit_mov_imm64(jit, JIT_RAX, (unsigned long long)(uintptr_t)address);
+    jit_reg(jit, 0, 0, 0xFF, 2, JIT_RAX);
+}
+
+// Stops the run with error, the stack is aligned at every point this is emitted
+void jit_emit_fail(struct jit_compiler* jc, const char* error){
+    struct jit* jit = jc->jit;
+    jit_reg(jit, 0, 1, 0x89, JIT_R13, JIT_RDI);
+    jit_mov_imm64(jit, JIT_RSI, (unsigned long long)(uintptr_t)error);
+    jit_mov_imm64(jit, JIT_RDX, (unsigned long long)(uintptr_t)jc->function->name);
+    jit_call_c(jit, (void*)jit_fail);
+}
+
+/******************************** Operands ********************************/
+int jit_disp(int r){
+    return 8 * r;
+}
+
+// Bits of a double, for immediates
+unsigned long long jit_bits(double d){
+    union {
+        double d;
+        unsigned long long bits;
+    } value = {d};
+    return value.bits;
+}
+
+int jit_is_constant(struct jit_compiler* jc, int r){
+    return r >= jc->function->first_constant;
+}
+
+union vm_value jit_constant(struct jit_compiler* jc, int r){
+    return jc->function->constants[r - jc->function->first_constant];
+}
+
+// Loads the int in register r into a machine register
+void jit_load_int(struct jit_compiler* jc, int reg, int r){
+    if (jit_is_constant(jc, r)) {
+        jit_opcode(jc->jit, 0, 0, 0xB8 + (reg & 7), 0, reg);
+        jit_int32(jc->jit, jit_constant(jc, r).i);
+    }
+    else {
+        jit_mem(jc->jit, 0, 0, 0x8B, reg, JIT_RBX, jit_disp(r));
+    }
+}
+
+void jit_store_int(struct jit_compiler* jc, int reg, int r){
+    jit_mem(jc->jit, 0, 0, 0x89, reg, JIT_RBX, jit_disp(r));
+}
+
+void jit_load_double(struct jit_compiler* jc, int xmm, int r){
+    if (jit_is_constant(jc, r)) {
+        jit_mov_imm64(jc->jit, JIT_RAX, jit_bits(jit_constant(jc, r).d));
+        jit_reg(jc->jit, 0x66, 1, 0x0F6E, xmm, JIT_RAX);
+    }
+    else {
+        jit_mem(jc->jit, 0xF2, 0, 0x0F10, xmm, JIT_RBX, jit_disp(r));
+    }
+}
+
+void jit_store_double(struct jit_compiler* jc, int xmm, int r){
+    jit_mem(jc->jit, 0xF2, 0, 0x0F11, xmm, JIT_RBX, jit_disp(r));
+}
+
+// Copies register r of a type to the frame offset disp, the whole register unless r is a constant
+void jit_copy(struct jit_compiler* jc, int type, int r, int disp){
+    struct jit* jit = jc->jit;
+    if (jit_is_constant(jc, r) && type == 1) {
+        jit_mem(jit, 0, 0, 0xC7, 0, JIT_RBX, disp);
+        jit_int32(jit, jit_constant(jc, r).i);
+        return;
+    }
+    if (jit_is_constant(jc, r)) {
+        jit_mov_imm64(jit, JIT_RAX, jit_bits(jit_constant(jc, r).d));
+    }
+    else {
+        jit_mem(jit, 0, 1, 0x8B, JIT_RAX, JIT_RBX, jit_disp(r));
+    }
+    jit_mem(jit, 0, 1, 0x89, JIT_RAX, JIT_RBX, disp);
+}
+
+// Applies an int operation with an opcode for a memory source and an extension of 0x81 for an immediate one
+void jit_int_op(struct jit_compiler* jc, int opcode, int extension, int reg, int r){
+    if (jit_is_constant(jc, r)) {
+        jit_reg(jc->jit, 0, 0, 0x81, extension, reg);
+        jit_int32(jc->jit, jit_constant(jc, r).i);
+    }
+    else {
+        jit_mem(jc->jit, 0, 0, opcode, reg, JIT_RBX, jit_disp(r));
+    }
+}
+
+// Applies an SSE2 double operation to %xmm0
+void jit_double_op(struct jit_compiler* jc, int opcode, int prefix, int r){
+    if (jit_is_constant(jc, r)) {
+        jit_load_double(jc, JIT_XMM1, r);
+        jit_reg(jc->jit, prefix, 0, opcode, JIT_XMM0, JIT_XMM1);
+    }
+    else {
+        jit_mem(jc->jit, prefix, 0, opcode, JIT_XMM0, JIT_RBX, jit_disp(r));
+    }
+}
+
+/******************************** Code Generation ********************************/
+// Sets the flags for x against y: cmp for ints, ucomisd for doubles
+void jit_compare(struct jit_compiler* jc, int type, int x, int y){
+    if (type == 1) {
+        jit_load_int(jc, JIT_RAX, x);
+        jit_int_op(jc, 0x3B, 7, JIT_RAX, y);
+    }
+    else {
+        jit_load_double(jc, JIT_XMM0, x);
+        jit_double_op(jc, 0x0F2E, 0x66, y);
+    }
+}
+
+// Compares b with c, or c with b for double < and <= since only the above conditions are false on NaN
+void jit_compare_relop(struct jit_compiler* jc, int relop, int type, int b, int c){
+    if (type == 0 && (relop == TAC_LT || relop == TAC_LE)) {
+        jit_compare(jc, 0, c, b);
+    }
+    else {
+        jit_compare(jc, type, b, c);
+    }
+}
+
+// Condition code of relop after jit_compare_relop, EQ and NE on doubles also check parity
+int jit_condition(int relop, int type){
+    if (type == 1) {
+        return jit_int_conditions[relop - TAC_LT];
+    }
+    switch (relop) {
+        case TAC_LT:
+        case TAC_GT:
+            return JIT_A;
+        case TAC_LE:
+        case TAC_GE:
+            return JIT_AE;
+        case TAC_EQ:
+            return JIT_E;
+    }
+    return JIT_NE;
+}
+
+// Writes the truth of the flags for relop into register a
+void jit_set(struct jit_compiler* jc, int relop, int type, int a){
+    struct jit* jit = jc->jit;
+    jit_reg(jit, 0, 0, 0x0F90 + jit_condition(relop, type), 0, JIT_RAX);
+    if (type == 0 && relop == TAC_EQ) {
+        jit_reg(jit, 0, 0, 0x0F90 + JIT_NP, 0, JIT_RCX);
+        jit_reg(jit, 0, 0, 0x20, JIT_RCX, JIT_RAX);
+    }
+    else if (type == 0 && relop == TAC_NE) {
+        jit_reg(jit, 0, 0, 0x0F90 + JIT_P, 0, JIT_RCX);
+        jit_reg(jit, 0, 0, 0x08, JIT_RCX, JIT_RAX);
+    }
+    jit_reg(jit, 0, 0, 0x0FB6, JIT_RAX, JIT_RAX);
+    jit_store_int(jc, JIT_RAX, a);
+}
+
+// Jumps to pc target
+void jit_jump(struct jit_compiler* jc, int condition, int target){
+    struct jit* jit = jc->jit;
+    if (condition < 0) {
+        jit_byte(jit, 0xE9);
+    }
+    else {
+        jit_byte(jit, 0x0F);
+        jit_byte(jit, 0x80 + condition);
+    }
+    struct jit_patch jump = {jit->size, target};
+    jc->jumps[jc->num_jumps++] = jump;
+    jit_int32(jit, 0);
+}
+
+// Jumps to target when the flags hold relop
+void jit_branch(struct jit_compiler* jc, int relop, int type, int target){
+    if (type == 0 && relop == TAC_EQ) {
+        int unordered = jit_skip(jc->jit, JIT_P);
+        jit_jump(jc, JIT_E, target);
+        jit_land(jc->jit, unordered);
+    }
+    else if (type == 0 && relop == TAC_NE) {
+        jit_jump(jc, JIT_P, target);
+        jit_jump(jc, JIT_NE, target);
+    }
+    else {
+        jit_jump(jc, jit_condition(relop, type), target);
+    }
+}
+
+// Integer / and %: zero stops the run, -1 negates or gives 0 so the smallest int wraps like on the VM
+void jit_divide(struct jit_compiler* jc, struct vm_instr* instr, int modulo){
+    struct jit* jit = jc->jit;
+    jit_load_int(jc, JIT_RCX, instr->c);
+    jit_reg(jit, 0, 0, 0x85, JIT_RCX, JIT_RCX);
+    int nonzero = jit_skip(jit, JIT_NE);
+    jit_emit_fail(jc, modulo ? "modulo by zero" : "division by zero");
+    jit_land(jit, nonzero);
+    jit_load_int(jc, JIT_RAX, instr->b);
+    jit_reg(jit, 0, 0, 0x81, 7, JIT_RCX);
+    jit_int32(jit, -1);
+    int divide = jit_skip(jit, JIT_NE);
+    if (modulo) {
+        jit_reg(jit, 0, 0, 0x31, JIT_RDX, JIT_RDX);
+    }
+    else {
+        jit_reg(jit, 0, 0, 0xF7, 3, JIT_RAX);
+    }
+    int done = jit_skip(jit, -1);
+    jit_land(jit, divide);
+    jit_byte(jit, 0x99);
+    jit_reg(jit, 0, 0, 0xF7, 7, JIT_RCX);
+    jit_land(jit, done);
+    jit_store_int(jc, modulo ? JIT_RDX : JIT_RAX, instr->a);
+}
+
+void jit_print(struct jit_compiler* jc, int type, int a){
+    jit_mem(jc->jit, 0, 1, 0x8B, JIT_RDI, JIT_R13, offsetof(struct jit_context, output));
+    if (type == 1) {
+        jit_load_int(jc, JIT_RSI, a);
+        jit_call_c(jc->jit, (void*)vm_output_int);
+    }
+    else {
+        jit_load_double(jc, JIT_XMM0, a);
+        jit_call_c(jc->jit, (void*)vm_output_double);
+    }
+}
+
+// Slot of the k-th pending argument, after the VM registers
+int jit_argument_disp(struct jit_compiler* jc, int k){
+    return jit_disp(jc->function->num_regs + k);
+}
+
+// Moves pending arguments pushed from register r to their slots before r is overwritten
+void jit_before_write(struct jit_compiler* jc, int r){
+    for (int k = 0; k < jc->num_pending; k++) {
+        struct jit_pending* pending = &jc->pending[k];
+        if (pending->reg == r && !pending->saved) {
+            jit_copy(jc, pending->type, r, jit_argument_disp(jc, k));
+            pending->saved = 1;
+        }
+    }
+}
+
+// Copies the innermost call's arguments to the first registers of the frame at disp, the last pending argument
+// fills the first param
+void jit_pass_arguments(struct jit_compiler* jc, struct vm_function* callee, int disp){
+    int first = jc->num_pending - callee->num_params;
+    for (int p = 0; p < callee->num_params; p++) {
+        int k = first + callee->num_params - 1 - p;
+        struct jit_pending* pending = &jc->pending[k];
+        if (pending->saved) {
+            jit_mem(jc->jit, 0, 1, 0x8B, JIT_RAX, JIT_RBX, jit_argument_disp(jc, k));
+            jit_mem(jc->jit, 0, 1, 0x89, JIT_RAX, JIT_RBX, disp + jit_disp(p));
+        }
+        else {
+            jit_copy(jc, pending->type, pending->reg, disp + jit_disp(p));
+        }
+    }
+    jc->num_pending = first;
+}
+
+// A call or jump to the entry of function callee, patched once every function of the batch is compiled
+void jit_call_site(struct jit_compiler* jc, int opcode, int callee){
+    struct jit* jit = jc->jit;
+    jit_byte(jit, opcode);
+    if (jit->num_calls == jit->call_capacity) {
+        jit->call_capacity = (jit->call_capacity == 0) ? 64 : jit->call_capacity * 2;
+        jit->calls = realloc(jit->calls, sizeof(struct jit_patch) * jit->call_capacity);
+    }
+    struct jit_patch call = {jit->size, callee};
+    jit->calls[jit->num_calls++] = call;
+    jit_int32(jit, 0);
+}
+
+// Returns from the frame with the value in %rax, giving its frame back
+void jit_return(struct jit_compiler* jc){
+    jit_mem(jc->jit, 0, 1, 0x83, 0, JIT_R13, offsetof(struct jit_context, frames_left));
+    jit_byte(jc->jit, 1);
+    jit_byte(jc->jit, 0x5B);
+    jit_byte(jc->jit, 0xC3);
+}
+
+// Opcode an instruction runs, superinstructions run their first half and leave the second to the next pc
+int jit_base_op(int op){
+    for (int k = 0; k < VM_NUM_SUPERINSTRUCTIONS; k++) {
+        if (vm_superinstructions[k][0] == op) {
+            return vm_superinstructions[k][1];
+        }
+    }
+    return op;
+}
+
+// Matches every PUSH to the param it fills, with the stack discipline call_arguments relies on. Returns 0, or 1
+// when a branch comes between a PUSH and its call.
+int jit_match_pushes(struct jit_compiler* jc){
+    struct vm_function* function = jc->function;
+    int n = function->num_code;
+    char* targets = calloc(n + 1, 1);
+    for (int pc = 0; pc < n; pc++) {
+        int op = jit_base_op(function->code[pc].op);
+        if (op >= VM_JMP && op <= VM_JNE_D) {
+            targets[function->code[pc].c] = 1;
+        }
+    }
+    int* stack = malloc(sizeof(int) * (n + 1));
+    int top = 0;
+    int error = 0;
+    jc->max_pending = 0;
+    for (int pc = 0; pc < n && !error; pc++) {
+        int op = jit_base_op(function->code[pc].op);
+        jc->push_types[pc] = -1;
+        if (top > 0 && (targets[pc] || (op >= VM_JMP && op <= VM_JNE_D))) {
+            error = 1;
+        }
+        else if (op == VM_PUSH) {
+            stack[top++] = pc;
+            jc->max_pending = (top > jc->max_pending) ? top : jc->max_pending;
+        }
+        else if (op == VM_CALL || op == VM_TAILCALL) {
+            struct vm_function* callee = &jc->vm->functions[function->code[pc].b];
+            if (function->code[pc].c > top) {
+                error = 1;
+                break;
+            }
+            for (int p = 0; p < function->code[pc].c; p++) {
+                jc->push_types[stack[top - 1 - p]] = callee->param_types[p];
+            }
+            top -= function->code[pc].c;
+        }
+    }
+    free(stack);
+    free(targets);
+    return error;
+}
+
+// Entry of a compiled function: %rdi holds its registers. Takes a frame, checking the depth and room like a VM
+// call does.
+void jit_prologue(struct jit_compiler* jc){
+    struct jit* jit = jc->jit;
+    jit_byte(jit, 0x53);
+    jit_reg(jit, 0, 1, 0x89, JIT_RDI, JIT_RBX);
+    jit_mem(jit, 0, 1, 0x83, 5, JIT_R13, offsetof(struct jit_context, frames_left));
+    jit_byte(jit, 1);
+    int no_frame = jit_skip(jit, JIT_B);
+    jit_mem(jit, 0, 1, 0x8D, JIT_RAX, JIT_RBX, jit_disp(jc->frame));
+    jit_mem(jit, 0, 1, 0x3B, JIT_RAX, JIT_R13, offsetof(struct jit_context, stack_end));
+    int room = jit_skip(jit, 0x6);   // Below or equal
+    jit_land(jit, no_frame);
+    jit_emit_fail(jc, "stack overflow");
+    jit_land(jit, room);
+}
+
+// Compiles one function into the buffer, returns 0 on success or 1 if it has to stay interpreted
+int jit_compile_function(struct jit* jit, struct vm_program* vm, int f){
+    struct vm_function* function = &vm->functions[f];
+    int n = function->num_code;
+    struct jit_compiler jc = {jit, vm, f, function, NULL, NULL, 0, NULL, NULL, 0, 0, 0};
+    jc.push_types = malloc(sizeof(int) * (n + 1));
+    if (jit_match_pushes(&jc)) {
+        free(jc.push_types);
+        return 1;
+    }
+    jc.offsets = malloc(sizeof(int) * (n + 1));
+    jc.jumps = malloc(sizeof(struct jit_patch) * (2 * n + 1));
+    jc.pending = malloc(sizeof(struct jit_pending) * (jc.max_pending + 1));
+    jc.frame = function->num_regs + jc.max_pending;
+
+    int start = jit->size;
+    int error = 0;
+    jit->entries[f] = start;
+    jit_prologue(&jc);
+    for (int pc = 0; pc < n && !error; pc++) {
+        if (jit->size + JIT_INSTR_ROOM > JIT_BUFFER_SIZE) {
+            error = 1;
+            break;
+        }
+        struct vm_instr* instr = &function->code[pc];
+        int op = jit_base_op(instr->op);
+        jc.offsets[pc] = jit->size;
+        if (op <= VM_OR_I || op == VM_CALL) {
+            jit_before_write(&jc, instr->a);
+        }
+        switch (op) {
+            case VM_MOV:
+                if (instr->a != instr->b) {
+                    jit_copy(&jc, instr->c, instr->b, jit_disp(instr->a));
+                }
+                break;
+            case VM_I2D:
+                jit_load_int(&jc, JIT_RAX, instr->b);
+                jit_reg(jit, 0xF2, 0, 0x0F2A, JIT_XMM0, JIT_RAX);
+                jit_store_double(&jc, JIT_XMM0, instr->a);
+                break;
+            case VM_D2I:
+                jit_load_double(&jc, JIT_XMM0, instr->b);
+                jit_reg(jit, 0xF2, 0, 0x0F2C, JIT_RAX, JIT_XMM0);
+                jit_store_int(&jc, JIT_RAX, instr->a);
+                break;
+            case VM_ADD_I:
+            case VM_SUB_I:
+                jit_load_int(&jc, JIT_RAX, instr->b);
+                jit_int_op(&jc, (op == VM_ADD_I) ? 0x03 : 0x2B, (op == VM_ADD_I) ? 0 : 5, JIT_RAX, instr->c);
+                jit_store_int(&jc, JIT_RAX, instr->a);
+                break;
+            case VM_MUL_I:
+                jit_load_int(&jc, JIT_RAX, instr->b);
+                if (jit_is_constant(&jc, instr->c)) {
+                    jit_reg(jit, 0, 0, 0x69, JIT_RAX, JIT_RAX);
+                    jit_int32(jit, jit_constant(&jc, instr->c).i);
+                }
+                else {
+                    jit_mem(jit, 0, 0, 0x0FAF, JIT_RAX, JIT_RBX, jit_disp(instr->c));
+                }
+                jit_store_int(&jc, JIT_RAX, instr->a);
+                break;
+            case VM_DIV_I:
+            case VM_MOD_I:
+                jit_divide(&jc, instr, op == VM_MOD_I);
+                break;
+            case VM_ADD_D:
+            case VM_SUB_D:
+            case VM_MUL_D:
+            case VM_DIV_D: {
+                static const int opcodes[4] = {0x0F58, 0x0F5C, 0x0F59, 0x0F5E};
+                jit_load_double(&jc, JIT_XMM0, instr->b);
+                jit_double_op(&jc, opcodes[op - VM_ADD_D], 0xF2, instr->c);
+                jit_store_double(&jc, JIT_XMM0, instr->a);
+                break;
+            }
+            case VM_LT_I: case VM_GT_I: case VM_EQ_I: case VM_LE_I: case VM_GE_I: case VM_NE_I:
+                jit_compare(&jc, 1, instr->b, instr->c);
+                jit_set(&jc, TAC_LT + (op - VM_LT_I), 1, instr->a);
+                break;
+            case VM_LT_D: case VM_GT_D: case VM_EQ_D: case VM_LE_D: case VM_GE_D: case VM_NE_D:
+                jit_compare_relop(&jc, TAC_LT + (op - VM_LT_D), 0, instr->b, instr->c);
+                jit_set(&jc, TAC_LT + (op - VM_LT_D), 0, instr->a);
+                break;
+            case VM_NOT_I:
+                jit_load_int(&jc, JIT_RAX, instr->b);
+                jit_reg(jit, 0, 0, 0x85, JIT_RAX, JIT_RAX);
+                jit_set(&jc, TAC_EQ, 1, instr->a);
+                break;
+            case VM_OR_I:
+                jit_load_int(&jc, JIT_RAX, instr->b);
+                jit_int_op(&jc, 0x0B, 1, JIT_RAX, instr->c);
+                jit_set(&jc, TAC_NE, 1, instr->a);
+                break;
+            case VM_JMP:
+                jit_jump(&jc, -1, instr->c);
+                break;
+            case VM_JZ_I:
+                jit_load_int(&jc, JIT_RAX, instr->b);
+                jit_reg(jit, 0, 0, 0x85, JIT_RAX, JIT_RAX);
+                jit_jump(&jc, JIT_E, instr->c);
+                break;
+            case VM_JZ_D:
+                jit_load_double(&jc, JIT_XMM0, instr->b);
+                jit_reg(jit, 0x66, 0, 0x0F57, JIT_XMM1, JIT_XMM1);
+                jit_reg(jit, 0x66, 0, 0x0F2E, JIT_XMM0, JIT_XMM1);
+                jit_branch(&jc, TAC_EQ, 0, instr->c);
+                break;
+            case VM_JLT_I: case VM_JGT_I: case VM_JEQ_I: case VM_JLE_I: case VM_JGE_I: case VM_JNE_I:
+                jit_compare(&jc, 1, instr->a, instr->b);
+                jit_branch(&jc, TAC_LT + (op - VM_JLT_I), 1, instr->c);
+                break;
+            case VM_JLT_D: case VM_JGT_D: case VM_JEQ_D: case VM_JLE_D: case VM_JGE_D: case VM_JNE_D:
+                jit_compare_relop(&jc, TAC_LT + (op - VM_JLT_D), 0, instr->a, instr->b);
+                jit_branch(&jc, TAC_LT + (op - VM_JLT_D), 0, instr->c);
+                break;
+            case VM_PRINT_I:
+            case VM_PRINT_D:
+                jit_print(&jc, op == VM_PRINT_I, instr->a);
+                break;
+            case VM_PUSH: {
+                struct jit_pending pending = {instr->a, jc.push_types[pc], 0};
+                jc.pending[jc.num_pending++] = pending;
+                break;
+            }
+            case VM_CALL:
+                // The callee's frame starts after this frame's argument slots
+                jit_pass_arguments(&jc, &vm->functions[instr->b], jit_disp(jc.frame));
+                jit_mem(jit, 0, 1, 0x8D, JIT_RDI, JIT_RBX, jit_disp(jc.frame));
+                jit_call_site(&jc, 0xE8, instr->b);
+                jit_mem(jit, 0, 1, 0x89, JIT_RAX, JIT_RBX, jit_disp(instr->a));
+                break;
+            case VM_TAILCALL: {
+                // The arguments may read the params they replace, so each goes through its own slot first
+                struct vm_function* callee = &vm->functions[instr->b];
+                int first = jc.num_pending - callee->num_params;
+                for (int k = first; k < jc.num_pending; k++) {
+                    if (!jc.pending[k].saved) {
+                        jit_copy(&jc, jc.pending[k].type, jc.pending[k].reg, jit_argument_disp(&jc, k));
+                    }
+                }
+                for (int p = 0; p < callee->num_params; p++) {
+                    jit_mem(jit, 0, 1, 0x8B, JIT_RAX, JIT_RBX, jit_argument_disp(&jc, jc.num_pending - 1 - p));
+                    jit_mem(jit, 0, 1, 0x89, JIT_RAX, JIT_RBX, jit_disp(p));
+                }
+                jc.num_pending = first;
+                jit_reg(jit, 0, 1, 0x89, JIT_RBX, JIT_RDI);
+                jit_mem(jit, 0, 1, 0x83, 0, JIT_R13, offsetof(struct jit_context, frames_left));
+                jit_byte(jit, 1);
+                jit_byte(jit, 0x5B);
+                jit_call_site(&jc, 0xE9, instr->b);
+                break;
+            }
+            case VM_RET:
+                if (jit_is_constant(&jc, instr->a) && function->return_type == 0) {
+                    jit_mov_imm64(jit, JIT_RAX, jit_bits(jit_constant(&jc, instr->a).d));
+                }
+                else if (jit_is_constant(&jc, instr->a)) {
+                    jit_load_int(&jc, JIT_RAX, instr->a);
+                }
+                else {
+                    jit_mem(jit, 0, 1, 0x8B, JIT_RAX, JIT_RBX, jit_disp(instr->a));
+                }
+                jit_return(&jc);
+                break;
+            case VM_HALT:
+                jit_reg(jit, 0, 0, 0x31, JIT_RAX, JIT_RAX);
+                jit_return(&jc);
+                break;
+            default:
+                error = 1;
+                break;
+        }
+    }
+    if (!error) {
+        for (int j = 0; j < jc.num_jumps; j++) {
+            jit_patch32(jit, jc.jumps[j].site, jc.offsets[jc.jumps[j].target]);
+        }
+        jit->lengths[f] = jit->size - start;
+    }
+
+    free(jc.push_types);
+    free(jc.offsets);
+    free(jc.jumps);
+    free(jc.pending);
+    return error;
+}
+
+/******************************** Tiering ********************************/
+// Compiles function f and every function it reaches that is not compiled yet, then patches their call sites.
+// When any of them cannot be compiled the whole batch stays interpreted.
+void jit_tier_up(struct vm_program* vm, int f){
+    struct jit* jit = vm->jit;
+    if (jit->entries[f] >= 0 || jit->failed[f]) {
+        return;
+    }
+    int* batch = malloc(sizeof(int) * (vm->num_functions + 1));
+    char* seen = calloc(vm->num_functions + 1, 1);
+    int num_batch = 0;
+    batch[num_batch++] = f;
+    seen[f] = 1;
+    int failed = 0;
+    for (int i = 0; i < num_batch; i++) {
+        struct vm_function* function = &vm->functions[batch[i]];
+        failed |= jit->failed[batch[i]];
+        for (int pc = 0; pc < function->num_code; pc++) {
+            int op = jit_base_op(function->code[pc].op);
+            int callee = function->code[pc].b;
+            if ((op == VM_CALL || op == VM_TAILCALL) && !seen[callee] && jit->entries[callee] < 0) {
+                seen[callee] = 1;
+                batch[num_batch++] = callee;
+            }
+        }
+    }
+
+    int size = jit->size;
+    if (!failed && mprotect(jit->code, JIT_BUFFER_SIZE, PROT_READ | PROT_WRITE) != 0) {
+        perror("Error unprotecting JIT buffer");
+        failed = 1;
+    }
+    jit->num_calls = 0;
+    for (int i = 0; i < num_batch && !failed; i++) {
+        double start = vm_now();
+        failed = jit_compile_function(jit, vm, batch[i]);
+        jit->seconds[batch[i]] = vm_now() - start;
+        jit->tier_calls[batch[i]] = vm->functions[batch[i]].calls;
+    }
+    if (!failed) {
+        for (int c = 0; c < jit->num_calls; c++) {
+            jit_patch32(jit, jit->calls[c].site, jit->entries[jit->calls[c].target]);
+        }
+        for (int i = 0; i < num_batch; i++) {
+            vm->functions[batch[i]].native = jit->code + jit->entries[batch[i]];
+            jit->order[jit->num_compiled++] = batch[i];
+        }
+    }
+    else {
+        // Roll the buffer back, every function of the batch stays interpreted
+        jit->size = size;
+        for (int i = 0; i < num_batch; i++) {
+            if (vm->functions[batch[i]].native == NULL) {
+                jit->entries[batch[i]] = -1;
+                jit->failed[batch[i]] = 1;
+            }
+        }
+    }
+    if (mprotect(jit->code, JIT_BUFFER_SIZE, PROT_READ | PROT_EXEC) != 0) {
+        perror("Error protecting JIT buffer");
+    }
+    free(batch);
+    free(seen);
+}
+
+// Runs compiled code on the registers at regs, called by vm_execute. Returns 0 with the returned value in
+// result, or 1 after a runtime error which is recorded in state.
+int jit_call_native(struct vm_program* vm, struct vm_state* state, struct vm_function* callee, union vm_value* regs,
+                    long long frames_left, union vm_value* result){
+    struct jit_context context;
+    context.stack_end = state->stack + VM_STACK_SIZE;
+    context.frames_left = frames_left;
+    context.output = &state->output;
+    context.error = NULL;
+    context.error_function = NULL;
+    if (setjmp(context.jump) != 0) {
+        state->error = context.error;
+        state->error_function = context.error_function;
+        return 1;
+    }
+    unsigned long long (*enter)(union vm_value*, struct jit_context*, void*) =
+        (unsigned long long (*)(union vm_value*, struct jit_context*, void*))(void*)(vm->jit->code + vm->jit->enter);
+    union {
+        unsigned long long bits;
+        union vm_value value;
+    } returned = {enter(regs, &context, callee->native)};
+    *result = returned.value;
+    return 0;
+}
+
+/******************************** Driver ********************************/
+// Attaches a JIT to a lowered program, returns NULL when no executable buffer can be mapped
+struct jit* jit_new(struct vm_program* vm, long long threshold){
+    void* code = mmap(NULL, JIT_BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code == MAP_FAILED) {
+        perror("Error mapping JIT buffer");
+        return NULL;
+    }
+    struct jit* jit = malloc(sizeof(struct jit));
+    jit->code = code;
+    jit->size = 0;
+    jit->entries = malloc(sizeof(int) * (vm->num_functions + 1));
+    jit->lengths = calloc(vm->num_functions + 1, sizeof(int));
+    jit->seconds = calloc(vm->num_functions + 1, sizeof(double));
+    jit->tier_calls = calloc(vm->num_functions + 1, sizeof(long long));
+    jit->failed = calloc(vm->num_functions + 1, sizeof(int));
+    jit->order = malloc(sizeof(int) * (vm->num_functions + 1));
+    jit->num_compiled = 0;
+    jit->calls = NULL;
+    jit->num_calls = 0;
+    jit->call_capacity = 0;
+    for (int f = 0; f < vm->num_functions; f++) {
+        jit->entries[f] = -1;
+    }
+
+    // Thunk from C: keeps the callee saved registers compiled code uses and aligns the stack for its calls
+    jit->enter = jit->size;
+    jit_byte(jit, 0x55);
+    jit_byte(jit, 0x53);
+    jit_byte(jit, 0x41);
+    jit_byte(jit, 0x55);
+    jit_reg(jit, 0, 1, 0x89, JIT_RSI, JIT_R13);
+    jit_reg(jit, 0, 0, 0xFF, 2, JIT_RDX);
+    jit_byte(jit, 0x41);
+    jit_byte(jit, 0x5D);
+    jit_byte(jit, 0x5B);
+    jit_byte(jit, 0x5D);
+    jit_byte(jit, 0xC3);
+    if (mprotect(jit->code, JIT_BUFFER_SIZE, PROT_READ | PROT_EXEC) != 0) {
+        perror("Error protecting JIT buffer");
+    }
+
+    vm->jit = jit;
+    vm->jit_threshold = threshold;
+    vm->tier_up = jit_tier_up;
+    vm->call_native = jit_call_native;
+    return jit;
+}
+
+void jit_free(struct jit* jit){
+    munmap(jit->code, JIT_BUFFER_SIZE);
+    free(jit->entries);
+    free(jit->lengths);
+    free(jit->seconds);
+    free(jit->tier_calls);
+    free(jit->failed);
+    free(jit->order);
+    free(jit->calls);
+    free(jit);
+}
+
+// Writes what the JIT compiled, when, how large and how long each function took
+void jit_report(struct vm_program* vm, struct jit* jit, FILE* report){
+    double total = 0;
+    int bytes = 0;
+    for (int i = 0; i < jit->num_compiled; i++) {
+        total += jit->seconds[jit->order[i]];
+        bytes += jit->lengths[jit->order[i]];
+    }
+    fprintf(report, "JIT: threshold %lld calls, %d of %d functions compiled into %d bytes in %.1f us\n",
+            vm->jit_threshold, jit->num_compiled, vm->num_functions, bytes, total * 1e6);
+    for (int i = 0; i < jit->num_compiled; i++) {
+        int f = jit->order[i];
+        fprintf(report, "    %-16s %6d bytes %8.1f us  after %lld calls\n", vm->functions[f].name, jit->lengths[f],
+                jit->seconds[f] * 1e6, jit->tier_calls[f]);
+    }
+    for (int f = 0; f < vm->num_functions; f++) {
+        if (jit->failed[f]) {
+            fprintf(report, "    %-16s interpreted, the JIT could not compile it\n", vm->functions[f].name);
+        }
+    }
+}
+
+// Lowers and runs a program on the VM with a JIT compiling functions called threshold times, returns 0 on success
+int jit_run_program(struct tac_program* program, FILE* report, long long threshold){
+    struct vm_program vm;
+    if (vm_lower_program(program, &vm)) {
+        free_vm_program(&vm);
+        return 1;
+    }
+    struct jit* jit = jit_new(&vm, threshold);
+    int status = vm_run_lowered(&vm, report, 0);
+    if (jit != NULL) {
+        jit_report(&vm, jit, report);
+        jit_free(jit);
+    }
+    free_vm_program(&vm);
+    return status;
+}
+
+#endif // JIT_H
@@ -0,0 +1,913 @@
+#ifndef LSP_H
+#define LSP_H
+
+#include <pthread.h>
+
+// Language server: speaks the Language Server Protocol over stdin and stdout so an editor gets this compiler's
+// diagnostics and go-to-definition. The request thread reads messages and keeps the text of every open document,
+// applying each change to it, and answers what it can on the spot. Compiling is left to a worker thread, which
+// owns a compiler_context with a per-function cache for each document: when a document has changes it hasn't
+// compiled, the worker turns the difference between the text it compiled last and the current one into a single
+// edit for compiler_edit, so a burst of keystrokes costs one compilation that redoes only the functions touched,
+// and then publishes the lines of error.txt as diagnostics. Definition requests wait in a queue for the worker,
+// which answers them from the scope tables of a compilation of the current text; $/cancelRequest takes a request
+// back out of the queue. The time each kind of request took, from reading it to answering it, and for diagnostics
+// from the first change to publishing them, goes into a histogram per kind printed to stderr on exit.
+
+/******************************** LSP Definitions ********************************/
+// Kinds of request timed
+#define LSP_INITIALIZE       0       // initialize, shutdown and the other requests answered at once
+#define LSP_OPEN             1       // textDocument/didOpen
+#define LSP_CHANGE           2       // textDocument/didChange
+#define LSP_CLOSE            3       // textDocument/didClose
+#define LSP_DEFINITION       4       // textDocument/definition, until the worker answers
+#define LSP_DIAGNOSTICS      5       // First change not yet compiled until its diagnostics are published
+#define LSP_NUM_KINDS        6
+
+#define LSP_BUCKETS          32      // Histogram bucket b holds latencies under 2^b microseconds
+#define LSP_DEFAULT_CACHE    (64LL << 20) // Per-function cache of a document without -I
+#define LSP_MAX_MESSAGE      (64LL << 20) // Bytes of the longest message body read, longer ones are skipped
+
+// JSON-RPC error codes
+#define LSP_PARSE_ERROR      -32700  //
+#define LSP_METHOD_NOT_FOUND -32601  //
+#define LSP_CANCELLED        -32800  // The request was cancelled before it was answered
+
+/******************************** Struct Definitions ********************************/
+struct lsp_document{
+    char* uri;                       //
+    int version;                     // Version of text
+    char* text;                      // Latest text, kept by the request thread
+    size_t length;                   //
+    size_t capacity;                 //
+    int dirty;                       // True(1) while text has changes the worker hasn't compiled
+    double dirty_since;              // When the first of them arrived
+    int closed;                      // True(1) once closed, for the worker to free
+
+    // Worker
+    struct compiler_context* compiler; // Context the document is compiled in, NULL before the first compilation
+    char* compiled;                  // Text of its last compilation
+    size_t compiled_length;          //
+    size_t compiled_capacity;        //
+};
+
+// A definition request waiting for the worker
+struct lsp_request{
+    char* id;                        // JSON of the request's id, to answer with
+    char* uri;                       //
+    int line;                        //
+    int character;                   //
+    double received;                 //
+};
+
+struct lsp_histogram{
+    long long counts[LSP_BUCKETS];   //
+    long long total;                 //
+    double max;                      // Seconds
+};
+
+struct lsp_server{
+    pthread_mutex_t lock;            // Guards everything below but the worker's fields of a document
+    pthread_cond_t wake;             // Signals the worker that there is work or it should stop
+    pthread_mutex_t output;          // Held while writing a message to stdout
+    struct lsp_document** documents; //
+    int num_documents;               //
+    int documents_capacity;          //
+    struct lsp_request* requests;    // Definition requests, oldest first
+    int num_requests;                //
+    int requests_capacity;           //
+    struct lsp_histogram histograms[LSP_NUM_KINDS];
+    struct compiler_options options; // Options each document's context is made with
+    int stopping;                    // True(1) once the worker should exit
+    int shutdown;                    // True(1) once shutdown was requested
+};
+
+static const char* lsp_kind_names[LSP_NUM_KINDS] = {
+    "requests", "didOpen", "didChange", "didClose", "definition", "diagnostics"
+};
+
+/******************************** JSON ********************************/
+// The messages are parsed in place: a value is a pointer to its first char in the NUL terminated body
+
+size_t lsp_length(const char* text){
+    size_t length = 0;
+    while (text[length] != '\0') {
+        length++;
+    }
+    return length;
+}
+
+const char* lsp_space(const char* p){
+    while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') {
+        p++;
+    }
+    return p;
+}
+
+// Skips a value, returns the char after it or NULL if it is malformed
+const char* lsp_skip(const char* p){
+    p = lsp_space(p);
+    if (*p == '"') {
+        for (p++; *p != '"'; p++) {
+            if (*p == '\0') {
+                return NULL;
+            }
+            if (*p == '\\' && *++p == '\0') {
+                return NULL;
+            }
+        }
+        return p + 1;
+    }
+    if (*p == '{' || *p == '[') {
+        char close = (*p == '{') ? '}' : ']';
+        p = lsp_space(p + 1);
+        while (*p != close) {
+            if (close == '}') {
+                p = lsp_skip(p);
+                if (p == NULL || *(p = lsp_space(p)) != ':') {
+                    return NULL;
+                }
+                p++;
+            }
+            p = lsp_skip(p);
+            if (p == NULL) {
+                return NULL;
+            }
+            p = lsp_space(p);
+            if (*p == ',') {
+                p = lsp_space(p + 1);
+            }
+            else if (*p != close) {
+                return NULL;
+            }
+        }
+        return p + 1;
+    }
+    const char* start = p;
+    while (*p == '-' || *p == '+' || *p == '.' || (*p >= '0' && *p <= '9') || (*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z')) {
+        p++;
+    }
+    return (p == start) ? NULL : p;
+}
+
+// Value of key in the object value, NULL if value isn't an object or has no such key
+const char* lsp_member(const char* value, const char* key){
+    if (value == NULL || *(value = lsp_space(value)) != '{') {
+        return NULL;
+    }
+    const char* p = lsp_space(value + 1);
+    while (*p == '"') {
+        const char* name = p + 1;
+        int i = 0;
+        while (key[i] != '\0' && name[i] == key[i]) {
+            i++;
+        }
+        int matches = (key[i] == '\0' && name[i] == '"');
+        p = lsp_skip(p);
+        if (p == NULL || *(p = lsp_space(p)) != ':') {
+            return NULL;
+        }
+        p = lsp_space(p + 1);
+        if (matches) {
+            return p;
+        }
+        p = lsp_skip(p);
+        if (p == NULL) {
+            return NULL;
+        }
+        p = lsp_space(p);
+        if (*p != ',') {
+            return NULL;
+        }
+        p = lsp_space(p + 1);
+    }
+    return NULL;
+}
+
+// Integer in value, fallback if it isn't a number
+long long lsp_integer(const char* value, long long fallback){
+    if (value == NULL) {
+        return fallback;
+    }
+    value = lsp_space(value);
+    int negative = (*value == '-');
+    if (negative) {
+        value++;
+    }
+    if (*value < '0' || *value > '9') {
+        return fallback;
+    }
+    // Stops growing past 18 digits instead of overflowing, no count or position comes near that
+    long long number = 0;
+    for (; *value >= '0' && *value <= '9'; value++) {
+        if (number < 100000000000000000LL) {
+            number = number * 10 + (*value - '0');
+        }
+    }
+    return negative ? -number : number;
+}
+
+// Hex digit's value, -1 if c isn't one
+int lsp_hex(char c){
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+// New NUL terminated copy of the string value with its escapes decoded, storing its length. NULL if value isn't
+// a string
+char* lsp_string(const char* value, size_t* length){
+    if (value == NULL || *(value = lsp_space(value)) != '"') {
+        return NULL;
+    }
+    const char* end = lsp_skip(value);
+    if (end == NULL) {
+        return NULL;
+    }
+    char* text = malloc(end - value);
+    size_t size = 0;
+    for (const char* p = value + 1; p < end - 1; p++) {
+        if (*p != '\\') {
+            text[size++] = *p;
+            continue;
+        }
+        p++;
+        switch (*p) {
+            case 'n': text[size++] = '\n'; break;
+            case 't': text[size++] = '\t'; break;
+            case 'r': text[size++] = '\r'; break;
+            case 'b': text[size++] = '\b'; break;
+            case 'f': text[size++] = '\f'; break;
+            case 'u': {
+                // Encode the code unit as UTF-8, a surrogate half on its own
+                int code = 0;
+                for (int i = 1; i <= 4; i++) {
+                    int digit = (p + i < end - 1) ? lsp_hex(p[i]) : -1;
+                    code = (digit < 0) ? code : code * 16 + digit;
+                }
+                p += 4;
+                if (code < 0x80) {
+                    text[size++] = (char)code;
+                }
+                else if (code < 0x800) {
+                    text[size++] = (char)(0xC0 | (code >> 6));
+                    text[size++] = (char)(0x80 | (code & 0x3F));
+                }
+                else {
+                    text[size++] = (char)(0xE0 | (code >> 12));
+                    text[size++] = (char)(0x80 | ((code >> 6) & 0x3F));
+                    text[size++] = (char)(0x80 | (code & 0x3F));
+                }
+                break;
+            }
+            default: text[size++] = *p; break;
+        }
+    }
+    text[size] = '\0';
+    if (length != NULL) {
+        *length = size;
+    }
+    return text;
+}
+
+// New NUL terminated copy of the JSON text of value, NULL if it is malformed
+char* lsp_raw(const char* value){
+    if (value == NULL) {
+        return NULL;
+    }
+    value = lsp_space(value);
+    const char* end = lsp_skip(value);
+    if (end == NULL) {
+        return NULL;
+    }
+    char* raw = malloc(end - value + 1);
+    for (const char* p = value; p < end; p++) {
+        raw[p - value] = *p;
+    }
+    raw[end - value] = '\0';
+    return raw;
+}
+
+// Writes text as a JSON string
+void lsp_write_string(FILE* out, const char* text, size_t length){
+    fputc('"', out);
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)text[i];
+        if (c == '"' || c == '\\') {
+            fputc('\\', out);
+            fputc(c, out);
+        }
+        else if (c == '\n') {
+            fputs("\\n", out);
+        }
+        else if (c == '\t') {
+            fputs("\\t", out);
+        }
+        else if (c < 0x20) {
+            fprintf(out, "\\u%04x", c);
+        }
+        else {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+/******************************** Messages ********************************/
+// Reads one message body into *body, grown as needed. Returns 0, 1 at the end of stdin or on a bad header, or 2
+// after skipping a body over LSP_MAX_MESSAGE bytes or one there was no memory for
+int lsp_read_message(char** body, size_t* capacity){
+    char header[256];
+    long long length = -1;
+    for (;;) {
+        if (fgets(header, sizeof(header), stdin) == NULL) {
+            return 1;
+        }
+        if (header[0] == '\r' || header[0] == '\n') {
+            break;
+        }
+        size_t skip = incremental_match(header, sizeof(header), "Content-Length:");
+        if (skip > 0) {
+            length = lsp_integer(header + skip, -1);
+        }
+    }
+    if (length < 0) {
+        return 1;
+    }
+    char* grown = *body;
+    if (length <= LSP_MAX_MESSAGE && (size_t)length + 1 > *capacity) {
+        grown = realloc(*body, (size_t)length + 1);
+    }
+    if (length > LSP_MAX_MESSAGE || grown == NULL) {
+        // Read past the body so the next message starts where the client put it
+        char skipped[4096];
+        while (length > 0) {
+            size_t chunk = (length < (long long)sizeof(skipped)) ? (size_t)length : sizeof(skipped);
+            if (fread(skipped, 1, chunk, stdin) != chunk) {
+                return 1;
+            }
+            length -= chunk;
+        }
+        return 2;
+    }
+    if (grown != *body) {
+        *body = grown;
+        *capacity = (size_t)length + 1;
+    }
+    if (fread(*body, 1, (size_t)length, stdin) != (size_t)length) {
+        return 1;
+    }
+    (*body)[length] = '\0';
+    return 0;
+}
+
+// Writes a message to stdout, from either thread
+void lsp_send(struct lsp_server* server, const char* body, size_t length){
+    pthread_mutex_lock(&server->output);
+    printf("Content-Length: %zu\r\n\r\n", length);
+    fwrite(body, 1, length, stdout);
+    fflush(stdout);
+    pthread_mutex_unlock(&server->output);
+}
+
+// Answers request id with result, JSON text
+void lsp_respond(struct lsp_server* server, const char* id, const char* result){
+    char* body = NULL;
+    size_t length = 0;
+    FILE* out = open_memstream(&body, &length);
+    fprintf(out, "{\"jsonrpc\":\"2.0\",\"id\":%s,\"result\":%s}", id, result);
+    fclose(out);
+    lsp_send(server, body, length);
+    free(body);
+}
+
+void lsp_respond_error(struct lsp_server* server, const char* id, int code, const char* message){
+    char* body = NULL;
+    size_t length = 0;
+    FILE* out = open_memstream(&body, &length);
+    fprintf(out, "{\"jsonrpc\":\"2.0\",\"id\":%s,\"error\":{\"code\":%d,\"message\":\"%s\"}}", id, code, message);
+    fclose(out);
+    lsp_send(server, body, length);
+    free(body);
+}
+
+// Adds a latency to the histogram of its kind
+void lsp_record(struct lsp_server* server, int kind, double seconds){
+    long long micros = (long long)(seconds * 1e6);
+    int bucket = 0;
+    while (bucket < LSP_BUCKETS - 1 && micros >= (1LL << bucket)) {
+        bucket++;
+    }
+    pthread_mutex_lock(&server->lock);
+    struct lsp_histogram* histogram = &server->histograms[kind];
+    histogram->counts[bucket]++;
+    histogram->total++;
+    if (seconds > histogram->max) {
+        histogram->max = seconds;
+    }
+    pthread_mutex_unlock(&server->lock);
+}
+
+// Upper bound in microseconds of the latency fraction of a histogram's requests are under
+long long lsp_percentile(struct lsp_histogram* histogram, double fraction){
+    long long seen = 0;
+    for (int b = 0; b < LSP_BUCKETS; b++) {
+        seen += histogram->counts[b];
+        if (seen > 0 && seen >= fraction * histogram->total) {
+            return 1LL << b;
+        }
+    }
+    return 1LL << (LSP_BUCKETS - 1);
+}
+
+void lsp_print_histograms(struct lsp_server* server, FILE* out){
+    for (int k = 0; k < LSP_NUM_KINDS; k++) {
+        struct lsp_histogram* histogram = &server->histograms[k];
+        if (histogram->total == 0) {
+            continue;
+        }
+        fprintf(out, "Latency of %s: %lld, p50 < %lld us, p99 < %lld us, max %.1f us\n", lsp_kind_names[k], histogram->total,
+                lsp_percentile(histogram, 0.5), lsp_percentile(histogram, 0.99), histogram->max * 1e6);
+        fprintf(out, "   ");
+        for (int b = 0; b < LSP_BUCKETS; b++) {
+            if (histogram->counts[b] > 0) {
+                fprintf(out, " <%lldus:%lld", 1LL << b, histogram->counts[b]);
+            }
+        }
+        fprintf(out, "\n");
+    }
+}
+
+/******************************** Documents ********************************/
+// Open document named uri, NULL if there is none. Called with the lock held
+struct lsp_document* lsp_find_document(struct lsp_server* server, const char* uri){
+    for (int i = 0; i < server->num_documents; i++) {
+        if (!server->documents[i]->closed && compare_strings(server->documents[i]->uri, uri) == 0) {
+            return server->documents[i];
+        }
+    }
+    return NULL;
+}
+
+// Replaces removed bytes of a buffer at offset with length bytes of text
+void lsp_splice(char** buffer, size_t* size, size_t* capacity, size_t offset, size_t removed, const char* text, size_t length){
+    size_t new_size = *size - removed + length;
+    if (new_size + 1 > *capacity) {
+        *capacity = (new_size + 1) * 2;
+        *buffer = realloc(*buffer, *capacity);
+    }
+    char* tail = *buffer + offset + removed;
+    size_t tail_length = *size - offset - removed;
+    if (length < removed) {
+        for (size_t i = 0; i < tail_length; i++) {
+            (*buffer)[offset + length + i] = tail[i];
+        }
+    }
+    else if (length > removed) {
+        for (size_t i = tail_length; i > 0; i--) {
+            (*buffer)[offset + length + i - 1] = tail[i - 1];
+        }
+    }
+    for (size_t i = 0; i < length; i++) {
+        (*buffer)[offset + i] = text[i];
+    }
+    *size = new_size;
+    (*buffer)[new_size] = '\0';
+}
+
+// Byte offset of an LSP position in text, clamped to its line and to the text. Characters count bytes, which
+// is what editors count for the ASCII this language is written in
+size_t lsp_offset(const char* text, size_t length, const char* position){
+    long long line = lsp_integer(lsp_member(position, "line"), 0);
+    long long character = lsp_integer(lsp_member(position, "character"), 0);
+    size_t offset = 0;
+    for (long long l = 0; l < line && offset < length; offset++) {
+        if (text[offset] == '\n') {
+            l++;
+        }
+    }
+    for (long long c = 0; c < character && offset < length && text[offset] != '\n'; c++) {
+        offset++;
+    }
+    return offset;
+}
+
+// textDocument/didOpen, textDocument/didChange and textDocument/didClose, on the request thread
+void lsp_document_notification(struct lsp_server* server, int kind, const char* params){
+    const char* document = lsp_member(params, "textDocument");
+    char* uri = lsp_string(lsp_member(document, "uri"), NULL);
+    if (uri == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&server->lock);
+    struct lsp_document* open = lsp_find_document(server, uri);
+    if (kind == LSP_OPEN) {
+        size_t length;
+        char* text = lsp_string(lsp_member(document, "text"), &length);
+        if (text == NULL) {
+            text = calloc(1, 1);
+            length = 0;
+        }
+        if (open != NULL) {
+            open->closed = 1;
+        }
+        open = calloc(1, sizeof(struct lsp_document));
+        open->uri = uri;
+        uri = NULL;
+        open->text = text;
+        open->length = length;
+        open->capacity = length + 1;
+        if (server->num_documents == server->documents_capacity) {
+            server->documents_capacity = (server->documents_capacity == 0) ? 8 : server->documents_capacity * 2;
+            server->documents = realloc(server->documents, sizeof(struct lsp_document*) * server->documents_capacity);
+        }
+        server->documents[server->num_documents++] = open;
+    }
+    else if (open != NULL && kind == LSP_CHANGE) {
+        // Ranged changes apply one after another, one without a range replaces the whole text
+        const char* changes = lsp_member(params, "contentChanges");
+        const char* change = (changes != NULL && *changes == '[') ? lsp_space(changes + 1) : NULL;
+        while (change != NULL && *change == '{') {
+            size_t length;
+            char* text = lsp_string(lsp_member(change, "text"), &length);
+            const char* range = lsp_member(change, "range");
+            if (text != NULL && range != NULL) {
+                size_t start = lsp_offset(open->text, open->length, lsp_member(range, "start"));
+                size_t end = lsp_offset(open->text, open->length, lsp_member(range, "end"));
+                end = (end < start) ? start : end;
+                lsp_splice(&open->text, &open->length, &open->capacity, start, end - start, text, length);
+            }
+            else if (text != NULL) {
+                lsp_splice(&open->text, &open->length, &open->capacity, 0, open->length, text, length);
+            }
+            free(text);
+            change = lsp_skip(change);
+            change = (change != NULL) ? lsp_space(change) : NULL;
+            change = (change != NULL && *change == ',') ? lsp_space(change + 1) : NULL;
+        }
+    }
+    else if (open != NULL) {
+        open->closed = 1;
+    }
+    if (open != NULL) {
+        open->version = (int)lsp_integer(lsp_member(document, "version"), open->version);
+        if (!open->dirty) {
+            open->dirty = 1;
+            open->dirty_since = vm_now();
+        }
+        pthread_cond_signal(&server->wake);
+    }
+    pthread_mutex_unlock(&server->lock);
+    free(uri);
+}
+
+/******************************** Worker ********************************/
+// Line number of a line of error.txt, 0 if it names none. The errors print it after "line ", "Line " or "Line: "
+int lsp_error_line(const char* text, size_t length){
+    for (size_t i = 0; i < length; i++) {
+        size_t skip = incremental_match(text + i, length - i, "line ");
+        if (skip == 0) {
+            skip = incremental_match(text + i, length - i, "Line ");
+        }
+        if (skip == 0) {
+            skip = incremental_match(text + i, length - i, "Line: ");
+        }
+        if (skip > 0 && i + skip < length && text[i + skip] >= '0' && text[i + skip] <= '9') {
+            return (int)lsp_integer(text + i + skip, 0);
+        }
+    }
+    return 0;
+}
+
+// Publishes the errors of the document's last compilation, each over the whole line it names
+void lsp_publish(struct lsp_server* server, struct lsp_document* document, int version){
+    size_t errors_length = 0;
+    const char* errors = (document->compiler != NULL) ? compiler_output(document->compiler, COMPILER_OUT_ERRORS, &errors_length) : "";
+    char* body = NULL;
+    size_t length = 0;
+    FILE* out = open_memstream(&body, &length);
+    fprintf(out, "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/publishDiagnostics\",\"params\":{\"uri\":");
+    lsp_write_string(out, document->uri, lsp_length(document->uri));
+    fprintf(out, ",\"version\":%d,\"diagnostics\":[", version);
+    int first = 1;
+    for (size_t i = 0; i < errors_length;) {
+        size_t end = i;
+        while (end < errors_length && errors[end] != '\n') {
+            end++;
+        }
+        if (end > i) {
+            int line = lsp_error_line(errors + i, end - i);
+            line = (line > 0) ? line - 1 : 0;
+            // Measure the line in the text compiled
+            size_t start = 0;
+            for (int l = 0; l < line && start < document->compiled_length; start++) {
+                if (document->compiled[start] == '\n') {
+                    l++;
+                }
+            }
+            size_t stop = start;
+            while (stop < document->compiled_length && document->compiled[stop] != '\n') {
+                stop++;
+            }
+            fprintf(out, "%s{\"range\":{\"start\":{\"line\":%d,\"character\":0},\"end\":{\"line\":%d,\"character\":%zu}},"
+                    "\"severity\":1,\"source\":\"compiler\",\"message\":", first ? "" : ",", line, line, stop - start);
+            lsp_write_string(out, errors + i, end - i);
+            fputc('}', out);
+            first = 0;
+        }
+        i = end + 1;
+    }
+    fprintf(out, "]}}");
+    fclose(out);
+    lsp_send(server, body, length);
+    free(body);
+}
+
+void lsp_free_document(struct lsp_document* document){
+    compiler_free(document->compiler);
+    free(document->uri);
+    free(document->text);
+    free(document->compiled);
+    free(document);
+}
+
+// Compiles the changes of a dirty document as one edit and publishes its diagnostics. Called with the lock held,
+// which it lets go of while compiling
+void lsp_compile_document(struct lsp_server* server, struct lsp_document* document){
+    document->dirty = 0;
+    double since = document->dirty_since;
+    int version = document->version;
+    if (document->closed) {
+        // Clear the diagnostics of a closed document and free it
+        for (int i = 0; i < server->num_documents; i++) {
+            if (server->documents[i] == document) {
+                server->documents[i] = server->documents[--server->num_documents];
+                break;
+            }
+        }
+        pthread_mutex_unlock(&server->lock);
+        if (document->compiler != NULL) {
+            compiler_free(document->compiler);
+            document->compiler = NULL;
+            lsp_publish(server, document, version);
+        }
+        lsp_free_document(document);
+        pthread_mutex_lock(&server->lock);
+        return;
+    }
+
+    // The bytes between the common prefix and suffix of the texts are the edit
+    size_t prefix = 0;
+    size_t limit = (document->length < document->compiled_length) ? document->length : document->compiled_length;
+    while (prefix < limit && document->text[prefix] == document->compiled[prefix]) {
+        prefix++;
+    }
+    size_t suffix = 0;
+    while (suffix < limit - prefix && document->text[document->length - 1 - suffix] == document->compiled[document->compiled_length - 1 - suffix]) {
+        suffix++;
+    }
+    size_t removed = document->compiled_length - prefix - suffix;
+    size_t inserted = document->length - prefix - suffix;
+    lsp_splice(&document->compiled, &document->compiled_length, &document->compiled_capacity, prefix, removed, document->text + prefix, inserted);
+    pthread_mutex_unlock(&server->lock);
+
+    if (document->compiler == NULL) {
+        document->compiler = compiler_new(server->options);
+    }
+    if (document->compiler != NULL) {
+        const char* text = document->compiled + prefix;
+        if (compiler_edit(document->compiler, prefix, removed, text, inserted) < 0) {
+            compiler_compile(document->compiler, document->compiled, document->compiled_length);
+        }
+        lsp_publish(server, document, version);
+    }
+    lsp_record(server, LSP_DIAGNOSTICS, vm_now() - since);
+    pthread_mutex_lock(&server->lock);
+}
+
+// Answers a definition request from the last compilation of its document
+void lsp_answer_definition(struct lsp_server* server, struct lsp_document* document, struct lsp_request* request){
+    int line;
+    int character;
+    if (document == NULL || document->compiler == NULL ||
+        compiler_definition(document->compiler, request->line, request->character, &line, &character)) {
+        lsp_respond(server, request->id, "null");
+        return;
+    }
+    // The range covers the id in the text compiled, its chars being those the lexer puts in an id
+    size_t offset = 0;
+    for (int l = 0; l < line && offset < document->compiled_length; offset++) {
+        if (document->compiled[offset] == '\n') {
+            l++;
+        }
+    }
+    offset += character;
+    int end = character;
+    while (offset < document->compiled_length && incremental_word(document->compiled[offset])) {
+        offset++;
+        end++;
+    }
+    char* body = NULL;
+    size_t length = 0;
+    FILE* out = open_memstream(&body, &length);
+    fprintf(out, "{\"uri\":");
+    lsp_write_string(out, document->uri, lsp_length(document->uri));
+    fprintf(out, ",\"range\":{\"start\":{\"line\":%d,\"character\":%d},\"end\":{\"line\":%d,\"character\":%d}}}", line, character, line, end);
+    fclose(out);
+    lsp_respond(server, request->id, body);
+    free(body);
+}
+
+// Compiles dirty documents, then answers definition requests, until told to stop
+void* lsp_worker(void* argument){
+    struct lsp_server* server = argument;
+    pthread_mutex_lock(&server->lock);
+    while (!server->stopping) {
+        struct lsp_document* dirty = NULL;
+        for (int i = 0; i < server->num_documents && dirty == NULL; i++) {
+            if (server->documents[i]->dirty) {
+                dirty = server->documents[i];
+            }
+        }
+        if (dirty != NULL) {
+            lsp_compile_document(server, dirty);
+            continue;
+        }
+        if (server->num_requests > 0) {
+            struct lsp_request request = server->requests[0];
+            server->num_requests--;
+            for (int i = 0; i < server->num_requests; i++) {
+                server->requests[i] = server->requests[i + 1];
+            }
+            // Only the worker frees documents, so it can use this one unlocked
+            struct lsp_document* document = lsp_find_document(server, request.uri);
+            pthread_mutex_unlock(&server->lock);
+            lsp_answer_definition(server, document, &request);
+            lsp_record(server, LSP_DEFINITION, vm_now() - request.received);
+            free(request.id);
+            free(request.uri);
+            pthread_mutex_lock(&server->lock);
+            continue;
+        }
+        pthread_cond_wait(&server->wake, &server->lock);
+    }
+    pthread_mutex_unlock(&server->lock);
+    return NULL;
+}
+
+/******************************** Server ********************************/
+// Handles one message on the request thread. Returns 1 once the client sent exit
+int lsp_handle(struct lsp_server* server, const char* body){
+    double received = vm_now();
+    char* method = lsp_string(lsp_member(body, "method"), NULL);
+    char* id = lsp_raw(lsp_member(body, "id"));
+    const char* params = lsp_member(body, "params");
+    int kind = LSP_INITIALIZE;
+    int exiting = 0;
+    if (method == NULL) {
+        // A response to a request of ours, the server makes none
+    }
+    else if (compare_strings(method, "initialize") == 0 && id != NULL) {
+        lsp_respond(server, id, "{\"capabilities\":{\"textDocumentSync\":{\"openClose\":true,\"change\":2},\"definitionProvider\":true},"
+                    "\"serverInfo\":{\"name\":\"compiler\"}}");
+    }
+    else if (compare_strings(method, "textDocument/didOpen") == 0) {
+        kind = LSP_OPEN;
+        lsp_document_notification(server, kind, params);
+    }
+    else if (compare_strings(method, "textDocument/didChange") == 0) {
+        kind = LSP_CHANGE;
+        lsp_document_notification(server, kind, params);
+    }
+    else if (compare_strings(method, "textDocument/didClose") == 0) {
+        kind = LSP_CLOSE;
+        lsp_document_notification(server, kind, params);
+    }
+    else if (compare_strings(method, "textDocument/definition") == 0 && id != NULL) {
+        // Queue it for the worker, which times it from here
+        struct lsp_request request;
+        request.id = id;
+        request.uri = lsp_string(lsp_member(lsp_member(params, "textDocument"), "uri"), NULL);
+        const char* position = lsp_member(params, "position");
+        request.line = (int)lsp_integer(lsp_member(position, "line"), 0);
+        request.character = (int)lsp_integer(lsp_member(position, "character"), 0);
+        request.received = received;
+        if (request.uri == NULL) {
+            request.uri = calloc(1, 1);
+        }
+        id = NULL;
+        pthread_mutex_lock(&server->lock);
+        if (server->num_requests == server->requests_capacity) {
+            server->requests_capacity = (server->requests_capacity == 0) ? 16 : server->requests_capacity * 2;
+            server->requests = realloc(server->requests, sizeof(struct lsp_request) * server->requests_capacity);
+        }
+        server->requests[server->num_requests++] = request;
+        pthread_cond_signal(&server->wake);
+        pthread_mutex_unlock(&server->lock);
+        free(method);
+        return 0;
+    }
+    else if (compare_strings(method, "$/cancelRequest") == 0) {
+        // Take the request back if the worker hasn't got to it, and answer it as cancelled
+        char* cancel = lsp_raw(lsp_member(params, "id"));
+        struct lsp_request request = {NULL, NULL, 0, 0, 0};
+        pthread_mutex_lock(&server->lock);
+        for (int i = 0; cancel != NULL && i < server->num_requests; i++) {
+            if (compare_strings(server->requests[i].id, cancel) == 0) {
+                request = server->requests[i];
+                server->num_requests--;
+                for (int k = i; k < server->num_requests; k++) {
+                    server->requests[k] = server->requests[k + 1];
+                }
+                break;
+            }
+        }
+        pthread_mutex_unlock(&server->lock);
+        if (request.id != NULL) {
+            lsp_respond_error(server, request.id, LSP_CANCELLED, "Request cancelled");
+            free(request.id);
+            free(request.uri);
+        }
+        free(cancel);
+    }
+    else if (compare_strings(method, "shutdown") == 0 && id != NULL) {
+        server->shutdown = 1;
+        lsp_respond(server, id, "null");
+    }
+    else if (compare_strings(method, "exit") == 0) {
+        exiting = 1;
+    }
+    else if (id != NULL) {
+        lsp_respond_error(server, id, LSP_METHOD_NOT_FOUND, "Method not found");
+    }
+    // Notifications other than the document ones aren't timed
+    if (method != NULL && !exiting && (kind != LSP_INITIALIZE || id != NULL)) {
+        lsp_record(server, kind, vm_now() - received);
+    }
+    free(method);
+    free(id);
+    return exiting;
+}
+
+// Serves the client on stdin and stdout until it sends exit or closes stdin, then prints the latency histograms.
+// Returns 0 if the client asked for shutdown first, otherwise 1
+int lsp_run(struct compiler_options options){
+    struct lsp_server server = {0};
+    pthread_mutex_init(&server.lock, NULL);
+    pthread_cond_init(&server.wake, NULL);
+    pthread_mutex_init(&server.output, NULL);
+    server.options = options;
+    if (server.options.incremental < 1) {
+        server.options.incremental = LSP_DEFAULT_CACHE;
+    }
+    pthread_t worker;
+    pthread_create(&worker, NULL, lsp_worker, &server);
+
+    char* body = NULL;
+    size_t capacity = 0;
+    int read;
+    while ((read = lsp_read_message(&body, &capacity)) != 1) {
+        if (read == 2) {
+            lsp_respond_error(&server, "null", LSP_PARSE_ERROR, "Message too large");
+            continue;
+        }
+        if (lsp_member(body, "jsonrpc") == NULL) {
+            lsp_respond_error(&server, "null", LSP_PARSE_ERROR, "Parse error");
+            continue;
+        }
+        if (lsp_handle(&server, body)) {
+            break;
+        }
+    }
+
+    pthread_mutex_lock(&server.lock);
+    server.stopping = 1;
+    pthread_cond_signal(&server.wake);
+    pthread_mutex_unlock(&server.lock);
+    pthread_join(worker, NULL);
+    lsp_print_histograms(&server, stderr);
+
+    for (int i = 0; i < server.num_documents; i++) {
+        lsp_free_document(server.documents[i]);
+    }
+    for (int i = 0; i < server.num_requests; i++) {
+        free(server.requests[i].id);
+        free(server.requests[i].uri);
+    }
+    free(server.documents);
+    free(server.requests);
+    free(body);
+    pthread_mutex_destroy(&server.lock);
+    pthread_cond_destroy(&server.wake);
+    pthread_mutex_destroy(&server.output);
+    return server.shutdown ? 0 : 1;
+}
+
+#endif // LSP_H
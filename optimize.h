@@ -0,0 +1,2933 @@
+#ifndef OPTIMIZE_H
+#define OPTIMIZE_H
+
+/******************************** Struct Definitions ********************************/
+// DATAFLOW
+// Numbers every variable and temp a function touches so dataflow sets can be stored as bit vectors
+struct tac_slots{
+    int num_vars;                    // Number of distinct variables
+    int capacity;                    // Allocated variable slots
+    char** vars;                     // Variable names, slot i is vars[i]
+    int* is_global;                  // True(1) if vars[i] is not a param or local of the function
+    int min_temp;                    // Lowest temp number in the function
+    int max_temp;                    // Highest temp number in the function
+    int num_slots;                   // num_vars + number of temps in [min_temp, max_temp]
+    int words;                       // Words per bit vector
+};
+
+// A basic block, a run of instructions entered only at the top and left only at the bottom
+struct tac_block{
+    int start;                       // First instruction
+    int end;                         // One past the last instruction
+    int num_succ;                    // Number of successor blocks
+    int* succ;                       // Successor block indeces, -1 is the function exit
+    int num_pred;                    // Number of predecessor blocks
+    int* pred;                       // Predecessor block indeces
+    int reachable;                   // True(1) if reachable from the entry block
+    unsigned int* use;               // Slots read before written in the block
+    unsigned int* def;               // Slots written in the block
+    unsigned int* in;                // Slots live on entry
+    unsigned int* out;               // Slots live on exit
+};
+
+// Control flow graph of one function
+struct tac_cfg{
+    struct tac_function* function;   // Function the graph was built from
+    struct tac_slots slots;          // Slot numbering for the bit vectors
+    int num_blocks;                  //
+    struct tac_block* blocks;        //
+    unsigned int* globals;           // Slots of global variables, read by every call
+    unsigned int* exit_live;         // Slots live when the function returns
+};
+
+#define NUM_PEEPHOLE_RULES 7
+
+// Per function optimization counters, written to opt_report.txt
+struct opt_stats{
+    int before;                      // Instructions before optimization
+    int after;                       // Instructions after optimization
+    int dead_stores;                 // Pure instructions whose result is never read
+    int unreachable;                 // Instructions in blocks with no path from the entry
+    int labels;                      // Labels no jump refers to
+    int constants;                   // Operands replaced by a constant, operations and branches folded
+    int peephole[NUM_PEEPHOLE_RULES];// Hits of each peephole rule
+    int loops;                       // Natural loops found
+    int hoisted;                     // Loop invariant instructions moved to a preheader
+    int reduced;                     // Induction variable multiplications replaced by additions
+    int unrolled;                    // Loops replaced by copies of their body
+    int partially_unrolled;          // Loops whose body was copied UNROLL_FACTOR times per exit test
+    int inlined;                     // Calls replaced by a copy of the callee
+    int tail_calls;                  // Self tail calls turned into a jump to the entry
+    int tail_marked;                 // Other calls marked as tail calls
+    int specialized;                 // Params replaced by the constant every call passes
+    int constant_returns;            // Calls whose result was replaced by the callee's constant return
+    int temps;                       // Distinct temps before allocation
+    int slots;                       // Temp slots after allocation
+    int frame_before;                // BeginFunc size before allocation
+    int frame_after;                 // BeginFunc size after allocation
+};
+
+// Live interval of one temp over the linear instruction order
+struct live_interval{
+    int temp;                        // Temp number before allocation
+    int type;                        // Temp type (1 for int || 0 for double || -1 unknown)
+    int start;                       // First instruction the temp is live at
+    int end;                         // Last instruction the temp is live at
+    int slot;                        // Assigned slot, printed as the new temp number
+};
+
+/******************************** Bit Vectors ********************************/
+unsigned int* bits_new(int words){
+    return calloc(words > 0 ? words : 1, sizeof(unsigned int));
+}
+
+void bits_set(unsigned int* bits, int i){
+    bits[i / 32] |= (1u << (i % 32));
+}
+
+void bits_clear(unsigned int* bits, int i){
+    bits[i / 32] &= ~(1u << (i % 32));
+}
+
+int bits_test(unsigned int* bits, int i){
+    return (bits[i / 32] >> (i % 32)) & 1u;
+}
+
+void bits_copy(unsigned int* dest, unsigned int* src, int words){
+    for (int i = 0; i < words; i++) {
+        dest[i] = src[i];
+    }
+}
+
+// dest |= src, returns True(1) if dest changed
+int bits_union(unsigned int* dest, unsigned int* src, int words){
+    int changed = 0;
+    for (int i = 0; i < words; i++) {
+        unsigned int merged = dest[i] | src[i];
+        if (merged != dest[i]) {
+            dest[i] = merged;
+            changed = 1;
+        }
+    }
+    return changed;
+}
+
+/******************************** Slots ********************************/
+// Returns the slot of a variable or temp, -1 for constants, empty operands and unknown names
+int slot_of(struct tac_slots* slots, struct tac_operand operand){
+    if (operand.kind == TAC_TEMP) {
+        if (operand.temp < slots->min_temp || operand.temp > slots->max_temp) {
+            return -1;
+        }
+        return slots->num_vars + (operand.temp - slots->min_temp);
+    }
+    if (operand.kind == TAC_VAR) {
+        for (int i = 0; i < slots->num_vars; i++) {
+            if (compare_strings(slots->vars[i], operand.name) == 0) {
+                return i;
+            }
+        }
+    }
+    return -1;
+}
+
+// Adds a variable to the slot table if it is not already there
+void slots_add_var(struct tac_slots* slots, struct tac_function* function, struct tac_operand operand){
+    if (operand.kind != TAC_VAR || slot_of(slots, operand) >= 0) {
+        return;
+    }
+    if (slots->num_vars == slots->capacity) {
+        slots->capacity = (slots->capacity == 0) ? 16 : slots->capacity * 2;
+        slots->vars = realloc(slots->vars, sizeof(char*) * slots->capacity);
+        slots->is_global = realloc(slots->is_global, sizeof(int) * slots->capacity);
+    }
+    slots->vars[slots->num_vars] = operand.name;
+    slots->is_global[slots->num_vars] = function->is_main || !tac_is_local(function, operand.name);
+    slots->num_vars++;
+}
+
+// Widens the temp range of the slot table to include a temp
+void slots_add_temp(struct tac_slots* slots, struct tac_operand operand){
+    if (operand.kind != TAC_TEMP) {
+        return;
+    }
+    if (slots->min_temp < 0 || operand.temp < slots->min_temp) {
+        slots->min_temp = operand.temp;
+    }
+    if (operand.temp > slots->max_temp) {
+        slots->max_temp = operand.temp;
+    }
+}
+
+// Numbers every variable and temp used in a function
+struct tac_slots build_slots(struct tac_function* function){
+    struct tac_slots slots = {0, 0, NULL, NULL, -1, -1, 0, 0};
+    for (int i = 0; i < function->num_instrs; i++) {
+        struct tac_instr* instr = &function->instrs[i];
+        slots_add_var(&slots, function, instr->dest);
+        slots_add_var(&slots, function, instr->arg1);
+        slots_add_var(&slots, function, instr->arg2);
+        slots_add_temp(&slots, instr->dest);
+        slots_add_temp(&slots, instr->arg1);
+        slots_add_temp(&slots, instr->arg2);
+    }
+    int num_temps = (slots.min_temp < 0) ? 0 : slots.max_temp - slots.min_temp + 1;
+    slots.num_slots = slots.num_vars + num_temps;
+    slots.words = (slots.num_slots + 31) / 32;
+    return slots;
+}
+
+// Adds the slots an instruction reads to a bit vector
+void instr_uses(struct tac_cfg* cfg, struct tac_instr* instr, unsigned int* bits){
+    int slot = slot_of(&cfg->slots, instr->arg1);
+    if (slot >= 0) {
+        bits_set(bits, slot);
+    }
+    slot = slot_of(&cfg->slots, instr->arg2);
+    if (slot >= 0) {
+        bits_set(bits, slot);
+    }
+    // A call may read any global
+    if (instr->op == TAC_LCALL) {
+        bits_union(bits, cfg->globals, cfg->slots.words);
+    }
+}
+
+// Returns the slot an instruction writes, -1 if none
+int instr_def(struct tac_cfg* cfg, struct tac_instr* instr){
+    if (instr->op == TAC_NOP || instr->op == TAC_LABEL || tac_is_jump(instr->op)) {
+        return -1;
+    }
+    return slot_of(&cfg->slots, instr->dest);
+}
+
+/******************************** Control Flow Graph ********************************/
+// Adds an edge from a block to every block starting with a label (-1 when no such label exists)
+void cfg_add_label_edges(struct tac_cfg* cfg, struct tac_block* block, int label){
+    int found = 0;
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        struct tac_instr* first = &cfg->function->instrs[cfg->blocks[b].start];
+        if (first->op == TAC_LABEL && first->label == label) {
+            block->succ[block->num_succ++] = b;
+            found = 1;
+        }
+    }
+    // Jumps to labels that do not exist leave the function
+    if (!found) {
+        block->succ[block->num_succ++] = -1;
+    }
+}
+
+// Splits a compacted function into basic blocks and links them
+struct tac_cfg build_cfg(struct tac_function* function){
+    struct tac_cfg cfg;
+    cfg.function = function;
+    cfg.slots = build_slots(function);
+    cfg.num_blocks = 0;
+    cfg.blocks = malloc(sizeof(struct tac_block) * (function->num_instrs + 1));
+
+    // Find leaders, every label and every instruction after a jump starts a block
+    for (int i = 0; i < function->num_instrs; i++) {
+        int leader = (i == 0) || function->instrs[i].op == TAC_LABEL || tac_is_jump(function->instrs[i - 1].op);
+        if (leader) {
+            if (cfg.num_blocks > 0) {
+                cfg.blocks[cfg.num_blocks - 1].end = i;
+            }
+            cfg.blocks[cfg.num_blocks].start = i;
+            cfg.num_blocks++;
+        }
+    }
+    if (cfg.num_blocks > 0) {
+        cfg.blocks[cfg.num_blocks - 1].end = function->num_instrs;
+    }
+
+    // Count labels so a jump to a duplicated label has room for every target
+    int num_labels = 0;
+    for (int b = 0; b < cfg.num_blocks; b++) {
+        if (function->instrs[cfg.blocks[b].start].op == TAC_LABEL) {
+            num_labels++;
+        }
+    }
+
+    // Link blocks
+    for (int b = 0; b < cfg.num_blocks; b++) {
+        struct tac_block* block = &cfg.blocks[b];
+        struct tac_instr* last = &function->instrs[block->end - 1];
+        block->succ = malloc(sizeof(int) * (num_labels + 2));
+        block->num_succ = 0;
+        block->reachable = 0;
+        block->use = NULL;
+        block->def = NULL;
+        block->in = NULL;
+        block->out = NULL;
+        if (tac_is_branch(last->op)) {
+            cfg_add_label_edges(&cfg, block, last->label);
+        }
+        if (last->op != TAC_GOTO && last->op != TAC_RETURN) {
+            // Falls through to the next block or off the end of the function
+            block->succ[block->num_succ++] = (b + 1 < cfg.num_blocks) ? b + 1 : -1;
+        }
+        if (last->op == TAC_RETURN) {
+            block->succ[block->num_succ++] = -1;
+        }
+    }
+
+    // Predecessors are the reverse of the successor edges
+    for (int b = 0; b < cfg.num_blocks; b++) {
+        cfg.blocks[b].num_pred = 0;
+    }
+    for (int b = 0; b < cfg.num_blocks; b++) {
+        for (int s = 0; s < cfg.blocks[b].num_succ; s++) {
+            if (cfg.blocks[b].succ[s] >= 0) {
+                cfg.blocks[cfg.blocks[b].succ[s]].num_pred++;
+            }
+        }
+    }
+    for (int b = 0; b < cfg.num_blocks; b++) {
+        cfg.blocks[b].pred = malloc(sizeof(int) * (cfg.blocks[b].num_pred + 1));
+        cfg.blocks[b].num_pred = 0;
+    }
+    for (int b = 0; b < cfg.num_blocks; b++) {
+        for (int s = 0; s < cfg.blocks[b].num_succ; s++) {
+            int succ = cfg.blocks[b].succ[s];
+            if (succ >= 0) {
+                cfg.blocks[succ].pred[cfg.blocks[succ].num_pred++] = b;
+            }
+        }
+    }
+
+    // Globals and the live set at exit
+    int words = cfg.slots.words;
+    cfg.globals = bits_new(words);
+    cfg.exit_live = bits_new(words);
+    for (int i = 0; i < cfg.slots.num_vars; i++) {
+        if (cfg.slots.is_global[i]) {
+            bits_set(cfg.globals, i);
+        }
+    }
+    // Globals outlive a function, but nothing runs after main unless its final variables are an output
+    if (!function->is_main || function->keeps_vars) {
+        bits_copy(cfg.exit_live, cfg.globals, words);
+    }
+    return cfg;
+}
+
+void free_cfg(struct tac_cfg* cfg){
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        free(cfg->blocks[b].succ);
+        free(cfg->blocks[b].pred);
+        free(cfg->blocks[b].use);
+        free(cfg->blocks[b].def);
+        free(cfg->blocks[b].in);
+        free(cfg->blocks[b].out);
+    }
+    free(cfg->blocks);
+    free(cfg->slots.vars);
+    free(cfg->slots.is_global);
+    free(cfg->globals);
+    free(cfg->exit_live);
+}
+
+// Marks every block reachable from the entry block
+void cfg_mark_reachable(struct tac_cfg* cfg){
+    if (cfg->num_blocks == 0) {
+        return;
+    }
+    int* stack = malloc(sizeof(int) * cfg->num_blocks);
+    int top = 0;
+    stack[top++] = 0;
+    cfg->blocks[0].reachable = 1;
+    while (top > 0) {
+        struct tac_block* block = &cfg->blocks[stack[--top]];
+        for (int s = 0; s < block->num_succ; s++) {
+            int succ = block->succ[s];
+            if (succ >= 0 && !cfg->blocks[succ].reachable) {
+                cfg->blocks[succ].reachable = 1;
+                stack[top++] = succ;
+            }
+        }
+    }
+    free(stack);
+}
+
+/******************************** Liveness ********************************/
+// Backward dataflow: in = use | (out - def), out = union of in over successors
+void compute_liveness(struct tac_cfg* cfg){
+    int words = cfg->slots.words;
+    struct tac_function* function = cfg->function;
+
+    // Local use and def sets of each block
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        struct tac_block* block = &cfg->blocks[b];
+        block->use = bits_new(words);
+        block->def = bits_new(words);
+        block->in = bits_new(words);
+        block->out = bits_new(words);
+        unsigned int* reads = bits_new(words);
+        for (int i = block->start; i < block->end; i++) {
+            struct tac_instr* instr = &function->instrs[i];
+            for (int w = 0; w < words; w++) {
+                reads[w] = 0;
+            }
+            instr_uses(cfg, instr, reads);
+            // A read counts as a use unless the block already wrote the slot
+            for (int w = 0; w < words; w++) {
+                block->use[w] |= reads[w] & ~block->def[w];
+            }
+            int def = instr_def(cfg, instr);
+            if (def >= 0) {
+                bits_set(block->def, def);
+            }
+        }
+        free(reads);
+    }
+
+    // Iterate to a fixed point, visiting blocks in reverse order so most sets settle in one pass
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (int b = cfg->num_blocks - 1; b >= 0; b--) {
+            struct tac_block* block = &cfg->blocks[b];
+            for (int s = 0; s < block->num_succ; s++) {
+                if (block->succ[s] < 0) {
+                    bits_union(block->out, cfg->exit_live, words);
+                }
+                else {
+                    bits_union(block->out, cfg->blocks[block->succ[s]].in, words);
+                }
+            }
+            for (int w = 0; w < words; w++) {
+                unsigned int in = block->use[w] | (block->out[w] & ~block->def[w]);
+                if (in != block->in[w]) {
+                    block->in[w] = in;
+                    changed = 1;
+                }
+            }
+        }
+    }
+}
+
+/******************************** Passes ********************************/
+// Removes pure instructions whose result is not live afterwards, returns the number removed
+int eliminate_dead_stores(struct tac_cfg* cfg){
+    int removed = 0;
+    int words = cfg->slots.words;
+    unsigned int* live = bits_new(words);
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        struct tac_block* block = &cfg->blocks[b];
+        bits_copy(live, block->out, words);
+        for (int i = block->end - 1; i >= block->start; i--) {
+            struct tac_instr* instr = &cfg->function->instrs[i];
+            int def = instr_def(cfg, instr);
+            if (def >= 0 && tac_is_pure(instr->op) && !bits_test(live, def)) {
+                instr->op = TAC_NOP;
+                removed++;
+                continue;
+            }
+            if (def >= 0) {
+                bits_clear(live, def);
+            }
+            instr_uses(cfg, instr, live);
+        }
+    }
+    free(live);
+    return removed;
+}
+
+// Removes every block with no path from the entry, returns the number of instructions removed
+int eliminate_unreachable(struct tac_cfg* cfg){
+    int removed = 0;
+    cfg_mark_reachable(cfg);
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        if (cfg->blocks[b].reachable) {
+            continue;
+        }
+        for (int i = cfg->blocks[b].start; i < cfg->blocks[b].end; i++) {
+            cfg->function->instrs[i].op = TAC_NOP;
+            removed++;
+        }
+    }
+    return removed;
+}
+
+// Removes labels that no Goto, IFZ or IF refers to, returns the number removed
+int eliminate_unreferenced_labels(struct tac_function* function){
+    int removed = 0;
+    for (int i = 0; i < function->num_instrs; i++) {
+        if (function->instrs[i].op != TAC_LABEL) {
+            continue;
+        }
+        int referenced = 0;
+        for (int j = 0; j < function->num_instrs && !referenced; j++) {
+            if (tac_is_branch(function->instrs[j].op) && function->instrs[j].label == function->instrs[i].label) {
+                referenced = 1;
+            }
+        }
+        if (!referenced) {
+            function->instrs[i].op = TAC_NOP;
+            removed++;
+        }
+    }
+    return removed;
+}
+
+/******************************** Constant Propagation ********************************/
+#define CONST_UNDEF 0                // No definition reaches the slot yet
+#define CONST_KNOWN 1                // The same constant on every path
+#define CONST_VARYING 2              // Different or unknown values
+
+// Lattice value of one slot
+struct const_value{
+    int state;                       // CONST_UNDEF, CONST_KNOWN or CONST_VARYING
+    struct tac_operand constant;     // The constant when state is CONST_KNOWN
+};
+
+// True(1) if the operand is an integer constant, stores its value
+int const_int(struct tac_operand operand, long long* value){
+    if (operand.kind != TAC_CONST || operand.type != 1) {
+        return 0;
+    }
+    char* end;
+    long long parsed = strtoll(operand.name, &end, 10);
+    if (*end != '\0') {
+        return 0;
+    }
+    *value = parsed;
+    return 1;
+}
+
+// Returns an integer constant operand holding value, its lexeme owned by the program
+struct tac_operand int_const(struct tac_program* program, long long value){
+    return tac_const(tac_int_lexeme(program, value), 1);
+}
+
+// Evaluates a comparison opcode on two integers
+int eval_relop(int op, long long a, long long b){
+    switch (op) {
+        case TAC_LT:
+            return a < b;
+        case TAC_GT:
+            return a > b;
+        case TAC_EQ:
+            return a == b;
+        case TAC_LE:
+            return a <= b;
+        case TAC_GE:
+            return a >= b;
+        case TAC_NE:
+            return a != b;
+    }
+    return 0;
+}
+
+struct const_value const_varying(){
+    struct const_value value = {CONST_VARYING, {TAC_NONE, NULL, -1, -1}};
+    return value;
+}
+
+struct const_value const_known(struct tac_operand constant){
+    struct const_value value = {CONST_KNOWN, constant};
+    return value;
+}
+
+// True(1) if two known values are the same constant
+int const_same(struct const_value a, struct const_value b){
+    return a.constant.type == b.constant.type && compare_strings(a.constant.name, b.constant.name) == 0;
+}
+
+// dest = dest meet src, returns True(1) if dest changed
+int const_meet(struct const_value* dest, struct const_value src){
+    if (src.state == CONST_UNDEF || dest->state == CONST_VARYING) {
+        return 0;
+    }
+    if (dest->state == CONST_UNDEF) {
+        *dest = src;
+        return 1;
+    }
+    if (src.state == CONST_VARYING || !const_same(*dest, src)) {
+        *dest = const_varying();
+        return 1;
+    }
+    return 0;
+}
+
+// Value of an operand in a state
+struct const_value const_operand(struct tac_slots* slots, struct const_value* values, struct tac_operand operand){
+    if (operand.kind == TAC_CONST) {
+        return const_known(operand);
+    }
+    int slot = slot_of(slots, operand);
+    return (slot < 0) ? const_varying() : values[slot];
+}
+
+// Folds an operation on two values. Only integer arithmetic is folded, and only when the result fits
+// an int, so folding never changes what the program computes.
+struct const_value const_fold(struct tac_program* program, int op, struct const_value a, struct const_value b){
+    if (op == TAC_ASSIGN) {
+        return a;
+    }
+    if (a.state == CONST_UNDEF || (op != TAC_NOT && b.state == CONST_UNDEF)) {
+        struct const_value undef = {CONST_UNDEF, {TAC_NONE, NULL, -1, -1}};
+        return undef;
+    }
+    long long x, y = 0, result;
+    if (a.state != CONST_KNOWN || !const_int(a.constant, &x)) {
+        return const_varying();
+    }
+    if (op != TAC_NOT && (b.state != CONST_KNOWN || !const_int(b.constant, &y))) {
+        return const_varying();
+    }
+    switch (op) {
+        case TAC_ADD:
+            result = x + y;
+            break;
+        case TAC_SUB:
+            result = x - y;
+            break;
+        case TAC_MUL:
+            result = x * y;
+            break;
+        case TAC_DIV:
+        case TAC_MOD:
+            if (y == 0) {
+                return const_varying();
+            }
+            result = (op == TAC_DIV) ? x / y : x % y;
+            break;
+        case TAC_OR:
+            result = (x != 0) || (y != 0);
+            break;
+        case TAC_NOT:
+            result = (x == 0);
+            break;
+        default:
+            if (!tac_is_relop(op)) {
+                return const_varying();
+            }
+            result = eval_relop(op, x, y);
+    }
+    if (result > 2147483647LL || result < -2147483647LL - 1) {
+        return const_varying();
+    }
+    return const_known(int_const(program, result));
+}
+
+// Applies one instruction to a state
+void const_transfer(struct tac_program* program, struct tac_cfg* cfg, struct const_value* values, struct tac_instr* instr){
+    int def = instr_def(cfg, instr);
+    if (def >= 0) {
+        if (instr->op == TAC_LCALL || !tac_is_pure(instr->op)) {
+            values[def] = const_varying();
+        }
+        else {
+            values[def] = const_fold(program, instr->op, const_operand(&cfg->slots, values, instr->arg1),
+                                              const_operand(&cfg->slots, values, instr->arg2));
+        }
+    }
+    // The callee may assign any global
+    if (instr->op == TAC_LCALL) {
+        for (int s = 0; s < cfg->slots.num_vars; s++) {
+            if (cfg->slots.is_global[s]) {
+                values[s] = const_varying();
+            }
+        }
+    }
+}
+
+// Replaces a variable or temp operand whose value is known by the constant, returns True(1) if it did
+int const_substitute(struct tac_slots* slots, struct const_value* values, struct tac_operand* operand){
+    if (operand->kind != TAC_VAR && operand->kind != TAC_TEMP) {
+        return 0;
+    }
+    struct const_value value = const_operand(slots, values, *operand);
+    if (value.state != CONST_KNOWN) {
+        return 0;
+    }
+    *operand = value.constant;
+    return 1;
+}
+
+// Forward dataflow over the blocks: a slot holds a constant on entry to a block if every predecessor
+// leaves the same constant in it. Params, globals and uninitialized locals are unknown at the entry.
+// Reads of known slots are replaced by the constant, integer operations on constants are folded and
+// conditional branches on constants become a Goto or disappear. Returns the number of rewrites.
+int propagate_constants(struct tac_function* function, struct tac_program* program){
+    if (function->num_instrs == 0) {
+        return 0;
+    }
+    struct tac_cfg cfg = build_cfg(function);
+    cfg_mark_reachable(&cfg);
+    int num_slots = cfg.slots.num_slots;
+    struct const_value** in = malloc(sizeof(struct const_value*) * cfg.num_blocks);
+    for (int b = 0; b < cfg.num_blocks; b++) {
+        in[b] = calloc(num_slots + 1, sizeof(struct const_value));
+    }
+    for (int s = 0; s < num_slots; s++) {
+        in[0][s] = const_varying();
+    }
+
+    // Iterate to a fixed point in block order
+    struct const_value* values = malloc(sizeof(struct const_value) * (num_slots + 1));
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (int b = 0; b < cfg.num_blocks; b++) {
+            if (!cfg.blocks[b].reachable) {
+                continue;
+            }
+            for (int s = 0; s < num_slots; s++) {
+                values[s] = in[b][s];
+            }
+            for (int i = cfg.blocks[b].start; i < cfg.blocks[b].end; i++) {
+                const_transfer(program, &cfg, values, &function->instrs[i]);
+            }
+            for (int n = 0; n < cfg.blocks[b].num_succ; n++) {
+                int succ = cfg.blocks[b].succ[n];
+                for (int s = 0; succ >= 0 && s < num_slots; s++) {
+                    changed |= const_meet(&in[succ][s], values[s]);
+                }
+            }
+        }
+    }
+
+    // Rewrite each block walking its state forward
+    int rewrites = 0;
+    for (int b = 0; b < cfg.num_blocks; b++) {
+        if (!cfg.blocks[b].reachable) {
+            continue;
+        }
+        for (int s = 0; s < num_slots; s++) {
+            values[s] = in[b][s];
+        }
+        for (int i = cfg.blocks[b].start; i < cfg.blocks[b].end; i++) {
+            struct tac_instr* instr = &function->instrs[i];
+            if (instr->op != TAC_LABEL && instr->op != TAC_NOP) {
+                rewrites += const_substitute(&cfg.slots, values, &instr->arg1);
+                rewrites += const_substitute(&cfg.slots, values, &instr->arg2);
+            }
+            if (tac_is_pure(instr->op) && instr->op != TAC_ASSIGN) {
+                struct const_value folded = const_fold(program, instr->op, const_operand(&cfg.slots, values, instr->arg1),
+                                                       const_operand(&cfg.slots, values, instr->arg2));
+                if (folded.state == CONST_KNOWN) {
+                    *instr = tac_instr_new(TAC_ASSIGN, instr->dest, folded.constant, tac_none());
+                    rewrites++;
+                }
+            }
+            long long x, y;
+            if (instr->op == TAC_IF && const_int(instr->arg1, &x) && const_int(instr->arg2, &y)) {
+                instr->op = eval_relop(instr->relop, x, y) ? TAC_GOTO : TAC_NOP;
+                instr->arg1 = tac_none();
+                instr->arg2 = tac_none();
+                rewrites++;
+            }
+            if (instr->op == TAC_IFZ && const_int(instr->arg1, &x)) {
+                instr->op = (x == 0) ? TAC_GOTO : TAC_NOP;
+                instr->arg1 = tac_none();
+                rewrites++;
+            }
+            const_transfer(program, &cfg, values, instr);
+        }
+    }
+
+    free(values);
+    for (int b = 0; b < cfg.num_blocks; b++) {
+        free(in[b]);
+    }
+    free(in);
+    free_cfg(&cfg);
+    tac_compact(function);
+    return rewrites;
+}
+
+/******************************** Peephole ********************************/
+// State shared by the peephole rules during one sweep over a function
+struct peephole_state{
+    struct tac_function* function;   //
+    int min_temp;                    // Lowest temp number in the function
+    int* uses;                       // Reads of each temp, -1 once a rule has changed the temp this sweep
+    int* label_pos;                  // Instruction index of each label, -1 if the label is not in the function
+    int num_labels;                  // Size of label_pos
+};
+
+// A rule looks at the window starting at instruction i and rewrites it in place, returning True(1) on a hit
+struct peephole_rule{
+    const char* name;                // Name written to opt_report.txt
+    int (*apply)(struct peephole_state*, int);
+};
+
+// Index of the next instruction that has not been removed, num_instrs if there is none
+int next_instr(struct tac_function* function, int i){
+    i++;
+    while (i < function->num_instrs && function->instrs[i].op == TAC_NOP) {
+        i++;
+    }
+    return i;
+}
+
+// Index of the first real instruction at or after i, skipping removed instructions and labels
+int skip_labels(struct tac_function* function, int i){
+    while (i < function->num_instrs && (function->instrs[i].op == TAC_NOP || function->instrs[i].op == TAC_LABEL)) {
+        i++;
+    }
+    return i;
+}
+
+// True(1) if the operand is a temp read exactly once in the function
+int single_use(struct peephole_state* state, struct tac_operand operand){
+    return operand.kind == TAC_TEMP && state->uses[operand.temp - state->min_temp] == 1;
+}
+
+// Stops further rules from trusting the use count of a temp until the next sweep
+void touch_temp(struct peephole_state* state, struct tac_operand operand){
+    if (operand.kind == TAC_TEMP) {
+        state->uses[operand.temp - state->min_temp] = -1;
+    }
+}
+
+// True(1) if the operand is a constant equal to value
+int const_equals(struct tac_operand operand, double value){
+    if (operand.kind != TAC_CONST) {
+        return 0;
+    }
+    char* end;
+    double parsed = strtod(operand.name, &end);
+    return *end == '\0' && parsed == value;
+}
+
+// Index of the instruction a branch lands on (after the label), num_instrs if the label is not in the function
+int branch_target(struct peephole_state* state, int label){
+    if (label < 0 || label >= state->num_labels || state->label_pos[label] < 0) {
+        return state->function->num_instrs;
+    }
+    return skip_labels(state->function, state->label_pos[label]);
+}
+
+// Whether invert_branch may be applied: comparing a NaN is false whatever the comparison, so only int ones invert
+int can_invert_branch(struct tac_instr* instr){
+    return instr->op == TAC_IFZ || (instr->arg1.type == 1 && instr->arg2.type == 1);
+}
+
+// Turns a conditional branch into the branch taken exactly when it was not
+void invert_branch(struct tac_instr* instr){
+    if (instr->op == TAC_IFZ) {
+        // IFZ x becomes IF x != 0
+        instr->op = TAC_IF;
+        instr->relop = TAC_NE;
+        instr->arg2 = tac_const("0", instr->arg1.type);
+    }
+    else {
+        instr->relop = tac_invert_relop(instr->relop);
+    }
+}
+
+// Goto L; L  =>  L (also for conditional branches, the condition has no side effects)
+int peephole_goto_next(struct peephole_state* state, int i){
+    struct tac_function* function = state->function;
+    struct tac_instr* instr = &function->instrs[i];
+    if (!tac_is_branch(instr->op)) {
+        return 0;
+    }
+    for (int j = i + 1; j < function->num_instrs; j++) {
+        if (function->instrs[j].op == TAC_LABEL && function->instrs[j].label == instr->label) {
+            touch_temp(state, instr->arg1);
+            touch_temp(state, instr->arg2);
+            instr->op = TAC_NOP;
+            return 1;
+        }
+        if (function->instrs[j].op != TAC_NOP && function->instrs[j].op != TAC_LABEL) {
+            return 0;
+        }
+    }
+    return 0;
+}
+
+// Goto L1 ... L1: Goto L2  =>  Goto L2 ... L1: Goto L2, and Goto L1 ... L1: Return x  =>  Return x
+int peephole_jump_thread(struct peephole_state* state, int i){
+    struct tac_function* function = state->function;
+    struct tac_instr* instr = &function->instrs[i];
+    if (!tac_is_branch(instr->op)) {
+        return 0;
+    }
+    int target = branch_target(state, instr->label);
+    if (target >= function->num_instrs || target == i) {
+        return 0;
+    }
+    struct tac_instr* landing = &function->instrs[target];
+    if (landing->op == TAC_GOTO && landing->label != instr->label) {
+        instr->label = landing->label;
+        return 1;
+    }
+    if (instr->op == TAC_GOTO && landing->op == TAC_RETURN) {
+        *instr = *landing;
+        touch_temp(state, landing->arg1);
+        return 1;
+    }
+    return 0;
+}
+
+// IF c Goto L1; Goto L2; L1  =>  IF !c Goto L2; L1
+int peephole_branch_invert(struct peephole_state* state, int i){
+    struct tac_function* function = state->function;
+    struct tac_instr* instr = &function->instrs[i];
+    if ((instr->op != TAC_IF && instr->op != TAC_IFZ) || !can_invert_branch(instr)) {
+        return 0;
+    }
+    int j = next_instr(function, i);
+    if (j >= function->num_instrs || function->instrs[j].op != TAC_GOTO) {
+        return 0;
+    }
+    for (int k = j + 1; k < function->num_instrs; k++) {
+        if (function->instrs[k].op == TAC_LABEL && function->instrs[k].label == instr->label) {
+            invert_branch(instr);
+            instr->label = function->instrs[j].label;
+            function->instrs[j].op = TAC_NOP;
+            return 1;
+        }
+        if (function->instrs[k].op != TAC_NOP && function->instrs[k].op != TAC_LABEL) {
+            return 0;
+        }
+    }
+    return 0;
+}
+
+// t = !x; IFZ t Goto L  =>  IF x != 0 Goto L, and t = a < b; IFZ t Goto L  =>  IF a >= b Goto L
+int peephole_fold_branch(struct peephole_state* state, int i){
+    struct tac_function* function = state->function;
+    struct tac_instr* instr = &function->instrs[i];
+    if ((instr->op != TAC_NOT && !tac_is_relop(instr->op)) || !single_use(state, instr->dest)) {
+        return 0;
+    }
+    int j = next_instr(function, i);
+    if (j >= function->num_instrs) {
+        return 0;
+    }
+    struct tac_instr* branch = &function->instrs[j];
+    // The branch must test the temp for zero (IFZ t, IF t == 0) or for non zero (IF t != 0)
+    int jump_if_true;
+    if (branch->op == TAC_IFZ && tac_same_operand(branch->arg1, instr->dest)) {
+        jump_if_true = 0;
+    }
+    else if (branch->op == TAC_IF && tac_same_operand(branch->arg1, instr->dest) && const_equals(branch->arg2, 0)
+             && (branch->relop == TAC_EQ || branch->relop == TAC_NE)) {
+        jump_if_true = (branch->relop == TAC_NE);
+    }
+    else {
+        return 0;
+    }
+    // Jumping when a double comparison is false is not jumping when its inverse is true (NaN)
+    if (!jump_if_true && instr->op != TAC_NOT && (instr->arg1.type != 1 || instr->arg2.type != 1)) {
+        return 0;
+    }
+
+    if (instr->op == TAC_NOT) {
+        // !x is true when x is zero
+        branch->op = TAC_IF;
+        branch->arg1 = instr->arg1;
+        branch->arg2 = tac_const("0", instr->arg1.type);
+        branch->relop = jump_if_true ? TAC_EQ : TAC_NE;
+    }
+    else {
+        branch->op = TAC_IF;
+        branch->arg1 = instr->arg1;
+        branch->arg2 = instr->arg2;
+        branch->relop = jump_if_true ? instr->op : tac_invert_relop(instr->op);
+    }
+    touch_temp(state, instr->dest);
+    instr->op = TAC_NOP;
+    return 1;
+}
+
+// t = a op b; y = t  =>  y = a op b
+int peephole_copy_forward(struct peephole_state* state, int i){
+    struct tac_function* function = state->function;
+    struct tac_instr* instr = &function->instrs[i];
+    if (!tac_is_pure(instr->op) || !single_use(state, instr->dest)) {
+        return 0;
+    }
+    int j = next_instr(function, i);
+    if (j >= function->num_instrs) {
+        return 0;
+    }
+    struct tac_instr* copy = &function->instrs[j];
+    if (copy->op != TAC_ASSIGN || !tac_same_operand(copy->arg1, instr->dest)) {
+        return 0;
+    }
+    touch_temp(state, instr->dest);
+    instr->dest = copy->dest;
+    copy->op = TAC_NOP;
+    return 1;
+}
+
+// t = x; ... t ...  =>  ... x ... when the next instruction is the only reader of t
+int peephole_copy_propagate(struct peephole_state* state, int i){
+    struct tac_function* function = state->function;
+    struct tac_instr* instr = &function->instrs[i];
+    if (instr->op != TAC_ASSIGN || !single_use(state, instr->dest)) {
+        return 0;
+    }
+    int j = next_instr(function, i);
+    if (j >= function->num_instrs || function->instrs[j].op == TAC_LABEL) {
+        return 0;
+    }
+    struct tac_instr* user = &function->instrs[j];
+    if (tac_same_operand(user->arg1, instr->dest)) {
+        user->arg1 = instr->arg1;
+    }
+    else if (tac_same_operand(user->arg2, instr->dest)) {
+        user->arg2 = instr->arg1;
+    }
+    else {
+        return 0;
+    }
+    touch_temp(state, instr->dest);
+    touch_temp(state, instr->arg1);
+    instr->op = TAC_NOP;
+    return 1;
+}
+
+// x * 1, 1 * x, x / 1, x - 0  =>  x, and for ints x + 0, 0 + x  =>  x and x * 0, 0 * x  =>  0. The int only rules
+// don't hold for doubles: -0.0 + 0 is 0.0, and inf * 0 and nan * 0 are nan
+int peephole_algebraic(struct peephole_state* state, int i){
+    struct tac_instr* instr = &state->function->instrs[i];
+    int ints = instr->arg1.type == 1 && instr->arg2.type == 1;
+    struct tac_operand result;
+    switch (instr->op) {
+        case TAC_MUL:
+            if (ints && (const_equals(instr->arg1, 0) || const_equals(instr->arg2, 0))) {
+                result = const_equals(instr->arg1, 0) ? instr->arg1 : instr->arg2;
+            }
+            else if (const_equals(instr->arg2, 1)) {
+                result = instr->arg1;
+            }
+            else if (const_equals(instr->arg1, 1)) {
+                result = instr->arg2;
+            }
+            else {
+                return 0;
+            }
+            break;
+        case TAC_ADD:
+            if (ints && const_equals(instr->arg2, 0)) {
+                result = instr->arg1;
+            }
+            else if (ints && const_equals(instr->arg1, 0)) {
+                result = instr->arg2;
+            }
+            else {
+                return 0;
+            }
+            break;
+        case TAC_SUB:
+            if (!const_equals(instr->arg2, 0)) {
+                return 0;
+            }
+            result = instr->arg1;
+            break;
+        case TAC_DIV:
+            if (!const_equals(instr->arg2, 1)) {
+                return 0;
+            }
+            result = instr->arg1;
+            break;
+        default:
+            return 0;
+    }
+    touch_temp(state, instr->arg1);
+    touch_temp(state, instr->arg2);
+    instr->op = TAC_ASSIGN;
+    instr->arg1 = result;
+    instr->arg2 = tac_none();
+    return 1;
+}
+
+// Pattern table, rules are tried in order at every instruction
+struct peephole_rule peephole_rules[NUM_PEEPHOLE_RULES] = {
+    {"goto-next",      peephole_goto_next},
+    {"jump-thread",    peephole_jump_thread},
+    {"branch-invert",  peephole_branch_invert},
+    {"fold-branch",    peephole_fold_branch},
+    {"copy-forward",   peephole_copy_forward},
+    {"copy-propagate", peephole_copy_propagate},
+    {"algebraic",      peephole_algebraic}
+};
+
+// Counts reads of every temp and records label positions for one sweep
+void peephole_prepare(struct peephole_state* state, struct tac_function* function, struct tac_slots* slots){
+    state->function = function;
+    state->min_temp = slots->min_temp;
+    int num_temps = slots->num_slots - slots->num_vars;
+    state->uses = calloc(num_temps + 1, sizeof(int));
+    state->num_labels = 0;
+    for (int i = 0; i < function->num_instrs; i++) {
+        struct tac_instr* instr = &function->instrs[i];
+        if (instr->arg1.kind == TAC_TEMP) {
+            state->uses[instr->arg1.temp - state->min_temp]++;
+        }
+        if (instr->arg2.kind == TAC_TEMP) {
+            state->uses[instr->arg2.temp - state->min_temp]++;
+        }
+        if (instr->label >= state->num_labels) {
+            state->num_labels = instr->label + 1;
+        }
+    }
+    state->label_pos = malloc(sizeof(int) * (state->num_labels + 1));
+    for (int l = 0; l < state->num_labels; l++) {
+        state->label_pos[l] = -1;
+    }
+    for (int i = 0; i < function->num_instrs; i++) {
+        if (function->instrs[i].op == TAC_LABEL) {
+            state->label_pos[function->instrs[i].label] = i;
+        }
+    }
+}
+
+// One sweep of the pattern table over a function, returns the number of hits
+int peephole_sweep(struct tac_function* function, struct opt_stats* stats){
+    struct tac_slots slots = build_slots(function);
+    struct peephole_state state;
+    peephole_prepare(&state, function, &slots);
+    int hits = 0;
+    for (int i = 0; i < function->num_instrs; i++) {
+        for (int r = 0; r < NUM_PEEPHOLE_RULES && function->instrs[i].op != TAC_NOP; r++) {
+            if (peephole_rules[r].apply(&state, i)) {
+                stats->peephole[r]++;
+                hits++;
+            }
+        }
+    }
+    free(state.uses);
+    free(state.label_pos);
+    free(slots.vars);
+    free(slots.is_global);
+    tac_compact(function);
+    return hits;
+}
+
+// Fixed point driver, sweeps until no rule fires (bounded in case two rules keep undoing each other)
+int peephole_optimize(struct tac_function* function, struct opt_stats* stats){
+    int total = 0;
+    for (int round = 0; round < 64; round++) {
+        int hits = peephole_sweep(function, stats);
+        if (hits == 0) {
+            break;
+        }
+        total += hits;
+    }
+    return total;
+}
+
+/******************************** Loops ********************************/
+#define MAX_UNROLL_INSTRS 64         // Largest body an unrolled loop may grow to, in instructions
+#define MAX_FULL_UNROLL 16           // Largest trip count that is unrolled completely
+#define UNROLL_FACTOR 4              // Copies of the body per exit test when unrolling partially
+#define MAX_TRIP_COUNT 1000000       // Trip counts are found by stepping the counter, give up past this
+
+// A natural loop, the header plus every block that reaches a back edge without passing through the header
+struct tac_loop{
+    int header;                      // Header block, dominates every block in the loop
+    unsigned int* blocks;            // Bit vector of the blocks in the loop
+    int num_blocks;                  // Number of blocks in the loop
+};
+
+// Iterative dominator sets over reachable blocks, dom(entry) = {entry} and
+// dom(b) = {b} | the intersection of dom(p) over the predecessors p of b
+unsigned int** compute_dominators(struct tac_cfg* cfg){
+    int n = cfg->num_blocks;
+    int words = (n + 31) / 32;
+    unsigned int** dom = malloc(sizeof(unsigned int*) * (n + 1));
+    for (int b = 0; b < n; b++) {
+        dom[b] = bits_new(words);
+        for (int i = 0; i < n; i++) {
+            if (b != 0 || i == 0) {
+                bits_set(dom[b], i);
+            }
+        }
+    }
+    unsigned int* next = bits_new(words);
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (int b = 1; b < n; b++) {
+            struct tac_block* block = &cfg->blocks[b];
+            if (!block->reachable) {
+                continue;
+            }
+            for (int w = 0; w < words; w++) {
+                next[w] = ~0u;
+            }
+            for (int p = 0; p < block->num_pred; p++) {
+                if (!cfg->blocks[block->pred[p]].reachable) {
+                    continue;
+                }
+                for (int w = 0; w < words; w++) {
+                    next[w] &= dom[block->pred[p]][w];
+                }
+            }
+            bits_set(next, b);
+            for (int w = 0; w < words; w++) {
+                if (next[w] != dom[b][w]) {
+                    dom[b][w] = next[w];
+                    changed = 1;
+                }
+            }
+        }
+    }
+    free(next);
+    return dom;
+}
+
+void free_dominators(unsigned int** dom, int num_blocks){
+    for (int b = 0; b < num_blocks; b++) {
+        free(dom[b]);
+    }
+    free(dom);
+}
+
+// True(1) if block a dominates block b
+int dominates(unsigned int** dom, int a, int b){
+    return bits_test(dom[b], a);
+}
+
+int loop_contains(struct tac_loop* loop, int block){
+    return block >= 0 && bits_test(loop->blocks, block);
+}
+
+// Finds the natural loops of a function, merging back edges to the same header into one loop.
+// Loops are returned smallest first so inner loops are transformed before the loops around them.
+int find_loops(struct tac_cfg* cfg, unsigned int** dom, struct tac_loop** loops_out){
+    int n = cfg->num_blocks;
+    int words = (n + 31) / 32;
+    struct tac_loop* loops = malloc(sizeof(struct tac_loop) * (n + 1));
+    int num_loops = 0;
+    int* stack = malloc(sizeof(int) * (n + 1));
+    for (int t = 0; t < n; t++) {
+        if (!cfg->blocks[t].reachable) {
+            continue;
+        }
+        for (int s = 0; s < cfg->blocks[t].num_succ; s++) {
+            int h = cfg->blocks[t].succ[s];
+            if (h < 0 || !dominates(dom, h, t)) {
+                continue;
+            }
+
+            // t -> h is a back edge, find or open the loop of h
+            struct tac_loop* loop = NULL;
+            for (int l = 0; l < num_loops; l++) {
+                if (loops[l].header == h) {
+                    loop = &loops[l];
+                }
+            }
+            if (loop == NULL) {
+                loop = &loops[num_loops++];
+                loop->header = h;
+                loop->blocks = bits_new(words);
+                loop->num_blocks = 1;
+                bits_set(loop->blocks, h);
+            }
+
+            // Walk predecessors back from t until the header
+            int top = 0;
+            if (!bits_test(loop->blocks, t)) {
+                bits_set(loop->blocks, t);
+                loop->num_blocks++;
+                stack[top++] = t;
+            }
+            while (top > 0) {
+                struct tac_block* block = &cfg->blocks[stack[--top]];
+                for (int p = 0; p < block->num_pred; p++) {
+                    int pred = block->pred[p];
+                    if (cfg->blocks[pred].reachable && !bits_test(loop->blocks, pred)) {
+                        bits_set(loop->blocks, pred);
+                        loop->num_blocks++;
+                        stack[top++] = pred;
+                    }
+                }
+            }
+        }
+    }
+    free(stack);
+
+    // Insertion sort by size
+    for (int i = 1; i < num_loops; i++) {
+        struct tac_loop loop = loops[i];
+        int j = i - 1;
+        while (j >= 0 && loops[j].num_blocks > loop.num_blocks) {
+            loops[j + 1] = loops[j];
+            j--;
+        }
+        loops[j + 1] = loop;
+    }
+    *loops_out = loops;
+    return num_loops;
+}
+
+void free_loops(struct tac_loop* loops, int num_loops){
+    for (int l = 0; l < num_loops; l++) {
+        free(loops[l].blocks);
+    }
+    free(loops);
+}
+
+// Counts the writes of every slot inside a loop and records the last writing instruction (-1 if none).
+// A call counts as a write of every global since the callee may assign it.
+int* loop_defs(struct tac_cfg* cfg, struct tac_loop* loop, int** def_instr_out){
+    int* defs = calloc(cfg->slots.num_slots + 1, sizeof(int));
+    int* def_instr = malloc(sizeof(int) * (cfg->slots.num_slots + 1));
+    for (int s = 0; s < cfg->slots.num_slots; s++) {
+        def_instr[s] = -1;
+    }
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        if (!loop_contains(loop, b)) {
+            continue;
+        }
+        for (int i = cfg->blocks[b].start; i < cfg->blocks[b].end; i++) {
+            struct tac_instr* instr = &cfg->function->instrs[i];
+            int def = instr_def(cfg, instr);
+            if (def >= 0) {
+                defs[def]++;
+                def_instr[def] = i;
+            }
+            if (instr->op == TAC_LCALL) {
+                for (int s = 0; s < cfg->slots.num_vars; s++) {
+                    if (cfg->slots.is_global[s]) {
+                        defs[s]++;
+                    }
+                }
+            }
+        }
+    }
+    *def_instr_out = def_instr;
+    return defs;
+}
+
+// Maps every instruction to the block holding it
+int* block_map(struct tac_cfg* cfg){
+    int* block_of = malloc(sizeof(int) * (cfg->function->num_instrs + 1));
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        for (int i = cfg->blocks[b].start; i < cfg->blocks[b].end; i++) {
+            block_of[i] = b;
+        }
+    }
+    return block_of;
+}
+
+// True(1) if a slot is live on some edge leaving the loop
+int live_after_loop(struct tac_cfg* cfg, struct tac_loop* loop, int slot){
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        if (!loop_contains(loop, b)) {
+            continue;
+        }
+        for (int s = 0; s < cfg->blocks[b].num_succ; s++) {
+            int succ = cfg->blocks[b].succ[s];
+            if (succ < 0 && bits_test(cfg->exit_live, slot)) {
+                return 1;
+            }
+            if (succ >= 0 && !loop_contains(loop, succ) && bits_test(cfg->blocks[succ].in, slot)) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+// True(1) if a block runs before every exit from the loop
+int dominates_exits(struct tac_cfg* cfg, unsigned int** dom, struct tac_loop* loop, int block){
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        if (!loop_contains(loop, b)) {
+            continue;
+        }
+        for (int s = 0; s < cfg->blocks[b].num_succ; s++) {
+            if (!loop_contains(loop, cfg->blocks[b].succ[s]) && !dominates(dom, block, b)) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+// Inserts code that runs once before the loop. The code goes behind a new label placed in front of the
+// header, and jumps to the header from outside the loop are redirected to it so only the back edges
+// skip it. Returns the index of the new label, -1 if a block inside the loop falls through into the header.
+int insert_preheader(struct tac_cfg* cfg, struct tac_loop* loop, struct tac_instr* code, int count, struct tac_program* program){
+    struct tac_function* function = cfg->function;
+    int header = loop->header;
+    int position = cfg->blocks[header].start;
+    if (function->instrs[position].op != TAC_LABEL) {
+        return -1;
+    }
+    if (header > 0 && loop_contains(loop, header - 1)) {
+        int last = function->instrs[cfg->blocks[header - 1].end - 1].op;
+        if (last != TAC_GOTO && last != TAC_RETURN) {
+            return -1;
+        }
+    }
+
+    int old_label = function->instrs[position].label;
+    int new_label = program->next_label++;
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        struct tac_instr* last = &function->instrs[cfg->blocks[b].end - 1];
+        if (!loop_contains(loop, b) && tac_is_branch(last->op) && last->label == old_label) {
+            last->label = new_label;
+        }
+    }
+
+    struct tac_instr* preheader = malloc(sizeof(struct tac_instr) * (count + 1));
+    preheader[0] = tac_instr_new(TAC_LABEL, tac_none(), tac_none(), tac_none());
+    preheader[0].label = new_label;
+    for (int i = 0; i < count; i++) {
+        preheader[i + 1] = code[i];
+    }
+    tac_insert(function, position, preheader, count + 1);
+    free(preheader);
+    return position;
+}
+
+// True(1) if an instruction can be moved out of a loop, division and modulo only by a nonzero constant
+// so a loop that never runs cannot trap in its preheader
+int loop_hoistable(struct tac_instr* instr){
+    if (!tac_is_pure(instr->op)) {
+        return 0;
+    }
+    if (instr->op == TAC_DIV || instr->op == TAC_MOD) {
+        return instr->arg2.kind == TAC_CONST && !const_equals(instr->arg2, 0);
+    }
+    return 1;
+}
+
+// True(1) if an operand has the same value on every iteration of the loop
+int loop_invariant_operand(struct tac_cfg* cfg, struct tac_operand operand, int* defs, int* def_instr, char* invariant){
+    if (operand.kind == TAC_NONE || operand.kind == TAC_CONST) {
+        return 1;
+    }
+    int slot = slot_of(&cfg->slots, operand);
+    if (slot < 0) {
+        return 0;
+    }
+    if (defs[slot] == 0) {
+        return 1;
+    }
+    return defs[slot] == 1 && def_instr[slot] >= 0 && invariant[def_instr[slot]];
+}
+
+// Loop invariant code motion. An instruction moves to the preheader when its operands are invariant, it is
+// the only write of its result in the loop, the result is not read before it on any iteration, and either
+// the result is dead after the loop or the instruction runs on every path out of it. Returns the number moved.
+int hoist_invariants(struct tac_cfg* cfg, unsigned int** dom, struct tac_loop* loop, struct tac_program* program){
+    struct tac_function* function = cfg->function;
+    int* def_instr;
+    int* defs = loop_defs(cfg, loop, &def_instr);
+    int* block_of = block_map(cfg);
+    char* invariant = calloc(function->num_instrs + 1, sizeof(char));
+    int* order = malloc(sizeof(int) * (function->num_instrs + 1));
+    int num_hoisted = 0;
+
+    // Mark until nothing changes, an instruction can become invariant once the writes it reads are
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (int b = 0; b < cfg->num_blocks; b++) {
+            if (!loop_contains(loop, b)) {
+                continue;
+            }
+            for (int i = cfg->blocks[b].start; i < cfg->blocks[b].end; i++) {
+                struct tac_instr* instr = &function->instrs[i];
+                if (invariant[i] || !loop_hoistable(instr)) {
+                    continue;
+                }
+                int def = instr_def(cfg, instr);
+                if (def < 0 || defs[def] != 1 || bits_test(cfg->blocks[loop->header].in, def)) {
+                    continue;
+                }
+                if (!loop_invariant_operand(cfg, instr->arg1, defs, def_instr, invariant) ||
+                    !loop_invariant_operand(cfg, instr->arg2, defs, def_instr, invariant)) {
+                    continue;
+                }
+                if (live_after_loop(cfg, loop, def) && !dominates_exits(cfg, dom, loop, b)) {
+                    continue;
+                }
+                invariant[i] = 1;
+                order[num_hoisted++] = i;
+                changed = 1;
+            }
+        }
+    }
+
+    // Copy in marking order so every instruction follows the writes it reads
+    if (num_hoisted > 0) {
+        struct tac_instr* code = malloc(sizeof(struct tac_instr) * num_hoisted);
+        for (int n = 0; n < num_hoisted; n++) {
+            code[n] = function->instrs[order[n]];
+        }
+        int position = insert_preheader(cfg, loop, code, num_hoisted, program);
+        if (position < 0) {
+            num_hoisted = 0;
+        }
+        for (int n = 0; n < num_hoisted; n++) {
+            int i = (order[n] >= position) ? order[n] + num_hoisted + 1 : order[n];
+            function->instrs[i].op = TAC_NOP;
+        }
+        free(code);
+    }
+
+    free(order);
+    free(invariant);
+    free(block_of);
+    free(defs);
+    free(def_instr);
+    return num_hoisted;
+}
+
+// One reduced multiplication, s = i * k kept up to date by s = s + step * k after every update of i
+struct induction_product{
+    struct tac_operand counter;      // The induction variable i
+    long long factor;                // k
+    long long step;                  // Change of i per update
+    int update;                      // Index of the instruction updating i
+    int temp;                        // Temp number of s
+};
+
+// Returns the step of an induction variable update i = i + c, i = c + i or i = i - c, 0 if it is not one
+long long induction_step(struct tac_instr* instr){
+    long long c;
+    if (instr->dest.type != 1) {
+        return 0;
+    }
+    if (instr->op == TAC_ADD && tac_same_operand(instr->arg1, instr->dest) && const_int(instr->arg2, &c)) {
+        return c;
+    }
+    if (instr->op == TAC_ADD && tac_same_operand(instr->arg2, instr->dest) && const_int(instr->arg1, &c)) {
+        return c;
+    }
+    if (instr->op == TAC_SUB && tac_same_operand(instr->arg1, instr->dest) && const_int(instr->arg2, &c)) {
+        return -c;
+    }
+    return 0;
+}
+
+// Induction variable strength reduction. A counter i whose only write in the loop is i = i + c turns every
+// integer d = i * k into d = s, with s = i * k computed in the preheader and s = s + c * k after the
+// update of i. Returns the number of multiplications replaced.
+int reduce_induction_products(struct tac_cfg* cfg, struct tac_loop* loop, struct tac_program* program){
+    struct tac_function* function = cfg->function;
+    int* def_instr;
+    int* defs = loop_defs(cfg, loop, &def_instr);
+    struct induction_product* products = malloc(sizeof(struct induction_product) * (function->num_instrs + 1));
+    int num_products = 0;
+    int* reduced = malloc(sizeof(int) * (function->num_instrs + 1));
+    int* reduced_product = malloc(sizeof(int) * (function->num_instrs + 1));
+    int num_reduced = 0;
+
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        if (!loop_contains(loop, b)) {
+            continue;
+        }
+        for (int i = cfg->blocks[b].start; i < cfg->blocks[b].end; i++) {
+            struct tac_instr* instr = &function->instrs[i];
+            long long factor;
+            struct tac_operand counter;
+            if (instr->op != TAC_MUL) {
+                continue;
+            }
+            if (instr->arg1.kind != TAC_CONST && const_int(instr->arg2, &factor)) {
+                counter = instr->arg1;
+            }
+            else if (instr->arg2.kind != TAC_CONST && const_int(instr->arg1, &factor)) {
+                counter = instr->arg2;
+            }
+            else {
+                continue;
+            }
+            int slot = slot_of(&cfg->slots, counter);
+            if (slot < 0 || counter.type != 1 || defs[slot] != 1 || def_instr[slot] < 0) {
+                continue;
+            }
+            long long step = induction_step(&function->instrs[def_instr[slot]]);
+            long long increment = step * factor;
+            if (step == 0 || increment > 2147483647LL || increment < -2147483647LL) {
+                continue;
+            }
+
+            // Products of the same counter and factor share one temp
+            int p = 0;
+            while (p < num_products && !(tac_same_operand(products[p].counter, counter) && products[p].factor == factor)) {
+                p++;
+            }
+            if (p == num_products) {
+                products[p].counter = counter;
+                products[p].factor = factor;
+                products[p].step = step;
+                products[p].update = def_instr[slot];
+                products[p].temp = program->next_temp++;
+                num_products++;
+            }
+            reduced[num_reduced] = i;
+            reduced_product[num_reduced] = p;
+            num_reduced++;
+        }
+    }
+
+    if (num_products > 0) {
+        struct tac_instr* code = malloc(sizeof(struct tac_instr) * num_products);
+        for (int p = 0; p < num_products; p++) {
+            code[p] = tac_instr_new(TAC_MUL, tac_temp(products[p].temp, 1), products[p].counter, int_const(program, products[p].factor));
+        }
+        int position = insert_preheader(cfg, loop, code, num_products, program);
+        free(code);
+        if (position < 0) {
+            num_reduced = 0;
+            num_products = 0;
+        }
+        int shift = num_products + 1;
+
+        // d = i * k  =>  d = s
+        for (int r = 0; r < num_reduced; r++) {
+            int i = (reduced[r] >= position) ? reduced[r] + shift : reduced[r];
+            struct tac_instr* instr = &function->instrs[i];
+            *instr = tac_instr_new(TAC_ASSIGN, instr->dest, tac_temp(products[reduced_product[r]].temp, 1), tac_none());
+        }
+
+        // s = s + c * k after each update, latest first so earlier indeces stay valid
+        for (int p = 0; p < num_products; p++) {
+            products[p].update = (products[p].update >= position) ? products[p].update + shift : products[p].update;
+        }
+        for (int done = 0; done < num_products; done++) {
+            int latest = -1;
+            for (int p = 0; p < num_products; p++) {
+                if (products[p].update >= 0 && (latest < 0 || products[p].update > products[latest].update)) {
+                    latest = p;
+                }
+            }
+            struct tac_operand temp = tac_temp(products[latest].temp, 1);
+            long long increment = products[latest].step * products[latest].factor;
+            struct tac_instr update = (increment < 0) ? tac_instr_new(TAC_SUB, temp, temp, int_const(program, -increment))
+                                                      : tac_instr_new(TAC_ADD, temp, temp, int_const(program, increment));
+            tac_insert(function, products[latest].update + 1, &update, 1);
+            products[latest].update = -1;
+        }
+    }
+
+    free(reduced_product);
+    free(reduced);
+    free(products);
+    free(defs);
+    free(def_instr);
+    return num_reduced;
+}
+
+// Appends a copy of the instructions in [start, end), giving the labels defined there new numbers
+// when rename is True(1) so several copies can sit in one function
+void copy_loop_body(struct tac_function* function, int start, int end, int rename, struct tac_instr* out, int* count, struct tac_program* program){
+    int first_label = program->next_label;
+    int* labels = malloc(sizeof(int) * (end - start + 1));
+    int num_labels = 0;
+    for (int i = start; i < end && rename; i++) {
+        if (function->instrs[i].op == TAC_LABEL) {
+            labels[num_labels++] = function->instrs[i].label;
+            program->next_label++;
+        }
+    }
+    for (int i = start; i < end; i++) {
+        struct tac_instr instr = function->instrs[i];
+        if (instr.op == TAC_LABEL || tac_is_branch(instr.op)) {
+            for (int l = 0; l < num_labels; l++) {
+                if (labels[l] == instr.label) {
+                    instr.label = first_label + l;
+                }
+            }
+        }
+        out[(*count)++] = instr;
+    }
+    free(labels);
+}
+
+// Unrolls a counted loop of the shape a while statement lowers to
+//     Lh
+//     IF i relop N Goto Lx
+//     body, where i = i + c is the only write of i and runs on every iteration
+//     Goto Lh
+//     Lx
+// with i holding a constant K on entry. The trip count comes from stepping i from K until the exit test
+// holds. Loops that run at most MAX_FULL_UNROLL times become that many copies of the body, longer ones
+// whose trip count divides by UNROLL_FACTOR test the exit once per UNROLL_FACTOR copies.
+// Returns 1 for a full unroll, 2 for a partial one and 0 if the loop was left alone.
+int unroll_loop(struct tac_cfg* cfg, unsigned int** dom, struct tac_loop* loop, struct tac_program* program){
+    struct tac_function* function = cfg->function;
+    struct tac_instr* instrs = function->instrs;
+    int header = loop->header;
+    int head = cfg->blocks[header].start;
+    if (instrs[head].op != TAC_LABEL || head + 1 >= function->num_instrs || instrs[head + 1].op != TAC_IF) {
+        return 0;
+    }
+    struct tac_instr* test = &instrs[head + 1];
+    long long limit;
+    if (test->arg1.kind == TAC_CONST || !const_int(test->arg2, &limit) || test->arg1.type != 1) {
+        return 0;
+    }
+
+    // The loop must be one contiguous run ending in the back edge, entered only by falling into the header
+    int last = head;
+    int size = 0;
+    int latch = -1;
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        if (!loop_contains(loop, b)) {
+            continue;
+        }
+        size += cfg->blocks[b].end - cfg->blocks[b].start;
+        if (cfg->blocks[b].start < head) {
+            return 0;
+        }
+        if (cfg->blocks[b].end - 1 > last) {
+            last = cfg->blocks[b].end - 1;
+            latch = b;
+        }
+    }
+    if (size != last - head + 1 || instrs[last].op != TAC_GOTO || instrs[last].label != instrs[head].label) {
+        return 0;
+    }
+    for (int p = 0; p < cfg->blocks[header].num_pred; p++) {
+        int pred = cfg->blocks[header].pred[p];
+        if (!loop_contains(loop, pred) && (pred != header - 1 || tac_is_branch(instrs[cfg->blocks[pred].end - 1].op))) {
+            return 0;
+        }
+    }
+    int exit = last + 1;
+    while (exit < function->num_instrs && instrs[exit].op == TAC_LABEL && instrs[exit].label != test->label) {
+        exit++;
+    }
+    if (exit >= function->num_instrs || instrs[exit].op != TAC_LABEL) {
+        return 0;
+    }
+
+    // Branches in the body stay in the body
+    int body = head + 2;
+    for (int i = body; i < last; i++) {
+        if (!tac_is_branch(instrs[i].op)) {
+            continue;
+        }
+        int inside = 0;
+        for (int j = body; j < last; j++) {
+            if (instrs[j].op == TAC_LABEL && instrs[j].label == instrs[i].label) {
+                inside = 1;
+            }
+        }
+        if (!inside) {
+            return 0;
+        }
+    }
+
+    // The counter and its single update
+    int* def_instr;
+    int* defs = loop_defs(cfg, loop, &def_instr);
+    int* block_of = block_map(cfg);
+    int slot = slot_of(&cfg->slots, test->arg1);
+    long long step = 0;
+    if (slot >= 0 && defs[slot] == 1 && def_instr[slot] >= 0 && dominates(dom, block_of[def_instr[slot]], latch)) {
+        step = induction_step(&instrs[def_instr[slot]]);
+    }
+    free(block_of);
+    free(defs);
+    free(def_instr);
+    if (step == 0) {
+        return 0;
+    }
+
+    // Constant on entry, from the straight line code in front of the header
+    long long start;
+    int found = 0;
+    for (int i = head - 1; i >= 0 && !found; i--) {
+        if (instrs[i].op == TAC_LABEL || tac_is_jump(instrs[i].op)) {
+            return 0;
+        }
+        if (instrs[i].op == TAC_LCALL && cfg->slots.is_global[slot]) {
+            return 0;
+        }
+        if (instr_def(cfg, &instrs[i]) == slot) {
+            if (instrs[i].op != TAC_ASSIGN || !const_int(instrs[i].arg1, &start)) {
+                return 0;
+            }
+            found = 1;
+        }
+    }
+    if (!found) {
+        return 0;
+    }
+
+    // Step the counter to find the trip count, staying inside the int range
+    long long value = start;
+    int trips = 0;
+    while (!eval_relop(test->relop, value, limit)) {
+        value += step;
+        trips++;
+        if (trips > MAX_TRIP_COUNT || value > 2147483647LL || value < -2147483647LL - 1) {
+            return 0;
+        }
+    }
+
+    int body_size = last - body;
+    int copies;
+    int full;
+    if (trips <= MAX_FULL_UNROLL && (long long)trips * body_size <= MAX_UNROLL_INSTRS) {
+        copies = trips;
+        full = 1;
+    }
+    else if (trips % UNROLL_FACTOR == 0 && body_size * UNROLL_FACTOR <= MAX_UNROLL_INSTRS) {
+        copies = UNROLL_FACTOR;
+        full = 0;
+    }
+    else {
+        return 0;
+    }
+
+    // A full unroll drops the test and the back edge, a partial one keeps both around the copies
+    struct tac_instr* code = malloc(sizeof(struct tac_instr) * (copies * body_size + 2));
+    int count = 0;
+    if (!full) {
+        code[count++] = *test;
+    }
+    for (int c = 0; c < copies; c++) {
+        copy_loop_body(function, body, last, c > 0, code, &count, program);
+    }
+    if (!full) {
+        code[count++] = instrs[last];
+    }
+    tac_replace_range(function, head + 1, last + 1, code, count);
+    free(code);
+    return full ? 1 : 2;
+}
+
+// Transforms the loops of a function innermost first. Each loop header goes through unrolling, invariant
+// code motion and strength reduction in that order, and the graph is rebuilt after every change.
+// Returns the number of changes made.
+int optimize_loops(struct tac_function* function, struct tac_program* program, struct opt_stats* stats){
+    int total = 0;
+    int capacity = 16;
+    int num_headers = 0;
+    int* header_labels = malloc(sizeof(int) * capacity);
+    int* stages = malloc(sizeof(int) * capacity);
+    for (int round = 0; round < 1024 && function->num_instrs > 0; round++) {
+        tac_compact(function);
+        struct tac_cfg cfg = build_cfg(function);
+        cfg_mark_reachable(&cfg);
+        compute_liveness(&cfg);
+        unsigned int** dom = compute_dominators(&cfg);
+        struct tac_loop* loops;
+        int num_loops = find_loops(&cfg, dom, &loops);
+        if (round == 0) {
+            stats->loops = num_loops;
+        }
+
+        int changed = 0;
+        for (int l = 0; l < num_loops && !changed; l++) {
+            struct tac_instr* first = &function->instrs[cfg.blocks[loops[l].header].start];
+            if (first->op != TAC_LABEL) {
+                continue;
+            }
+            int h = 0;
+            while (h < num_headers && header_labels[h] != first->label) {
+                h++;
+            }
+            if (h == num_headers) {
+                if (num_headers == capacity) {
+                    capacity *= 2;
+                    header_labels = realloc(header_labels, sizeof(int) * capacity);
+                    stages = realloc(stages, sizeof(int) * capacity);
+                }
+                header_labels[h] = first->label;
+                stages[h] = 0;
+                num_headers++;
+            }
+            while (stages[h] < 3 && !changed) {
+                int stage = stages[h]++;
+                if (stage == 0) {
+                    int unrolled = unroll_loop(&cfg, dom, &loops[l], program);
+                    stats->unrolled += (unrolled == 1);
+                    stats->partially_unrolled += (unrolled == 2);
+                    changed = unrolled;
+                }
+                else if (stage == 1) {
+                    changed = hoist_invariants(&cfg, dom, &loops[l], program);
+                    stats->hoisted += changed;
+                }
+                else {
+                    changed = reduce_induction_products(&cfg, &loops[l], program);
+                    stats->reduced += changed;
+                }
+            }
+        }
+
+        free_loops(loops, num_loops);
+        free_dominators(dom, cfg.num_blocks);
+        free_cfg(&cfg);
+        tac_compact(function);
+        if (!changed) {
+            break;
+        }
+        total += changed;
+    }
+    free(stages);
+    free(header_labels);
+    return total;
+}
+
+/******************************** Tail Calls ********************************/
+// Finds the PushParams of the call at index call by replaying the pushes and calls in front of it and
+// stores their indeces in push order (last argument first). Returns the number of arguments, -1 if the
+// pushes do not line up with the PopParams counts.
+int call_arguments(struct tac_function* function, int call, int* pushes){
+    if (call + 1 >= function->num_instrs || function->instrs[call + 1].op != TAC_POP_PARAMS) {
+        return -1;
+    }
+    int* stack = malloc(sizeof(int) * (call + 1));
+    int top = 0;
+    for (int i = 0; i < call; i++) {
+        struct tac_instr* instr = &function->instrs[i];
+        if (instr->op == TAC_PUSH_PARAM) {
+            stack[top++] = i;
+        }
+        else if (instr->op == TAC_LCALL && i + 1 < function->num_instrs && function->instrs[i + 1].op == TAC_POP_PARAMS) {
+            top -= function->instrs[i + 1].count / 4;
+            if (top < 0) {
+                free(stack);
+                return -1;
+            }
+        }
+    }
+    int num_args = function->instrs[call + 1].count / 4;
+    if (num_args > top) {
+        free(stack);
+        return -1;
+    }
+    for (int a = 0; a < num_args; a++) {
+        pushes[a] = stack[top - num_args + a];
+    }
+    free(stack);
+    return num_args;
+}
+
+// True(1) if the LCall at index call is followed, past its PopParams and any labels, by a Return of its result
+int is_tail_call(struct tac_function* function, int call){
+    if (function->is_main || function->instrs[call].op != TAC_LCALL) {
+        return 0;
+    }
+    if (call + 1 >= function->num_instrs || function->instrs[call + 1].op != TAC_POP_PARAMS) {
+        return 0;
+    }
+    int next = skip_labels(function, call + 2);
+    return next < function->num_instrs && function->instrs[next].op == TAC_RETURN &&
+           tac_same_operand(function->instrs[next].arg1, function->instrs[call].dest);
+}
+
+// Self tail call elimination. In
+//     PushParam an ... PushParam a1
+//     t = LCall f
+//     PopParams n
+//     Return t
+// inside f, each PushParam becomes a copy of its argument into a fresh temp, and the call becomes an
+// assignment of every param from its temp followed by a jump to a label at the top of f. The temps keep
+// an argument that reads a param from seeing the param's new value. Returns the number of calls removed.
+int eliminate_tail_calls(struct tac_function* function, struct tac_program* program){
+    if (function->is_main || function->num_instrs == 0) {
+        return 0;
+    }
+    int removed = 0;
+    int entry_label = -1;
+    int* pushes = malloc(sizeof(int) * (function->num_instrs + 1));
+
+    // Latest first so rewriting a call leaves the indeces of earlier calls alone
+    for (int call = function->num_instrs - 1; call >= 0; call--) {
+        struct tac_instr* instr = &function->instrs[call];
+        if (instr->op != TAC_LCALL || compare_strings(instr->callee, function->name) != 0 || !is_tail_call(function, call)) {
+            continue;
+        }
+        int num_args = call_arguments(function, call, pushes);
+        if (num_args != function->num_params) {
+            continue;
+        }
+        if (entry_label < 0) {
+            entry_label = program->next_label++;
+        }
+
+        struct tac_instr* code = malloc(sizeof(struct tac_instr) * (num_args + 1));
+        for (int a = 0; a < num_args; a++) {
+            // The last PushParam passes the first param
+            struct tac_instr* push = &function->instrs[pushes[num_args - 1 - a]];
+            struct tac_operand temp = tac_temp(program->next_temp++, push->arg1.type);
+            *push = tac_instr_new(TAC_ASSIGN, temp, push->arg1, tac_none());
+            code[a] = tac_instr_new(TAC_ASSIGN, tac_var(function->locals[a], temp.type), temp, tac_none());
+        }
+        code[num_args] = tac_instr_new(TAC_GOTO, tac_none(), tac_none(), tac_none());
+        code[num_args].label = entry_label;
+        tac_replace_range(function, call, call + 2, code, num_args + 1);
+        free(code);
+        removed++;
+    }
+
+    if (entry_label >= 0) {
+        struct tac_instr label = tac_instr_new(TAC_LABEL, tac_none(), tac_none(), tac_none());
+        label.label = entry_label;
+        tac_insert(function, 0, &label, 1);
+    }
+    free(pushes);
+    return removed;
+}
+
+// Marks every remaining call whose result is returned right away, returns the number marked
+int mark_tail_calls(struct tac_function* function){
+    int marked = 0;
+    for (int call = 0; call < function->num_instrs; call++) {
+        if (is_tail_call(function, call)) {
+            function->instrs[call].tail = 1;
+            marked++;
+        }
+    }
+    return marked;
+}
+
+/******************************** Temp Allocation ********************************/
+// Bytes a temp slot of a type takes in the frame
+int slot_size(int type){
+    return (type == 0) ? 8 : 4;
+}
+
+// Extends an interval to cover an instruction
+void extend_interval(struct live_interval* interval, int position){
+    if (interval->start < 0 || position < interval->start) {
+        interval->start = position;
+    }
+    if (position > interval->end) {
+        interval->end = position;
+    }
+}
+
+// Extends the interval of a temp operand to cover an instruction
+void extend_operand(struct tac_slots* slots, struct live_interval* intervals, struct tac_operand operand, int position){
+    if (operand.kind != TAC_TEMP) {
+        return;
+    }
+    struct live_interval* interval = &intervals[operand.temp - slots->min_temp];
+    extend_interval(interval, position);
+    if (interval->type < 0) {
+        interval->type = operand.type;
+    }
+}
+
+// Rewrites a temp operand to its allocated slot
+void rename_temp(struct tac_slots* slots, struct live_interval* intervals, struct tac_operand* operand){
+    if (operand->kind == TAC_TEMP) {
+        operand->temp = intervals[operand->temp - slots->min_temp].slot;
+    }
+}
+
+// Orders intervals by start, used with qsort
+int compare_intervals(const void* a, const void* b){
+    const struct live_interval* x = *(struct live_interval* const*)a;
+    const struct live_interval* y = *(struct live_interval* const*)b;
+    if (x->start != y->start) {
+        return x->start - y->start;
+    }
+    return x->temp - y->temp;
+}
+
+// Linear scan allocation of temps onto frame slots. Temps whose live intervals do not overlap share a
+// slot of the same size, the slot number becomes the new temp number and the frame shrinks to the peak
+// number of slots in use at once.
+void allocate_temps(struct tac_function* function, struct opt_stats* stats){
+    stats->frame_before = function->memory;
+    stats->frame_after = function->memory;
+    if (function->num_instrs == 0) {
+        function->memory = function->var_memory;
+        stats->frame_after = function->memory;
+        return;
+    }
+
+    struct tac_cfg cfg = build_cfg(function);
+    compute_liveness(&cfg);
+    struct tac_slots* slots = &cfg.slots;
+    int num_temps = slots->num_slots - slots->num_vars;
+    if (num_temps == 0) {
+        function->memory = function->var_memory;
+        stats->frame_after = function->memory;
+        free_cfg(&cfg);
+        return;
+    }
+
+    // Build intervals from every mention of a temp
+    struct live_interval* intervals = malloc(sizeof(struct live_interval) * num_temps);
+    for (int t = 0; t < num_temps; t++) {
+        intervals[t].temp = slots->min_temp + t;
+        intervals[t].type = -1;
+        intervals[t].start = -1;
+        intervals[t].end = -1;
+        intervals[t].slot = -1;
+    }
+    for (int i = 0; i < function->num_instrs; i++) {
+        extend_operand(slots, intervals, function->instrs[i].dest, i);
+        extend_operand(slots, intervals, function->instrs[i].arg1, i);
+        extend_operand(slots, intervals, function->instrs[i].arg2, i);
+    }
+
+    // A temp live across a block boundary (around a loop back edge) covers the whole boundary
+    for (int b = 0; b < cfg.num_blocks; b++) {
+        for (int t = 0; t < num_temps; t++) {
+            if (bits_test(cfg.blocks[b].in, slots->num_vars + t)) {
+                extend_interval(&intervals[t], cfg.blocks[b].start);
+            }
+            if (bits_test(cfg.blocks[b].out, slots->num_vars + t)) {
+                extend_interval(&intervals[t], cfg.blocks[b].end - 1);
+            }
+        }
+    }
+
+    // Sort the temps that appear in the function by interval start
+    struct live_interval** order = malloc(sizeof(struct live_interval*) * num_temps);
+    int num_intervals = 0;
+    for (int t = 0; t < num_temps; t++) {
+        if (intervals[t].start >= 0) {
+            order[num_intervals++] = &intervals[t];
+        }
+    }
+    qsort(order, num_intervals, sizeof(struct live_interval*), compare_intervals);
+
+    // Scan, active holds intervals that currently own a slot and free_slots the slots that can be reused
+    struct live_interval** active = malloc(sizeof(struct live_interval*) * num_intervals);
+    int num_active = 0;
+    int* free_slots = malloc(sizeof(int) * num_intervals);
+    int num_free = 0;
+    int* slot_types = malloc(sizeof(int) * num_intervals);
+    int num_slots = 0;
+    for (int n = 0; n < num_intervals; n++) {
+        struct live_interval* current = order[n];
+
+        // Expire intervals that ended before this one starts
+        int kept = 0;
+        for (int a = 0; a < num_active; a++) {
+            if (active[a]->end < current->start) {
+                free_slots[num_free++] = active[a]->slot;
+            }
+            else {
+                active[kept++] = active[a];
+            }
+        }
+        num_active = kept;
+
+        // Reuse a free slot of the same size or open a new one
+        for (int f = 0; f < num_free; f++) {
+            if (slot_size(slot_types[free_slots[f]]) == slot_size(current->type)) {
+                current->slot = free_slots[f];
+                free_slots[f] = free_slots[--num_free];
+                break;
+            }
+        }
+        if (current->slot < 0) {
+            slot_types[num_slots] = current->type;
+            current->slot = num_slots++;
+        }
+        active[num_active++] = current;
+    }
+
+    // Rename temps to their slots
+    for (int i = 0; i < function->num_instrs; i++) {
+        rename_temp(slots, intervals, &function->instrs[i].dest);
+        rename_temp(slots, intervals, &function->instrs[i].arg1);
+        rename_temp(slots, intervals, &function->instrs[i].arg2);
+    }
+
+    // The frame is params and locals plus one entry per slot
+    int temp_memory = 0;
+    for (int s = 0; s < num_slots; s++) {
+        temp_memory += slot_size(slot_types[s]);
+    }
+    function->memory = function->var_memory + temp_memory;
+    stats->temps = num_intervals;
+    stats->slots = num_slots;
+    stats->frame_after = function->memory;
+
+    free(slot_types);
+    free(free_slots);
+    free(active);
+    free(order);
+    free(intervals);
+    free_cfg(&cfg);
+}
+
+/******************************** Inlining ********************************/
+#define INLINE_MAX_GROWTH 8          // Largest growth of the caller per inlined call, in instructions
+#define INLINE_LOOP_BONUS 3          // Growth allowance multiplier for calls inside a loop
+#define INLINE_MAX_CALLER 500        // Callers are not grown past this many instructions
+
+// Call graph over the functions of a program, indexed by position in program->functions
+struct call_graph{
+    int num_functions;               //
+    int** calls;                     // calls[f][g] is the number of LCalls from f to g
+    int* recursive;                  // True(1) if the function can reach itself through calls
+    int* order;                      // Callees before their callers, cycles broken arbitrarily
+};
+
+// Index of a function in the program, -1 if there is none
+int find_function(struct tac_program* program, const char* name){
+    for (int f = 0; f < program->num_functions; f++) {
+        if (compare_strings(program->functions[f]->name, name) == 0) {
+            return f;
+        }
+    }
+    return -1;
+}
+
+// Number of instructions a function executes code for, labels and removed instructions do not count
+int function_size(struct tac_function* function){
+    int size = 0;
+    for (int i = 0; i < function->num_instrs; i++) {
+        if (function->instrs[i].op != TAC_NOP && function->instrs[i].op != TAC_LABEL) {
+            size++;
+        }
+    }
+    return size;
+}
+
+// Appends f and then its callers' postorder, callees first
+void call_graph_postorder(struct call_graph* graph, int f, int* visited, int* count){
+    visited[f] = 1;
+    for (int g = 0; g < graph->num_functions; g++) {
+        if (graph->calls[f][g] > 0 && !visited[g]) {
+            call_graph_postorder(graph, g, visited, count);
+        }
+    }
+    graph->order[(*count)++] = f;
+}
+
+struct call_graph build_call_graph(struct tac_program* program){
+    struct call_graph graph;
+    int n = program->num_functions;
+    graph.num_functions = n;
+    graph.calls = malloc(sizeof(int*) * (n + 1));
+    graph.recursive = calloc(n + 1, sizeof(int));
+    graph.order = malloc(sizeof(int) * (n + 1));
+    for (int f = 0; f < n; f++) {
+        graph.calls[f] = calloc(n + 1, sizeof(int));
+        struct tac_function* function = program->functions[f];
+        for (int i = 0; i < function->num_instrs; i++) {
+            if (function->instrs[i].op == TAC_LCALL) {
+                int g = find_function(program, function->instrs[i].callee);
+                if (g >= 0) {
+                    graph.calls[f][g]++;
+                }
+            }
+        }
+    }
+
+    // A function is recursive if a depth first search from its callees finds it again
+    int* visited = malloc(sizeof(int) * (n + 1));
+    int* stack = malloc(sizeof(int) * (n * n + n + 1));
+    for (int f = 0; f < n; f++) {
+        int top = 0;
+        for (int g = 0; g < n; g++) {
+            visited[g] = 0;
+            if (graph.calls[f][g] > 0) {
+                visited[g] = 1;
+                stack[top++] = g;
+            }
+        }
+        while (top > 0 && !graph.recursive[f]) {
+            int g = stack[--top];
+            if (g == f) {
+                graph.recursive[f] = 1;
+            }
+            for (int h = 0; h < n; h++) {
+                if (graph.calls[g][h] > 0 && !visited[h]) {
+                    visited[h] = 1;
+                    stack[top++] = h;
+                }
+            }
+        }
+    }
+
+    int count = 0;
+    for (int f = 0; f < n; f++) {
+        visited[f] = 0;
+    }
+    for (int f = 0; f < n; f++) {
+        if (!visited[f]) {
+            call_graph_postorder(&graph, f, visited, &count);
+        }
+    }
+    free(stack);
+    free(visited);
+    return graph;
+}
+
+void free_call_graph(struct call_graph* graph){
+    for (int f = 0; f < graph->num_functions; f++) {
+        free(graph->calls[f]);
+    }
+    free(graph->calls);
+    free(graph->recursive);
+    free(graph->order);
+}
+
+// Marks every instruction inside a loop of the function
+char* instrs_in_loops(struct tac_function* function){
+    char* in_loop = calloc(function->num_instrs + 1, sizeof(char));
+    if (function->num_instrs == 0) {
+        return in_loop;
+    }
+    struct tac_cfg cfg = build_cfg(function);
+    cfg_mark_reachable(&cfg);
+    unsigned int** dom = compute_dominators(&cfg);
+    struct tac_loop* loops;
+    int num_loops = find_loops(&cfg, dom, &loops);
+    for (int l = 0; l < num_loops; l++) {
+        for (int b = 0; b < cfg.num_blocks; b++) {
+            if (!loop_contains(&loops[l], b)) {
+                continue;
+            }
+            for (int i = cfg.blocks[b].start; i < cfg.blocks[b].end; i++) {
+                in_loop[i] = 1;
+            }
+        }
+    }
+    free_loops(loops, num_loops);
+    free_dominators(dom, cfg.num_blocks);
+    free_cfg(&cfg);
+    return in_loop;
+}
+
+// Name a callee's param or local takes in the caller, callee_name_site. Source identifiers cannot
+// contain an underscore so the name cannot clash with a variable of the caller.
+char* inline_name(struct tac_function* callee, const char* name, int site){
+    int length = snprintf(NULL, 0, "%s_%s_%d", callee->name, name, site);
+    char* renamed = malloc(length + 1);
+    snprintf(renamed, length + 1, "%s_%s_%d", callee->name, name, site);
+    return renamed;
+}
+
+// Rewrites a callee operand into the caller's names and temps
+struct tac_operand inline_operand(struct tac_function* callee, char** renamed, int temp_base, int min_temp, struct tac_operand operand){
+    if (operand.kind == TAC_TEMP) {
+        operand.temp = temp_base + (operand.temp - min_temp);
+    }
+    if (operand.kind == TAC_VAR) {
+        for (int l = 0; l < callee->num_locals; l++) {
+            if (compare_strings(callee->locals[l], operand.name) == 0) {
+                operand.name = renamed[l];
+            }
+        }
+    }
+    return operand;
+}
+
+// True(1) if the callee uses a global that the caller hides behind a param or local of the same name
+int inline_shadows(struct tac_function* caller, struct tac_function* callee){
+    // The globals are main's variables, so a name means the same variable there
+    if (caller->is_main) {
+        return 0;
+    }
+    for (int i = 0; i < callee->num_instrs; i++) {
+        struct tac_operand operands[3] = {callee->instrs[i].dest, callee->instrs[i].arg1, callee->instrs[i].arg2};
+        for (int o = 0; o < 3; o++) {
+            if (operands[o].kind == TAC_VAR && !tac_is_local(callee, operands[o].name) && tac_is_local(caller, operands[o].name)) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+// Replaces the call at index call, with its PushParams at pushes (in push order, last argument first),
+// by a copy of the callee. Params and locals become new locals of the caller, temps and labels are
+// renumbered, each PushParam becomes an assignment to its param and each Return assigns the LCall's
+// result and jumps past the copy. Returns the number of instructions the copy occupies.
+int inline_call(struct tac_program* program, struct tac_function* caller, struct tac_function* callee, int call, int* pushes, int site){
+    // Params and locals join the caller's frame
+    char** renamed = malloc(sizeof(char*) * (callee->num_locals + 1));
+    caller->locals = realloc(caller->locals, sizeof(char*) * (caller->num_locals + callee->num_locals + 1));
+    for (int l = 0; l < callee->num_locals; l++) {
+        renamed[l] = tac_own(program, inline_name(callee, callee->locals[l], site));
+        caller->locals[caller->num_locals++] = renamed[l];
+    }
+    caller->var_memory += callee->var_memory;
+    caller->memory += callee->var_memory;
+
+    // Fresh temps and labels
+    int min_temp = -1;
+    int max_temp = -1;
+    int num_labels = 0;
+    for (int i = 0; i < callee->num_instrs; i++) {
+        struct tac_operand operands[3] = {callee->instrs[i].dest, callee->instrs[i].arg1, callee->instrs[i].arg2};
+        for (int o = 0; o < 3; o++) {
+            if (operands[o].kind == TAC_TEMP) {
+                if (min_temp < 0 || operands[o].temp < min_temp) {
+                    min_temp = operands[o].temp;
+                }
+                if (operands[o].temp > max_temp) {
+                    max_temp = operands[o].temp;
+                }
+            }
+        }
+        if (callee->instrs[i].op == TAC_LABEL) {
+            num_labels++;
+        }
+    }
+    int temp_base = program->next_temp;
+    program->next_temp += (min_temp < 0) ? 0 : max_temp - min_temp + 1;
+    int* old_labels = malloc(sizeof(int) * (num_labels + 1));
+    int first_label = program->next_label;
+    num_labels = 0;
+    for (int i = 0; i < callee->num_instrs; i++) {
+        if (callee->instrs[i].op == TAC_LABEL) {
+            old_labels[num_labels++] = callee->instrs[i].label;
+            program->next_label++;
+        }
+    }
+    int end_label = program->next_label++;
+
+    // Arguments, the last PushParam passes the first param
+    for (int a = 0; a < callee->num_params; a++) {
+        struct tac_instr* push = &caller->instrs[pushes[callee->num_params - 1 - a]];
+        *push = tac_instr_new(TAC_ASSIGN, tac_var(renamed[a], push->arg1.type), push->arg1, tac_none());
+    }
+
+    // Body
+    struct tac_operand result = caller->instrs[call].dest;
+    struct tac_instr* body = malloc(sizeof(struct tac_instr) * (2 * callee->num_instrs + 1));
+    int count = 0;
+    for (int i = 0; i < callee->num_instrs; i++) {
+        struct tac_instr instr = callee->instrs[i];
+        if (instr.op == TAC_NOP) {
+            continue;
+        }
+        instr.dest = inline_operand(callee, renamed, temp_base, min_temp, instr.dest);
+        instr.arg1 = inline_operand(callee, renamed, temp_base, min_temp, instr.arg1);
+        instr.arg2 = inline_operand(callee, renamed, temp_base, min_temp, instr.arg2);
+        if (instr.op == TAC_LABEL || tac_is_branch(instr.op)) {
+            // A jump to a label the callee does not define leaves it
+            int label = end_label;
+            for (int l = 0; l < num_labels; l++) {
+                if (old_labels[l] == instr.label) {
+                    label = first_label + l;
+                }
+            }
+            instr.label = label;
+        }
+        if (instr.op == TAC_RETURN) {
+            if (result.kind != TAC_NONE && instr.arg1.kind != TAC_NONE) {
+                body[count++] = tac_instr_new(TAC_ASSIGN, result, instr.arg1, tac_none());
+            }
+            instr = tac_instr_new(TAC_GOTO, tac_none(), tac_none(), tac_none());
+            instr.label = end_label;
+        }
+        body[count++] = instr;
+    }
+    body[count] = tac_instr_new(TAC_LABEL, tac_none(), tac_none(), tac_none());
+    body[count++].label = end_label;
+
+    // The copy replaces the LCall and its PopParams
+    tac_replace_range(caller, call, call + 2, body, count);
+    free(body);
+    free(old_labels);
+    free(renamed);
+    return count;
+}
+
+// Decides and performs inlining for every call of one function, writing one report line per call site.
+// The cost model charges the growth of the caller: the callee body, one label and one extra instruction
+// per Return, less the LCall and PopParams that go away (PushParams become assignments one for one).
+// A call is inlined when the callee is not recursive, the growth is at most INLINE_MAX_GROWTH, times
+// INLINE_LOOP_BONUS when the call sits in a loop and pays its overhead every iteration, and the caller
+// stays under INLINE_MAX_CALLER instructions. Returns the number of calls inlined.
+int inline_function_calls(struct tac_program* program, struct call_graph* graph, int f, int* site, FILE* report){
+    struct tac_function* caller = program->functions[f];
+    int inlined = 0;
+    int call_number = 0;
+    char* in_loop = instrs_in_loops(caller);
+    int* stack = malloc(sizeof(int) * (caller->num_instrs + 1));
+    int top = 0;
+    int i = 0;
+    while (i < caller->num_instrs) {
+        struct tac_instr* instr = &caller->instrs[i];
+        if (instr->op == TAC_PUSH_PARAM) {
+            stack[top++] = i++;
+            continue;
+        }
+        if (instr->op != TAC_LCALL) {
+            i++;
+            continue;
+        }
+
+        // Match the call with the PushParams of its arguments
+        call_number++;
+        if (i + 1 >= caller->num_instrs || caller->instrs[i + 1].op != TAC_POP_PARAMS || caller->instrs[i + 1].count / 4 > top) {
+            fprintf(report, "Inline: %s -> %s, call %d: kept, arguments not found\n", caller->name, instr->callee, call_number);
+            break;
+        }
+        int num_args = caller->instrs[i + 1].count / 4;
+        top -= num_args;
+        int* pushes = &stack[top];
+
+        int g = find_function(program, instr->callee);
+        struct tac_function* callee = (g >= 0) ? program->functions[g] : NULL;
+        int returns = 0;
+        for (int j = 0; callee != NULL && j < callee->num_instrs; j++) {
+            returns += (callee->instrs[j].op == TAC_RETURN);
+        }
+        int growth = (callee != NULL) ? function_size(callee) + 1 + returns - 2 : 0;
+        int limit = INLINE_MAX_GROWTH * (in_loop[i] ? INLINE_LOOP_BONUS : 1);
+        int caller_size = function_size(caller);
+
+        fprintf(report, "Inline: %s -> %s, call %d: ", caller->name, instr->callee, call_number);
+        if (callee == NULL || callee->is_main) {
+            fprintf(report, "kept, unknown callee\n");
+        }
+        else if (graph->recursive[g]) {
+            fprintf(report, "kept, recursive\n");
+        }
+        else if (callee->num_params != num_args) {
+            fprintf(report, "kept, call does not match the definition\n");
+        }
+        else if (growth > limit) {
+            fprintf(report, "kept, growth %d over limit %d\n", growth, limit);
+        }
+        else if (caller_size + growth > INLINE_MAX_CALLER) {
+            fprintf(report, "kept, caller would grow past %d instructions\n", INLINE_MAX_CALLER);
+        }
+        else if (inline_shadows(caller, callee)) {
+            fprintf(report, "kept, callee global shadowed in caller\n");
+        }
+        else {
+            fprintf(report, "inlined, growth %d%s\n", growth, in_loop[i] ? " (in loop)" : "");
+            int count = inline_call(program, caller, callee, i, pushes, (*site)++);
+            inlined++;
+
+            // Loop membership and the push stack index shifted, the body is spliced in at i
+            free(in_loop);
+            in_loop = instrs_in_loops(caller);
+            stack = realloc(stack, sizeof(int) * (caller->num_instrs + 1));
+            i += count;
+            continue;
+        }
+        i++;
+    }
+    free(stack);
+    free(in_loop);
+    return inlined;
+}
+
+/******************************** Interprocedural ********************************/
+// One call of a function, with the PushParams of its arguments in push order (last argument first)
+struct call_site{
+    int caller;                      // Index of the calling function in program->functions
+    int call;                        // Index of the LCall in the caller
+    int num_args;                    // Number of arguments, -1 if the PushParams could not be matched
+    int* pushes;                     // Indeces of the PushParams
+};
+
+// Collects every call of function f across the program, returns the number found
+int find_call_sites(struct tac_program* program, int f, struct call_site** sites_out){
+    int capacity = 8;
+    int num_sites = 0;
+    struct call_site* sites = malloc(sizeof(struct call_site) * capacity);
+    for (int c = 0; c < program->num_functions; c++) {
+        struct tac_function* caller = program->functions[c];
+        for (int i = 0; i < caller->num_instrs; i++) {
+            if (caller->instrs[i].op != TAC_LCALL || compare_strings(caller->instrs[i].callee, program->functions[f]->name) != 0) {
+                continue;
+            }
+            if (num_sites == capacity) {
+                capacity *= 2;
+                sites = realloc(sites, sizeof(struct call_site) * capacity);
+            }
+            struct call_site* site = &sites[num_sites++];
+            site->caller = c;
+            site->call = i;
+            site->pushes = malloc(sizeof(int) * (i + 1));
+            site->num_args = call_arguments(caller, i, site->pushes);
+        }
+    }
+    *sites_out = sites;
+    return num_sites;
+}
+
+void free_call_sites(struct call_site* sites, int num_sites){
+    for (int s = 0; s < num_sites; s++) {
+        free(sites[s].pushes);
+    }
+    free(sites);
+}
+
+// Argument a call site passes for param p
+struct tac_operand call_site_argument(struct tac_program* program, struct call_site* site, int p){
+    return program->functions[site->caller]->instrs[site->pushes[site->num_args - 1 - p]].arg1;
+}
+
+// Removes every function no chain of calls from main reaches, returns the number removed
+int eliminate_dead_functions(struct tac_program* program, struct opt_stats* stats, FILE* report){
+    struct call_graph graph = build_call_graph(program);
+    int n = program->num_functions;
+    int* live = calloc(n + 1, sizeof(int));
+    int* stack = malloc(sizeof(int) * (n + 1));
+    int top = 0;
+    for (int f = 0; f < n; f++) {
+        if (program->functions[f]->is_main) {
+            live[f] = 1;
+            stack[top++] = f;
+        }
+    }
+    while (top > 0) {
+        int f = stack[--top];
+        for (int g = 0; g < n; g++) {
+            if (graph.calls[f][g] > 0 && !live[g]) {
+                live[g] = 1;
+                stack[top++] = g;
+            }
+        }
+    }
+
+    // Compact the function list and the counters alongside it
+    int kept = 0;
+    for (int f = 0; f < n; f++) {
+        struct tac_function* function = program->functions[f];
+        if (live[f]) {
+            stats[kept] = stats[f];
+            program->functions[kept++] = function;
+            continue;
+        }
+        fprintf(report, "Removed function: %s, unreachable from main\n", function->name);
+        free(function->instrs);
+        free(function->locals);
+        free(function);
+    }
+    program->num_functions = kept;
+    free(stack);
+    free(live);
+    free_call_graph(&graph);
+    return n - kept;
+}
+
+// True(1) if some instruction of the function assigns the variable
+int writes_var(struct tac_function* function, const char* name){
+    for (int i = 0; i < function->num_instrs; i++) {
+        struct tac_instr* instr = &function->instrs[i];
+        if (instr->op != TAC_NOP && instr->dest.kind == TAC_VAR && compare_strings(instr->dest.name, name) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Constant parameter specialization. A param that every call passes the same constant (a recursive call
+// may also pass the param through unchanged, as long as the function never assigns it) stops being a param: its PushParams are removed, the
+// PopParams shrink and the function starts by assigning the constant. Returns the number of params removed.
+int specialize_constant_params(struct tac_program* program, int f, FILE* report){
+    struct tac_function* function = program->functions[f];
+    if (function->is_main || function->num_params == 0) {
+        return 0;
+    }
+    struct call_site* sites;
+    int num_sites = find_call_sites(program, f, &sites);
+    int external = 0;
+    for (int s = 0; s < num_sites; s++) {
+        if (sites[s].num_args != function->num_params) {
+            free_call_sites(sites, num_sites);
+            return 0;
+        }
+        external += (sites[s].caller != f);
+    }
+    if (external == 0) {
+        free_call_sites(sites, num_sites);
+        return 0;
+    }
+
+    int removed = 0;
+    for (int p = function->num_params - 1; p >= 0; p--) {
+        // Find the constant and check every call agrees
+        struct tac_operand constant = tac_none();
+        int agree = 1;
+        int pass_through = !writes_var(function, function->locals[p]);
+        for (int s = 0; s < num_sites && agree; s++) {
+            struct tac_operand argument = call_site_argument(program, &sites[s], p);
+            if (pass_through && sites[s].caller == f && argument.kind == TAC_VAR
+                && compare_strings(argument.name, function->locals[p]) == 0) {
+                continue;
+            }
+            if (argument.kind != TAC_CONST) {
+                agree = 0;
+            }
+            else if (constant.kind == TAC_NONE) {
+                constant = argument;
+            }
+            else if (constant.type != argument.type || compare_strings(constant.name, argument.name) != 0) {
+                agree = 0;
+            }
+        }
+        if (!agree || constant.kind == TAC_NONE) {
+            continue;
+        }
+
+        // Drop the argument from every call
+        for (int s = 0; s < num_sites; s++) {
+            struct tac_function* caller = program->functions[sites[s].caller];
+            caller->instrs[sites[s].pushes[sites[s].num_args - 1 - p]].op = TAC_NOP;
+            caller->instrs[sites[s].call + 1].count -= 4;
+        }
+
+        // The param becomes the first local and takes the constant on entry
+        char* name = function->locals[p];
+        for (int l = p; l < function->num_params - 1; l++) {
+            function->locals[l] = function->locals[l + 1];
+        }
+        function->locals[function->num_params - 1] = name;
+        function->num_params--;
+        struct tac_instr entry = tac_instr_new(TAC_ASSIGN, tac_var(name, constant.type), constant, tac_none());
+        tac_insert(function, 0, &entry, 1);
+        for (int s = 0; s < num_sites; s++) {
+            if (sites[s].caller == f) {
+                sites[s].call++;
+                for (int a = 0; a < sites[s].num_args; a++) {
+                    sites[s].pushes[a]++;
+                }
+            }
+        }
+        fprintf(report, "Specialized: %s, param %s is always %s\n", function->name, name, constant.name);
+        removed++;
+    }
+    free_call_sites(sites, num_sites);
+    return removed;
+}
+
+// True(1) if a function has no effect besides its return value and always finishes: it prints nothing,
+// writes no globals, has no backward jumps and only calls functions that are pure themselves
+int is_pure_function(struct tac_program* program, int f, int* visiting){
+    struct tac_function* function = program->functions[f];
+    if (function->is_main || visiting[f]) {
+        return 0;
+    }
+    visiting[f] = 1;
+    int pure = 1;
+    for (int i = 0; i < function->num_instrs && pure; i++) {
+        struct tac_instr* instr = &function->instrs[i];
+        if (instr->op == TAC_PRINT) {
+            pure = 0;
+        }
+        if (instr->dest.kind == TAC_VAR && !tac_is_local(function, instr->dest.name)) {
+            pure = 0;
+        }
+        if (tac_is_branch(instr->op)) {
+            for (int j = 0; j <= i; j++) {
+                if (function->instrs[j].op == TAC_LABEL && function->instrs[j].label == instr->label) {
+                    pure = 0;
+                }
+            }
+        }
+        if (instr->op == TAC_LCALL) {
+            int g = find_function(program, instr->callee);
+            pure = (g >= 0) && is_pure_function(program, g, visiting);
+        }
+    }
+    visiting[f] = 0;
+    return pure;
+}
+
+// Constant return propagation. When every Return of a function returns the same constant, each call's
+// result is replaced by the constant: the whole call goes away if the function is pure, otherwise the
+// call stays for its effects and the constant is assigned after it. Returns the number of calls rewritten.
+int propagate_constant_return(struct tac_program* program, int f, FILE* report){
+    struct tac_function* function = program->functions[f];
+    struct tac_operand constant = tac_none();
+    for (int i = 0; i < function->num_instrs; i++) {
+        struct tac_instr* instr = &function->instrs[i];
+        if (instr->op != TAC_RETURN) {
+            continue;
+        }
+        if (instr->arg1.kind != TAC_CONST ||
+            (constant.kind == TAC_CONST && (constant.type != instr->arg1.type || compare_strings(constant.name, instr->arg1.name) != 0))) {
+            return 0;
+        }
+        constant = instr->arg1;
+    }
+    if (function->is_main || constant.kind != TAC_CONST) {
+        return 0;
+    }
+
+    int* visiting = calloc(program->num_functions + 1, sizeof(int));
+    int pure = is_pure_function(program, f, visiting);
+    free(visiting);
+
+    struct call_site* sites;
+    int num_sites = find_call_sites(program, f, &sites);
+    int rewritten = 0;
+    // Latest first, so inserting after one call leaves the indeces of earlier calls in the same caller alone
+    for (int s = num_sites - 1; s >= 0; s--) {
+        struct tac_function* caller = program->functions[sites[s].caller];
+        int call = sites[s].call;
+        struct tac_operand result = caller->instrs[call].dest;
+        if (sites[s].caller == f || result.kind == TAC_NONE) {
+            continue;
+        }
+        struct tac_instr assign = tac_instr_new(TAC_ASSIGN, result, constant, tac_none());
+        if (pure && sites[s].num_args >= 0) {
+            for (int a = 0; a < sites[s].num_args; a++) {
+                caller->instrs[sites[s].pushes[a]].op = TAC_NOP;
+            }
+            caller->instrs[call] = assign;
+            caller->instrs[call + 1].op = TAC_NOP;
+        }
+        else {
+            tac_insert(caller, call + 2, &assign, 1);
+        }
+        rewritten++;
+    }
+    if (rewritten > 0) {
+        fprintf(report, "Constant return: %s always returns %s, %d call%s %s\n", function->name, constant.name,
+                rewritten, (rewritten == 1) ? "" : "s", pure ? "removed" : "kept for effects");
+    }
+    free_call_sites(sites, num_sites);
+    return rewritten;
+}
+
+/******************************** Drivers ********************************/
+// Runs the cleanup passes until none of them changes anything
+void cleanup_function(struct tac_function* function, struct tac_program* program, struct opt_stats* stats){
+    int changed = 1;
+    while (changed && function->num_instrs > 0) {
+        changed = 0;
+
+        int peephole = peephole_optimize(function, stats);
+        int constants = propagate_constants(function, program);
+
+        struct tac_cfg cfg = build_cfg(function);
+        int unreachable = eliminate_unreachable(&cfg);
+        compute_liveness(&cfg);
+        int dead = eliminate_dead_stores(&cfg);
+        free_cfg(&cfg);
+        tac_compact(function);
+
+        int labels = eliminate_unreferenced_labels(function);
+        tac_compact(function);
+
+        stats->unreachable += unreachable;
+        stats->dead_stores += dead;
+        stats->labels += labels;
+        stats->constants += constants;
+        changed = (peephole + constants + unreachable + dead + labels) > 0;
+    }
+}
+
+// Cleans a function up, transforms its loops and cleans up what the loop passes left behind
+void optimize_function(struct tac_function* function, struct tac_program* program, struct opt_stats* stats){
+    stats->before = function->num_instrs;
+    cleanup_function(function, program, stats);
+    stats->tail_calls = eliminate_tail_calls(function, program);
+    if (stats->tail_calls > 0) {
+        cleanup_function(function, program, stats);
+    }
+    if (optimize_loops(function, program, stats) > 0) {
+        cleanup_function(function, program, stats);
+    }
+    stats->after = function->num_instrs;
+}
+
+// Inlines calls bottom up through the call graph, so a callee has had its own calls inlined before it
+// is copied, then reoptimizes every function that changed
+void inline_program(struct tac_program* program, struct opt_stats* stats, FILE* report){
+    struct call_graph graph = build_call_graph(program);
+    int site = 0;
+    for (int n = 0; n < graph.num_functions; n++) {
+        int f = graph.order[n];
+        int inlined = inline_function_calls(program, &graph, f, &site, report);
+        stats[f].inlined += inlined;
+        if (inlined > 0) {
+            struct tac_function* function = program->functions[f];
+            cleanup_function(function, program, &stats[f]);
+            if (optimize_loops(function, program, &stats[f]) > 0) {
+                cleanup_function(function, program, &stats[f]);
+            }
+            stats[f].after = function->num_instrs;
+        }
+    }
+    free_call_graph(&graph);
+}
+
+// Whole program passes over the call graph. Constant params and constant returns feed each other through
+// constant propagation in the functions they touch, so they repeat until neither finds anything, then
+// functions main no longer reaches are dropped.
+void interprocedural_program(struct tac_program* program, struct opt_stats* stats, FILE* report){
+    int* touched = calloc(program->num_functions + 1, sizeof(int));
+    int* returns_done = calloc(program->num_functions + 1, sizeof(int));
+    for (int round = 0; round < 16; round++) {
+        int changed = 0;
+        for (int f = 0; f < program->num_functions; f++) {
+            int removed = specialize_constant_params(program, f, report);
+            stats[f].specialized += removed;
+            if (removed > 0) {
+                // The callee and every caller changed
+                for (int c = 0; c < program->num_functions; c++) {
+                    touched[c] = 1;
+                }
+                changed = 1;
+            }
+        }
+        for (int f = 0; f < program->num_functions; f++) {
+            // A call kept for its effects still looks like a candidate, so each function is rewritten once
+            if (returns_done[f]) {
+                continue;
+            }
+            int rewritten = propagate_constant_return(program, f, report);
+            returns_done[f] = (rewritten > 0);
+            stats[f].constant_returns += rewritten;
+            if (rewritten > 0) {
+                for (int c = 0; c < program->num_functions; c++) {
+                    touched[c] = 1;
+                }
+                changed = 1;
+            }
+        }
+        for (int f = 0; f < program->num_functions; f++) {
+            if (touched[f]) {
+                cleanup_function(program->functions[f], program, &stats[f]);
+                stats[f].after = program->functions[f]->num_instrs;
+                touched[f] = 0;
+            }
+        }
+        if (!changed) {
+            break;
+        }
+    }
+    free(returns_done);
+    free(touched);
+    eliminate_dead_functions(program, stats, report);
+}
+
+// Writes a function's counters to the optimization report
+void print_opt_stats(struct tac_function* function, struct opt_stats* stats, FILE* report){
+    fprintf(report, "Function: %s, Instructions: %d -> %d, Removed: %d\n",
+            function->name, stats->before, stats->after, stats->before - stats->after);
+    fprintf(report, "    Dead stores: %d, Unreachable: %d, Unreferenced labels: %d, Constants: %d\n",
+            stats->dead_stores, stats->unreachable, stats->labels, stats->constants);
+    fprintf(report, "    Peephole:");
+    for (int r = 0; r < NUM_PEEPHOLE_RULES; r++) {
+        fprintf(report, " %s %d%s", peephole_rules[r].name, stats->peephole[r], (r < NUM_PEEPHOLE_RULES - 1) ? "," : "\n");
+    }
+    fprintf(report, "    Loops: %d, Hoisted: %d, Strength reduced: %d, Unrolled: %d full, %d partial\n",
+            stats->loops, stats->hoisted, stats->reduced, stats->unrolled, stats->partially_unrolled);
+    fprintf(report, "    Inlined calls: %d, Tail calls: %d removed, %d marked\n", stats->inlined, stats->tail_calls, stats->tail_marked);
+    fprintf(report, "    Specialized params: %d, Constant returns: %d\n", stats->specialized, stats->constant_returns);
+    fprintf(report, "    Temps: %d -> %d slots, Frame: %d -> %d bytes\n",
+            stats->temps, stats->slots, stats->frame_before, stats->frame_after);
+}
+
+// Optimizes every function of a program, inlines small calls and reports what each pass did
+void optimize_program(struct tac_program* program, FILE* report){
+    struct opt_stats* stats = calloc(program->num_functions + 1, sizeof(struct opt_stats));
+    for (int i = 0; i < program->num_functions; i++) {
+        optimize_function(program->functions[i], program, &stats[i]);
+    }
+    inline_program(program, stats, report);
+    interprocedural_program(program, stats, report);
+    for (int i = 0; i < program->num_functions; i++) {
+        stats[i].tail_marked = mark_tail_calls(program->functions[i]);
+        allocate_temps(program->functions[i], &stats[i]);
+        print_opt_stats(program->functions[i], &stats[i], report);
+    }
+    free(stats);
+}
+
+#endif // OPTIMIZE_H
@@ -0,0 +1,132 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+// Parallel front end: with the parallel option a compilation first finds its def ... fed ; blocks with a scan of
+// the source for top level def and fed keywords and reads each block's signature from its header. Worker threads
+// then parse and check the blocks, each on a compiler_context of its own so every allocation a block makes is the
+// worker's, starting from the state the parser rests in between blocks and seeing the signatures of the blocks
+// before it. What each block did is kept as a per-function cache entry, and the compilation goes on as an
+// incremental one, so the entries are validated against the real parser state and functions in source order and
+// spliced into the tree where they hold. A block whose header was misread, whose start state was guessed wrong or
+// that had errors is analyzed again in place, which keeps the outputs, errors included, the same as serially.
+//
+// The blocks are dealt out to the workers in contiguous runs. A worker takes its own blocks from the bottom of its
+// deque and, once it runs out, steals from the top of the others', so a run of long functions doesn't hold up the
+// compilation behind one worker.
+
+/******************************** Parallel Definitions ********************************/
+#define PARALLEL_MAX_WORKERS 256     // Most threads the blocks are checked on
+
+// What parallel_signature expects next in a header
+#define PARALLEL_RETURN_TYPE 0       //
+#define PARALLEL_NAME        1       //
+#define PARALLEL_OPEN        2       // The ( before the params
+#define PARALLEL_PARAM_TYPE  3       // The type of the first param, or the ) of none
+#define PARALLEL_PARAM_ID    4       //
+#define PARALLEL_COMMA       5       // The , before the next param or the )
+#define PARALLEL_NEXT_PARAM  6       // The type of a param after a ,
+
+/******************************** Struct Definitions ********************************/
+struct parallel_work;
+
+// A thread checking blocks, with a context of its own
+struct parallel_worker{
+    struct parallel_work* work;      //
+    struct compiler_context* compiler;
+    struct scope* global;            // Scope of main its blocks start in, always empty
+    struct deque deque;              // Spans of the blocks dealt to it, filled before the workers start
+    unsigned seed;                   // Picks steal victims
+};
+
+// The blocks of one compilation and what the workers made of them
+struct parallel_work{
+    const char* source;              // Source of the compilation, read by every worker
+    struct incremental_span* spans;  // Blocks of the source, in source order
+    int num_blocks;                  //
+    int* lines;                      // Line each block starts on
+    struct function* signatures;     // Signature read from each block's header, named "" if it couldn't be
+    struct incremental_entry** entries;
+                                     // Entry each block checked stored, NULL if it had errors or wasn't dealt out
+    struct parallel_worker* workers; //
+    int num_workers;                 //
+};
+
+/******************************** Functions ********************************/
+// Reads the signature of a def ... fed ; block from its header, "def type name(type id, ...)", into function
+// with the types numbered as the checker numbers them. Returns 0, or 1 leaving function's name NULL if the header
+// isn't one
+int parallel_signature(const char* text, size_t length, struct function* function){
+    function->lexeme = NULL;
+    function->return_type = -1;
+    function->num_params = 0;
+    function->param_types = NULL;
+    function->my_scope = NULL;
+
+    // Where in the header the next word or char is: the return type, the name, (, a param's type or ), its id,
+    // then , or )
+    int expect = PARALLEL_RETURN_TYPE;
+    size_t i = 3;
+    while (i < length) {
+        char c = text[i];
+        if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+            i++;
+            continue;
+        }
+        size_t start = i;
+        while (i < length && ((text[i] >= 'a' && text[i] <= 'z') || (text[i] >= 'A' && text[i] <= 'Z') || (text[i] >= '0' && text[i] <= '9'))) {
+            i++;
+        }
+        size_t word = i - start;
+        int type = -1;
+        if (word == 3 && incremental_match(text + start, word, "int") == 3) {
+            type = 1;
+        }
+        else if (word == 6 && incremental_match(text + start, word, "double") == 6) {
+            type = 0;
+        }
+        if (word == 0) {
+            i++;
+        }
+
+        if (expect == PARALLEL_RETURN_TYPE && type != -1) {
+            function->return_type = type;
+            expect = PARALLEL_NAME;
+        }
+        else if (expect == PARALLEL_NAME && word > 0 && type == -1) {
+            function->lexeme = malloc(word + 1);
+            for (size_t k = 0; k < word; k++) {
+                function->lexeme[k] = text[start + k];
+            }
+            function->lexeme[word] = '\0';
+            expect = PARALLEL_OPEN;
+        }
+        else if (expect == PARALLEL_OPEN && c == '(') {
+            expect = PARALLEL_PARAM_TYPE;
+        }
+        else if ((expect == PARALLEL_PARAM_TYPE || expect == PARALLEL_NEXT_PARAM) && type != -1) {
+            function->param_types = realloc(function->param_types, sizeof(int) * (function->num_params + 1));
+            function->param_types[function->num_params++] = type;
+            expect = PARALLEL_PARAM_ID;
+        }
+        else if (expect == PARALLEL_PARAM_ID && word > 0 && type == -1) {
+            expect = PARALLEL_COMMA;
+        }
+        else if (expect == PARALLEL_COMMA && c == ',') {
+            expect = PARALLEL_NEXT_PARAM;
+        }
+        else if ((expect == PARALLEL_PARAM_TYPE || expect == PARALLEL_COMMA) && c == ')') {
+            return 0;
+        }
+        else {
+            break;
+        }
+    }
+    free(function->lexeme);
+    free(function->param_types);
+    function->lexeme = NULL;
+    function->param_types = NULL;
+    function->num_params = 0;
+    return 1;
+}
+
+#endif // PARALLEL_H
@@ -0,0 +1,112 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+// Lexer/parser pipeline: with the pipeline option the lexer runs on a thread of its own and hands what it finds to
+// the parser as token records, compact integers with the lexeme copied beside them. The records go through a single
+// producer single consumer ring of batches, so the two threads touch the ring's counters once per batch rather than
+// once per token, and neither takes a lock. Lexical errors travel through the ring as records too, which lets the
+// parser write them to the error file in the same order as the serial path does.
+
+/******************************** Pipeline Definitions ********************************/
+// Kinds of record
+#define LEX_TOKEN           0        // A token for the parser
+#define LEX_ERROR_ASCII     1        // A non-ASCII char, value holds it
+#define LEX_ERROR_LEXEME    2        // A lexeme no token matches
+#define LEX_ERROR_LENGTH    3        // A lexeme longer than the lexer's buffer
+
+#define PIPELINE_BATCH      256      // Records per batch
+#define PIPELINE_TEXT       16384    // Bytes of lexeme text per batch, a batch is handed over early when it fills
+#define PIPELINE_SLOTS      8        // Batches in the ring, a power of two
+#define PIPELINE_SPINS      64       // Checks of the other thread's counter before yielding the CPU to it
+
+/******************************** Struct Definitions ********************************/
+// What the lexer found, with the numbers set_tl_nums gave it so the parser only rebuilds the token_lexeme
+struct lex_token{
+    int kind;                        // LEX_TOKEN or one of LEX_ERROR_*
+    int line;                        // Line the lexer was on
+    int token_num;                   // my_token_num of the token
+    int lexeme_num;                  // my_lexeme_num of the token
+    int is_int_flag;                 // is_int_flag of the token
+    int value;                       // Char of LEX_ERROR_ASCII
+    int text;                        // Offset of the lexeme in the batch's text
+};
+
+struct token_batch{
+    int count;                       // Records filled
+    int text_used;                   // Bytes of text filled
+    int last;                        // True(1) for the batch the lexer ends on
+    struct lex_token tokens[PIPELINE_BATCH];
+    char text[PIPELINE_TEXT];        // Lexemes, each terminated by '\0'
+};
+
+struct token_ring{
+    atomic_llong head;               // Batches the lexer has handed over, written by the lexer only
+    atomic_llong tail;               // Batches the parser is done with, written by the parser only
+    struct token_batch slots[PIPELINE_SLOTS];
+};
+
+/******************************** Functions ********************************/
+// Waits until counter has moved past value, spinning briefly and then yielding so the other thread can run on
+// the same CPU. Returns the counter
+long long pipeline_wait(atomic_llong* counter, long long value){
+    long long seen;
+    int spins = 0;
+    while ((seen = atomic_load_explicit(counter, memory_order_acquire)) <= value) {
+        if (++spins >= PIPELINE_SPINS) {
+            sched_yield();
+            spins = 0;
+        }
+    }
+    return seen;
+}
+
+// The slot the lexer fills next, waiting for the parser to free one
+struct token_batch* pipeline_claim(struct token_ring* ring){
+    long long head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&ring->tail, memory_order_acquire) >= PIPELINE_SLOTS) {
+        pipeline_wait(&ring->tail, head - PIPELINE_SLOTS);
+    }
+    struct token_batch* batch = &ring->slots[head & (PIPELINE_SLOTS - 1)];
+    batch->count = 0;
+    batch->text_used = 0;
+    batch->last = 0;
+    return batch;
+}
+
+// Hands the claimed slot to the parser
+void pipeline_publish(struct token_ring* ring){
+    long long head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+// The next batch the lexer handed over, waiting for it
+struct token_batch* pipeline_next(struct token_ring* ring){
+    long long tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    if (atomic_load_explicit(&ring->head, memory_order_acquire) <= tail) {
+        pipeline_wait(&ring->head, tail);
+    }
+    return &ring->slots[tail & (PIPELINE_SLOTS - 1)];
+}
+
+// Gives the batch pipeline_next returned back to the lexer
+void pipeline_release(struct token_ring* ring){
+    long long tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+// True(1) if the batch has no room for another record with a lexeme of length chars
+int pipeline_full(struct token_batch* batch, int length){
+    return batch->count == PIPELINE_BATCH || batch->text_used + length + 1 > PIPELINE_TEXT;
+}
+
+// Appends a record and its lexeme to a batch with room for them
+void pipeline_add(struct token_batch* batch, struct lex_token token, const char* lexeme, int length){
+    token.text = batch->text_used;
+    for (int i = 0; i < length; i++) {
+        batch->text[batch->text_used++] = lexeme[i];
+    }
+    batch->text[batch->text_used++] = '\0';
+    batch->tokens[batch->count++] = token;
+}
+
+#endif // PIPELINE_H
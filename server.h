@@ -0,0 +1,414 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdint.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+// Compile server: a daemon that listens on a Unix domain socket and compiles source buffers sent to it, replying
+// with the TAC and the diagnostics, so a build system pays neither process startup nor output files per compile.
+// Each worker thread accepts connections itself and serves every request on one with a compiler_context it keeps
+// for its whole life, along with its receive buffer and the in-memory outputs, so requests after the first find
+// them allocated. A connection carries any number of requests one after another and holds its worker until it
+// closes, so at most num_workers connections are served at once and later ones wait to be accepted. With a
+// per-function cache the contexts replay the functions of a source the worker compiled before, so resending a
+// file after editing one function redoes only that function. The client and the load generator speak the same
+// protocol.
+
+/******************************** Server Definitions ********************************/
+#define SERVER_MAGIC      0x31535043 // "CPS1", first word of every request
+#define SERVER_BACKLOG    128        // Connections waiting to be accepted
+#define SERVER_MAX_SOURCE (64 << 20) // Bytes of source one request may carry
+
+/******************************** Struct Definitions ********************************/
+// Sent before the source bytes of a request, in host byte order
+struct server_request{
+    uint32_t magic;                  // SERVER_MAGIC
+    uint32_t optimize;               // True(1) to run the TAC optimization passes
+    uint64_t length;                 // Bytes of source that follow
+};
+
+// Sent before the TAC and then the diagnostics of a reply
+struct server_reply{
+    uint32_t status;                 // What compiler_compile returned
+    uint32_t unused;                 //
+    uint64_t tac_length;             // Bytes of TAC that follow
+    uint64_t errors_length;          // Bytes of diagnostics after the TAC
+};
+
+struct server{
+    int listener;                    // Listening socket every worker accepts on
+    int num_workers;                 //
+    long long incremental;           // Bytes of per-function cache each context keeps, 0 for none
+    pthread_t* threads;              //
+};
+
+// One connection of the load generator
+struct server_load{
+    const char* path;                // Socket of the server
+    const char* source;              // Request sent again and again
+    size_t length;                   //
+    int optimize;                    //
+    long long requests;              // Requests this connection sends
+    double* latencies;               // Seconds from send to full reply of each request
+    int failed;                      // True(1) if the connection broke
+};
+
+/******************************** Socket I/O ********************************/
+// Reads exactly length bytes, returns 0, or 1 at the end of the stream or on an error
+int server_read(int fd, void* buffer, size_t length){
+    char* cursor = buffer;
+    while (length > 0) {
+        ssize_t got = read(fd, cursor, length);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return 1;
+        }
+        cursor += got;
+        length -= got;
+    }
+    return 0;
+}
+
+// Writes exactly length bytes, returns 0 or 1 on an error
+int server_write(int fd, const void* buffer, size_t length){
+    const char* cursor = buffer;
+    while (length > 0) {
+        ssize_t put = write(fd, cursor, length);
+        if (put < 0 && errno == EINTR) {
+            continue;
+        }
+        if (put <= 0) {
+            return 1;
+        }
+        cursor += put;
+        length -= put;
+    }
+    return 0;
+}
+
+// Fills address with the socket path, returns 0 or 1 after writing an error if it doesn't fit
+int server_address(const char* path, struct sockaddr_un* address){
+    int length = 0;
+    while (path[length] != '\0') {
+        length++;
+    }
+    if (length >= (int)sizeof(address->sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return 1;
+    }
+    address->sun_family = AF_UNIX;
+    for (int i = 0; i <= length; i++) {
+        address->sun_path[i] = path[i];
+    }
+    return 0;
+}
+
+// Connects to the server at path, returns the socket or -1 after writing an error
+int server_connect(const char* path){
+    struct sockaddr_un address = {0};
+    if (server_address(path, &address)) {
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("Error creating socket");
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Sends one request and reads its reply header, then the TAC and diagnostics into *texts, grown as needed.
+// Returns 0 or 1 if the connection broke
+int server_exchange(int fd, const char* source, size_t length, int optimize, struct server_reply* reply, char** texts, size_t* capacity){
+    struct server_request request = {SERVER_MAGIC, (uint32_t)optimize, length};
+    if (server_write(fd, &request, sizeof(request)) || server_write(fd, source, length)) {
+        return 1;
+    }
+    if (server_read(fd, reply, sizeof(*reply))) {
+        return 1;
+    }
+    size_t total = reply->tac_length + reply->errors_length;
+    if (total + 1 > *capacity) {
+        *capacity = total + 1;
+        *texts = realloc(*texts, *capacity);
+    }
+    if (server_read(fd, *texts, total)) {
+        return 1;
+    }
+    (*texts)[total] = '\0';
+    return 0;
+}
+
+/******************************** Server ********************************/
+// Replies to a request that can't be compiled with status 1 and message as its diagnostics, returns 0 or 1 on an
+// error
+int server_refuse(int fd, const char* message){
+    size_t length = 0;
+    while (message[length] != '\0') {
+        length++;
+    }
+    struct server_reply reply = {1, 0, 0, length};
+    return server_write(fd, &reply, sizeof(reply)) || server_write(fd, message, length);
+}
+
+// Serves the requests of one connection until the client closes it
+void server_serve(int fd, struct compiler_context** compilers, long long incremental, char** source, size_t* capacity){
+    struct server_request request;
+    while (server_read(fd, &request, sizeof(request)) == 0) {
+        if (request.magic != SERVER_MAGIC) {
+            fprintf(stderr, "Server: dropping a connection that sent a malformed request\n");
+            return;
+        }
+        // The source isn't read past a refusal, so the connection is dropped after it
+        char message[128];
+        if (request.length > SERVER_MAX_SOURCE) {
+            snprintf(message, sizeof(message), "Error: a request of %llu bytes is over the server's limit of %d\n",
+                     (unsigned long long)request.length, SERVER_MAX_SOURCE);
+            server_refuse(fd, message);
+            return;
+        }
+        if (request.length > *capacity) {
+            char* grown = realloc(*source, request.length);
+            if (grown == NULL) {
+                snprintf(message, sizeof(message), "Error: out of memory for a request of %llu bytes\n",
+                         (unsigned long long)request.length);
+                server_refuse(fd, message);
+                return;
+            }
+            *source = grown;
+            *capacity = request.length;
+        }
+        if (server_read(fd, *source, request.length)) {
+            return;
+        }
+
+        // One context per setting of the optimize option, each made on first use
+        int optimize = (request.optimize != 0);
+        if (compilers[optimize] == NULL) {
+            struct compiler_options options = {optimize, 0, 0, NULL, 0, 0, 0, 0, incremental, 0, 0};
+            compilers[optimize] = compiler_new(options);
+            if (compilers[optimize] == NULL) {
+                fprintf(stderr, "Error: out of memory\n");
+                return;
+            }
+        }
+        struct compiler_context* compiler = compilers[optimize];
+        struct server_reply reply = {0, 0, 0, 0};
+        reply.status = compiler_compile(compiler, *source, request.length);
+        size_t tac_length;
+        size_t errors_length;
+        const char* tac = compiler_output(compiler, COMPILER_OUT_TAC, &tac_length);
+        const char* errors = compiler_output(compiler, COMPILER_OUT_ERRORS, &errors_length);
+        reply.tac_length = tac_length;
+        reply.errors_length = errors_length;
+        if (server_write(fd, &reply, sizeof(reply)) || server_write(fd, tac, tac_length) || server_write(fd, errors, errors_length)) {
+            return;
+        }
+    }
+}
+
+void* server_worker(void* argument){
+    struct server* server = argument;
+    struct compiler_context* compilers[2] = {NULL, NULL};
+    char* source = NULL;
+    size_t capacity = 0;
+    for (;;) {
+        int fd = accept(server->listener, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            perror("Error accepting connection");
+            break;
+        }
+        server_serve(fd, compilers, server->incremental, &source, &capacity);
+        close(fd);
+    }
+    free(source);
+    compiler_free(compilers[0]);
+    compiler_free(compilers[1]);
+    return NULL;
+}
+
+// Listens on path and serves requests on num_workers threads, each keeping incremental bytes of per-function
+// cache, until killed. Replaces a stale socket left at path. Returns only after writing an error, with 1
+int server_run(const char* path, int num_workers, long long incremental){
+    struct sockaddr_un address = {0};
+    if (server_address(path, &address)) {
+        return 1;
+    }
+    struct stat existing;
+    if (stat(path, &existing) == 0 && S_ISSOCK(existing.st_mode)) {
+        unlink(path);
+    }
+    // A client that hangs up mid reply must not kill the server
+    signal(SIGPIPE, SIG_IGN);
+
+    struct server server;
+    server.listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server.listener < 0) {
+        perror("Error creating socket");
+        return 1;
+    }
+    if (bind(server.listener, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(server.listener, SERVER_BACKLOG) != 0) {
+        perror(path);
+        close(server.listener);
+        return 1;
+    }
+    server.num_workers = num_workers;
+    server.incremental = incremental;
+    server.threads = malloc(sizeof(pthread_t) * num_workers);
+    for (int w = 0; w < num_workers; w++) {
+        pthread_create(&server.threads[w], NULL, server_worker, &server);
+    }
+    printf("Serving on %s with %d workers\n", path, num_workers);
+    fflush(stdout);
+    for (int w = 0; w < num_workers; w++) {
+        pthread_join(server.threads[w], NULL);
+    }
+    close(server.listener);
+    free(server.threads);
+    return 1;
+}
+
+/******************************** Client ********************************/
+// Reads a whole file into a new buffer, returns it or NULL after writing an error
+char* server_read_file(const char* name, size_t* length){
+    FILE* file = fopen(name, "rb");
+    if (!file) {
+        perror(name);
+        return NULL;
+    }
+    size_t capacity = 4096;
+    char* text = malloc(capacity);
+    *length = 0;
+    size_t got;
+    while ((got = fread(text + *length, 1, capacity - *length, file)) > 0) {
+        *length += got;
+        if (*length == capacity) {
+            capacity *= 2;
+            text = realloc(text, capacity);
+        }
+    }
+    fclose(file);
+    return text;
+}
+
+// Compiles input_name on the server at path, writing the TAC to stdout and the diagnostics to stderr.
+// Returns the server's status, or 1 if it couldn't be reached
+int server_compile_remote(const char* path, const char* input_name, int optimize){
+    size_t length;
+    char* source = server_read_file(input_name, &length);
+    if (source == NULL) {
+        return 1;
+    }
+    int fd = server_connect(path);
+    if (fd < 0) {
+        free(source);
+        return 1;
+    }
+    struct server_reply reply;
+    char* texts = NULL;
+    size_t capacity = 0;
+    int status = 1;
+    if (server_exchange(fd, source, length, optimize, &reply, &texts, &capacity)) {
+        fprintf(stderr, "Error: the server at %s closed the connection\n", path);
+    }
+    else {
+        fwrite(texts, 1, reply.tac_length, stdout);
+        fwrite(texts + reply.tac_length, 1, reply.errors_length, stderr);
+        status = reply.status;
+    }
+    close(fd);
+    free(texts);
+    free(source);
+    return status;
+}
+
+/******************************** Load Generator ********************************/
+void* server_load_connection(void* argument){
+    struct server_load* load = argument;
+    int fd = server_connect(load->path);
+    if (fd < 0) {
+        load->failed = 1;
+        return NULL;
+    }
+    struct server_reply reply;
+    char* texts = NULL;
+    size_t capacity = 0;
+    for (long long r = 0; r < load->requests; r++) {
+        double start = vm_now();
+        if (server_exchange(fd, load->source, load->length, load->optimize, &reply, &texts, &capacity)) {
+            load->failed = 1;
+            break;
+        }
+        load->latencies[r] = vm_now() - start;
+    }
+    close(fd);
+    free(texts);
+    return NULL;
+}
+
+// Sends input_name to the server at path requests times over connections connections at once, each waiting for
+// a reply before its next request, and prints the requests/sec and the latency percentiles. Returns 0, or 1 if
+// a connection failed
+int server_load_test(const char* path, const char* input_name, int optimize, long long requests, int connections){
+    size_t length;
+    char* source = server_read_file(input_name, &length);
+    if (source == NULL) {
+        return 1;
+    }
+    struct server_load* loads = malloc(sizeof(struct server_load) * connections);
+    pthread_t* threads = malloc(sizeof(pthread_t) * connections);
+    double* latencies = malloc(sizeof(double) * (requests + 1));
+    long long offset = 0;
+    for (int c = 0; c < connections; c++) {
+        loads[c].path = path;
+        loads[c].source = source;
+        loads[c].length = length;
+        loads[c].optimize = optimize;
+        loads[c].requests = requests / connections + (c < requests % connections);
+        loads[c].latencies = latencies + offset;
+        loads[c].failed = 0;
+        offset += loads[c].requests;
+    }
+
+    double start = vm_now();
+    for (int c = 0; c < connections; c++) {
+        pthread_create(&threads[c], NULL, server_load_connection, &loads[c]);
+    }
+    int failed = 0;
+    for (int c = 0; c < connections; c++) {
+        pthread_join(threads[c], NULL);
+        failed |= loads[c].failed;
+    }
+    double seconds = vm_now() - start;
+
+    if (failed) {
+        fprintf(stderr, "Error: a connection to %s failed, no results\n", path);
+    }
+    else if (requests > 0) {
+        qsort(latencies, requests, sizeof(double), vm_compare_seconds);
+        printf("Requests: %lld on %d connections in %.3f s, %.1f requests/sec\n", requests, connections, seconds, requests / seconds);
+        printf("Latency: p50 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us\n", latencies[requests / 2] * 1e6,
+               latencies[(requests - 1) * 99 / 100] * 1e6, latencies[(requests - 1) * 999 / 1000] * 1e6, latencies[requests - 1] * 1e6);
+    }
+    free(latencies);
+    free(threads);
+    free(loads);
+    free(source);
+    return failed;
+}
+
+#endif // SERVER_H
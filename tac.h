@@ -0,0 +1,474 @@
+#ifndef TAC_H
+#define TAC_H
+
+/******************************** TAC Definitions ********************************/
+// Operand kinds
+#define TAC_NONE  0                  // Empty operand
+#define TAC_VAR   1                  // Source variable, name holds the lexeme
+#define TAC_TEMP  2                  // Compiler temp, temp holds the temp number (printed as tN)
+#define TAC_CONST 3                  // Constant, name holds the lexeme
+
+// Instruction opcodes
+#define TAC_NOP         0            // Removed instruction, never printed
+#define TAC_ASSIGN      1            // dest = arg1
+#define TAC_ADD         2            // dest = arg1 + arg2
+#define TAC_SUB         3            // dest = arg1 - arg2
+#define TAC_MUL         4            // dest = arg1 * arg2
+#define TAC_DIV         5            // dest = arg1 / arg2
+#define TAC_MOD         6            // dest = arg1 % arg2
+#define TAC_LT          7            // dest = arg1 < arg2
+#define TAC_GT          8            // dest = arg1 > arg2
+#define TAC_EQ          9            // dest = arg1 == arg2
+#define TAC_LE          10           // dest = arg1 <= arg2
+#define TAC_GE          11           // dest = arg1 >= arg2
+#define TAC_NE          12           // dest = arg1 != arg2
+#define TAC_OR          13           // dest = arg1 || arg2
+#define TAC_NOT         14           // dest = !arg1
+#define TAC_LABEL       15           // Ln
+#define TAC_GOTO        16           // Goto Ln
+#define TAC_IFZ         17           // IFZ arg1 Goto Ln
+#define TAC_IF          18           // IF arg1 relop arg2 Goto Ln
+#define TAC_PRINT       19           // Print arg1
+#define TAC_RETURN      20           // Return arg1
+#define TAC_PUSH_PARAM  21           // PushParam arg1
+#define TAC_LCALL       22           // dest = LCall callee (dest = TailCall callee when tail is set)
+#define TAC_POP_PARAMS  23           // PopParams count
+#define TAC_NUM_OPS     24
+
+// Printed symbol of each binary opcode, indexed by opcode
+static const char* tac_op_symbols[TAC_NUM_OPS] = {
+    "", "", "+", "-", "*", "/", "%", "<", ">", "==", "<=", ">=", "!=", "||", "!",
+    "", "", "", "", "", "", "", "", ""
+};
+
+/******************************** Struct Definitions ********************************/
+// A single operand of a TAC instruction
+struct tac_operand{
+    int kind;                        // TAC_NONE, TAC_VAR, TAC_TEMP or TAC_CONST
+    char* name;                      // Lexeme of a variable or constant
+    int temp;                        // Temp number of a temp
+    int type;                        // Operand type (1 for int || 0 for double || -1 unknown)
+};
+
+// A single three address code instruction
+struct tac_instr{
+    int op;                          // Opcode
+    struct tac_operand dest;         // Written operand
+    struct tac_operand arg1;         // First read operand
+    struct tac_operand arg2;         // Second read operand
+    int label;                       // Label number for TAC_LABEL, TAC_GOTO, TAC_IFZ and TAC_IF
+    int relop;                       // Comparison opcode for TAC_IF
+    int count;                       // Byte count for TAC_POP_PARAMS
+    char* callee;                    // Function name for TAC_LCALL
+    int tail;                        // True(1) for a TAC_LCALL whose result is returned right away, a backend may jump
+};
+
+// The TAC of one function (or main)
+struct tac_function{
+    char* name;                      // Function name printed as the entry label
+    int memory;                      // Frame size printed by BeginFunc
+    int var_memory;                  // Part of the frame used by params and locals, the rest holds temps
+    int num_instrs;                  // Number of instructions
+    int capacity;                    // Allocated instruction slots
+    struct tac_instr* instrs;        // Instruction list
+    int num_params;                  // Number of params, the first num_params entries of locals
+    int num_locals;                  // Number of params and locals of the function
+    char** locals;                   // Names of params and locals, anything else is a global
+    int is_main;                     // True(1) for main, whose variables are the globals
+    int keeps_vars;                  // True(1) for main when its final variables are an output, as in batch mode
+};
+
+// An int constant the optimizer made, kept so folding the same value again reuses its lexeme
+struct tac_interned{
+    long long value;                 //
+    char* lexeme;                    // NULL for an empty slot
+};
+
+// The TAC of a whole program, functions in source order followed by main
+struct tac_program{
+    int num_functions;               //
+    int capacity;                    //
+    struct tac_function** functions; //
+    int next_temp;                   // First temp number not used by any function
+    int next_label;                  // First label number not used by any function
+    char** lexemes;                  // Lexemes the optimizer made, freed with the program
+    int num_lexemes;                 //
+    int lexemes_capacity;            //
+    struct tac_interned* interned;   // Open addressing table of the int constants among lexemes
+    int interned_capacity;           // Power of two
+    char** main_vars;                // Variables main declares in declaration order, before optimization
+    int* main_var_types;             // Type of each (1 for int || 0 for double)
+    int num_main_vars;               //
+};
+
+/******************************** Helper Functions ********************************/
+// OPERANDS
+// Returns an empty operand
+struct tac_operand tac_none(){
+    struct tac_operand operand = {TAC_NONE, NULL, -1, -1};
+    return operand;
+}
+
+// Returns a variable operand
+struct tac_operand tac_var(char* name, int type){
+    struct tac_operand operand = {TAC_VAR, name, -1, type};
+    return operand;
+}
+
+// Returns a constant operand
+struct tac_operand tac_const(char* lexeme, int type){
+    struct tac_operand operand = {TAC_CONST, lexeme, -1, type};
+    return operand;
+}
+
+// Returns a temp operand
+struct tac_operand tac_temp(int temp, int type){
+    struct tac_operand operand = {TAC_TEMP, NULL, temp, type};
+    return operand;
+}
+
+// True(1) if two operands name the same value
+int tac_same_operand(struct tac_operand a, struct tac_operand b){
+    if (a.kind != b.kind || a.kind == TAC_NONE) {
+        return 0;
+    }
+    if (a.kind == TAC_TEMP) {
+        return a.temp == b.temp;
+    }
+    return compare_strings(a.name, b.name) == 0;
+}
+
+// Writes an operand as it appears in tac.txt
+void print_tac_operand(struct tac_operand operand, FILE* tac_table){
+    switch (operand.kind) {
+        case TAC_TEMP:
+            fprintf(tac_table, "t%d", operand.temp);
+            break;
+        case TAC_VAR:
+        case TAC_CONST:
+            fprintf(tac_table, "%s", operand.name);
+            break;
+        default:
+            break;
+    }
+}
+
+// INSTRUCTIONS
+// Returns an instruction with no label, count or callee
+struct tac_instr tac_instr_new(int op, struct tac_operand dest, struct tac_operand arg1, struct tac_operand arg2){
+    struct tac_instr instr;
+    instr.op = op;
+    instr.dest = dest;
+    instr.arg1 = arg1;
+    instr.arg2 = arg2;
+    instr.label = -1;
+    instr.relop = TAC_NOP;
+    instr.count = 0;
+    instr.callee = NULL;
+    instr.tail = 0;
+    return instr;
+}
+
+// Maps an operator lexeme from the source to its opcode
+int tac_binary_op(const char* lexeme){
+    for (int op = TAC_ADD; op <= TAC_OR; op++) {
+        if (compare_strings(tac_op_symbols[op], lexeme) == 0) {
+            return op;
+        }
+    }
+    return TAC_NOP;
+}
+
+// Maps a comparison terminal to its opcode, following get_terminal() (15 is > and 17 is <=)
+int tac_relop(int terminal){
+    switch (terminal) {
+        case 14: return TAC_LT;
+        case 15: return TAC_GT;
+        case 16: return TAC_EQ;
+        case 17: return TAC_LE;
+        case 18: return TAC_GE;
+        case 19: return TAC_NE;
+    }
+    return TAC_NOP;
+}
+
+// Returns the comparison that is true exactly when op is false. Only for ints: every comparison with a NaN is false
+int tac_invert_relop(int op){
+    switch (op) {
+        case TAC_LT: return TAC_GE;
+        case TAC_GE: return TAC_LT;
+        case TAC_GT: return TAC_LE;
+        case TAC_LE: return TAC_GT;
+        case TAC_EQ: return TAC_NE;
+        case TAC_NE: return TAC_EQ;
+    }
+    return TAC_NOP;
+}
+
+// True(1) if the opcode is a comparison
+int tac_is_relop(int op){
+    return (op >= TAC_LT && op <= TAC_NE);
+}
+
+// True(1) if the opcode writes its dest without any other effect, these can be removed when dest is dead
+int tac_is_pure(int op){
+    return (op >= TAC_ASSIGN && op <= TAC_NOT);
+}
+
+// True(1) if the opcode jumps to a label
+int tac_is_branch(int op){
+    return (op == TAC_GOTO || op == TAC_IFZ || op == TAC_IF);
+}
+
+// True(1) if the opcode ends a basic block
+int tac_is_jump(int op){
+    return (tac_is_branch(op) || op == TAC_RETURN);
+}
+
+// FUNCTIONS
+// Creates an empty TAC function
+struct tac_function* new_tac_function(char* name){
+    struct tac_function* function = malloc(sizeof(struct tac_function));
+    function->name = name;
+    function->memory = 0;
+    function->var_memory = 0;
+    function->num_instrs = 0;
+    function->capacity = 0;
+    function->instrs = NULL;
+    function->num_params = 0;
+    function->num_locals = 0;
+    function->locals = NULL;
+    function->is_main = 0;
+    function->keeps_vars = 0;
+    return function;
+}
+
+// Appends an instruction to a function
+void tac_emit(struct tac_function* function, struct tac_instr instr){
+    if (function->num_instrs == function->capacity) {
+        function->capacity = (function->capacity == 0) ? 64 : function->capacity * 2;
+        function->instrs = realloc(function->instrs, sizeof(struct tac_instr) * function->capacity);
+    }
+    function->instrs[function->num_instrs++] = instr;
+}
+
+// Drops every TAC_NOP from a function, returns the number of instructions removed
+int tac_compact(struct tac_function* function){
+    int kept = 0;
+    for (int i = 0; i < function->num_instrs; i++) {
+        if (function->instrs[i].op != TAC_NOP) {
+            function->instrs[kept++] = function->instrs[i];
+        }
+    }
+    int removed = function->num_instrs - kept;
+    function->num_instrs = kept;
+    return removed;
+}
+
+// Replaces the instructions in [start, end) with count new instructions
+void tac_replace_range(struct tac_function* function, int start, int end, struct tac_instr* instrs, int count){
+    int new_size = function->num_instrs - (end - start) + count;
+    if (new_size > function->capacity) {
+        while (function->capacity < new_size) {
+            function->capacity = (function->capacity == 0) ? 64 : function->capacity * 2;
+        }
+        function->instrs = realloc(function->instrs, sizeof(struct tac_instr) * function->capacity);
+    }
+    // Move the tail to its new position, then copy the new instructions in
+    int tail = function->num_instrs - end;
+    if (count > end - start) {
+        for (int i = tail - 1; i >= 0; i--) {
+            function->instrs[start + count + i] = function->instrs[end + i];
+        }
+    }
+    else {
+        for (int i = 0; i < tail; i++) {
+            function->instrs[start + count + i] = function->instrs[end + i];
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        function->instrs[start + i] = instrs[i];
+    }
+    function->num_instrs = new_size;
+}
+
+// Inserts count instructions before index
+void tac_insert(struct tac_function* function, int index, struct tac_instr* instrs, int count){
+    tac_replace_range(function, index, index, instrs, count);
+}
+
+// True(1) if name is a param or local of the function
+int tac_is_local(struct tac_function* function, const char* name){
+    for (int i = 0; i < function->num_locals; i++) {
+        if (compare_strings(function->locals[i], name) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Appends a function to a program
+void tac_add_function(struct tac_program* program, struct tac_function* function){
+    if (program->num_functions == program->capacity) {
+        program->capacity = (program->capacity == 0) ? 8 : program->capacity * 2;
+        program->functions = realloc(program->functions, sizeof(struct tac_function*) * program->capacity);
+    }
+    program->functions[program->num_functions++] = function;
+}
+
+// Hands a lexeme the optimizer made to the program, which frees it with itself. Returns the lexeme
+char* tac_own(struct tac_program* program, char* lexeme){
+    if (program->num_lexemes == program->lexemes_capacity) {
+        program->lexemes_capacity = (program->lexemes_capacity == 0) ? 16 : program->lexemes_capacity * 2;
+        program->lexemes = realloc(program->lexemes, sizeof(char*) * program->lexemes_capacity);
+    }
+    program->lexemes[program->num_lexemes++] = lexeme;
+    return lexeme;
+}
+
+// Lexeme of the int constant value, made once per program
+char* tac_int_lexeme(struct tac_program* program, long long value){
+    if (program->num_lexemes * 2 >= program->interned_capacity) {
+        // Double the table once it is half full
+        int capacity = (program->interned_capacity == 0) ? 64 : program->interned_capacity * 2;
+        struct tac_interned* interned = calloc(capacity, sizeof(struct tac_interned));
+        for (int i = 0; i < program->interned_capacity; i++) {
+            if (program->interned[i].lexeme != NULL) {
+                int slot = (int)(((unsigned long long)program->interned[i].value * 0x9E3779B97F4A7C15ULL) >> 40) & (capacity - 1);
+                while (interned[slot].lexeme != NULL) {
+                    slot = (slot + 1) & (capacity - 1);
+                }
+                interned[slot] = program->interned[i];
+            }
+        }
+        free(program->interned);
+        program->interned = interned;
+        program->interned_capacity = capacity;
+    }
+    int mask = program->interned_capacity - 1;
+    int slot = (int)(((unsigned long long)value * 0x9E3779B97F4A7C15ULL) >> 40) & mask;
+    while (program->interned[slot].lexeme != NULL) {
+        if (program->interned[slot].value == value) {
+            return program->interned[slot].lexeme;
+        }
+        slot = (slot + 1) & mask;
+    }
+    char* lexeme = malloc(24);
+    snprintf(lexeme, 24, "%lld", value);
+    program->interned[slot].value = value;
+    program->interned[slot].lexeme = tac_own(program, lexeme);
+    return lexeme;
+}
+
+// Frees a program and every function in it (operand strings belong to the AST, except the ones the program owns)
+void free_tac_program(struct tac_program* program){
+    for (int i = 0; i < program->num_functions; i++) {
+        free(program->functions[i]->instrs);
+        free(program->functions[i]->locals);
+        free(program->functions[i]);
+    }
+    free(program->functions);
+    program->functions = NULL;
+    program->num_functions = 0;
+    program->capacity = 0;
+    for (int i = 0; i < program->num_lexemes; i++) {
+        free(program->lexemes[i]);
+    }
+    free(program->lexemes);
+    free(program->interned);
+    free(program->main_vars);
+    free(program->main_var_types);
+    program->main_vars = NULL;
+    program->main_var_types = NULL;
+    program->num_main_vars = 0;
+    program->lexemes = NULL;
+    program->num_lexemes = 0;
+    program->lexemes_capacity = 0;
+    program->interned = NULL;
+    program->interned_capacity = 0;
+}
+
+// PRINTING
+// Writes a single instruction as it appears in tac.txt
+void print_tac_instr(struct tac_instr* instr, FILE* tac_table){
+    switch (instr->op) {
+        case TAC_NOP:
+            return;
+        case TAC_LABEL:
+            fprintf(tac_table, "L%d\n", instr->label);
+            return;
+        case TAC_GOTO:
+            fprintf(tac_table, "    Goto L%d\n", instr->label);
+            return;
+        case TAC_IFZ:
+            fprintf(tac_table, "    IFZ  ");
+            print_tac_operand(instr->arg1, tac_table);
+            fprintf(tac_table, " Goto L%d\n", instr->label);
+            return;
+        case TAC_IF:
+            fprintf(tac_table, "    IF ");
+            print_tac_operand(instr->arg1, tac_table);
+            fprintf(tac_table, " %s ", tac_op_symbols[instr->relop]);
+            print_tac_operand(instr->arg2, tac_table);
+            fprintf(tac_table, " Goto L%d\n", instr->label);
+            return;
+        case TAC_PRINT:
+            fprintf(tac_table, "    Print ");
+            break;
+        case TAC_RETURN:
+            fprintf(tac_table, "    Return ");
+            break;
+        case TAC_PUSH_PARAM:
+            fprintf(tac_table, "    PushParam ");
+            break;
+        case TAC_POP_PARAMS:
+            fprintf(tac_table, "    PopParams %d\n", instr->count);
+            return;
+        case TAC_LCALL:
+            fprintf(tac_table, "    ");
+            print_tac_operand(instr->dest, tac_table);
+            fprintf(tac_table, " = %s %s\n", instr->tail ? "TailCall" : "LCall", instr->callee);
+            return;
+        case TAC_ASSIGN:
+            fprintf(tac_table, "    ");
+            print_tac_operand(instr->dest, tac_table);
+            fprintf(tac_table, " = ");
+            break;
+        case TAC_NOT:
+            fprintf(tac_table, "    ");
+            print_tac_operand(instr->dest, tac_table);
+            fprintf(tac_table, " = !");
+            break;
+        default:    // Binary operators
+            fprintf(tac_table, "    ");
+            print_tac_operand(instr->dest, tac_table);
+            fprintf(tac_table, " = ");
+            print_tac_operand(instr->arg1, tac_table);
+            fprintf(tac_table, " %s ", tac_op_symbols[instr->op]);
+            print_tac_operand(instr->arg2, tac_table);
+            fprintf(tac_table, "\n");
+            return;
+    }
+    // Single operand instructions
+    print_tac_operand(instr->arg1, tac_table);
+    fprintf(tac_table, "\n");
+}
+
+// Writes a function with its BeginFunc/EndFunc frame
+void print_tac_function(struct tac_function* function, FILE* tac_table){
+    fprintf(tac_table, "%s:\n", function->name);
+    fprintf(tac_table, "    BeginFunc %d:\n", function->memory);
+    for (int i = 0; i < function->num_instrs; i++) {
+        print_tac_instr(&function->instrs[i], tac_table);
+    }
+    fprintf(tac_table, "    EndFunc:\n");
+}
+
+// Writes every function of a program
+void print_tac_program(struct tac_program* program, FILE* tac_table){
+    for (int i = 0; i < program->num_functions; i++) {
+        print_tac_function(program->functions[i], tac_table);
+    }
+}
+
+#endif // TAC_H
@@ -0,0 +1,22 @@
+def int gcd(int a, int b)
+    int r;
+    while (b <> 0) do
+        r = a % b;
+        a = b;
+        b = r;
+    od;
+    return a;
+fed;
+def int fact(int n)
+    if (n < 1) then return 1 fi;
+    return n * fact(n - 1);
+fed;
+def double mean(double p, double q)
+    return (p + q) / 2.0;
+fed;
+int a, b, g;
+double p, q, m;
+g = gcd(a, b) + fact(b % 6);
+m = mean(p, q);
+print g;
+print m
@@ -0,0 +1,10 @@
+int n, k, steps;
+double x, y;
+k = 3;
+steps = 0;
+while (n > 1) do
+    if (n % 2 == 0) then n = n / 2 else n = n * k + 1 fi;
+    steps = steps + 1;
+od;
+y = x / 2.0;
+print steps
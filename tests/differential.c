@@ -0,0 +1,278 @@
+// Differential test of the library's fast paths. Whatever the per-function cache, compiler_edit or the parallel
+// front end does, a compilation must produce the same outputs as a cold compilation of the same text. For each
+// input this applies a script of edits, then seeded random ones, one after another. The script is written to
+// cross def ... fed ; block boundaries. Each edited text is compiled four ways, with and without -O:
+// - cold, on a fresh context;
+// - by compiler_edit, on a context with a per-function cache that has seen every earlier text;
+// - by compiler_edit with the blocks checked on worker threads;
+// - by compiler_compile on a context with the cache.
+// Every return value and output is compared with the cold compile's.
+//
+// Build and run from the repository root (tests/run_tests.sh does):
+//     gcc -O2 -DCOMPILER_LIBRARY -pthread -o differential tests/differential.c compiler.c -lm
+//     ./differential tests/golden/*.cp benchmarks/*/*.cp
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../compiler.h"
+
+/******************************** Test Definitions ********************************/
+#define DIFF_RANDOM_EDITS  40        // Random edits applied after the script to each input
+#define DIFF_CACHE_BYTES   (1 << 20) // Per-function cache of the incremental contexts
+#define DIFF_WORKERS       4         // Threads of the parallel context
+#define DIFF_NUM_WAYS      3         // Contexts compared with the cold one
+
+/******************************** Struct Definitions ********************************/
+// The text being edited
+struct diff_text{
+    char* bytes;                     //
+    size_t length;                   //
+    size_t capacity;                 //
+};
+
+// The contexts that compile each text and what went wrong so far
+struct diff_run{
+    const char* input;               // Name of the input, for failures
+    int optimize;                    //
+    struct compiler_context* ways[DIFF_NUM_WAYS];
+    int edits;                       // Edits compared
+    int failures;                    //
+    unsigned long long seed;         // Random edits
+};
+
+static const char* diff_way_names[DIFF_NUM_WAYS] = {"edit", "parallel edit", "incremental compile"};
+static const char* diff_output_names[COMPILER_NUM_OUTPUTS] = {"lex", "syn", "sem", "errors", "tac", "report"};
+
+// Snippets the random edits insert, chosen to open, close and split blocks
+static const char* diff_snippets[] = {
+    "", "fed;", "fed;\n", "def ", "def int r(int a)\n", ";", "\n", " ", "int x;", "1", "(", ")", "return 0;", "x = 2;\n"
+};
+#define DIFF_NUM_SNIPPETS (int)(sizeof(diff_snippets) / sizeof(diff_snippets[0]))
+
+/******************************** Helpers ********************************/
+unsigned diff_random(struct diff_run* run){
+    run->seed ^= run->seed << 13;
+    run->seed ^= run->seed >> 7;
+    run->seed ^= run->seed << 17;
+    return (unsigned)run->seed;
+}
+
+// Offset of the first needle at or after from, length if there is none
+size_t diff_find(const struct diff_text* text, size_t from, const char* needle){
+    size_t n = strlen(needle);
+    for (size_t i = from; i + n <= text->length; i++) {
+        if (memcmp(text->bytes + i, needle, n) == 0) {
+            return i;
+        }
+    }
+    return text->length;
+}
+
+// Offset just past the last needle, 0 if there is none
+size_t diff_find_last(const struct diff_text* text, const char* needle){
+    size_t n = strlen(needle);
+    for (size_t i = text->length; i >= n; i--) {
+        if (memcmp(text->bytes + i - n, needle, n) == 0) {
+            return i;
+        }
+    }
+    return 0;
+}
+
+void diff_splice(struct diff_text* text, size_t offset, size_t removed, const char* insert, size_t length){
+    size_t total = text->length - removed + length;
+    if (total + 1 > text->capacity) {
+        text->capacity = 2 * (total + 1);
+        text->bytes = realloc(text->bytes, text->capacity);
+    }
+    memmove(text->bytes + offset + length, text->bytes + offset + removed, text->length - offset - removed);
+    memcpy(text->bytes + offset, insert, length);
+    text->length = total;
+    text->bytes[total] = '\0';
+}
+
+/******************************** Comparison ********************************/
+// Replaces removed bytes at offset with insert, compiles the result every way and compares them
+void diff_edit(struct diff_run* run, struct diff_text* text, const char* what, size_t offset, size_t removed, const char* insert, size_t length){
+    if (offset > text->length || removed > text->length - offset) {
+        return;
+    }
+    diff_splice(text, offset, removed, insert, length);
+    struct compiler_options options = {run->optimize, 0, 0, NULL, 0, 0, 0, 0, 0, 0, 0};
+    struct compiler_context* cold = compiler_new(options);
+    int expected = compiler_compile(cold, text->bytes, text->length);
+
+    int results[DIFF_NUM_WAYS];
+    results[0] = compiler_edit(run->ways[0], offset, removed, insert, length);
+    results[1] = compiler_edit(run->ways[1], offset, removed, insert, length);
+    results[2] = compiler_compile(run->ways[2], text->bytes, text->length);
+    run->edits++;
+    for (int w = 0; w < DIFF_NUM_WAYS; w++) {
+        int differs = (results[w] != expected);
+        int output = -1;
+        for (int k = 0; k < COMPILER_NUM_OUTPUTS && output < 0; k++) {
+            size_t want;
+            size_t got;
+            const char* a = compiler_output(cold, k, &want);
+            const char* b = compiler_output(run->ways[w], k, &got);
+            if (want != got || memcmp(a, b, want) != 0) {
+                output = k;
+            }
+        }
+        if (differs || output >= 0) {
+            fprintf(stderr, "FAIL %s%s, %s after edit %d (%s): %s\n", run->input, run->optimize ? " -O" : "", diff_way_names[w],
+                    run->edits, what, differs ? "return value differs" : diff_output_names[output]);
+            run->failures++;
+        }
+    }
+    compiler_free(cold);
+}
+
+// Edits the text as the script says, then undoes it when the edit is one that is undone
+void diff_edit_and_undo(struct diff_run* run, struct diff_text* text, const char* what, size_t offset, size_t removed, const char* insert){
+    if (offset > text->length || removed > text->length - offset) {
+        return;
+    }
+    char* saved = malloc(removed + 1);
+    memcpy(saved, text->bytes + offset, removed);
+    diff_edit(run, text, what, offset, removed, insert, strlen(insert));
+    diff_edit(run, text, what, offset, strlen(insert), saved, removed);
+    free(saved);
+}
+
+/******************************** Script ********************************/
+void diff_script(struct diff_run* run, struct diff_text* text){
+    // Join the first two blocks by deleting the fed; between them and the def of the second
+    size_t fed = diff_find(text, 0, "fed;");
+    size_t def = diff_find(text, fed, "def");
+    if (def < text->length) {
+        diff_edit_and_undo(run, text, "join blocks", fed, def + 3 - fed, "");
+    }
+
+    // Split the first block after its header, the second half becoming a block of its own
+    size_t header = diff_find(text, diff_find(text, 0, "def"), "\n");
+    if (header < text->length) {
+        diff_edit_and_undo(run, text, "split block", header + 1, 0, "fed;\ndef int split(int q)\n");
+    }
+
+    // Replace the bytes around a boundary with themselves
+    fed = diff_find(text, 0, "fed;");
+    if (fed >= 6 && fed + 12 <= text->length) {
+        char same[32];
+        memcpy(same, text->bytes + fed - 6, 18);
+        same[18] = '\0';
+        diff_edit(run, text, "rewrite boundary", fed - 6, 18, same, 18);
+    }
+
+    // Drop the first block, then put it back
+    size_t start = diff_find(text, 0, "def");
+    size_t end = diff_find(text, start, "fed;");
+    if (end < text->length) {
+        diff_edit_and_undo(run, text, "drop block", start, end + 4 - start, "");
+    }
+
+    // Change a char in the middle of the last block
+    size_t last = diff_find_last(text, "fed;");
+    if (last > 8) {
+        diff_edit_and_undo(run, text, "change body", last - 8, 1, "9");
+    }
+
+    // Prepend a function, and carry the last block's fed; into main
+    diff_edit_and_undo(run, text, "prepend block", 0, 0, "def int first(int a)\n    return a + 1;\nfed;\n");
+    if (last >= 4) {
+        diff_edit_and_undo(run, text, "move fed", last - 4, 4, "");
+    }
+
+    // Duplicate a block so a name is defined twice
+    if (end < text->length) {
+        size_t length = end + 4 - start;
+        char* block = malloc(length + 2);
+        memcpy(block, text->bytes + start, length);
+        block[length] = '\n';
+        block[length + 1] = '\0';
+        diff_edit_and_undo(run, text, "duplicate block", end + 4, 0, block);
+        free(block);
+    }
+}
+
+// Edits at random places, each removing up to 40 bytes and inserting one of the snippets. Every edit is kept
+void diff_random_edits(struct diff_run* run, struct diff_text* text){
+    for (int e = 0; e < DIFF_RANDOM_EDITS; e++) {
+        size_t offset = (text->length > 0) ? diff_random(run) % (text->length + 1) : 0;
+        size_t removed = diff_random(run) % 41;
+        if (removed > text->length - offset) {
+            removed = text->length - offset;
+        }
+        const char* insert = diff_snippets[diff_random(run) % DIFF_NUM_SNIPPETS];
+        diff_edit(run, text, "random", offset, removed, insert, strlen(insert));
+    }
+}
+
+/******************************** Main ********************************/
+// Reads a whole file, returns 0 or 1 after writing an error
+int diff_read(const char* name, struct diff_text* text){
+    FILE* file = fopen(name, "rb");
+    if (!file) {
+        perror(name);
+        return 1;
+    }
+    text->capacity = 4096;
+    text->bytes = malloc(text->capacity);
+    text->length = 0;
+    size_t got;
+    while ((got = fread(text->bytes + text->length, 1, text->capacity - text->length - 1, file)) > 0) {
+        text->length += got;
+        if (text->length + 1 == text->capacity) {
+            text->capacity *= 2;
+            text->bytes = realloc(text->bytes, text->capacity);
+        }
+    }
+    text->bytes[text->length] = '\0';
+    fclose(file);
+    return 0;
+}
+
+int main(int argc, char* argv[]){
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s inputFile...\n", argv[0]);
+        return 2;
+    }
+    int edits = 0;
+    int failures = 0;
+    for (int i = 1; i < argc; i++) {
+        for (int optimize = 0; optimize <= 1; optimize++) {
+            struct diff_text text;
+            if (diff_read(argv[i], &text)) {
+                return 2;
+            }
+            struct diff_run run;
+            run.input = argv[i];
+            run.optimize = optimize;
+            run.edits = 0;
+            run.failures = 0;
+            run.seed = 0x9E3779B97F4A7C15ULL ^ (unsigned long long)i;
+            struct compiler_options incremental = {optimize, 0, 0, NULL, 0, 0, 0, 0, DIFF_CACHE_BYTES, 0, 0};
+            struct compiler_options parallel = {optimize, 0, 0, NULL, 0, 0, 0, 0, DIFF_CACHE_BYTES, 0, DIFF_WORKERS};
+            run.ways[0] = compiler_new(incremental);
+            run.ways[1] = compiler_new(parallel);
+            run.ways[2] = compiler_new(incremental);
+
+            // The edit contexts start from the input itself
+            compiler_compile(run.ways[0], text.bytes, text.length);
+            compiler_compile(run.ways[1], text.bytes, text.length);
+            diff_edit(&run, &text, "input", 0, 0, "", 0);
+            diff_script(&run, &text);
+            diff_random_edits(&run, &text);
+
+            for (int w = 0; w < DIFF_NUM_WAYS; w++) {
+                compiler_free(run.ways[w]);
+            }
+            free(text.bytes);
+            edits += run.edits;
+            failures += run.failures;
+        }
+    }
+    printf("differential: %d edits, %d failures\n", edits, failures);
+    return failures != 0;
+}
@@ -0,0 +1 @@
+def)r;r;fed;int
\ No newline at end of file
@@ -0,0 +1 @@
+fed
\ No newline at end of file
@@ -0,0 +1,6 @@
+def int f(int v)
+    return v + 1;
+fed;
+int x;
+x = g(1);
+print f(g(x))
@@ -0,0 +1 @@
+in
\ No newline at end of file
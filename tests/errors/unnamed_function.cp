@@ -0,0 +1,9 @@
+def int (int a)
+    return a;
+fed;
+def int k(int b)
+    return b;
+fed;
+int x;
+x = f(1);
+print k(h(x))
@@ -0,0 +1,12 @@
+def double mix(double d)
+    double r;
+    r = d * 2.0 + d * 3.0 * d + d / 2.0 - d * d;
+    return r;
+fed;
+int i, j;
+double x;
+i = 3;
+j = i * 2 + i * 3 * i + i * 4 - i * i;
+x = mix(1.5);
+print j;
+print x
@@ -0,0 +1,8 @@
+def int digits(int a, int b, int c, int d)
+    return a * 1000 + b * 100 + c * 10 + d;
+fed;
+def double mix(double x, double y, double z)
+    return x * y + z;
+fed;
+print digits(1, 2, 3, 4);
+print mix(1.5, 2.0, 0.25)
@@ -0,0 +1,14 @@
+int a, b, c;
+double x, y;
+a = 20;
+b = 5;
+c = 3;
+print a - b - c;
+print a - b + c;
+print a / b / c;
+print a % b * c;
+print a * b % c;
+x = 8.0;
+y = 2.0;
+print x / y / y;
+print x - y - y + x
@@ -0,0 +1,27 @@
+int a, b, c, i, n;
+double x, y;
+a = 3;
+b = 0;
+c = a < 2 or b and a > 0;
+print c;
+if (not (a == 1 or b == 1) and a <> 0) then print 1 else print 0 fi;
+if (a >= 3 and (b < 1 or a / b > 0)) then print 2 fi;
+if (a < 3) then print 3 else if (b <> 0) then print 4 else print 5 fi fi;
+x = 2.5;
+y = 0.0 - 1.5;
+if (not y >= 0.0 and x > y) then print x fi;
+print x <= y;
+print not a > b;
+n = 0;
+i = 0;
+while (i < 10 and n <> 12) do
+    if (i % 2 == 0) then n = n + i; fi;
+    i = i + 1;
+od;
+print n;
+print i;
+while (a > 0) do
+    a = a - 1;
+    if (a == 1) then b = b + 10 else b = b + 1 fi;
+od;
+print b
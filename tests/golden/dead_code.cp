@@ -0,0 +1,20 @@
+def int noisy(int n)
+    int a, b, c;
+    a = n + 1;
+    b = a * 2;
+    a = n * 3;
+    c = b + 0;
+    c = a - n;
+    return c;
+fed;
+int x, y, z, w;
+x = 4;
+y = x * 2;
+y = x + 5;
+z = y;
+w = z * 1;
+print w;
+print noisy(7);
+x = 1;
+x = 2;
+print x
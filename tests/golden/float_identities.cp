@@ -0,0 +1,30 @@
+double v, w, z, n, d;
+int x, y;
+v = 0.0 - 1.0 / 0.0;
+n = v * 0.0;
+w = v * 0.0;
+print w;
+w = 0.0 * v;
+print w;
+w = n + 0.0;
+print w;
+z = 0.0 * (0.0 - 1.0);
+print z;
+d = 0.0 - 0.0;
+z = d * (0.0 - 1.0);
+print z;
+z = z + 0.0;
+print z;
+z = 0.0 + z;
+print z;
+print v * 1.0;
+print v / 1.0;
+print v - 0.0;
+print n * 1.0;
+x = 7;
+y = x * 0 + x;
+print y;
+y = 0 + x * 1;
+print y;
+y = x - 0;
+print y
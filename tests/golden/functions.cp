@@ -0,0 +1,50 @@
+def int square(int v)
+    return v * v;
+fed;
+def int scale(int v, int k)
+    return v * k + 1;
+fed;
+def int fact(int n)
+    if (n < 1) then return 1 else return n * fact(n - 1); fi;
+fed;
+def int down(int n)
+    if (n < 1) then return 0 fi;
+    return down(n - 1);
+fed;
+def int gcd(int a, int b)
+    int r;
+    while (b <> 0) do
+        r = a % b;
+        a = b;
+        b = r;
+    od;
+    return a;
+fed;
+def double half(double d)
+    return d / 2.0;
+fed;
+def int unused(int u)
+    return u + 99;
+fed;
+def int twice(int t)
+    int r;
+    r = scale(t, 2);
+    return r + square(t);
+fed;
+int i, t;
+double h;
+t = 0;
+i = 0;
+while (i < 5) do
+    t = t + scale(i, 3);
+    i = i + 1;
+od;
+print t;
+print square(12);
+print fact(10);
+print down(5000);
+print gcd(1071, 462);
+h = half(7.0);
+print h;
+print half(half(1.0));
+print twice(6)
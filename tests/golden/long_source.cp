@@ -0,0 +1,128 @@
+int total, i;
+total = 0;
+total = total + 0 * 3 - 0;
+total = total + 1 * 3 - 1;
+total = total + 2 * 3 - 2;
+total = total + 3 * 3 - 3;
+total = total + 4 * 3 - 4;
+total = total + 5 * 3 - 5;
+total = total + 6 * 3 - 6;
+total = total + 7 * 3 - 0;
+total = total + 8 * 3 - 1;
+total = total + 9 * 3 - 2;
+total = total + 10 * 3 - 3;
+total = total + 11 * 3 - 4;
+total = total + 12 * 3 - 5;
+total = total + 13 * 3 - 6;
+total = total + 14 * 3 - 0;
+total = total + 15 * 3 - 1;
+total = total + 16 * 3 - 2;
+total = total + 17 * 3 - 3;
+total = total + 18 * 3 - 4;
+total = total + 19 * 3 - 5;
+total = total + 20 * 3 - 6;
+total = total + 21 * 3 - 0;
+total = total + 22 * 3 - 1;
+total = total + 23 * 3 - 2;
+total = total + 24 * 3 - 3;
+total = total + 25 * 3 - 4;
+total = total + 26 * 3 - 5;
+total = total + 27 * 3 - 6;
+total = total + 28 * 3 - 0;
+total = total + 29 * 3 - 1;
+total = total + 30 * 3 - 2;
+total = total + 31 * 3 - 3;
+total = total + 32 * 3 - 4;
+total = total + 33 * 3 - 5;
+total = total + 34 * 3 - 6;
+total = total + 35 * 3 - 0;
+total = total + 36 * 3 - 1;
+total = total + 37 * 3 - 2;
+total = total + 38 * 3 - 3;
+total = total + 39 * 3 - 4;
+total = total + 40 * 3 - 5;
+total = total + 41 * 3 - 6;
+total = total + 42 * 3 - 0;
+total = total + 43 * 3 - 1;
+total = total + 44 * 3 - 2;
+total = total + 45 * 3 - 3;
+total = total + 46 * 3 - 4;
+total = total + 47 * 3 - 5;
+total = total + 48 * 3 - 6;
+total = total + 49 * 3 - 0;
+total = total + 50 * 3 - 1;
+total = total + 51 * 3 - 2;
+total = total + 52 * 3 - 3;
+total = total + 53 * 3 - 4;
+total = total + 54 * 3 - 5;
+total = total + 55 * 3 - 6;
+total = total + 56 * 3 - 0;
+total = total + 57 * 3 - 1;
+total = total + 58 * 3 - 2;
+total = total + 59 * 3 - 3;
+total = total + 60 * 3 - 4;
+total = total + 61 * 3 - 5;
+total = total + 62 * 3 - 6;
+total = total + 63 * 3 - 0;
+total = total + 64 * 3 - 1;
+total = total + 65 * 3 - 2;
+total = total + 66 * 3 - 3;
+total = total + 67 * 3 - 4;
+total = total + 68 * 3 - 5;
+total = total + 69 * 3 - 6;
+total = total + 70 * 3 - 0;
+total = total + 71 * 3 - 1;
+total = total + 72 * 3 - 2;
+total = total + 73 * 3 - 3;
+total = total + 74 * 3 - 4;
+total = total + 75 * 3 - 5;
+total = total + 76 * 3 - 6;
+total = total + 77 * 3 - 0;
+total = total + 78 * 3 - 1;
+total = total + 79 * 3 - 2;
+total = total + 80 * 3 - 3;
+total = total + 81 * 3 - 4;
+total = total + 82 * 3 - 5;
+total = total + 83 * 3 - 6;
+total = total + 84 * 3 - 0;
+total = total + 85 * 3 - 1;
+total = total + 86 * 3 - 2;
+total = total + 87 * 3 - 3;
+total = total + 88 * 3 - 4;
+total = total + 89 * 3 - 5;
+total = total + 90 * 3 - 6;
+total = total + 91 * 3 - 0;
+total = total + 92 * 3 - 1;
+total = total + 93 * 3 - 2;
+total = total + 94 * 3 - 3;
+total = total + 95 * 3 - 4;
+total = total + 96 * 3 - 5;
+total = total + 97 * 3 - 6;
+total = total + 98 * 3 - 0;
+total = total + 99 * 3 - 1;
+total = total + 100 * 3 - 2;
+total = total + 101 * 3 - 3;
+total = total + 102 * 3 - 4;
+total = total + 103 * 3 - 5;
+total = total + 104 * 3 - 6;
+total = total + 105 * 3 - 0;
+total = total + 106 * 3 - 1;
+total = total + 107 * 3 - 2;
+total = total + 108 * 3 - 3;
+total = total + 109 * 3 - 4;
+total = total + 110 * 3 - 5;
+total = total + 111 * 3 - 6;
+total = total + 112 * 3 - 0;
+total = total + 113 * 3 - 1;
+total = total + 114 * 3 - 2;
+total = total + 115 * 3 - 3;
+total = total + 116 * 3 - 4;
+total = total + 117 * 3 - 5;
+total = total + 118 * 3 - 6;
+total = total + 119 * 3 - 0;
+i = 0;
+while (i < 10) do
+    total = total + i;
+    i = i + 1;
+od;
+print total
@@ -0,0 +1,45 @@
+int i, j, k, n, s, t;
+double d;
+n = 37;
+s = 0;
+i = 0;
+while (i < n) do
+    t = n * 3 + 7;
+    s = s + i * 4 + t / 5;
+    i = i + 1;
+od;
+print s;
+s = 0;
+i = 0;
+while (i < 4) do
+    s = s * 10 + i + 1;
+    i = i + 1;
+od;
+print s;
+s = 0;
+i = 0;
+while (i < 100) do
+    s = s + i % 7;
+    i = i + 1;
+od;
+print s;
+s = 0;
+i = 0;
+while (i < 8) do
+    j = 0;
+    while (j < 8) do
+        k = i * 64 + j * 4;
+        s = s + k % 13;
+        j = j + 1;
+    od;
+    i = i + 1;
+od;
+print s;
+i = 20;
+d = 0.0;
+while (i > 0) do
+    d = d + 0.5;
+    i = i - 3;
+od;
+print d;
+print i
@@ -0,0 +1,17 @@
+double y, z;
+int n;
+y = 0.0 / 0.0;
+z = 1.0;
+if (y < z) then print 1 else print 2 fi;
+if (y >= z) then print 3 else print 4 fi;
+if (not y == y) then print 5 else print 6 fi;
+if (y < z or z < y) then print 7 else print 8 fi;
+print y < z;
+print y < z or z < y;
+n = 0;
+while (y < z) do
+    n = n + 1;
+    y = z;
+od;
+print n;
+if (1 < 2) then print 9 fi
@@ -0,0 +1,11 @@
+int a, b;
+double d;
+a = 7;
+b = (a + 1) * 2;
+print b;
+b = a - (b - 3);
+print b;
+d = 2.5;
+d = (d * (d + 1.0)) / (0.5);
+print d;
+print ((a))
@@ -0,0 +1,13 @@
+def int f(int n, int k)
+    if (n < 1) then return k fi;
+    k = k + 1;
+    return f(n - 1, k) + k;
+fed;
+def int g(int n, int k)
+    if (n < 1) then return k fi;
+    return g(n - 1, k) + k;
+fed;
+print f(5, 0);
+print f(3, 0);
+print g(4, 2);
+print g(2, 2)
@@ -0,0 +1,15 @@
+def int fact(int n)
+    if (n < 1) then return 1 fi;
+    return n * fact(n - 1);
+fed;
+def int wrap(int n)
+    int m;
+    m = n + 1;
+    return fact(m);
+fed;
+def int swap(int a, int b)
+    if (a < 1) then return b fi;
+    return swap(b - 1, a);
+fed;
+print wrap(4);
+print swap(3, 10)
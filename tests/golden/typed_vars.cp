@@ -0,0 +1,11 @@
+def int half(int n)
+    if (n > 1) then return n / 2 fi;
+    return n;
+fed;
+double g;
+int a;
+a = half(9);
+g = 1.5;
+if (a > 2) then print a fi;
+if (g > 1.0) then print g fi;
+if (not a == 4) then print 0 fi
@@ -0,0 +1,304 @@
+#!/bin/sh
+# Tests of the compiler, all of them comparing against a reference:
+# - golden: every tests/golden/name.cp runs on the VM with and without -O, printing name.expected, and once more
+#   unfused under -p. When name.tac exists the unoptimized TAC must match it, when name.opt.tac exists the
+#   optimized TAC must.
+# - batch: every tests/batch/name.cp runs with -b over the rows of name.in, with and without -O, in lockstep and
+#   on a 4 worker service (-w 4), writing name.expected to batch_output.txt.
+# - backends: the goldens print name.expected on the JIT, the x86 backend and the C backend too.
+# - front ends: -m compiling the goldens and the errors on 2 workers, -P lexing each of them on a thread of its
+#   own, -F checking its functions on 4 threads, -T streaming each of them, and -k compiling each twice (cold, then
+#   from the cache) and once more after corrupting its entry, write the same files as a plain compile.
+# - server: a compile through -D and -s gives the same TAC as a local one, also twice in a row on a server whose
+#   worker keeps a per-function cache (-I).
+# - lsp: an editor session on -L gets its diagnostics and definitions.
+# - errors: every tests/errors/name.cp is rejected with the diagnostics in name.error, without crashing or
+#   hanging.
+# - sanitizers: a build with ASan and UBSan compiles and runs the goldens and the errors without a report, leaks
+#   included.
+# - differential: tests/differential.c checks compiler_edit, the per-function cache and the parallel front end
+#   against cold compiles while it edits the goldens and the benchmarks.
+#
+# Usage: tests/run_tests.sh [compiler]   (builds compiler.c into a temporary directory when no binary is given)
+
+root=$(cd "$(dirname "$0")/.." && pwd)
+work=$(mktemp -d)
+server=
+trap '[ -n "$server" ] && kill $server 2>/dev/null; rm -rf "$work"' EXIT
+compiler=$1
+if [ -z "$compiler" ]; then
+    compiler=$work/compiler
+    ${CC:-gcc} -O2 -w -pthread -o "$compiler" "$root/compiler.c" -lm || exit 1
+fi
+case $compiler in
+    /*) ;;
+    *) compiler=$(pwd)/$compiler ;;
+esac
+
+failed=0
+total=0
+outputs="symbol_table_lex.txt symbol_table_syn.txt symbol_table_sem.txt error.txt tac.txt opt_report.txt"
+
+# Records a failed check: fail name message
+fail() {
+    echo "FAIL $1: $2"
+    failed=$((failed + 1))
+}
+
+# Prints how many checks of a section passed: section name failed total
+section() {
+    echo "$1: $(($3 - $2))/$3 passed"
+}
+
+# Runs the compiler with the given flags in a fresh directory, $work/run. It is killed after a minute or once it
+# writes a file over 100 MB
+run() {
+    rm -rf "$work/run" && mkdir "$work/run"
+    (cd "$work/run" && ulimit -f 204800 && timeout 60 "$compiler" "$@" > stdout 2>&1)
+}
+
+# Frames an LSP message
+frame() {
+    printf 'Content-Length: %d\r\n\r\n%s' "${#1}" "$1"
+}
+
+# Waits up to 10 seconds for the language server to write the pattern
+await() {
+    tries=0
+    while ! grep -q "$1" "$work/lsp.out" 2>/dev/null && [ $tries -lt 100 ]; do
+        sleep 0.1
+        tries=$((tries + 1))
+    done
+}
+
+######## Golden ########
+start_failed=$failed
+start_total=$total
+for input in "$root"/tests/golden/*.cp; do
+    name=$(basename "$input" .cp)
+    expected=$root/tests/golden/$name.expected
+    for flags in "-r" "-O -r" "-O -p"; do
+        total=$((total + 1))
+        run $flags "$input"
+        tac=$root/tests/golden/$name.tac
+        [ "$flags" != "-r" ] && tac=$root/tests/golden/$name.opt.tac
+        if ! cmp -s "$expected" "$work/run/stdout"; then
+            fail "$name ($flags)" "output differs"
+            diff "$expected" "$work/run/stdout" | head -10
+        elif [ -f "$tac" ] && ! cmp -s "$tac" "$work/run/tac.txt"; then
+            fail "$name ($flags)" "TAC differs"
+            diff "$tac" "$work/run/tac.txt" | head -10
+        fi
+    done
+done
+section golden $((failed - start_failed)) $((total - start_total))
+
+######## Batch ########
+start_failed=$failed
+start_total=$total
+for input in "$root"/tests/batch/*.cp; do
+    name=$(basename "$input" .cp)
+    for flags in "" "-O" "-w 4" "-O -w 4"; do
+        total=$((total + 1))
+        run $flags -b "$root/tests/batch/$name.in" "$input"
+        if ! cmp -s "$root/tests/batch/$name.expected" "$work/run/batch_output.txt"; then
+            fail "$name${flags:+ ($flags)}" "batch output differs"
+            diff "$root/tests/batch/$name.expected" "$work/run/batch_output.txt" | head -10
+        fi
+    done
+done
+section batch $((failed - start_failed)) $((total - start_total))
+
+######## Backends ########
+start_failed=$failed
+start_total=$total
+for input in "$root"/tests/golden/*.cp; do
+    name=$(basename "$input" .cp)
+    expected=$root/tests/golden/$name.expected
+    for optimize in "" "-O"; do
+        total=$((total + 1))
+        run $optimize -j 1 "$input"
+        cmp -s "$expected" "$work/run/stdout" || fail "$name ($optimize -j 1)" "JIT output differs"
+        total=$((total + 1))
+        run $optimize -S "$input"
+        (cd "$work/run" && ./program > stdout 2>&1)
+        cmp -s "$expected" "$work/run/stdout" || fail "$name ($optimize -S)" "x86 output differs"
+        total=$((total + 1))
+        run $optimize -C "$input"
+        (cd "$work/run" && ./program_c > stdout 2>&1)
+        cmp -s "$expected" "$work/run/stdout" || fail "$name ($optimize -C)" "C backend output differs"
+    done
+done
+section backends $((failed - start_failed)) $((total - start_total))
+
+######## Front ends ########
+start_failed=$failed
+start_total=$total
+printf '%s\n' "$root"/tests/golden/*.cp "$root"/tests/errors/*.cp > "$work/inputs"
+for optimize in "" "-O"; do
+    run $optimize -m "$work/inputs" -o many -w 2
+    rm -rf "$work/many" && mv "$work/run/many" "$work/many"
+    while read -r input; do
+        name=$(basename "$input" .cp)
+        total=$((total + 1))
+        run $optimize "$input"
+        for output in $outputs; do
+            if ! cmp -s "$work/run/$output" "$work/many/$name/$output" 2>/dev/null && [ -f "$work/run/$output" ]; then
+                fail "$name ($optimize -m)" "$output differs"
+                break
+            fi
+        done
+    done < "$work/inputs"
+done
+while read -r input; do
+    name=$(basename "$input" .cp)
+    for optimize in "" "-O"; do
+        rm -rf "$work/cache"
+        run $optimize "$input"
+        rm -rf "$work/plain" && mv "$work/run" "$work/plain"
+        for pass in pipeline parallel stream cold cached corrupt; do
+            flags="-k $work/cache"
+            [ $pass = pipeline ] && flags=-P
+            [ $pass = parallel ] && flags="-F 4"
+            # -T streams unoptimized TAC only
+            if [ $pass = stream ]; then
+                [ -n "$optimize" ] && continue
+                flags=-T
+            fi
+            # Past its end, the first stored length of an entry must make it a miss
+            if [ $pass = corrupt ]; then
+                for entry in "$work"/cache/*.entry; do
+                    printf '\377\377\377\377\377\377\377\377' | dd of="$entry" bs=1 seek=8 conv=notrunc 2>/dev/null
+                done
+            fi
+            total=$((total + 1))
+            run $optimize $flags "$input"
+            for output in $outputs; do
+                if ! cmp -s "$work/plain/$output" "$work/run/$output" 2>/dev/null && [ -f "$work/plain/$output" ]; then
+                    fail "$name ($optimize ${flags%% *}, $pass)" "$output differs"
+                    break
+                fi
+            done
+        done
+        total=$((total + 1))
+        grep -q "^hits 1$" "$work/cache/stats" || fail "$name ($optimize -k)" "the second compile missed the cache"
+    done
+done < "$work/inputs"
+section "front ends" $((failed - start_failed)) $((total - start_total))
+
+######## Server ########
+start_failed=$failed
+start_total=$total
+# The second server keeps a per-function cache on its one worker, so each source's second compile replays its blocks
+for incremental in "" "-I 16"; do
+    socket=$work/socket${incremental:+-incremental}
+    workers=2
+    passes=cold
+    [ -n "$incremental" ] && workers=1 && passes="cold warm"
+    "$compiler" $incremental -D "$socket" -w $workers > "$work/server.log" 2>&1 &
+    server=$!
+    tries=0
+    while [ ! -S "$socket" ] && [ $tries -lt 50 ]; do
+        sleep 0.1
+        tries=$((tries + 1))
+    done
+    for input in "$root"/tests/golden/*.cp "$root"/benchmarks/*/*.cp; do
+        name=$(basename "$input" .cp)
+        for optimize in "" "-O"; do
+            run $optimize "$input"
+            rm -rf "$work/plain" && mv "$work/run" "$work/plain"
+            for pass in $passes; do
+                total=$((total + 1))
+                run $optimize -s "$socket" "$input"
+                cmp -s "$work/plain/tac.txt" "$work/run/stdout" ||
+                    fail "$name ($optimize $incremental -s, $pass)" "remote TAC differs"
+            done
+        done
+    done
+    kill $server 2>/dev/null
+    wait $server 2>/dev/null
+    server=
+done
+section server $((failed - start_failed)) $((total - start_total))
+
+######## LSP ########
+# Opens a document with an undeclared variable, asks where add1 is defined, then fixes the error with an edit. Each
+# message waits for the answer to the one before, the server dropping work still queued when the client exits
+start_failed=$failed
+start_total=$total
+{
+    frame '{"jsonrpc":"2.0","id":1,"method":"initialize","params":{}}'
+    frame '{"jsonrpc":"2.0","method":"textDocument/didOpen","params":{"textDocument":{"uri":"file:///t.cp","languageId":"cp","version":1,"text":"def int add1(int a)\n    return a + 1;\nfed;\nint x;\nx = add1(2);\nprint y"}}}'
+    await '"version":1,'
+    frame '{"jsonrpc":"2.0","id":2,"method":"textDocument/definition","params":{"textDocument":{"uri":"file:///t.cp"},"position":{"line":4,"character":4}}}'
+    await '"id":2,'
+    frame '{"jsonrpc":"2.0","method":"textDocument/didChange","params":{"textDocument":{"uri":"file:///t.cp","version":2},"contentChanges":[{"range":{"start":{"line":5,"character":6},"end":{"line":5,"character":7}},"text":"x"}]}}'
+    await '"version":2,'
+    frame '{"jsonrpc":"2.0","id":3,"method":"shutdown"}'
+    frame '{"jsonrpc":"2.0","method":"exit"}'
+} | "$compiler" -L > "$work/lsp.out" 2> /dev/null
+total=$((total + 1))
+grep -q "\"version\":1,\"diagnostics\":\[{[^]]*'y' has been referenced but not declared" "$work/lsp.out" || fail lsp "no diagnostic for y"
+total=$((total + 1))
+grep -q '"id":2,"result":{"uri":"file:///t.cp","range":{"start":{"line":0,"character":8},"end":{"line":0,"character":12}}}' "$work/lsp.out" || fail lsp "wrong definition of add1"
+total=$((total + 1))
+grep -q '"version":2,"diagnostics":\[\]' "$work/lsp.out" || fail lsp "the edit didn't clear the diagnostics"
+section lsp $((failed - start_failed)) $((total - start_total))
+
+######## Errors ########
+start_failed=$failed
+start_total=$total
+for input in "$root"/tests/errors/*.cp; do
+    name=$(basename "$input" .cp)
+    total=$((total + 1))
+    run "$input"
+    status=$?
+    if [ $status -eq 124 ]; then
+        fail "$name" "timed out"
+    elif [ $status -gt 128 ]; then
+        fail "$name" "killed by signal $((status - 128))"
+    elif ! cmp -s "$root/tests/errors/$name.error" "$work/run/error.txt"; then
+        fail "$name" "diagnostics differ"
+        diff "$root/tests/errors/$name.error" "$work/run/error.txt" | head -10
+    fi
+done
+section errors $((failed - start_failed)) $((total - start_total))
+
+######## Sanitizers ########
+start_failed=$failed
+start_total=$total
+sanitized=$work/sanitized
+if ${CC:-gcc} -O1 -g -w -pthread -fsanitize=address,undefined -fno-sanitize-recover=all -o "$sanitized" \
+        "$root/compiler.c" -lm 2>/dev/null; then
+    plain=$compiler
+    compiler=$sanitized
+    export ASAN_OPTIONS=detect_leaks=1
+    for input in "$root"/tests/golden/*.cp "$root"/tests/errors/*.cp; do
+        name=$(basename "$input" .cp)
+        for optimize in "" "-O"; do
+            total=$((total + 1))
+            run $optimize -r "$input"
+            if grep -q "Sanitizer\|runtime error" "$work/run/stdout"; then
+                fail "$name${optimize:+ $optimize}" "sanitizer report"
+                grep -m 5 "Sanitizer\|runtime error\|#[0-9]" "$work/run/stdout"
+            fi
+        done
+    done
+    compiler=$plain
+else
+    echo "sanitizers: skipped, the compiler cannot build with -fsanitize=address,undefined"
+fi
+section sanitizers $((failed - start_failed)) $((total - start_total))
+
+######## Differential ########
+start_failed=$failed
+total=$((total + 1))
+if ! ${CC:-gcc} -O2 -w -DCOMPILER_LIBRARY -pthread -o "$work/differential" "$root/tests/differential.c" "$root/compiler.c" -lm; then
+    fail differential "doesn't build"
+elif ! (cd "$work" && ./differential "$root"/tests/golden/*.cp "$root"/benchmarks/*/*.cp); then
+    fail differential "compiles differ"
+fi
+section differential $((failed - start_failed)) 1
+
+echo "total: $((total - failed))/$total passed"
+[ "$failed" -eq 0 ]
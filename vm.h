@@ -0,0 +1,2378 @@
+#ifndef VM_H
+#define VM_H
+
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+
+/******************************** VM Definitions ********************************/
+// The VM runs a register bytecode lowered from the TAC. Every param, variable, temp and constant of a
+// function gets a register in its frame, operands are register indeces and opcodes are typed, _I opcodes
+// work on ints and _D opcodes on doubles. Build with -DVM_SWITCH_DISPATCH to use the switch dispatch loop
+// instead of computed goto, and with -DVM_NO_SUPERINSTRUCTIONS to run the bytecode without fusing.
+#if defined(__GNUC__) && !defined(VM_SWITCH_DISPATCH)
+#define VM_COMPUTED_GOTO 1
+#else
+#define VM_COMPUTED_GOTO 0
+#endif
+
+// Opcodes, a is the written register unless noted
+#define VM_MOV          0            // a = b, c is the type (1 int, 0 double) for batch mode
+#define VM_I2D          1            // a = (double)b
+#define VM_D2I          2            // a = (int)b
+#define VM_ADD_I        3            // a = b + c, in the order of TAC_ADD to TAC_MOD
+#define VM_SUB_I        4            //
+#define VM_MUL_I        5            //
+#define VM_DIV_I        6            //
+#define VM_MOD_I        7            //
+#define VM_ADD_D        8            // a = b + c, in the order of TAC_ADD to TAC_DIV
+#define VM_SUB_D        9            //
+#define VM_MUL_D        10           //
+#define VM_DIV_D        11           //
+#define VM_LT_I         12           // a = b < c, in the order of TAC_LT to TAC_NE
+#define VM_GT_I         13           //
+#define VM_EQ_I         14           //
+#define VM_LE_I         15           //
+#define VM_GE_I         16           //
+#define VM_NE_I         17           //
+#define VM_LT_D         18           // a = b < c on doubles, same order
+#define VM_GT_D         19           //
+#define VM_EQ_D         20           //
+#define VM_LE_D         21           //
+#define VM_GE_D         22           //
+#define VM_NE_D         23           //
+#define VM_NOT_I        24           // a = !b
+#define VM_OR_I         25           // a = b || c
+#define VM_JMP          26           // Jump to c
+#define VM_JZ_I         27           // Jump to c if b is zero
+#define VM_JZ_D         28           //
+#define VM_JLT_I        29           // Jump to c if a < b, in the order of TAC_LT to TAC_NE
+#define VM_JGT_I        30           //
+#define VM_JEQ_I        31           //
+#define VM_JLE_I        32           //
+#define VM_JGE_I        33           //
+#define VM_JNE_I        34           //
+#define VM_JLT_D        35           // Jump to c if a < b on doubles, same order
+#define VM_JGT_D        36           //
+#define VM_JEQ_D        37           //
+#define VM_JLE_D        38           //
+#define VM_JGE_D        39           //
+#define VM_JNE_D        40           //
+#define VM_PRINT_I      41           // Print a
+#define VM_PRINT_D      42           //
+#define VM_PUSH         43           // Push a on the argument stack
+#define VM_CALL         44           // a = call of function b, its c arguments are popped from the argument stack
+#define VM_TAILCALL     45           // Call of function b that reuses the current frame
+#define VM_RET          46           // Return a
+#define VM_HALT         47           // End of main
+// Superinstructions run an instruction and the one after it in a single dispatch. The second instruction
+// stays in place and supplies its own operands, so a jump or return to it still runs it alone.
+#define VM_MOV_MOV      48           //
+#define VM_MOV_ADD_I    49           //
+#define VM_ADD_I_MOV    50           // t = a op b followed by x = t
+#define VM_SUB_I_MOV    51           //
+#define VM_MUL_I_MOV    52           //
+#define VM_MUL_I_MOD_I  53           //
+#define VM_MOD_I_ADD_I  54           //
+#define VM_SUB_I_PUSH   55           // f(n - 1)
+#define VM_PUSH_CALL    56           //
+#define VM_ADD_I_RET    57           //
+#define VM_MOV_JMP      58           //
+#define VM_ADD_I_JMP    59           // Loop latches
+#define VM_ADD_I_JLT_I  60           // Rotated loop latches, i = i + 1 followed by the loop test
+#define VM_NUM_OPS      61
+
+// Name of each opcode for reports, indexed by opcode
+static const char* vm_op_names[VM_NUM_OPS] = {
+    "mov", "i2d", "d2i", "add_i", "sub_i", "mul_i", "div_i", "mod_i", "add_d", "sub_d", "mul_d", "div_d",
+    "lt_i", "gt_i", "eq_i", "le_i", "ge_i", "ne_i", "lt_d", "gt_d", "eq_d", "le_d", "ge_d", "ne_d", "not_i", "or_i",
+    "jmp", "jz_i", "jz_d", "jlt_i", "jgt_i", "jeq_i", "jle_i", "jge_i", "jne_i", "jlt_d", "jgt_d", "jeq_d", "jle_d",
+    "jge_d", "jne_d", "print_i", "print_d", "push", "call", "tailcall", "ret", "halt",
+    "mov+mov", "mov+add_i", "add_i+mov", "sub_i+mov", "mul_i+mov", "mul_i+mod_i", "mod_i+add_i", "sub_i+push",
+    "push+call", "add_i+ret", "mov+jmp", "add_i+jmp", "add_i+jlt_i"
+};
+
+// Each superinstruction and the pair it fuses. The pairs are the hottest ones -p reported on benchmarks/vm,
+// with and without -O.
+#define VM_NUM_SUPERINSTRUCTIONS 13
+static const int vm_superinstructions[VM_NUM_SUPERINSTRUCTIONS][3] = {
+    {VM_MOV_MOV, VM_MOV, VM_MOV},
+    {VM_MOV_ADD_I, VM_MOV, VM_ADD_I},
+    {VM_ADD_I_MOV, VM_ADD_I, VM_MOV},
+    {VM_SUB_I_MOV, VM_SUB_I, VM_MOV},
+    {VM_MUL_I_MOV, VM_MUL_I, VM_MOV},
+    {VM_MUL_I_MOD_I, VM_MUL_I, VM_MOD_I},
+    {VM_MOD_I_ADD_I, VM_MOD_I, VM_ADD_I},
+    {VM_SUB_I_PUSH, VM_SUB_I, VM_PUSH},
+    {VM_PUSH_CALL, VM_PUSH, VM_CALL},
+    {VM_ADD_I_RET, VM_ADD_I, VM_RET},
+    {VM_MOV_JMP, VM_MOV, VM_JMP},
+    {VM_ADD_I_JMP, VM_ADD_I, VM_JMP},
+    {VM_ADD_I_JLT_I, VM_ADD_I, VM_JLT_I}
+};
+
+// Limits of a run
+#define VM_STACK_SIZE   (1 << 20)    // Registers across all frames
+#define VM_MAX_FRAMES   (1 << 16)    // Call depth
+#define VM_MAX_ARGS     (1 << 16)    // Pushed arguments waiting for their call
+
+/******************************** Struct Definitions ********************************/
+// A register holds either an int or a double, the opcode reading it decides which
+union vm_value{
+    int i;                           //
+    double d;                        //
+};
+
+struct vm_instr{
+    int op;                          // VM opcode
+    int a;                           // Written register (read register of Print, Push, Return and conditional jumps)
+    int b;                           // First read register, or the callee of a call
+    int c;                           // Second read register, jump target or argument count of a call
+};
+
+// Frame layout: params, variables, temps, two scratch registers, constants
+struct vm_function{
+    char* name;                      //
+    struct vm_instr* code;           // Bytecode
+    int num_code;                    //
+    int num_params;                  //
+    int num_regs;                    // Registers in a frame
+    int first_constant;              // Register of the first constant
+    int num_constants;               //
+    union vm_value* constants;       // Values copied into the constant registers on entry
+    int* param_types;                // Type of each param (1 for int || 0 for double)
+    int return_type;                 // Type of the returned value
+    long long* counts;               // Executions of each instruction, only while profiling
+    int num_vars;                    // Params and variables, which hold the first registers
+    char** vars;                     // Name of each of those registers
+    int* var_types;                  // Type of each of those registers
+    long long calls;                 // Times the function was entered, counted only while a JIT is attached
+    void* native;                    // Machine code of the function once the JIT compiled it, NULL before
+};
+
+struct vm_state;
+struct jit;
+
+struct vm_program{
+    int num_functions;               //
+    struct vm_function* functions;   // Same order as the TAC program
+    int main;                        // Index of main
+    struct jit* jit;                 // JIT attached to the program, NULL to only interpret
+    long long jit_threshold;         // Calls after which the JIT compiles a function
+    void (*tier_up)(struct vm_program* vm, int f);  // Compiles function f and every function it reaches
+    int (*call_native)(struct vm_program* vm, struct vm_state* state, struct vm_function* callee, union vm_value* regs,
+                       long long frames_left, union vm_value* result);  // Runs compiled code, 1 after a runtime error
+};
+
+// Where a call returns to
+struct vm_frame{
+    struct vm_function* function;    // Function running in the frame
+    struct vm_instr* return_ip;      // Instruction after the call in the caller
+    union vm_value* regs;            // First register of the frame
+    int dest;                        // Caller register receiving the returned value
+};
+
+// Where Print writes: straight to a file, or into a buffer when file is NULL
+struct vm_output{
+    FILE* file;                      //
+    char* buffer;                    //
+    int length;                      //
+    int capacity;                    //
+};
+
+// Stacks and output of one execution, reused from run to run
+struct vm_state{
+    union vm_value* stack;           // Registers of every frame, main's first
+    struct vm_frame* frames;         // Call frames, main's first
+    union vm_value* args;            // Pushed arguments waiting for their call
+    struct vm_output output;         // Where Print writes
+    const char* error;               // Runtime error that ended the last run, NULL if none
+    char* error_function;            // Function the runtime error happened in
+};
+
+// Counters of one run
+struct vm_stats{
+    long long instructions;          // Instructions dispatched, a superinstruction counts once
+    long long calls;                 // Calls and tail calls
+    double seconds;                  // Processor time of the run
+};
+
+// State used while lowering one TAC function
+struct vm_lowering{
+    struct tac_program* tac_program; //
+    struct tac_function* tac;        // Function being lowered
+    struct vm_function* function;    // Function receiving the bytecode
+    int capacity;                    // Allocated bytecode slots
+    char** vars;                     // Variable of each register, params first
+    int num_vars;                    //
+    int* temp_regs;                  // Register of each temp number, -1 until seen
+    int num_temps;                   // Length of temp_regs
+    int scratch;                     // First of the two scratch registers
+    char** constant_names;           // Lexeme of each constant
+    int* constant_types;             // Type of each constant
+    int constant_capacity;           //
+    int* label_pcs;                  // Bytecode index of each TAC label
+    int* push_types;                 // Type the param receiving each PushParam expects, -1 if unknown
+};
+
+/******************************** Lowering ********************************/
+// Operand type as the VM sees it, unknown types are ints
+int vm_type(struct tac_operand operand){
+    return (operand.type == 0) ? 0 : 1;
+}
+
+void vm_emit(struct vm_lowering* lw, int op, int a, int b, int c){
+    struct vm_function* function = lw->function;
+    if (function->num_code == lw->capacity) {
+        lw->capacity = (lw->capacity == 0) ? 64 : lw->capacity * 2;
+        function->code = realloc(function->code, sizeof(struct vm_instr) * lw->capacity);
+    }
+    struct vm_instr instr = {op, a, b, c};
+    function->code[function->num_code++] = instr;
+}
+
+// Register of a variable, params keep the registers of their position
+int vm_var_reg(struct vm_lowering* lw, const char* name){
+    for (int v = 0; v < lw->num_vars; v++) {
+        if (compare_strings(lw->vars[v], name) == 0) {
+            return v;
+        }
+    }
+    return -1;
+}
+
+// Register of a constant with the given type, the lexeme is converted when the types differ
+int vm_constant_reg(struct vm_lowering* lw, char* lexeme, int type){
+    struct vm_function* function = lw->function;
+    for (int k = 0; k < function->num_constants; k++) {
+        if (lw->constant_types[k] == type && compare_strings(lw->constant_names[k], lexeme) == 0) {
+            return function->first_constant + k;
+        }
+    }
+    if (function->num_constants == lw->constant_capacity) {
+        lw->constant_capacity = (lw->constant_capacity == 0) ? 16 : lw->constant_capacity * 2;
+        function->constants = realloc(function->constants, sizeof(union vm_value) * lw->constant_capacity);
+        lw->constant_names = realloc(lw->constant_names, sizeof(char*) * lw->constant_capacity);
+        lw->constant_types = realloc(lw->constant_types, sizeof(int) * lw->constant_capacity);
+    }
+    int k = function->num_constants++;
+    double value = strtod(lexeme, NULL);
+    if (type == 1) {
+        function->constants[k].i = (int)value;
+    }
+    else {
+        function->constants[k].d = value;
+    }
+    lw->constant_names[k] = lexeme;
+    lw->constant_types[k] = type;
+    return function->first_constant + k;
+}
+
+// Register holding an operand
+int vm_reg(struct vm_lowering* lw, struct tac_operand operand){
+    switch (operand.kind) {
+        case TAC_VAR:
+            return vm_var_reg(lw, operand.name);
+        case TAC_TEMP:
+            return lw->temp_regs[operand.temp];
+        case TAC_CONST:
+            return vm_constant_reg(lw, operand.name, vm_type(operand));
+    }
+    return -1;
+}
+
+// Register holding an operand converted to type, scratch register k holds the conversion when one is needed
+int vm_read(struct vm_lowering* lw, struct tac_operand operand, int type, int k){
+    if (vm_type(operand) == type) {
+        return vm_reg(lw, operand);
+    }
+    if (operand.kind == TAC_CONST) {
+        return vm_constant_reg(lw, operand.name, type);
+    }
+    vm_emit(lw, (type == 0) ? VM_I2D : VM_D2I, lw->scratch + k, vm_reg(lw, operand), 0);
+    return lw->scratch + k;
+}
+
+// Register an int truth value of an operand is read from, doubles are compared against 0.0
+int vm_read_truth(struct vm_lowering* lw, struct tac_operand operand, int k){
+    if (vm_type(operand) == 1) {
+        return vm_reg(lw, operand);
+    }
+    vm_emit(lw, VM_NE_D, lw->scratch + k, vm_reg(lw, operand), vm_constant_reg(lw, "0.0", 0));
+    return lw->scratch + k;
+}
+
+// Emits op with a result of type into dest, going through the first scratch register when dest has the other type
+void vm_emit_result(struct vm_lowering* lw, int op, struct tac_operand dest, int type, int b, int c){
+    int dest_type = vm_type(dest);
+    if (dest_type == type) {
+        vm_emit(lw, op, vm_reg(lw, dest), b, c);
+        return;
+    }
+    vm_emit(lw, op, lw->scratch, b, c);
+    vm_emit(lw, (dest_type == 0) ? VM_I2D : VM_D2I, vm_reg(lw, dest), lw->scratch, 0);
+}
+
+// Declared type of a variable, read from the operands naming it
+int vm_var_type(struct tac_function* function, const char* name){
+    for (int i = 0; i < function->num_instrs; i++) {
+        struct tac_operand* operands[3] = {&function->instrs[i].dest, &function->instrs[i].arg1, &function->instrs[i].arg2};
+        for (int o = 0; o < 3; o++) {
+            if (operands[o]->kind == TAC_VAR && operands[o]->type >= 0 && compare_strings(operands[o]->name, name) == 0) {
+                return operands[o]->type;
+            }
+        }
+    }
+    return 1;
+}
+
+// Type a function returns: the type its callers expect, or the type of its first Return
+int vm_return_type(struct tac_program* program, struct tac_function* function){
+    for (int f = 0; f < program->num_functions; f++) {
+        struct tac_function* caller = program->functions[f];
+        for (int i = 0; i < caller->num_instrs; i++) {
+            if (caller->instrs[i].op == TAC_LCALL && compare_strings(caller->instrs[i].callee, function->name) == 0) {
+                return vm_type(caller->instrs[i].dest);
+            }
+        }
+    }
+    for (int i = 0; i < function->num_instrs; i++) {
+        if (function->instrs[i].op == TAC_RETURN) {
+            return vm_type(function->instrs[i].arg1);
+        }
+    }
+    return 1;
+}
+
+// Lays out the frame of a function and records its signature, lowering needs every signature first
+void vm_prepare_function(struct tac_program* program, int f, struct vm_function* function){
+    struct tac_function* tac = program->functions[f];
+    function->name = tac->name;
+    function->code = NULL;
+    function->num_code = 0;
+    function->num_params = tac->num_params;
+    function->num_constants = 0;
+    function->constants = NULL;
+    function->param_types = malloc(sizeof(int) * (tac->num_params + 1));
+    for (int p = 0; p < tac->num_params; p++) {
+        function->param_types[p] = vm_var_type(tac, tac->locals[p]);
+    }
+    function->return_type = vm_return_type(program, tac);
+    function->counts = NULL;
+    function->num_vars = 0;
+    function->vars = NULL;
+    function->var_types = NULL;
+    function->calls = 0;
+    function->native = NULL;
+}
+
+// Lowers one TAC function to bytecode, returns 0 on success or 1 after writing an error
+int vm_lower_function(struct tac_program* program, struct vm_program* vm, int f){
+    struct tac_function* tac = program->functions[f];
+    struct vm_function* function = &vm->functions[f];
+    struct vm_lowering lw = {program, tac, function, 0, NULL, 0, NULL, 0, 0, NULL, NULL, 0, NULL, NULL};
+
+    // Number the registers: params, variables, temps, scratch, then constants as they are used
+    int max_temp = -1;
+    int max_label = -1;
+    for (int i = 0; i < tac->num_instrs; i++) {
+        struct tac_instr* instr = &tac->instrs[i];
+        struct tac_operand operands[3] = {instr->dest, instr->arg1, instr->arg2};
+        for (int o = 0; o < 3; o++) {
+            if (operands[o].kind == TAC_TEMP && operands[o].temp > max_temp) {
+                max_temp = operands[o].temp;
+            }
+        }
+        if (instr->label > max_label) {
+            max_label = instr->label;
+        }
+    }
+    lw.num_temps = max_temp + 1;
+    lw.temp_regs = malloc(sizeof(int) * (lw.num_temps + 1));
+    for (int t = 0; t < lw.num_temps; t++) {
+        lw.temp_regs[t] = -1;
+    }
+    lw.vars = malloc(sizeof(char*) * (tac->num_params + program->num_main_vars + 3 * tac->num_instrs + 1));
+    for (int p = 0; p < tac->num_params; p++) {
+        lw.vars[lw.num_vars++] = tac->locals[p];
+    }
+    // In batch mode main's variables are its input and output, so each one main declares holds a register in
+    // declaration order, also when the optimizer removed every use of it
+    for (int v = 0; tac->keeps_vars && v < program->num_main_vars; v++) {
+        lw.vars[lw.num_vars++] = program->main_vars[v];
+    }
+    for (int i = 0; i < tac->num_instrs; i++) {
+        struct tac_operand operands[3] = {tac->instrs[i].dest, tac->instrs[i].arg1, tac->instrs[i].arg2};
+        for (int o = 0; o < 3; o++) {
+            if (operands[o].kind == TAC_VAR && vm_var_reg(&lw, operands[o].name) < 0) {
+                lw.vars[lw.num_vars++] = operands[o].name;
+            }
+        }
+    }
+    int next_reg = lw.num_vars;
+    for (int i = 0; i < tac->num_instrs; i++) {
+        struct tac_operand operands[3] = {tac->instrs[i].dest, tac->instrs[i].arg1, tac->instrs[i].arg2};
+        for (int o = 0; o < 3; o++) {
+            if (operands[o].kind == TAC_TEMP && lw.temp_regs[operands[o].temp] < 0) {
+                lw.temp_regs[operands[o].temp] = next_reg++;
+            }
+        }
+    }
+    lw.scratch = next_reg;
+    function->first_constant = lw.scratch + 2;
+
+    // Type each PushParam by the param it fills, so arguments arrive converted
+    lw.push_types = malloc(sizeof(int) * (tac->num_instrs + 1));
+    int* pushes = malloc(sizeof(int) * (tac->num_instrs + 1));
+    for (int i = 0; i < tac->num_instrs; i++) {
+        lw.push_types[i] = -1;
+    }
+    for (int i = 0; i < tac->num_instrs; i++) {
+        if (tac->instrs[i].op != TAC_LCALL) {
+            continue;
+        }
+        int callee = find_function(program, tac->instrs[i].callee);
+        int num_args = call_arguments(tac, i, pushes);
+        if (callee < 0 || num_args != vm->functions[callee].num_params) {
+            continue;
+        }
+        for (int a = 0; a < num_args; a++) {
+            lw.push_types[pushes[a]] = vm->functions[callee].param_types[num_args - 1 - a];
+        }
+    }
+    free(pushes);
+
+    // Labels are resolved once every position is known
+    lw.label_pcs = malloc(sizeof(int) * (max_label + 2));
+    int error = 0;
+    for (int i = 0; i < tac->num_instrs && !error; i++) {
+        struct tac_instr* instr = &tac->instrs[i];
+        int type = (vm_type(instr->arg1) == 1 && (instr->arg2.kind == TAC_NONE || vm_type(instr->arg2) == 1)) ? 1 : 0;
+        switch (instr->op) {
+            case TAC_NOP:
+            case TAC_POP_PARAMS:    // The call pops its own arguments
+                break;
+            case TAC_LABEL:
+                lw.label_pcs[instr->label] = function->num_code;
+                break;
+            case TAC_ASSIGN:
+                if (vm_type(instr->dest) == vm_type(instr->arg1) || instr->arg1.kind == TAC_CONST) {
+                    vm_emit(&lw, VM_MOV, vm_reg(&lw, instr->dest), vm_read(&lw, instr->arg1, vm_type(instr->dest), 0), vm_type(instr->dest));
+                }
+                else {
+                    vm_emit(&lw, (vm_type(instr->dest) == 0) ? VM_I2D : VM_D2I, vm_reg(&lw, instr->dest), vm_reg(&lw, instr->arg1), 0);
+                }
+                break;
+            case TAC_ADD:
+            case TAC_SUB:
+            case TAC_MUL:
+            case TAC_DIV:
+            case TAC_MOD:
+                // % only exists on ints, its double operands are truncated
+                if (instr->op == TAC_MOD) {
+                    type = 1;
+                }
+                vm_emit_result(&lw, ((type == 1) ? VM_ADD_I : VM_ADD_D) + (instr->op - TAC_ADD), instr->dest, type,
+                               vm_read(&lw, instr->arg1, type, 0), vm_read(&lw, instr->arg2, type, 1));
+                break;
+            case TAC_LT:
+            case TAC_GT:
+            case TAC_EQ:
+            case TAC_LE:
+            case TAC_GE:
+            case TAC_NE:
+                vm_emit_result(&lw, ((type == 1) ? VM_LT_I : VM_LT_D) + (instr->op - TAC_LT), instr->dest, 1,
+                               vm_read(&lw, instr->arg1, type, 0), vm_read(&lw, instr->arg2, type, 1));
+                break;
+            case TAC_OR:
+                vm_emit_result(&lw, VM_OR_I, instr->dest, 1, vm_read_truth(&lw, instr->arg1, 0), vm_read_truth(&lw, instr->arg2, 1));
+                break;
+            case TAC_NOT:
+                if (type == 1) {
+                    vm_emit_result(&lw, VM_NOT_I, instr->dest, 1, vm_reg(&lw, instr->arg1), 0);
+                }
+                else {
+                    vm_emit_result(&lw, VM_EQ_D, instr->dest, 1, vm_reg(&lw, instr->arg1), vm_constant_reg(&lw, "0.0", 0));
+                }
+                break;
+            case TAC_GOTO:
+                vm_emit(&lw, VM_JMP, 0, 0, instr->label);
+                break;
+            case TAC_IFZ:
+                vm_emit(&lw, (type == 1) ? VM_JZ_I : VM_JZ_D, 0, vm_reg(&lw, instr->arg1), instr->label);
+                break;
+            case TAC_IF:
+                vm_emit(&lw, ((type == 1) ? VM_JLT_I : VM_JLT_D) + (instr->relop - TAC_LT),
+                        vm_read(&lw, instr->arg1, type, 0), vm_read(&lw, instr->arg2, type, 1), instr->label);
+                break;
+            case TAC_PRINT:
+                vm_emit(&lw, (vm_type(instr->arg1) == 1) ? VM_PRINT_I : VM_PRINT_D, vm_reg(&lw, instr->arg1), 0, 0);
+                break;
+            case TAC_PUSH_PARAM:
+                if (lw.push_types[i] >= 0) {
+                    vm_emit(&lw, VM_PUSH, vm_read(&lw, instr->arg1, lw.push_types[i], 0), 0, 0);
+                }
+                else {
+                    vm_emit(&lw, VM_PUSH, vm_reg(&lw, instr->arg1), 0, 0);
+                }
+                break;
+            case TAC_LCALL: {
+                int callee = find_function(program, instr->callee);
+                if (callee < 0) {
+                    fprintf(stderr, "VM error: %s calls unknown function %s\n", tac->name, instr->callee);
+                    error = 1;
+                    break;
+                }
+                struct vm_function* target = &vm->functions[callee];
+                // A marked tail call reuses the frame when the callee returns what this function returns
+                if (instr->tail && !tac->is_main && target->return_type == function->return_type) {
+                    vm_emit(&lw, VM_TAILCALL, 0, callee, target->num_params);
+                }
+                else if (instr->dest.kind == TAC_NONE) {
+                    vm_emit(&lw, VM_CALL, lw.scratch, callee, target->num_params);
+                }
+                else {
+                    vm_emit_result(&lw, VM_CALL, instr->dest, target->return_type, callee, target->num_params);
+                }
+                break;
+            }
+            case TAC_RETURN:
+                if (tac->is_main) {
+                    vm_emit(&lw, VM_HALT, 0, 0, 0);
+                }
+                else {
+                    vm_emit(&lw, VM_RET, vm_read(&lw, instr->arg1, function->return_type, 0), 0, 0);
+                }
+                break;
+        }
+    }
+
+    // Falling off the end returns 0
+    if (tac->is_main) {
+        vm_emit(&lw, VM_HALT, 0, 0, 0);
+    }
+    else {
+        vm_emit(&lw, VM_RET, vm_constant_reg(&lw, (function->return_type == 1) ? "0" : "0.0", function->return_type), 0, 0);
+    }
+    for (int pc = 0; pc < function->num_code; pc++) {
+        struct vm_instr* instr = &function->code[pc];
+        if (instr->op >= VM_JMP && instr->op <= VM_JNE_D) {
+            instr->c = lw.label_pcs[instr->c];
+        }
+    }
+    function->num_regs = function->first_constant + function->num_constants;
+    function->num_vars = lw.num_vars;
+    function->vars = lw.vars;
+    function->var_types = malloc(sizeof(int) * (lw.num_vars + 1));
+    for (int v = 0; v < lw.num_vars; v++) {
+        int declared = tac->keeps_vars && v < program->num_main_vars;
+        function->var_types[v] = declared ? program->main_var_types[v] : vm_var_type(tac, lw.vars[v]);
+    }
+
+    free(lw.temp_regs);
+    free(lw.constant_names);
+    free(lw.constant_types);
+    free(lw.label_pcs);
+    free(lw.push_types);
+    return error;
+}
+
+void free_vm_program(struct vm_program* vm){
+    for (int f = 0; f < vm->num_functions; f++) {
+        free(vm->functions[f].code);
+        free(vm->functions[f].constants);
+        free(vm->functions[f].param_types);
+        free(vm->functions[f].counts);
+        free(vm->functions[f].vars);
+        free(vm->functions[f].var_types);
+    }
+    free(vm->functions);
+    vm->functions = NULL;
+    vm->num_functions = 0;
+}
+
+// Lowers a whole TAC program, returns 0 on success
+int vm_lower_program(struct tac_program* program, struct vm_program* vm){
+    vm->num_functions = program->num_functions;
+    vm->functions = calloc(program->num_functions + 1, sizeof(struct vm_function));
+    vm->main = -1;
+    vm->jit = NULL;
+    vm->jit_threshold = 0;
+    vm->tier_up = NULL;
+    vm->call_native = NULL;
+    for (int f = 0; f < program->num_functions; f++) {
+        vm_prepare_function(program, f, &vm->functions[f]);
+        if (program->functions[f]->is_main) {
+            vm->main = f;
+        }
+    }
+    if (vm->main < 0) {
+        fprintf(stderr, "VM error: program has no main\n");
+        return 1;
+    }
+    for (int f = 0; f < program->num_functions; f++) {
+        if (vm_lower_function(program, vm, f)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/******************************** Superinstructions ********************************/
+// True(1) if the opcode is a conditional jump on two int registers
+int vm_is_int_branch(int op){
+    return (op >= VM_JLT_I && op <= VM_JNE_I);
+}
+
+// Opcode of the int conditional jump taken exactly when op is not, following the TAC relop order
+int vm_invert_int_branch(int op){
+    return VM_JLT_I + (tac_invert_relop(TAC_LT + (op - VM_JLT_I)) - TAC_LT);
+}
+
+// A loop tested at the top ends in a jump back to its test, and the test jumps past the loop when it fails:
+//     h: JGE i n -> x ... JMP h   x:
+// The jump back becomes the inverted test, entering the body directly and falling out of the loop, which
+// saves a dispatch per iteration. Double tests are left alone since NaN makes them not invert.
+// Returns the number of loops rotated.
+int vm_rotate_loops(struct vm_function* function){
+    int rotated = 0;
+    for (int pc = 0; pc < function->num_code; pc++) {
+        struct vm_instr* jump = &function->code[pc];
+        if (jump->op != VM_JMP) {
+            continue;
+        }
+        struct vm_instr* test = &function->code[jump->c];
+        if (!vm_is_int_branch(test->op) || test->c != pc + 1) {
+            continue;
+        }
+        jump->op = vm_invert_int_branch(test->op);
+        jump->a = test->a;
+        jump->b = test->b;
+        jump->c = (test - function->code) + 1;
+        rotated++;
+    }
+    return rotated;
+}
+
+// Replaces the first instruction of every catalogued pair with its superinstruction, returns the number fused.
+// Pairs may overlap: each superinstruction reads the second instruction's operands, never its opcode.
+int vm_fuse_function(struct vm_function* function){
+    int fused = 0;
+    for (int pc = 0; pc + 1 < function->num_code; pc++) {
+        for (int k = 0; k < VM_NUM_SUPERINSTRUCTIONS; k++) {
+            if (function->code[pc].op == vm_superinstructions[k][1] && function->code[pc + 1].op == vm_superinstructions[k][2]) {
+                function->code[pc].op = vm_superinstructions[k][0];
+                fused++;
+                break;
+            }
+        }
+    }
+    return fused;
+}
+
+// Number of times a profiled instruction ran straight into the next one
+long long vm_pair_count(struct vm_function* function, int pc){
+    int op = function->code[pc].op;
+    if (op == VM_JMP || op == VM_TAILCALL || op == VM_RET || op == VM_HALT) {
+        return 0;
+    }
+    // A conditional jump falls through at most as often as either end of the pair runs
+    if (op >= VM_JZ_I && op <= VM_JNE_D) {
+        long long next = function->counts[pc + 1];
+        return (next < function->counts[pc]) ? next : function->counts[pc];
+    }
+    return function->counts[pc];
+}
+
+// Writes the opcode pairs that ran most often in a profiled run, marking those a superinstruction covers
+void vm_print_profile(struct vm_program* vm, FILE* report){
+    long long* pairs = calloc(VM_NUM_OPS * VM_NUM_OPS, sizeof(long long));
+    for (int f = 0; f < vm->num_functions; f++) {
+        struct vm_function* function = &vm->functions[f];
+        for (int pc = 0; pc + 1 < function->num_code; pc++) {
+            pairs[function->code[pc].op * VM_NUM_OPS + function->code[pc + 1].op] += vm_pair_count(function, pc);
+        }
+    }
+    fprintf(report, "Hottest opcode pairs:\n");
+    for (int rank = 0; rank < 16; rank++) {
+        int best = 0;
+        for (int p = 1; p < VM_NUM_OPS * VM_NUM_OPS; p++) {
+            if (pairs[p] > pairs[best]) {
+                best = p;
+            }
+        }
+        if (pairs[best] == 0) {
+            break;
+        }
+        int fused = 0;
+        for (int k = 0; k < VM_NUM_SUPERINSTRUCTIONS; k++) {
+            fused |= (vm_superinstructions[k][1] == best / VM_NUM_OPS && vm_superinstructions[k][2] == best % VM_NUM_OPS);
+        }
+        fprintf(report, "    %-8s %-8s %12lld%s\n", vm_op_names[best / VM_NUM_OPS], vm_op_names[best % VM_NUM_OPS],
+                pairs[best], fused ? "  (superinstruction)" : "");
+        pairs[best] = 0;
+    }
+    free(pairs);
+}
+
+/******************************** State ********************************/
+// Makes room for count more characters of output
+void vm_output_reserve(struct vm_output* output, int count){
+    if (output->length + count + 1 > output->capacity) {
+        while (output->length + count + 1 > output->capacity) {
+            output->capacity = (output->capacity == 0) ? 256 : output->capacity * 2;
+        }
+        output->buffer = realloc(output->buffer, output->capacity);
+    }
+}
+
+void vm_output_int(struct vm_output* output, int value){
+    if (output->file != NULL) {
+        fprintf(output->file, "%d\n", value);
+        return;
+    }
+    vm_output_reserve(output, 16);
+    output->length += snprintf(output->buffer + output->length, 16, "%d\n", value);
+}
+
+void vm_output_double(struct vm_output* output, double value){
+    if (output->file != NULL) {
+        fprintf(output->file, "%f\n", value);
+        return;
+    }
+    // %f of a large double runs long, measure it first
+    int length = snprintf(NULL, 0, "%f\n", value);
+    vm_output_reserve(output, length);
+    output->length += snprintf(output->buffer + output->length, length + 1, "%f\n", value);
+}
+
+// Creates the stacks for running programs, prints go to file or to the output buffer when file is NULL
+struct vm_state* vm_new_state(FILE* file){
+    struct vm_state* state = malloc(sizeof(struct vm_state));
+    state->stack = calloc(VM_STACK_SIZE, sizeof(union vm_value));
+    state->frames = malloc(sizeof(struct vm_frame) * VM_MAX_FRAMES);
+    state->args = malloc(sizeof(union vm_value) * VM_MAX_ARGS);
+    state->output.file = file;
+    state->output.buffer = NULL;
+    state->output.length = 0;
+    state->output.capacity = 0;
+    state->error = NULL;
+    state->error_function = NULL;
+    return state;
+}
+
+// Clears main's registers and the output before a run, the caller may then set main's variables
+void vm_reset_state(struct vm_state* state, struct vm_program* vm){
+    int num_regs = vm->functions[vm->main].num_regs;
+    for (int r = 0; r < num_regs && r < VM_STACK_SIZE; r++) {
+        state->stack[r].d = 0;
+    }
+    state->output.length = 0;
+    state->error = NULL;
+    state->error_function = NULL;
+}
+
+void vm_free_state(struct vm_state* state){
+    free(state->stack);
+    free(state->frames);
+    free(state->args);
+    free(state->output.buffer);
+    free(state);
+}
+
+/******************************** Execution ********************************/
+// Runs main to completion on the stacks of state, starting from the registers vm_reset_state left. Returns 0,
+// or 1 after a runtime error which is recorded in state. When profile is set every function counts how often
+// each of its instructions runs.
+int vm_execute(struct vm_program* vm, struct vm_state* state, struct vm_stats* stats, int profile){
+    union vm_value* stack = state->stack;
+    union vm_value* stack_end = stack + VM_STACK_SIZE;
+    struct vm_frame* frames = state->frames;
+    struct vm_frame* frames_end = frames + VM_MAX_FRAMES;
+    union vm_value* arg_stack = state->args;
+    union vm_value* arg_end = arg_stack + VM_MAX_ARGS;
+    struct vm_output* output = &state->output;
+
+    struct vm_function* main_function = &vm->functions[vm->main];
+    struct vm_frame* fp = frames;
+    fp->function = main_function;
+    fp->return_ip = NULL;
+    fp->regs = stack;
+    fp->dest = 0;
+    union vm_value* regs = stack;
+    union vm_value* args = arg_stack;
+    struct vm_instr* code = main_function->code;
+    struct vm_instr* ip = code;
+    struct vm_function* callee;
+    union vm_value* callee_regs;
+    union vm_value value;
+    int dest;
+    long long executed = 0;
+    long long calls = 0;
+    int status = 0;
+    const char* error = NULL;
+    char* error_function = NULL;
+
+    if (profile) {
+        for (int f = 0; f < vm->num_functions; f++) {
+            vm->functions[f].counts = calloc(vm->functions[f].num_code + 1, sizeof(long long));
+        }
+    }
+    if (main_function->num_regs > VM_STACK_SIZE) {
+        error = "stack overflow";
+        goto done;
+    }
+    for (int k = 0; k < main_function->num_constants; k++) {
+        regs[main_function->first_constant + k] = main_function->constants[k];
+    }
+    // Main counts as called once, so a JIT with a threshold of 1 runs the whole program as machine code
+    if (vm->tier_up != NULL && ++main_function->calls == vm->jit_threshold) {
+        vm->tier_up(vm, vm->main);
+    }
+    if (main_function->native != NULL) {
+        if (vm->call_native(vm, state, main_function, regs, VM_MAX_FRAMES, &value)) {
+            error = state->error;
+            error_function = state->error_function;
+        }
+        goto done;
+    }
+
+#if VM_COMPUTED_GOTO
+    static void* dispatch[VM_NUM_OPS] = {
+        [VM_MOV] = &&op_mov, [VM_I2D] = &&op_i2d, [VM_D2I] = &&op_d2i,
+        [VM_ADD_I] = &&op_add_i, [VM_SUB_I] = &&op_sub_i, [VM_MUL_I] = &&op_mul_i, [VM_DIV_I] = &&op_div_i, [VM_MOD_I] = &&op_mod_i,
+        [VM_ADD_D] = &&op_add_d, [VM_SUB_D] = &&op_sub_d, [VM_MUL_D] = &&op_mul_d, [VM_DIV_D] = &&op_div_d,
+        [VM_LT_I] = &&op_lt_i, [VM_GT_I] = &&op_gt_i, [VM_EQ_I] = &&op_eq_i, [VM_LE_I] = &&op_le_i, [VM_GE_I] = &&op_ge_i, [VM_NE_I] = &&op_ne_i,
+        [VM_LT_D] = &&op_lt_d, [VM_GT_D] = &&op_gt_d, [VM_EQ_D] = &&op_eq_d, [VM_LE_D] = &&op_le_d, [VM_GE_D] = &&op_ge_d, [VM_NE_D] = &&op_ne_d,
+        [VM_NOT_I] = &&op_not_i, [VM_OR_I] = &&op_or_i,
+        [VM_JMP] = &&op_jmp, [VM_JZ_I] = &&op_jz_i, [VM_JZ_D] = &&op_jz_d,
+        [VM_JLT_I] = &&op_jlt_i, [VM_JGT_I] = &&op_jgt_i, [VM_JEQ_I] = &&op_jeq_i, [VM_JLE_I] = &&op_jle_i, [VM_JGE_I] = &&op_jge_i, [VM_JNE_I] = &&op_jne_i,
+        [VM_JLT_D] = &&op_jlt_d, [VM_JGT_D] = &&op_jgt_d, [VM_JEQ_D] = &&op_jeq_d, [VM_JLE_D] = &&op_jle_d, [VM_JGE_D] = &&op_jge_d, [VM_JNE_D] = &&op_jne_d,
+        [VM_PRINT_I] = &&op_print_i, [VM_PRINT_D] = &&op_print_d, [VM_PUSH] = &&op_push,
+        [VM_CALL] = &&op_call, [VM_TAILCALL] = &&op_tailcall, [VM_RET] = &&op_ret, [VM_HALT] = &&op_halt,
+        [VM_MOV_MOV] = &&op_mov_mov, [VM_MOV_ADD_I] = &&op_mov_add_i, [VM_ADD_I_MOV] = &&op_add_i_mov,
+        [VM_SUB_I_MOV] = &&op_sub_i_mov, [VM_MUL_I_MOV] = &&op_mul_i_mov, [VM_MUL_I_MOD_I] = &&op_mul_i_mod_i,
+        [VM_MOD_I_ADD_I] = &&op_mod_i_add_i, [VM_SUB_I_PUSH] = &&op_sub_i_push, [VM_PUSH_CALL] = &&op_push_call,
+        [VM_ADD_I_RET] = &&op_add_i_ret, [VM_MOV_JMP] = &&op_mov_jmp, [VM_ADD_I_JMP] = &&op_add_i_jmp,
+        [VM_ADD_I_JLT_I] = &&op_add_i_jlt_i
+    };
+    // Profiling sends every dispatch through op_profile first
+    static void* profile_dispatch[VM_NUM_OPS] = {[0 ... VM_NUM_OPS - 1] = &&op_profile};
+    void** table = profile ? profile_dispatch : dispatch;
+#define VM_CASE(op, label) case op: label:
+#define VM_DISPATCH() do { executed++; goto *table[ip->op]; } while (0)
+#else
+#define VM_CASE(op, label) case op:
+#define VM_DISPATCH() do { executed++; goto dispatch_top; } while (0)
+#endif
+#define VM_NEXT() do { ip++; VM_DISPATCH(); } while (0)
+// Integer arithmetic wraps instead of overflowing
+#define VM_WRAP(x, op, y) ((int)((unsigned)(x) op (unsigned)(y)))
+
+    VM_DISPATCH();
+#if !VM_COMPUTED_GOTO
+dispatch_top:
+    if (profile) {
+        fp->function->counts[ip - code]++;
+    }
+#endif
+    switch (ip->op) {
+        VM_CASE(VM_MOV, op_mov)     regs[ip->a] = regs[ip->b]; VM_NEXT();
+        VM_CASE(VM_I2D, op_i2d)     regs[ip->a].d = (double)regs[ip->b].i; VM_NEXT();
+        VM_CASE(VM_D2I, op_d2i)     regs[ip->a].i = (int)regs[ip->b].d; VM_NEXT();
+
+        VM_CASE(VM_ADD_I, op_add_i) regs[ip->a].i = VM_WRAP(regs[ip->b].i, +, regs[ip->c].i); VM_NEXT();
+        VM_CASE(VM_SUB_I, op_sub_i) regs[ip->a].i = VM_WRAP(regs[ip->b].i, -, regs[ip->c].i); VM_NEXT();
+        VM_CASE(VM_MUL_I, op_mul_i) regs[ip->a].i = VM_WRAP(regs[ip->b].i, *, regs[ip->c].i); VM_NEXT();
+        VM_CASE(VM_DIV_I, op_div_i)
+            if (regs[ip->c].i == 0) {
+                error = "division by zero";
+                goto done;
+            }
+            // -1 is negation, which wraps for the smallest int
+            regs[ip->a].i = (regs[ip->c].i == -1) ? VM_WRAP(0, -, regs[ip->b].i) : regs[ip->b].i / regs[ip->c].i;
+            VM_NEXT();
+        VM_CASE(VM_MOD_I, op_mod_i)
+        do_mod:
+            if (regs[ip->c].i == 0) {
+                error = "modulo by zero";
+                goto done;
+            }
+            regs[ip->a].i = (regs[ip->c].i == -1) ? 0 : regs[ip->b].i % regs[ip->c].i;
+            VM_NEXT();
+
+        VM_CASE(VM_ADD_D, op_add_d) regs[ip->a].d = regs[ip->b].d + regs[ip->c].d; VM_NEXT();
+        VM_CASE(VM_SUB_D, op_sub_d) regs[ip->a].d = regs[ip->b].d - regs[ip->c].d; VM_NEXT();
+        VM_CASE(VM_MUL_D, op_mul_d) regs[ip->a].d = regs[ip->b].d * regs[ip->c].d; VM_NEXT();
+        VM_CASE(VM_DIV_D, op_div_d) regs[ip->a].d = regs[ip->b].d / regs[ip->c].d; VM_NEXT();
+
+        VM_CASE(VM_LT_I, op_lt_i)   regs[ip->a].i = regs[ip->b].i < regs[ip->c].i; VM_NEXT();
+        VM_CASE(VM_GT_I, op_gt_i)   regs[ip->a].i = regs[ip->b].i > regs[ip->c].i; VM_NEXT();
+        VM_CASE(VM_EQ_I, op_eq_i)   regs[ip->a].i = regs[ip->b].i == regs[ip->c].i; VM_NEXT();
+        VM_CASE(VM_LE_I, op_le_i)   regs[ip->a].i = regs[ip->b].i <= regs[ip->c].i; VM_NEXT();
+        VM_CASE(VM_GE_I, op_ge_i)   regs[ip->a].i = regs[ip->b].i >= regs[ip->c].i; VM_NEXT();
+        VM_CASE(VM_NE_I, op_ne_i)   regs[ip->a].i = regs[ip->b].i != regs[ip->c].i; VM_NEXT();
+        VM_CASE(VM_LT_D, op_lt_d)   regs[ip->a].i = regs[ip->b].d < regs[ip->c].d; VM_NEXT();
+        VM_CASE(VM_GT_D, op_gt_d)   regs[ip->a].i = regs[ip->b].d > regs[ip->c].d; VM_NEXT();
+        VM_CASE(VM_EQ_D, op_eq_d)   regs[ip->a].i = regs[ip->b].d == regs[ip->c].d; VM_NEXT();
+        VM_CASE(VM_LE_D, op_le_d)   regs[ip->a].i = regs[ip->b].d <= regs[ip->c].d; VM_NEXT();
+        VM_CASE(VM_GE_D, op_ge_d)   regs[ip->a].i = regs[ip->b].d >= regs[ip->c].d; VM_NEXT();
+        VM_CASE(VM_NE_D, op_ne_d)   regs[ip->a].i = regs[ip->b].d != regs[ip->c].d; VM_NEXT();
+        VM_CASE(VM_NOT_I, op_not_i) regs[ip->a].i = !regs[ip->b].i; VM_NEXT();
+        VM_CASE(VM_OR_I, op_or_i)   regs[ip->a].i = regs[ip->b].i || regs[ip->c].i; VM_NEXT();
+
+        VM_CASE(VM_JMP, op_jmp)     ip = code + ip->c; VM_DISPATCH();
+        VM_CASE(VM_JZ_I, op_jz_i)   ip = (regs[ip->b].i == 0) ? code + ip->c : ip + 1; VM_DISPATCH();
+        VM_CASE(VM_JZ_D, op_jz_d)   ip = (regs[ip->b].d == 0) ? code + ip->c : ip + 1; VM_DISPATCH();
+        VM_CASE(VM_JLT_I, op_jlt_i) ip = (regs[ip->a].i < regs[ip->b].i) ? code + ip->c : ip + 1; VM_DISPATCH();
+        VM_CASE(VM_JGT_I, op_jgt_i) ip = (regs[ip->a].i > regs[ip->b].i) ? code + ip->c : ip + 1; VM_DISPATCH();
+        VM_CASE(VM_JEQ_I, op_jeq_i) ip = (regs[ip->a].i == regs[ip->b].i) ? code + ip->c : ip + 1; VM_DISPATCH();
+        VM_CASE(VM_JLE_I, op_jle_i) ip = (regs[ip->a].i <= regs[ip->b].i) ? code + ip->c : ip + 1; VM_DISPATCH();
+        VM_CASE(VM_JGE_I, op_jge_i) ip = (regs[ip->a].i >= regs[ip->b].i) ? code + ip->c : ip + 1; VM_DISPATCH();
+        VM_CASE(VM_JNE_I, op_jne_i) ip = (regs[ip->a].i != regs[ip->b].i) ? code + ip->c : ip + 1; VM_DISPATCH();
+        VM_CASE(VM_JLT_D, op_jlt_d) ip = (regs[ip->a].d < regs[ip->b].d) ? code + ip->c : ip + 1; VM_DISPATCH();
+        VM_CASE(VM_JGT_D, op_jgt_d) ip = (regs[ip->a].d > regs[ip->b].d) ? code + ip->c : ip + 1; VM_DISPATCH();
+        VM_CASE(VM_JEQ_D, op_jeq_d) ip = (regs[ip->a].d == regs[ip->b].d) ? code + ip->c : ip + 1; VM_DISPATCH();
+        VM_CASE(VM_JLE_D, op_jle_d) ip = (regs[ip->a].d <= regs[ip->b].d) ? code + ip->c : ip + 1; VM_DISPATCH();
+        VM_CASE(VM_JGE_D, op_jge_d) ip = (regs[ip->a].d >= regs[ip->b].d) ? code + ip->c : ip + 1; VM_DISPATCH();
+        VM_CASE(VM_JNE_D, op_jne_d) ip = (regs[ip->a].d != regs[ip->b].d) ? code + ip->c : ip + 1; VM_DISPATCH();
+
+        VM_CASE(VM_PRINT_I, op_print_i) vm_output_int(output, regs[ip->a].i); VM_NEXT();
+        VM_CASE(VM_PRINT_D, op_print_d) vm_output_double(output, regs[ip->a].d); VM_NEXT();
+        VM_CASE(VM_PUSH, op_push)
+        do_push:
+            if (args == arg_end) {
+                error = "argument stack overflow";
+                goto done;
+            }
+            *args++ = regs[ip->a];
+            VM_NEXT();
+
+        VM_CASE(VM_CALL, op_call)
+        do_call:
+            callee = &vm->functions[ip->b];
+            callee_regs = regs + fp->function->num_regs;
+            if (vm->tier_up != NULL && ++callee->calls == vm->jit_threshold) {
+                vm->tier_up(vm, ip->b);
+            }
+            if (callee->native != NULL) {
+                args -= ip->c;
+                for (int p = 0; p < ip->c; p++) {
+                    callee_regs[p] = args[ip->c - 1 - p];
+                }
+                if (vm->call_native(vm, state, callee, callee_regs, frames_end - fp - 1, &value)) {
+                    error = state->error;
+                    error_function = state->error_function;
+                    goto done;
+                }
+                regs[ip->a] = value;
+                ip++;
+                calls++;
+                VM_DISPATCH();
+            }
+            if (fp + 1 == frames_end || callee_regs + callee->num_regs > stack_end) {
+                error = "stack overflow";
+                goto done;
+            }
+            args -= ip->c;
+            for (int p = 0; p < ip->c; p++) {
+                callee_regs[p] = args[ip->c - 1 - p];
+            }
+            for (int k = 0; k < callee->num_constants; k++) {
+                callee_regs[callee->first_constant + k] = callee->constants[k];
+            }
+            fp++;
+            fp->function = callee;
+            fp->return_ip = ip + 1;
+            fp->regs = callee_regs;
+            fp->dest = ip->a;
+            regs = callee_regs;
+            code = callee->code;
+            ip = code;
+            calls++;
+            VM_DISPATCH();
+        VM_CASE(VM_TAILCALL, op_tailcall)
+            callee = &vm->functions[ip->b];
+            if (vm->tier_up != NULL && ++callee->calls == vm->jit_threshold) {
+                vm->tier_up(vm, ip->b);
+            }
+            if (callee->native != NULL) {
+                // Compiled code runs in this frame and its result returns from it
+                args -= ip->c;
+                for (int p = 0; p < ip->c; p++) {
+                    regs[p] = args[ip->c - 1 - p];
+                }
+                calls++;
+                if (vm->call_native(vm, state, callee, regs, frames_end - fp - 1, &value)) {
+                    error = state->error;
+                    error_function = state->error_function;
+                    goto done;
+                }
+                goto return_value;
+            }
+            if (regs + callee->num_regs > stack_end) {
+                error = "stack overflow";
+                goto done;
+            }
+            args -= ip->c;
+            for (int p = 0; p < ip->c; p++) {
+                regs[p] = args[ip->c - 1 - p];
+            }
+            for (int k = 0; k < callee->num_constants; k++) {
+                regs[callee->first_constant + k] = callee->constants[k];
+            }
+            fp->function = callee;
+            code = callee->code;
+            ip = code;
+            calls++;
+            VM_DISPATCH();
+        VM_CASE(VM_RET, op_ret)
+        do_ret:
+            value = regs[ip->a];
+        return_value:
+            ip = fp->return_ip;
+            dest = fp->dest;
+            fp--;
+            regs = fp->regs;
+            code = fp->function->code;
+            regs[dest] = value;
+            VM_DISPATCH();
+        VM_CASE(VM_HALT, op_halt)
+            goto done;
+
+        // Superinstructions run their first half here, then the second half from ip[1] or its own handler
+        VM_CASE(VM_MOV_MOV, op_mov_mov)
+            regs[ip->a] = regs[ip->b];
+            regs[ip[1].a] = regs[ip[1].b];
+            ip += 2;
+            VM_DISPATCH();
+        VM_CASE(VM_MOV_ADD_I, op_mov_add_i)
+            regs[ip->a] = regs[ip->b];
+            regs[ip[1].a].i = VM_WRAP(regs[ip[1].b].i, +, regs[ip[1].c].i);
+            ip += 2;
+            VM_DISPATCH();
+        VM_CASE(VM_ADD_I_MOV, op_add_i_mov)
+            regs[ip->a].i = VM_WRAP(regs[ip->b].i, +, regs[ip->c].i);
+            regs[ip[1].a] = regs[ip[1].b];
+            ip += 2;
+            VM_DISPATCH();
+        VM_CASE(VM_SUB_I_MOV, op_sub_i_mov)
+            regs[ip->a].i = VM_WRAP(regs[ip->b].i, -, regs[ip->c].i);
+            regs[ip[1].a] = regs[ip[1].b];
+            ip += 2;
+            VM_DISPATCH();
+        VM_CASE(VM_MUL_I_MOV, op_mul_i_mov)
+            regs[ip->a].i = VM_WRAP(regs[ip->b].i, *, regs[ip->c].i);
+            regs[ip[1].a] = regs[ip[1].b];
+            ip += 2;
+            VM_DISPATCH();
+        VM_CASE(VM_MUL_I_MOD_I, op_mul_i_mod_i)
+            regs[ip->a].i = VM_WRAP(regs[ip->b].i, *, regs[ip->c].i);
+            ip++;
+            goto do_mod;
+        VM_CASE(VM_MOD_I_ADD_I, op_mod_i_add_i)
+            if (regs[ip->c].i == 0) {
+                error = "modulo by zero";
+                goto done;
+            }
+            regs[ip->a].i = (regs[ip->c].i == -1) ? 0 : regs[ip->b].i % regs[ip->c].i;
+            regs[ip[1].a].i = VM_WRAP(regs[ip[1].b].i, +, regs[ip[1].c].i);
+            ip += 2;
+            VM_DISPATCH();
+        VM_CASE(VM_SUB_I_PUSH, op_sub_i_push)
+            regs[ip->a].i = VM_WRAP(regs[ip->b].i, -, regs[ip->c].i);
+            ip++;
+            goto do_push;
+        VM_CASE(VM_PUSH_CALL, op_push_call)
+            if (args == arg_end) {
+                error = "argument stack overflow";
+                goto done;
+            }
+            *args++ = regs[ip->a];
+            ip++;
+            goto do_call;
+        VM_CASE(VM_ADD_I_RET, op_add_i_ret)
+            regs[ip->a].i = VM_WRAP(regs[ip->b].i, +, regs[ip->c].i);
+            ip++;
+            goto do_ret;
+        VM_CASE(VM_MOV_JMP, op_mov_jmp)
+            regs[ip->a] = regs[ip->b];
+            ip = code + ip[1].c;
+            VM_DISPATCH();
+        VM_CASE(VM_ADD_I_JMP, op_add_i_jmp)
+            regs[ip->a].i = VM_WRAP(regs[ip->b].i, +, regs[ip->c].i);
+            ip = code + ip[1].c;
+            VM_DISPATCH();
+        VM_CASE(VM_ADD_I_JLT_I, op_add_i_jlt_i)
+            regs[ip->a].i = VM_WRAP(regs[ip->b].i, +, regs[ip->c].i);
+            ip = (regs[ip[1].a].i < regs[ip[1].b].i) ? code + ip[1].c : ip + 2;
+            VM_DISPATCH();
+    }
+#if VM_COMPUTED_GOTO
+op_profile:
+    fp->function->counts[ip - code]++;
+    goto *dispatch[ip->op];
+#endif
+#undef VM_CASE
+#undef VM_DISPATCH
+#undef VM_NEXT
+#undef VM_WRAP
+
+done:
+    if (error != NULL) {
+        state->error = error;
+        state->error_function = (error_function != NULL) ? error_function : fp->function->name;
+        status = 1;
+    }
+    stats->instructions += executed;
+    stats->calls += calls;
+    return status;
+}
+
+/******************************** Execution Service ********************************/
+// The service runs many invocations of one compiled program at once. The program is lowered and fused once
+// into an image whose bytecode is then made read-only, and a fixed pool of worker threads runs invocations
+// against it, each worker with its own registers, frames and output buffer. Submitted jobs wait in a shared
+// queue until an idle worker moves its share of them onto its own deque. A worker runs jobs from the bottom
+// of its deque, and one with nothing left steals from the top of another's.
+#define VM_DEQUE_SIZE   1024         // Jobs a worker's deque holds, a power of 2
+
+// Bytecode shared by every worker. The program header, functions, code and constants sit in one mapping
+// that is read-only once loaded, so a stray write from a worker faults instead of racing
+struct vm_image{
+    struct vm_program* vm;           // Read-only program the workers run
+    struct vm_program lowered;       // Program as lowered, owns the names and variable lists
+    void* mapping;                   // Pages holding vm
+    size_t size;                     //
+    int code_size;                   // Instructions over all functions
+    int fused;                       // Superinstructions fused
+};
+
+// One invocation of main
+struct vm_job{
+    union vm_value* inputs;          // Value of each of the service's input registers
+    union vm_value* results;         // Final value of each of its result registers
+    struct vm_output output;         // Prints of the run
+    const char* error;               // Runtime error that ended the run, NULL if none
+    double submitted;                // vm_now() when submitted, started and finished
+    double started;                  //
+    double finished;                 //
+};
+
+struct vm_service;
+
+struct vm_worker{
+    struct vm_service* service;      //
+    int index;                       // Position in the service's workers
+    pthread_t thread;                //
+    struct deque deque;              // Jobs this worker took from the queue
+    struct vm_state* state;          // Registers, frames and output buffer of this worker only
+    struct vm_stats stats;           // Summed over its jobs
+    long long jobs;                  // Jobs run
+    long long stolen;                // Jobs taken from another worker's deque
+    double* latencies;               // Finish minus submit, then finish minus start, of each job run
+    long long capacity;              // Jobs latencies has room for
+    unsigned seed;                   // Picks steal victims
+};
+
+struct vm_service{
+    const struct vm_image* image;    //
+    int* inputs;                     // Registers of main each job's inputs set
+    int num_inputs;                  //
+    int* results;                    // Registers of main each job reads back
+    int num_results;                 //
+    int num_workers;                 //
+    struct vm_worker* workers;       //
+    pthread_mutex_t lock;            // Guards the queue and stopping
+    pthread_cond_t work;             // Signalled when jobs are queued or the service stops
+    pthread_cond_t idle;             // Signalled when the last outstanding job finishes
+    struct vm_job** queue;           // Ring of submitted jobs no worker has taken yet
+    long long queue_head;            //
+    long long queue_length;          //
+    long long queue_capacity;        //
+    atomic_llong outstanding;        // Jobs submitted but not finished
+    int stopping;                    // Workers exit once set
+};
+
+// Wall clock seconds, cheap enough to read around every job
+double vm_now(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// Lowers and fuses a program and copies it into read-only pages, returns NULL if it doesn't lower
+struct vm_image* vm_load_image(struct tac_program* program){
+    struct vm_image* image = malloc(sizeof(struct vm_image));
+    if (vm_lower_program(program, &image->lowered)) {
+        free_vm_program(&image->lowered);
+        free(image);
+        return NULL;
+    }
+    struct vm_program* lowered = &image->lowered;
+    image->code_size = 0;
+    image->fused = 0;
+    size_t size = sizeof(struct vm_program) + sizeof(struct vm_function) * lowered->num_functions;
+    for (int f = 0; f < lowered->num_functions; f++) {
+#ifndef VM_NO_SUPERINSTRUCTIONS
+        vm_rotate_loops(&lowered->functions[f]);
+        image->fused += vm_fuse_function(&lowered->functions[f]);
+#endif
+        image->code_size += lowered->functions[f].num_code;
+        size += sizeof(struct vm_instr) * lowered->functions[f].num_code;
+        size += sizeof(union vm_value) * lowered->functions[f].num_constants;
+    }
+
+    // Header, then functions, then each function's code and constants
+    image->size = size;
+    image->mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (image->mapping == MAP_FAILED) {
+        perror("Error mapping VM image");
+        free_vm_program(lowered);
+        free(image);
+        return NULL;
+    }
+    struct vm_program* vm = image->mapping;
+    struct vm_function* functions = (struct vm_function*)(vm + 1);
+    char* next = (char*)(functions + lowered->num_functions);
+    *vm = *lowered;
+    vm->functions = functions;
+    for (int f = 0; f < lowered->num_functions; f++) {
+        struct vm_function* function = &lowered->functions[f];
+        functions[f] = *function;
+        functions[f].counts = NULL;
+        functions[f].constants = (union vm_value*)next;
+        for (int k = 0; k < function->num_constants; k++) {
+            functions[f].constants[k] = function->constants[k];
+        }
+        next += sizeof(union vm_value) * function->num_constants;
+        functions[f].code = (struct vm_instr*)next;
+        for (int pc = 0; pc < function->num_code; pc++) {
+            functions[f].code[pc] = function->code[pc];
+        }
+        next += sizeof(struct vm_instr) * function->num_code;
+    }
+    if (mprotect(image->mapping, size, PROT_READ) != 0) {
+        perror("Error protecting VM image");
+    }
+    image->vm = vm;
+    return image;
+}
+
+void vm_free_image(struct vm_image* image){
+    if (image == NULL) {
+        return;
+    }
+    munmap(image->mapping, image->size);
+    free_vm_program(&image->lowered);
+    free(image);
+}
+
+// Moves an even share of the queue onto the worker's deque and returns one job of it, NULL if the queue is
+// empty
+struct vm_job* vm_service_take(struct vm_service* service, struct vm_worker* worker){
+    pthread_mutex_lock(&service->lock);
+    struct vm_job* job = NULL;
+    if (service->queue_length > 0) {
+        long long share = service->queue_length / service->num_workers;
+        share = (share < 1) ? 1 : (share > VM_DEQUE_SIZE / 2) ? VM_DEQUE_SIZE / 2 : share;
+        for (long long k = 0; k < share; k++) {
+            struct vm_job* next = service->queue[service->queue_head];
+            if (job != NULL && !deque_push(&worker->deque, next)) {
+                break;
+            }
+            job = (job == NULL) ? next : job;
+            service->queue_head = (service->queue_head + 1) % service->queue_capacity;
+            service->queue_length--;
+        }
+    }
+    pthread_mutex_unlock(&service->lock);
+    return job;
+}
+
+// Tries every other worker's deque once, starting at a random one
+struct vm_job* vm_service_steal(struct vm_service* service, struct vm_worker* worker){
+    int start = rand_r(&worker->seed) % service->num_workers;
+    for (int k = 0; k < service->num_workers; k++) {
+        int victim = (start + k) % service->num_workers;
+        if (victim == worker->index) {
+            continue;
+        }
+        struct vm_job* job = deque_steal(&service->workers[victim].deque);
+        if (job != NULL) {
+            return job;
+        }
+    }
+    return NULL;
+}
+
+// True(1) if some worker's deque holds a job
+int vm_service_stealable(struct vm_service* service){
+    for (int w = 0; w < service->num_workers; w++) {
+        if (deque_pending(&service->workers[w].deque)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void vm_worker_run(struct vm_worker* worker, struct vm_job* job){
+    struct vm_service* service = worker->service;
+    struct vm_program* vm = service->image->vm;
+    struct vm_state* state = worker->state;
+    job->started = vm_now();
+    vm_reset_state(state, vm);
+    for (int k = 0; k < service->num_inputs; k++) {
+        state->stack[service->inputs[k]] = job->inputs[k];
+    }
+    vm_execute(vm, state, &worker->stats, 0);
+    for (int k = 0; k < service->num_results; k++) {
+        job->results[k] = state->stack[service->results[k]];
+    }
+    // The job keeps the prints and the worker reuses the job's old buffer
+    struct vm_output prints = job->output;
+    job->output = state->output;
+    state->output = prints;
+    job->error = state->error;
+    job->finished = vm_now();
+
+    if (worker->jobs == worker->capacity) {
+        worker->capacity = (worker->capacity == 0) ? 1024 : worker->capacity * 2;
+        worker->latencies = realloc(worker->latencies, sizeof(double) * 2 * worker->capacity);
+    }
+    worker->latencies[2 * worker->jobs] = job->finished - job->submitted;
+    worker->latencies[2 * worker->jobs + 1] = job->finished - job->started;
+    worker->jobs++;
+    if (atomic_fetch_sub(&service->outstanding, 1) == 1) {
+        pthread_mutex_lock(&service->lock);
+        pthread_cond_broadcast(&service->idle);
+        pthread_mutex_unlock(&service->lock);
+    }
+}
+
+void* vm_worker_main(void* argument){
+    struct vm_worker* worker = argument;
+    struct vm_service* service = worker->service;
+    for (;;) {
+        struct vm_job* job = deque_pop(&worker->deque);
+        if (job == NULL) {
+            job = vm_service_take(service, worker);
+        }
+        if (job == NULL) {
+            job = vm_service_steal(service, worker);
+            worker->stolen += (job != NULL);
+        }
+        if (job != NULL) {
+            vm_worker_run(worker, job);
+            continue;
+        }
+
+        // Nothing anywhere: sleep until a submit or stop
+        pthread_mutex_lock(&service->lock);
+        while (service->queue_length == 0 && !service->stopping && !vm_service_stealable(service)) {
+            pthread_cond_wait(&service->work, &service->lock);
+        }
+        int stop = service->stopping && service->queue_length == 0;
+        pthread_mutex_unlock(&service->lock);
+        if (stop && !vm_service_stealable(service)) {
+            return NULL;
+        }
+        // Jobs are left only in other deques, let their owners run
+        sched_yield();
+    }
+}
+
+// Starts num_workers threads running image. Every job sets main's registers inputs to its inputs and reads
+// main's registers results back into its results
+struct vm_service* vm_new_service(const struct vm_image* image, int num_workers, int* inputs, int num_inputs, int* results, int num_results){
+    struct vm_service* service = malloc(sizeof(struct vm_service));
+    service->image = image;
+    service->inputs = inputs;
+    service->num_inputs = num_inputs;
+    service->results = results;
+    service->num_results = num_results;
+    service->num_workers = num_workers;
+    service->workers = malloc(sizeof(struct vm_worker) * num_workers);
+    pthread_mutex_init(&service->lock, NULL);
+    pthread_cond_init(&service->work, NULL);
+    pthread_cond_init(&service->idle, NULL);
+    service->queue_capacity = 1024;
+    service->queue = malloc(sizeof(struct vm_job*) * service->queue_capacity);
+    service->queue_head = 0;
+    service->queue_length = 0;
+    atomic_init(&service->outstanding, 0);
+    service->stopping = 0;
+    for (int w = 0; w < num_workers; w++) {
+        struct vm_worker* worker = &service->workers[w];
+        worker->service = service;
+        worker->index = w;
+        deque_init(&worker->deque, VM_DEQUE_SIZE);
+        worker->state = vm_new_state(NULL);
+        worker->stats = (struct vm_stats){0, 0, 0};
+        worker->jobs = 0;
+        worker->stolen = 0;
+        worker->latencies = NULL;
+        worker->capacity = 0;
+        worker->seed = w + 1;
+    }
+    for (int w = 0; w < num_workers; w++) {
+        pthread_create(&service->workers[w].thread, NULL, vm_worker_main, &service->workers[w]);
+    }
+    return service;
+}
+
+// Queues a job, safe to call while workers run earlier ones
+void vm_service_submit(struct vm_service* service, struct vm_job* job){
+    job->submitted = vm_now();
+    pthread_mutex_lock(&service->lock);
+    if (service->queue_length == service->queue_capacity) {
+        struct vm_job** queue = malloc(sizeof(struct vm_job*) * service->queue_capacity * 2);
+        for (long long k = 0; k < service->queue_length; k++) {
+            queue[k] = service->queue[(service->queue_head + k) % service->queue_capacity];
+        }
+        free(service->queue);
+        service->queue = queue;
+        service->queue_head = 0;
+        service->queue_capacity *= 2;
+    }
+    service->queue[(service->queue_head + service->queue_length) % service->queue_capacity] = job;
+    service->queue_length++;
+    atomic_fetch_add(&service->outstanding, 1);
+    pthread_cond_signal(&service->work);
+    pthread_mutex_unlock(&service->lock);
+}
+
+// Blocks until every submitted job has finished
+void vm_service_wait(struct vm_service* service){
+    pthread_mutex_lock(&service->lock);
+    while (atomic_load(&service->outstanding) > 0) {
+        pthread_cond_wait(&service->idle, &service->lock);
+    }
+    pthread_mutex_unlock(&service->lock);
+}
+
+// Orders seconds ascending, used with qsort
+int vm_compare_seconds(const void* a, const void* b){
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Writes each worker's share of the jobs and the p50 and p99 job latency, end to end and running only.
+// Call after vm_service_wait
+void vm_service_report(struct vm_service* service, FILE* report){
+    long long total = 0;
+    for (int w = 0; w < service->num_workers; w++) {
+        total += service->workers[w].jobs;
+    }
+    fprintf(report, "Workers: %d\n", service->num_workers);
+    for (int w = 0; w < service->num_workers; w++) {
+        struct vm_worker* worker = &service->workers[w];
+        fprintf(report, "Worker %d: %lld jobs, %lld stolen, %lld dispatches\n", w, worker->jobs, worker->stolen, worker->stats.instructions);
+    }
+    if (total == 0) {
+        return;
+    }
+    double* queued = malloc(sizeof(double) * total);
+    double* running = malloc(sizeof(double) * total);
+    long long count = 0;
+    for (int w = 0; w < service->num_workers; w++) {
+        for (long long j = 0; j < service->workers[w].jobs; j++) {
+            queued[count] = service->workers[w].latencies[2 * j];
+            running[count] = service->workers[w].latencies[2 * j + 1];
+            count++;
+        }
+    }
+    qsort(queued, total, sizeof(double), vm_compare_seconds);
+    qsort(running, total, sizeof(double), vm_compare_seconds);
+    fprintf(report, "Latency: p50 %.1f us, p99 %.1f us from submit\n", queued[total / 2] * 1e6, queued[(total - 1) * 99 / 100] * 1e6);
+    fprintf(report, "Latency: p50 %.1f us, p99 %.1f us running\n", running[total / 2] * 1e6, running[(total - 1) * 99 / 100] * 1e6);
+    free(queued);
+    free(running);
+}
+
+// Stops the workers once the queue drains and frees the service, the image stays loaded
+void vm_free_service(struct vm_service* service){
+    if (service == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&service->lock);
+    service->stopping = 1;
+    pthread_cond_broadcast(&service->work);
+    pthread_mutex_unlock(&service->lock);
+    for (int w = 0; w < service->num_workers; w++) {
+        pthread_join(service->workers[w].thread, NULL);
+        vm_free_state(service->workers[w].state);
+        deque_free(&service->workers[w].deque);
+        free(service->workers[w].latencies);
+    }
+    pthread_mutex_destroy(&service->lock);
+    pthread_cond_destroy(&service->work);
+    pthread_cond_destroy(&service->idle);
+    free(service->queue);
+    free(service->workers);
+    free(service);
+}
+
+/******************************** Batch Execution ********************************/
+// Batch mode runs main once per row of an input file, with the row setting some of main's variables. Rows run
+// VM_BATCH_LANES at a time in lockstep: every register holds one value per lane, and each step runs the
+// instruction at the lowest pc of any lane on the lanes sitting there. Lanes that split at a branch wait for
+// each other at the lowest pc, so they run together again where the paths meet. A lane that halts takes the
+// next input row while the rest keep going, and results are written in input order. Arithmetic uses GCC
+// vector types and blends its result into the lanes of the mask, built for AVX2 and for plain x86-64.
+// Programs whose main still calls functions run row by row on the scalar VM instead, as do all programs when
+// built with -DVM_BATCH_SCALAR.
+#define VM_BATCH_LANES  256
+#define VM_BATCH_IVECS  (VM_BATCH_LANES / 8)
+#define VM_BATCH_DVECS  (VM_BATCH_LANES / 4)
+#define VM_BATCH_LINE   4096         // Longest input line
+#define VM_BATCH_DONE   0x7fffffff   // pc of a lane that halted
+#define VM_BATCH_WINDOW 4096         // Rows submitted to the execution service before waiting for them
+
+typedef int vm_ivec __attribute__((vector_size(32)));           // 8 int lanes
+typedef unsigned vm_uvec __attribute__((vector_size(32)));      // 8 int lanes with wrapping arithmetic
+typedef int vm_hvec __attribute__((vector_size(16)));           // 4 int lanes, half of a vm_ivec
+typedef double vm_dvec __attribute__((vector_size(32)));        // 4 double lanes
+typedef long long vm_lvec __attribute__((vector_size(32)));     // Mask of 4 double lanes
+
+// The lockstep loop is cloned for AVX2 and picked at load time by an ifunc resolver, which runs before a
+// sanitizer's runtime is set up, so sanitized builds keep only the default clone
+#if defined(__x86_64__) && defined(__linux__) && !defined(__SANITIZE_THREAD__) && !defined(__SANITIZE_ADDRESS__)
+#define VM_BATCH_TARGETS __attribute__((target_clones("avx2", "default")))
+#else
+#define VM_BATCH_TARGETS
+#endif
+
+// Registers and lane state of one group of rows
+struct vm_batch{
+    int num_regs;                    // Registers of main
+    vm_ivec (*ints)[VM_BATCH_IVECS]; // Int value of each register in each lane
+    vm_dvec (*doubles)[VM_BATCH_DVECS]; // Double value of each register in each lane
+    vm_ivec pcs[VM_BATCH_IVECS];     // pc of each lane, VM_BATCH_DONE once halted
+    long long rows[VM_BATCH_LANES];  // Input row each lane runs, -1 if idle
+    vm_ivec mask_i[VM_BATCH_IVECS];  // Lanes the current instruction runs on (-1) or skips (0)
+    vm_lvec mask_l[VM_BATCH_DVECS];  // Same, one 64 bit mask per double lane
+    struct vm_output outputs[VM_BATCH_LANES]; // Prints of each lane
+    const char* errors[VM_BATCH_LANES]; // Runtime error that halted a lane, NULL if none
+};
+
+// True(1) if main can run in lockstep, calls need a frame stack per lane
+int vm_batch_lockstep(struct vm_function* main_function){
+#ifdef VM_BATCH_SCALAR
+    return 0;
+#endif
+    for (int pc = 0; pc < main_function->num_code; pc++) {
+        int op = main_function->code[pc].op;
+        if (op == VM_PUSH || op == VM_CALL || op == VM_TAILCALL || op == VM_RET) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+struct vm_batch* vm_new_batch(struct vm_function* main_function){
+    struct vm_batch* batch = aligned_alloc(32, sizeof(struct vm_batch));
+    batch->num_regs = main_function->num_regs;
+    batch->ints = aligned_alloc(32, sizeof(vm_ivec) * VM_BATCH_IVECS * (batch->num_regs + 1));
+    batch->doubles = aligned_alloc(32, sizeof(vm_dvec) * VM_BATCH_DVECS * (batch->num_regs + 1));
+    for (int r = 0; r < batch->num_regs; r++) {
+        for (int v = 0; v < VM_BATCH_IVECS; v++) {
+            batch->ints[r][v] = (vm_ivec){0};
+        }
+        for (int v = 0; v < VM_BATCH_DVECS; v++) {
+            batch->doubles[r][v] = (vm_dvec){0};
+        }
+    }
+    for (int k = 0; k < main_function->num_constants; k++) {
+        int r = main_function->first_constant + k;
+        for (int l = 0; l < VM_BATCH_LANES; l++) {
+            batch->ints[r][l / 8][l % 8] = main_function->constants[k].i;
+            batch->doubles[r][l / 4][l % 4] = main_function->constants[k].d;
+        }
+    }
+    for (int l = 0; l < VM_BATCH_LANES; l++) {
+        batch->pcs[l / 8][l % 8] = VM_BATCH_DONE;
+        batch->rows[l] = -1;
+        batch->outputs[l].file = NULL;
+        batch->outputs[l].buffer = NULL;
+        batch->outputs[l].length = 0;
+        batch->outputs[l].capacity = 0;
+        batch->errors[l] = NULL;
+    }
+    return batch;
+}
+
+void vm_free_batch(struct vm_batch* batch){
+    for (int l = 0; l < VM_BATCH_LANES; l++) {
+        free(batch->outputs[l].buffer);
+    }
+    free(batch->ints);
+    free(batch->doubles);
+    free(batch);
+}
+
+// Starts input row row on idle lane l: the lane's registers are cleared, constants aside, then the row's
+// values set
+void vm_batch_start(struct vm_batch* batch, struct vm_function* main_function, int l, long long row, union vm_value* values, int* columns, int num_columns){
+    for (int r = 0; r < main_function->first_constant; r++) {
+        batch->ints[r][l / 8][l % 8] = 0;
+        batch->doubles[r][l / 4][l % 4] = 0;
+    }
+    for (int k = 0; k < num_columns; k++) {
+        batch->ints[columns[k]][l / 8][l % 8] = values[k].i;
+        batch->doubles[columns[k]][l / 4][l % 4] = values[k].d;
+    }
+    batch->pcs[l / 8][l % 8] = 0;
+    batch->rows[l] = row;
+    batch->outputs[l].length = 0;
+    batch->errors[l] = NULL;
+}
+
+// Halts a lane after a runtime error
+void vm_batch_fail(struct vm_batch* batch, int l, const char* error){
+    batch->errors[l] = error;
+    batch->pcs[l / 8][l % 8] = VM_BATCH_DONE;
+    batch->mask_i[l / 8][l % 8] = 0;
+}
+
+// Low and high halves of 8 int lanes, and back. Macros rather than functions: passing vectors by value
+// would need an AVX calling convention in the default build
+#define VM_LOW(x) __builtin_shufflevector(x, x, 0, 1, 2, 3)
+#define VM_HIGH(x) __builtin_shufflevector(x, x, 4, 5, 6, 7)
+#define VM_JOIN(low, high) __builtin_shufflevector(low, high, 0, 1, 2, 3, 4, 5, 6, 7)
+
+// Runs main on the live lanes until stop of them have halted or all have, returns the number of steps taken
+VM_BATCH_TARGETS
+long long vm_batch_run(struct vm_function* main_function, struct vm_batch* batch, int stop){
+    vm_ivec (*I)[VM_BATCH_IVECS] = batch->ints;
+    vm_dvec (*D)[VM_BATCH_DVECS] = batch->doubles;
+    vm_ivec* pcs = batch->pcs;
+    vm_ivec* mask_i = batch->mask_i;
+    vm_lvec* mask_l = batch->mask_l;
+    const vm_ivec done = VM_BATCH_DONE - (vm_ivec){0};
+    long long steps = 0;
+    int halted = 0;
+
+    // The lanes at one pc run as a group, the rest wait at their own pcs. The group splits at a branch it
+    // doesn't take as one and ends when it reaches the pc of a lane waiting ahead. The next group is the
+    // lowest pc, so split lanes meet again where their paths do, except after a group loops back past lanes
+    // waiting ahead: then the highest pc runs, so lanes that left a loop reach the halt and refill
+    int grouped = 0;
+    int highest = 0;                 // Next group is the highest pc rather than the lowest
+    int full = 0;                    // Every lane is in the group, so results need no blending
+    int pc = 0;
+    int waiting = VM_BATCH_DONE;     // Lowest pc of a lane waiting ahead of the group
+
+// Blends an int or double result r into register a on the lanes of the mask
+#define VM_BLEND_I(a, r) I[a][v] = ((r) & mask_i[v]) | (I[a][v] & ~mask_i[v])
+#define VM_BLEND_D(a, r) D[a][v] = (vm_dvec)(((vm_lvec)(r) & mask_l[v]) | ((vm_lvec)D[a][v] & ~mask_l[v]))
+// With every lane in the mask (full) the result is stored without blending
+#define VM_INT_OP(expr) \
+    if (full) for (int v = 0; v < VM_BATCH_IVECS; v++) { vm_ivec x = I[in->b][v], y = I[in->c][v]; (void)y; I[in->a][v] = (expr); } \
+    else for (int v = 0; v < VM_BATCH_IVECS; v++) { vm_ivec x = I[in->b][v], y = I[in->c][v]; (void)y; VM_BLEND_I(in->a, (expr)); }
+#define VM_DOUBLE_OP(expr) \
+    if (full) for (int v = 0; v < VM_BATCH_DVECS; v++) { vm_dvec x = D[in->b][v], y = D[in->c][v]; (void)y; D[in->a][v] = (expr); } \
+    else for (int v = 0; v < VM_BATCH_DVECS; v++) { vm_dvec x = D[in->b][v], y = D[in->c][v]; (void)y; VM_BLEND_D(in->a, (expr)); }
+// Compares double registers x and y into 8 int lanes of -1 or 0 per vector of taken
+#define VM_COMPARE_D(x, y, cmp) for (int v = 0; v < VM_BATCH_IVECS; v++) { \
+        vm_hvec low = __builtin_convertvector(D[x][2 * v] cmp D[y][2 * v], vm_hvec); \
+        vm_hvec high = __builtin_convertvector(D[x][2 * v + 1] cmp D[y][2 * v + 1], vm_hvec); \
+        taken[v] = VM_JOIN(low, high); }
+#define VM_DOUBLE_CMP(cmp) VM_COMPARE_D(in->b, in->c, cmp); for (int v = 0; v < VM_BATCH_IVECS; v++) VM_BLEND_I(in->a, taken[v] & 1)
+#define VM_BRANCH_I(cmp) for (int v = 0; v < VM_BATCH_IVECS; v++) taken[v] = I[in->a][v] cmp I[in->b][v]
+#define VM_BRANCH_D(cmp) VM_COMPARE_D(in->a, in->b, cmp)
+
+    vm_ivec taken[VM_BATCH_IVECS];
+    for (;;) {
+        if (!grouped) {
+            // Group the lanes at the lowest or highest pc, and find the lowest pc waiting ahead of it
+            vm_ivec lowest = done;
+            vm_ivec most = -1 - (vm_ivec){0};
+            for (int v = 0; v < VM_BATCH_IVECS; v++) {
+                vm_ivec lower = pcs[v] < lowest;
+                vm_ivec higher = (pcs[v] > most) & (pcs[v] != done);
+                lowest = (pcs[v] & lower) | (lowest & ~lower);
+                most = (pcs[v] & higher) | (most & ~higher);
+            }
+            pc = VM_BATCH_DONE;
+            int high = -1;
+            for (int k = 0; k < 8; k++) {
+                pc = (lowest[k] < pc) ? lowest[k] : pc;
+                high = (most[k] > high) ? most[k] : high;
+            }
+            if (pc == VM_BATCH_DONE) {
+                break;
+            }
+            if (highest) {
+                pc = high;
+                highest = 0;
+            }
+            vm_ivec next = done;
+            vm_ivec all = -1 - (vm_ivec){0};
+            for (int v = 0; v < VM_BATCH_IVECS; v++) {
+                mask_i[v] = pcs[v] == pc;
+                mask_l[2 * v] = __builtin_convertvector(VM_LOW(mask_i[v]), vm_lvec);
+                mask_l[2 * v + 1] = __builtin_convertvector(VM_HIGH(mask_i[v]), vm_lvec);
+                all &= mask_i[v];
+                vm_ivec lower = (pcs[v] < next) & (pcs[v] > pc);
+                next = (pcs[v] & lower) | (next & ~lower);
+            }
+            full = 1;
+            waiting = VM_BATCH_DONE;
+            for (int k = 0; k < 8; k++) {
+                full &= (all[k] != 0);
+                waiting = (next[k] < waiting) ? next[k] : waiting;
+            }
+            grouped = 1;
+        }
+        struct vm_instr* in = &main_function->code[pc];
+        int is_branch = 0;
+        int failed = 0;
+        steps++;
+        switch (in->op) {
+            case VM_MOV:
+                if (in->c == 1) {
+                    VM_INT_OP(x);
+                }
+                else {
+                    VM_DOUBLE_OP(x);
+                }
+                break;
+            case VM_I2D:
+                for (int v = 0; v < VM_BATCH_DVECS; v++) {
+                    vm_ivec x = I[in->b][v / 2];
+                    VM_BLEND_D(in->a, __builtin_convertvector((v % 2) ? VM_HIGH(x) : VM_LOW(x), vm_dvec));
+                }
+                break;
+            case VM_D2I:
+                for (int v = 0; v < VM_BATCH_IVECS; v++) {
+                    vm_hvec low = __builtin_convertvector(D[in->b][2 * v], vm_hvec);
+                    vm_hvec high = __builtin_convertvector(D[in->b][2 * v + 1], vm_hvec);
+                    VM_BLEND_I(in->a, VM_JOIN(low, high));
+                }
+                break;
+            case VM_ADD_I: VM_INT_OP((vm_ivec)((vm_uvec)x + (vm_uvec)y)); break;
+            case VM_SUB_I: VM_INT_OP((vm_ivec)((vm_uvec)x - (vm_uvec)y)); break;
+            case VM_MUL_I: VM_INT_OP((vm_ivec)((vm_uvec)x * (vm_uvec)y)); break;
+            case VM_DIV_I:
+            case VM_MOD_I:
+                // A zero divisor halts only its own lane
+                for (int v = 0; v < VM_BATCH_IVECS; v++) {
+                    vm_ivec zero = (I[in->c][v] == 0) & mask_i[v];
+                    if (zero[0] | zero[1] | zero[2] | zero[3] | zero[4] | zero[5] | zero[6] | zero[7]) {
+                        for (int k = 0; k < 8; k++) {
+                            if (zero[k]) {
+                                vm_batch_fail(batch, v * 8 + k, (in->op == VM_DIV_I) ? "division by zero" : "modulo by zero");
+                                failed = 1;
+                                halted++;
+                            }
+                        }
+                    }
+                }
+                // No vector int division, but the double quotient of two ints truncates to the int one. Lanes
+                // dividing by 0 or -1 divide by 1 instead so the quotient stays in range, -1 is fixed after.
+                // A constant divisor is multiplied by its inverse instead, which can leave the quotient 1 off
+                {
+                    int constant = in->c - main_function->first_constant;
+                    int divisor = (constant >= 0 && constant < main_function->num_constants) ? main_function->constants[constant].i : 0;
+                    double inverse = (divisor > 1 || (divisor < -1 && divisor != -2147483647 - 1)) ? 1.0 / divisor : 0;
+                    for (int v = 0; v < VM_BATCH_IVECS; v++) {
+                        vm_ivec x = I[in->b][v];
+                        vm_ivec y = I[in->c][v];
+                        vm_ivec q;
+                        if (inverse != 0) {
+                            vm_dvec scale = inverse - (vm_dvec){0};
+                            vm_hvec low = __builtin_convertvector(__builtin_convertvector(VM_LOW(x), vm_dvec) * scale, vm_hvec);
+                            vm_hvec high = __builtin_convertvector(__builtin_convertvector(VM_HIGH(x), vm_dvec) * scale, vm_hvec);
+                            q = VM_JOIN(low, high);
+                            // Step q toward zero if the remainder's sign is wrong, away if it is as big as y
+                            vm_ivec step = ((x ^ y) >> 31) | 1;
+                            vm_ivec r = (vm_ivec)((vm_uvec)x - (vm_uvec)q * (vm_uvec)y);
+                            vm_ivec over = (r != 0) & ((r ^ x) < 0);
+                            q = q - (step & over);
+                            r = (vm_ivec)((vm_uvec)r + ((vm_uvec)(step * y) & (vm_uvec)over));
+                            vm_uvec size = (vm_uvec)((r ^ (r >> 31)) - (r >> 31));
+                            vm_ivec under = (vm_ivec)(size >= (unsigned)(divisor < 0 ? -divisor : divisor));
+                            q = q + (step & under);
+                        }
+                        else {
+                            vm_ivec unit = (y == 0) | (y == -1);
+                            y = (y & ~unit) | (1 & unit);
+                            vm_hvec low = __builtin_convertvector(__builtin_convertvector(VM_LOW(x), vm_dvec) / __builtin_convertvector(VM_LOW(y), vm_dvec), vm_hvec);
+                            vm_hvec high = __builtin_convertvector(__builtin_convertvector(VM_HIGH(x), vm_dvec) / __builtin_convertvector(VM_HIGH(y), vm_dvec), vm_hvec);
+                            q = VM_JOIN(low, high);
+                            vm_ivec negative = (I[in->c][v] == -1);
+                            q = ((vm_ivec)(0u - (vm_uvec)x) & negative) | (q & ~negative);
+                        }
+                        if (in->op == VM_DIV_I) {
+                            VM_BLEND_I(in->a, q);
+                        }
+                        else {
+                            VM_BLEND_I(in->a, (vm_ivec)((vm_uvec)x - (vm_uvec)q * (vm_uvec)I[in->c][v]));
+                        }
+                    }
+                }
+                break;
+            case VM_ADD_D: VM_DOUBLE_OP(x + y); break;
+            case VM_SUB_D: VM_DOUBLE_OP(x - y); break;
+            case VM_MUL_D: VM_DOUBLE_OP(x * y); break;
+            case VM_DIV_D: VM_DOUBLE_OP(x / y); break;
+            case VM_LT_I: VM_INT_OP((x < y) & 1); break;
+            case VM_GT_I: VM_INT_OP((x > y) & 1); break;
+            case VM_EQ_I: VM_INT_OP((x == y) & 1); break;
+            case VM_LE_I: VM_INT_OP((x <= y) & 1); break;
+            case VM_GE_I: VM_INT_OP((x >= y) & 1); break;
+            case VM_NE_I: VM_INT_OP((x != y) & 1); break;
+            case VM_LT_D: VM_DOUBLE_CMP(<); break;
+            case VM_GT_D: VM_DOUBLE_CMP(>); break;
+            case VM_EQ_D: VM_DOUBLE_CMP(==); break;
+            case VM_LE_D: VM_DOUBLE_CMP(<=); break;
+            case VM_GE_D: VM_DOUBLE_CMP(>=); break;
+            case VM_NE_D: VM_DOUBLE_CMP(!=); break;
+            case VM_NOT_I: VM_INT_OP((x == 0) & 1); break;
+            case VM_OR_I: VM_INT_OP(((x != 0) | (y != 0)) & 1); break;
+            case VM_JMP:
+                for (int v = 0; v < VM_BATCH_IVECS; v++) {
+                    taken[v] = -1 - (vm_ivec){0};
+                }
+                is_branch = 1;
+                break;
+            case VM_JZ_I:
+                for (int v = 0; v < VM_BATCH_IVECS; v++) {
+                    taken[v] = I[in->b][v] == 0;
+                }
+                is_branch = 1;
+                break;
+            case VM_JZ_D:
+                for (int v = 0; v < VM_BATCH_IVECS; v++) {
+                    vm_hvec low = __builtin_convertvector(D[in->b][2 * v] == 0, vm_hvec);
+                    vm_hvec high = __builtin_convertvector(D[in->b][2 * v + 1] == 0, vm_hvec);
+                    taken[v] = VM_JOIN(low, high);
+                }
+                is_branch = 1;
+                break;
+            case VM_JLT_I: VM_BRANCH_I(<); is_branch = 1; break;
+            case VM_JGT_I: VM_BRANCH_I(>); is_branch = 1; break;
+            case VM_JEQ_I: VM_BRANCH_I(==); is_branch = 1; break;
+            case VM_JLE_I: VM_BRANCH_I(<=); is_branch = 1; break;
+            case VM_JGE_I: VM_BRANCH_I(>=); is_branch = 1; break;
+            case VM_JNE_I: VM_BRANCH_I(!=); is_branch = 1; break;
+            case VM_JLT_D: VM_BRANCH_D(<); is_branch = 1; break;
+            case VM_JGT_D: VM_BRANCH_D(>); is_branch = 1; break;
+            case VM_JEQ_D: VM_BRANCH_D(==); is_branch = 1; break;
+            case VM_JLE_D: VM_BRANCH_D(<=); is_branch = 1; break;
+            case VM_JGE_D: VM_BRANCH_D(>=); is_branch = 1; break;
+            case VM_JNE_D: VM_BRANCH_D(!=); is_branch = 1; break;
+            case VM_PRINT_I:
+            case VM_PRINT_D:
+                for (int l = 0; l < VM_BATCH_LANES; l++) {
+                    if (!mask_i[l / 8][l % 8]) {
+                        continue;
+                    }
+                    if (in->op == VM_PRINT_I) {
+                        vm_output_int(&batch->outputs[l], I[in->a][l / 8][l % 8]);
+                    }
+                    else {
+                        vm_output_double(&batch->outputs[l], D[in->a][l / 4][l % 4]);
+                    }
+                }
+                break;
+            case VM_HALT:
+                {
+                    vm_ivec count = {0};
+                    for (int v = 0; v < VM_BATCH_IVECS; v++) {
+                        pcs[v] = (done & mask_i[v]) | (pcs[v] & ~mask_i[v]);
+                        count -= mask_i[v];
+                    }
+                    for (int k = 0; k < 8; k++) {
+                        halted += count[k];
+                    }
+                }
+                if (waiting == VM_BATCH_DONE || halted >= stop) {
+                    return steps;
+                }
+                grouped = 0;
+                continue;
+        }
+
+        // Move the group on, as one unless it splits at a branch
+        int target = pc + 1;
+        if (is_branch) {
+            vm_ivec any_taken = {0};
+            vm_ivec any_not = {0};
+            for (int v = 0; v < VM_BATCH_IVECS; v++) {
+                any_taken |= taken[v] & mask_i[v];
+                any_not |= ~taken[v] & mask_i[v];
+            }
+            int some_taken = 0;
+            int some_not = 0;
+            for (int k = 0; k < 8; k++) {
+                some_taken |= any_taken[k];
+                some_not |= any_not[k];
+            }
+            if (some_taken && some_not) {
+                for (int v = 0; v < VM_BATCH_IVECS; v++) {
+                    vm_ivec next = (in->c & taken[v]) | ((pc + 1) & ~taken[v]);
+                    pcs[v] = (next & mask_i[v]) | (pcs[v] & ~mask_i[v]);
+                }
+                grouped = 0;
+                continue;
+            }
+            target = some_taken ? in->c : pc + 1;
+        }
+
+        // Once the group catches up with a waiting lane, loops back past one, or loses a lane to a runtime
+        // error, lanes regroup
+        if (target >= waiting || (target <= pc && waiting != VM_BATCH_DONE) || failed) {
+            for (int v = 0; v < VM_BATCH_IVECS; v++) {
+                pcs[v] = (target & mask_i[v]) | (pcs[v] & ~mask_i[v]);
+            }
+            highest = (target <= pc && target < waiting);
+            grouped = 0;
+        }
+        pc = target;
+    }
+#undef VM_BLEND_I
+#undef VM_BLEND_D
+#undef VM_INT_OP
+#undef VM_DOUBLE_OP
+#undef VM_DOUBLE_CMP
+#undef VM_COMPARE_D
+#undef VM_BRANCH_I
+#undef VM_BRANCH_D
+    return steps;
+}
+
+// Writes the value a register holds as the given type
+void vm_batch_write_value(FILE* output, int type, int i, double d){
+    if (type == 1) {
+        fprintf(output, "%d ", i);
+    }
+    else {
+        fprintf(output, "%f ", d);
+    }
+}
+
+// Writes the prints of a run on one line after the variables, and its runtime error if it had one
+void vm_batch_write_prints(FILE* output, struct vm_output* prints, const char* error){
+    fprintf(output, "|");
+    int start = 0;
+    for (int k = 0; k < prints->length; k++) {
+        if (prints->buffer[k] == '\n') {
+            fprintf(output, " %.*s", k - start, prints->buffer + start);
+            start = k + 1;
+        }
+    }
+    if (error != NULL) {
+        fprintf(output, " ! %s", error);
+    }
+    fprintf(output, "\n");
+}
+
+// Reads the next non-empty line into values, one per column, returns 1 for a row, 0 at the end of the input
+// and -1 after writing an error for a malformed row
+int vm_batch_read_row(FILE* input, int num_columns, int* columns, struct vm_function* main_function, union vm_value* values, int* line_number){
+    char line[VM_BATCH_LINE];
+    while (fgets(line, VM_BATCH_LINE, input) != NULL) {
+        (*line_number)++;
+        char* cursor = line;
+        int count = 0;
+        for (;;) {
+            while (*cursor == ' ' || *cursor == '\t' || *cursor == '\r' || *cursor == '\n') {
+                cursor++;
+            }
+            if (*cursor == '\0') {
+                break;
+            }
+            char* end;
+            double value = strtod(cursor, &end);
+            if (end == cursor || count == num_columns) {
+                fprintf(stderr, "Batch input line %d: expected %d numbers\n", *line_number, num_columns);
+                return -1;
+            }
+            if (main_function->var_types[columns[count]] == 1) {
+                values[count].i = (int)strtol(cursor, &end, 10);
+            }
+            else {
+                values[count].d = value;
+            }
+            cursor = end;
+            count++;
+        }
+        if (count == 0) {
+            continue;
+        }
+        if (count != num_columns) {
+            fprintf(stderr, "Batch input line %d: expected %d numbers\n", *line_number, num_columns);
+            return -1;
+        }
+        return 1;
+    }
+    return 0;
+}
+
+// Input rows of a batch run, and where their results go
+struct vm_batch_rows{
+    FILE* input;                     // Rows to run, header already read
+    FILE* output;                    // Results, header already written
+    struct vm_function* main_function;
+    int* columns;                    // Variable each input column sets
+    int num_columns;                 //
+    int* shown;                      // Variables written for each row
+    int num_shown;                   //
+    int line_number;                 // Last input line read
+    long long count;                 // Rows run so far
+    int status;                      // 1 once a malformed row ended the input
+};
+
+// Result of a row that finished ahead of an earlier one, kept until it can be written in order
+struct vm_batch_result{
+    int done;                        // Row has finished
+    union vm_value* values;          // Final value of each shown variable
+    struct vm_output output;         // Its prints
+    const char* error;               // Runtime error that stopped it, NULL if none
+};
+
+// Writes one row's results
+void vm_batch_write_row(struct vm_batch_rows* rows, union vm_value* values, struct vm_output* prints, const char* error){
+    for (int s = 0; s < rows->num_shown; s++) {
+        vm_batch_write_value(rows->output, rows->main_function->var_types[rows->shown[s]], values[s].i, values[s].d);
+    }
+    vm_batch_write_prints(rows->output, prints, error);
+}
+
+// Runs every row on the scalar VM, one after another
+void vm_batch_scalar_rows(struct vm_batch_rows* rows, struct vm_program* vm, struct vm_stats* stats){
+    struct vm_state* state = vm_new_state(NULL);
+    union vm_value* values = malloc(sizeof(union vm_value) * (rows->num_columns + rows->num_shown + 1));
+    union vm_value* results = values + rows->num_columns;
+    int read;
+    while ((read = vm_batch_read_row(rows->input, rows->num_columns, rows->columns, rows->main_function, values, &rows->line_number)) == 1) {
+        vm_reset_state(state, vm);
+        for (int k = 0; k < rows->num_columns; k++) {
+            state->stack[rows->columns[k]] = values[k];
+        }
+        double run_start = vm_now();
+        vm_execute(vm, state, stats, 0);
+        stats->seconds += vm_now() - run_start;
+        for (int s = 0; s < rows->num_shown; s++) {
+            results[s] = state->stack[rows->shown[s]];
+        }
+        vm_batch_write_row(rows, results, &state->output, state->error);
+        rows->count++;
+    }
+    rows->status = (read < 0);
+    free(values);
+    vm_free_state(state);
+}
+
+// Runs the rows in lockstep. Lanes are topped up with new rows whenever a quarter of them have halted, so a
+// long running row holds up only its own lane; rows that finish early wait in pending to be written in order
+void vm_batch_lockstep_rows(struct vm_batch_rows* rows, struct vm_stats* stats){
+    struct vm_function* main_function = rows->main_function;
+    struct vm_batch* batch = vm_new_batch(main_function);
+    union vm_value* values = malloc(sizeof(union vm_value) * (rows->num_columns + 1));
+    struct vm_batch_result* pending = NULL;
+    long long num_pending = 0;       // Rows started but not yet written
+    long long capacity = 0;
+    int reading = 1;
+    for (;;) {
+        // Start a new row on every idle lane
+        for (int l = 0; l < VM_BATCH_LANES && reading; l++) {
+            if (batch->rows[l] >= 0) {
+                continue;
+            }
+            int read = vm_batch_read_row(rows->input, rows->num_columns, rows->columns, main_function, values, &rows->line_number);
+            if (read <= 0) {
+                rows->status = (read < 0);
+                reading = 0;
+                break;
+            }
+            if (num_pending == capacity) {
+                capacity = (capacity == 0) ? VM_BATCH_LANES * 2 : capacity * 2;
+                pending = realloc(pending, sizeof(struct vm_batch_result) * capacity);
+                for (long long k = num_pending; k < capacity; k++) {
+                    pending[k].values = malloc(sizeof(union vm_value) * (rows->num_shown + 1));
+                    pending[k].output.file = NULL;
+                    pending[k].output.buffer = NULL;
+                    pending[k].output.length = 0;
+                    pending[k].output.capacity = 0;
+                }
+            }
+            pending[num_pending].done = 0;
+            vm_batch_start(batch, main_function, l, rows->count + num_pending, values, rows->columns, rows->num_columns);
+            num_pending++;
+        }
+        if (num_pending == 0) {
+            break;
+        }
+
+        double run_start = vm_now();
+        stats->instructions += vm_batch_run(main_function, batch, reading ? VM_BATCH_LANES / 4 : VM_BATCH_LANES);
+        stats->seconds += vm_now() - run_start;
+
+        // Collect the lanes that halted, handing their print buffers to the pending result
+        for (int l = 0; l < VM_BATCH_LANES; l++) {
+            if (batch->rows[l] < 0 || batch->pcs[l / 8][l % 8] != VM_BATCH_DONE) {
+                continue;
+            }
+            struct vm_batch_result* result = &pending[batch->rows[l] - rows->count];
+            for (int s = 0; s < rows->num_shown; s++) {
+                if (main_function->var_types[rows->shown[s]] == 1) {
+                    result->values[s].i = batch->ints[rows->shown[s]][l / 8][l % 8];
+                }
+                else {
+                    result->values[s].d = batch->doubles[rows->shown[s]][l / 4][l % 4];
+                }
+            }
+            struct vm_output prints = result->output;
+            result->output = batch->outputs[l];
+            batch->outputs[l] = prints;
+            result->error = batch->errors[l];
+            result->done = 1;
+            batch->rows[l] = -1;
+        }
+
+        // Write the finished rows at the front, then move the rest up
+        long long finished = 0;
+        while (finished < num_pending && pending[finished].done) {
+            vm_batch_write_row(rows, pending[finished].values, &pending[finished].output, pending[finished].error);
+            finished++;
+        }
+        for (long long k = 0; k + finished < num_pending; k++) {
+            struct vm_batch_result moved = pending[k];
+            pending[k] = pending[k + finished];
+            pending[k + finished] = moved;
+        }
+        num_pending -= finished;
+        rows->count += finished;
+    }
+
+    for (long long k = 0; k < capacity; k++) {
+        free(pending[k].values);
+        free(pending[k].output.buffer);
+    }
+    free(pending);
+    free(values);
+    vm_free_batch(batch);
+}
+
+// Runs the rows as jobs on the execution service, submitting a window of rows at a time and writing their
+// results in order once all of them finish
+void vm_batch_service_rows(struct vm_batch_rows* rows, struct vm_service* service, struct vm_stats* stats){
+    int width = rows->num_columns + rows->num_shown;
+    struct vm_job* jobs = malloc(sizeof(struct vm_job) * VM_BATCH_WINDOW);
+    union vm_value* values = malloc(sizeof(union vm_value) * VM_BATCH_WINDOW * (width + 1));
+    for (int j = 0; j < VM_BATCH_WINDOW; j++) {
+        jobs[j].inputs = values + j * width;
+        jobs[j].results = values + j * width + rows->num_columns;
+        jobs[j].output.file = NULL;
+        jobs[j].output.buffer = NULL;
+        jobs[j].output.length = 0;
+        jobs[j].output.capacity = 0;
+    }
+    int reading = 1;
+    while (reading) {
+        int count = 0;
+        while (count < VM_BATCH_WINDOW) {
+            int read = vm_batch_read_row(rows->input, rows->num_columns, rows->columns, rows->main_function, jobs[count].inputs, &rows->line_number);
+            if (read <= 0) {
+                rows->status = (read < 0);
+                reading = 0;
+                break;
+            }
+            count++;
+        }
+        double start = vm_now();
+        for (int j = 0; j < count; j++) {
+            vm_service_submit(service, &jobs[j]);
+        }
+        vm_service_wait(service);
+        stats->seconds += vm_now() - start;
+        for (int j = 0; j < count; j++) {
+            vm_batch_write_row(rows, jobs[j].results, &jobs[j].output, jobs[j].error);
+        }
+        rows->count += count;
+    }
+    for (int w = 0; w < service->num_workers; w++) {
+        stats->instructions += service->workers[w].stats.instructions;
+    }
+    for (int j = 0; j < VM_BATCH_WINDOW; j++) {
+        free(jobs[j].output.buffer);
+    }
+    free(values);
+    free(jobs);
+}
+
+// Runs main once per input row. The first line of input names the variables of main the columns set, each
+// following line holds one row. output gets a line naming main's variables, then per row the variables' final
+// values, a | and whatever the row printed. With workers set the rows run as jobs on an execution service of
+// that many threads instead of in lockstep. Returns 0 on success.
+int vm_run_batch(struct tac_program* program, FILE* input, FILE* output, FILE* report, int workers){
+    struct vm_program vm;
+    if (vm_lower_program(program, &vm)) {
+        free_vm_program(&vm);
+        return 1;
+    }
+    struct vm_function* main_function = &vm.functions[vm.main];
+
+    // Header: which variable each column sets
+    char line[VM_BATCH_LINE];
+    int columns[VM_BATCH_LINE / 2];
+    int num_columns = 0;
+    int line_number = 1;
+    if (fgets(line, VM_BATCH_LINE, input) == NULL) {
+        fprintf(stderr, "Batch input is empty\n");
+        free_vm_program(&vm);
+        return 1;
+    }
+    char* cursor = line;
+    for (;;) {
+        while (*cursor == ' ' || *cursor == '\t' || *cursor == '\r' || *cursor == '\n') {
+            cursor++;
+        }
+        if (*cursor == '\0') {
+            break;
+        }
+        char* name = cursor;
+        while (*cursor != '\0' && *cursor != ' ' && *cursor != '\t' && *cursor != '\r' && *cursor != '\n') {
+            cursor++;
+        }
+        char end = *cursor;
+        *cursor = '\0';
+        int column = -1;
+        for (int v = 0; v < main_function->num_vars; v++) {
+            if (compare_strings(main_function->vars[v], name) == 0) {
+                column = v;
+            }
+        }
+        if (column < 0) {
+            fprintf(stderr, "Batch input column %s is not a variable main uses\n", name);
+            free_vm_program(&vm);
+            return 1;
+        }
+        columns[num_columns++] = column;
+        *cursor = end;
+    }
+
+    // Output header: main's source variables, compiler made names hold an _
+    int* shown = malloc(sizeof(int) * (main_function->num_vars + 1));
+    int num_shown = 0;
+    for (int v = 0; v < main_function->num_vars; v++) {
+        int made = 0;
+        for (char* c = main_function->vars[v]; *c != '\0'; c++) {
+            made |= (*c == '_');
+        }
+        if (!made) {
+            shown[num_shown++] = v;
+            fprintf(output, "%s ", main_function->vars[v]);
+        }
+    }
+    fprintf(output, "| print\n");
+
+    int lockstep = (workers == 0) && vm_batch_lockstep(main_function);
+    struct vm_image* image = (workers > 0) ? vm_load_image(program) : NULL;
+    struct vm_service* service = (image != NULL) ? vm_new_service(image, workers, columns, num_columns, shown, num_shown) : NULL;
+    struct vm_batch_rows rows = {input, output, main_function, columns, num_columns, shown, num_shown, line_number, 0, 0};
+    struct vm_stats stats = {0, 0, 0};
+    double start = vm_now();
+    if (service != NULL) {
+        vm_batch_service_rows(&rows, service, &stats);
+    }
+    else if (lockstep) {
+        vm_batch_lockstep_rows(&rows, &stats);
+    }
+    else {
+        vm_batch_scalar_rows(&rows, &vm, &stats);
+    }
+    double total = vm_now() - start;
+
+    if (service != NULL) {
+        fprintf(report, "Batch: execution service, %d workers sharing one read-only image of %d instructions\n", workers, image->code_size);
+    }
+    else if (lockstep) {
+        fprintf(report, "Batch: lockstep, %d lanes\n", VM_BATCH_LANES);
+    }
+    else {
+#ifdef VM_BATCH_SCALAR
+        fprintf(report, "Batch: scalar, one row at a time (built with VM_BATCH_SCALAR)\n");
+#else
+        fprintf(report, "Batch: scalar, one row at a time (main calls functions)\n");
+#endif
+    }
+    fprintf(report, "Instances: %lld\n", rows.count);
+    fprintf(report, "Executed: %lld dispatches\n", stats.instructions);
+    fprintf(report, "Time: %.6f s running, %.6f s with input and output\n", stats.seconds, total);
+    if (stats.seconds > 0) {
+        fprintf(report, "Throughput: %.0f instances per second running, %.0f with input and output\n", rows.count / stats.seconds, rows.count / total);
+    }
+    if (service != NULL) {
+        vm_service_report(service, report);
+    }
+    vm_free_service(service);
+    vm_free_image(image);
+
+    free(shown);
+    free_vm_program(&vm);
+    return rows.status;
+}
+
+/******************************** Driver ********************************/
+// Runs a lowered program with its prints on stdout, writing its dispatch count and speed to report, returns 0
+// on success. A profiled run leaves the bytecode unfused and reports its hottest opcode pairs instead.
+int vm_run_lowered(struct vm_program* vm, FILE* report, int profile){
+    struct vm_stats stats = {0, 0, 0};
+    int code_size = 0;
+    int fused = 0;
+    int rotated = 0;
+    for (int f = 0; f < vm->num_functions; f++) {
+        code_size += vm->functions[f].num_code;
+#ifndef VM_NO_SUPERINSTRUCTIONS
+        if (!profile) {
+            rotated += vm_rotate_loops(&vm->functions[f]);
+            fused += vm_fuse_function(&vm->functions[f]);
+        }
+#endif
+    }
+
+    struct vm_state* state = vm_new_state(stdout);
+    vm_reset_state(state, vm);
+    clock_t start = clock();
+    int status = vm_execute(vm, state, &stats, profile);
+    stats.seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+    fflush(stdout);
+    if (status != 0) {
+        fprintf(stderr, "Runtime error in %s: %s\n", state->error_function, state->error);
+    }
+    vm_free_state(state);
+
+    fprintf(report, "Dispatch: %s\n", VM_COMPUTED_GOTO ? "computed goto" : "switch");
+    fprintf(report, "Bytecode: %d instructions in %d functions\n", code_size, vm->num_functions);
+    fprintf(report, "Superinstructions: %d fused, %d loop tests rotated\n", fused, rotated);
+    fprintf(report, "Executed: %lld dispatches, %lld calls\n", stats.instructions, stats.calls);
+    fprintf(report, "Time: %.6f s\n", stats.seconds);
+    if (stats.seconds > 0) {
+        fprintf(report, "Speed: %.1f million dispatches per second\n", stats.instructions / stats.seconds / 1e6);
+    }
+    if (profile) {
+        vm_print_profile(vm, report);
+    }
+    return status;
+}
+
+// Lowers and runs a program
+int vm_run_program(struct tac_program* program, FILE* report, int profile){
+    struct vm_program vm;
+    if (vm_lower_program(program, &vm)) {
+        free_vm_program(&vm);
+        return 1;
+    }
+    int status = vm_run_lowered(&vm, report, profile);
+    free_vm_program(&vm);
+    return status;
+}
+
+#endif // VM_H
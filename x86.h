@@ -0,0 +1,935 @@
+#ifndef X86_H
+#define X86_H
+
+// Native backend: turns the VM lowering of every function into x86-64 GNU assembly for the System V ABI, which
+// the system C compiler then assembles and links into an executable. Starting from the lowering means both
+// backends share the same typed registers, conversions and constants, so they print the same output.
+
+/******************************** x86-64 Definitions ********************************/
+#define X86_INT_HOMES    5           // Callee saved registers holding int VM registers
+#define X86_DOUBLE_HOMES 8           // xmm8 to xmm15 hold double VM registers, saved around calls
+#define X86_INT_ARGS     6           // Int params passed in registers
+#define X86_DOUBLE_ARGS  8           // Double params passed in registers
+#define X86_MIXED        2           // Type of a register read as an int in one place and as a double in another
+#define X86_STACK_BUDGET (7 << 20)   // Bytes of stack calls may use before the program stops with stack overflow
+
+// Where an operand is
+#define X86_IN_REGISTER  0           //
+#define X86_IN_MEMORY    1           // Frame slot, stack param or double constant
+#define X86_IMMEDIATE    2           // Int constant
+
+// Error stubs a function jumps to
+#define X86_DIVISION     1           //
+#define X86_MODULO       2           //
+#define X86_OVERFLOW     4           //
+
+// Compiler driver used to assemble and link, the C library provides printf
+#ifndef X86_CC
+#define X86_CC "cc"
+#endif
+
+static const char* x86_int_homes[X86_INT_HOMES] = {"%ebx", "%r12d", "%r13d", "%r14d", "%r15d"};
+static const char* x86_saved_homes[X86_INT_HOMES] = {"%rbx", "%r12", "%r13", "%r14", "%r15"};
+static const char* x86_double_homes[X86_DOUBLE_HOMES] = {"%xmm8", "%xmm9", "%xmm10", "%xmm11", "%xmm12", "%xmm13", "%xmm14", "%xmm15"};
+static const char* x86_int_args[X86_INT_ARGS] = {"%edi", "%esi", "%edx", "%ecx", "%r8d", "%r9d"};
+static const char* x86_double_args[X86_DOUBLE_ARGS] = {"%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm4", "%xmm5", "%xmm6", "%xmm7"};
+
+// Condition codes of the int comparisons, in the order of TAC_LT to TAC_NE
+static const char* x86_int_conditions[6] = {"l", "g", "e", "le", "ge", "ne"};
+
+/******************************** Struct Definitions ********************************/
+// A VM register, scratch register or stack param as an instruction operand
+struct x86_operand{
+    int kind;                        // X86_IN_REGISTER, X86_IN_MEMORY or X86_IMMEDIATE
+    char text[48];                   // Operand as written in the assembly
+};
+
+// Argument pushed for a call that has not been emitted yet
+struct x86_pending{
+    int reg;                         // VM register pushed
+    int type;                        // Type of the param it fills
+    int saved;                       // True(1) once its value moved to its argument slot, the register was overwritten
+};
+
+// State used while emitting one function
+struct x86_emitter{
+    FILE* out;                       //
+    struct vm_program* vm;           //
+    int f;                           // Index of the function
+    struct vm_function* function;    //
+    int* types;                      // Type every instruction uses each register with, -1 if unused or X86_MIXED
+    int* homes;                      // Int or xmm home of each register, -1 to keep it in its frame slot
+    int* push_types;                 // Type of the param each PUSH fills
+    char* targets;                   // True(1) for every pc a jump lands on
+    int num_saved;                   // Callee saved registers the prologue pushes
+    int num_doubles;                 // xmm homes in use
+    int max_pending;                 // Most arguments waiting for their calls at once
+    int frame_size;                  // Bytes below the saved registers: frame slots, argument slots and padding
+    struct x86_pending* pending;     // Arguments waiting for their calls, innermost call last
+    int num_pending;                 //
+    int errors;                      // Error stubs the function jumps to
+};
+
+/******************************** Frame Layout ********************************/
+// Types of the registers an instruction of function names (a, b and c), -1 where it names none. A PUSH takes
+// the type of its param and is typed by the caller.
+void x86_operand_types(struct vm_program* vm, struct vm_function* function, struct vm_instr* instr, int types[3]){
+    types[0] = types[1] = types[2] = -1;
+    int op = instr->op;
+    if (op == VM_MOV) {
+        types[0] = types[1] = instr->c;
+    }
+    else if (op == VM_I2D || op == VM_D2I) {
+        types[0] = (op == VM_D2I);
+        types[1] = (op == VM_I2D);
+    }
+    else if ((op >= VM_ADD_I && op <= VM_MOD_I) || (op >= VM_LT_I && op <= VM_NE_I) || op == VM_OR_I) {
+        types[0] = types[1] = types[2] = 1;
+    }
+    else if (op >= VM_ADD_D && op <= VM_DIV_D) {
+        types[0] = types[1] = types[2] = 0;
+    }
+    else if (op >= VM_LT_D && op <= VM_NE_D) {
+        types[0] = 1;
+        types[1] = types[2] = 0;
+    }
+    else if (op == VM_NOT_I) {
+        types[0] = types[1] = 1;
+    }
+    else if (op == VM_JZ_I || op == VM_JZ_D) {
+        types[1] = (op == VM_JZ_I);
+    }
+    else if (op >= VM_JLT_I && op <= VM_JNE_D) {
+        types[0] = types[1] = (op <= VM_JNE_I);
+    }
+    else if (op == VM_PRINT_I || op == VM_PRINT_D) {
+        types[0] = (op == VM_PRINT_I);
+    }
+    else if (op == VM_CALL) {
+        types[0] = vm->functions[instr->b].return_type;
+    }
+    else if (op == VM_RET) {
+        types[0] = function->return_type;
+    }
+}
+
+// True(1) if the instruction writes register a
+int x86_writes(int op){
+    return (op <= VM_OR_I || op == VM_CALL);
+}
+
+void x86_merge_type(int* types, int r, int type){
+    if (types[r] == -1) {
+        types[r] = type;
+    }
+    else if (types[r] != type) {
+        types[r] = X86_MIXED;
+    }
+}
+
+// Types every register, matches PUSHes to their calls and places the most used registers in machine registers.
+// Uses count more inside loops, 8 times per level of nesting. Returns 0 on success or 1 after writing an error.
+int x86_plan_frame(struct x86_emitter* em){
+    struct vm_function* function = em->function;
+    int n = function->num_code;
+    int num_regs = function->num_regs;
+    em->types = malloc(sizeof(int) * (num_regs + 1));
+    em->homes = malloc(sizeof(int) * (num_regs + 1));
+    em->push_types = malloc(sizeof(int) * (n + 1));
+    em->targets = calloc(n + 1, 1);
+    for (int r = 0; r < num_regs; r++) {
+        em->types[r] = -1;
+        em->homes[r] = -1;
+    }
+    for (int p = 0; p < function->num_params; p++) {
+        x86_merge_type(em->types, p, function->param_types[p]);
+    }
+    for (int pc = 0; pc < n; pc++) {
+        if (function->code[pc].op >= VM_JMP && function->code[pc].op <= VM_JNE_D) {
+            em->targets[function->code[pc].c] = 1;
+        }
+    }
+
+    // PushParam follows a stack discipline in code order, the same one call_arguments relies on
+    int* stack = malloc(sizeof(int) * (n + 1));
+    int top = 0;
+    int error = 0;
+    em->max_pending = 0;
+    for (int pc = 0; pc < n && !error; pc++) {
+        struct vm_instr* instr = &function->code[pc];
+        em->push_types[pc] = -1;
+        if (top > 0 && (em->targets[pc] || (instr->op >= VM_JMP && instr->op <= VM_JNE_D))) {
+            fprintf(stderr, "x86 error: %s branches between a PushParam and its call\n", function->name);
+            error = 1;
+        }
+        else if (instr->op == VM_PUSH) {
+            stack[top++] = pc;
+            em->max_pending = (top > em->max_pending) ? top : em->max_pending;
+        }
+        else if (instr->op == VM_CALL || instr->op == VM_TAILCALL) {
+            struct vm_function* callee = &em->vm->functions[instr->b];
+            if (instr->c > top) {
+                fprintf(stderr, "x86 error: %s calls %s with too few arguments\n", function->name, callee->name);
+                error = 1;
+                break;
+            }
+            // The last PUSH fills the first param
+            for (int p = 0; p < instr->c; p++) {
+                em->push_types[stack[top - 1 - p]] = callee->param_types[p];
+            }
+            top -= instr->c;
+        }
+    }
+    free(stack);
+    if (error) {
+        return 1;
+    }
+
+    // Loop depth of every instruction, from the back edges around it
+    int* depth = calloc(n + 1, sizeof(int));
+    for (int pc = 0; pc < n; pc++) {
+        struct vm_instr* instr = &function->code[pc];
+        if (instr->op >= VM_JMP && instr->op <= VM_JNE_D && instr->c <= pc) {
+            for (int q = instr->c; q <= pc; q++) {
+                depth[q]++;
+            }
+        }
+    }
+    long long* weights = calloc(num_regs + 1, sizeof(long long));
+    for (int pc = 0; pc < n; pc++) {
+        struct vm_instr* instr = &function->code[pc];
+        int types[3];
+        x86_operand_types(em->vm, function, instr, types);
+        if (instr->op == VM_PUSH) {
+            types[0] = em->push_types[pc];
+        }
+        int regs[3] = {instr->a, instr->b, instr->c};
+        long long weight = 1LL << (3 * ((depth[pc] < 6) ? depth[pc] : 6));
+        for (int o = 0; o < 3; o++) {
+            if (types[o] >= 0) {
+                x86_merge_type(em->types, regs[o], types[o]);
+                weights[regs[o]] += weight;
+            }
+        }
+    }
+    free(depth);
+
+    // Heaviest registers first, constants stay immediates or literals
+    int num_ints = 0;
+    em->num_doubles = 0;
+    while (1) {
+        int best = -1;
+        for (int r = 0; r < function->first_constant; r++) {
+            int room = (em->types[r] == 1 && num_ints < X86_INT_HOMES) || (em->types[r] == 0 && em->num_doubles < X86_DOUBLE_HOMES);
+            if (room && em->homes[r] < 0 && weights[r] > 0 && (best < 0 || weights[r] > weights[best])) {
+                best = r;
+            }
+        }
+        if (best < 0) {
+            break;
+        }
+        em->homes[best] = (em->types[best] == 1) ? num_ints++ : em->num_doubles++;
+    }
+    free(weights);
+
+    // Every register below the constants gets a slot, xmm homes are stored there across calls
+    em->num_saved = num_ints;
+    em->frame_size = 8 * (function->first_constant + em->max_pending);
+    if ((8 * em->num_saved + em->frame_size) % 16 != 0) {
+        em->frame_size += 8;
+    }
+    return 0;
+}
+
+/******************************** Operands ********************************/
+struct x86_operand x86_fixed(const char* name){
+    struct x86_operand operand;
+    operand.kind = X86_IN_REGISTER;
+    snprintf(operand.text, sizeof(operand.text), "%s", name);
+    return operand;
+}
+
+struct x86_operand x86_memory(int offset){
+    struct x86_operand operand;
+    operand.kind = X86_IN_MEMORY;
+    snprintf(operand.text, sizeof(operand.text), "%d(%%rbp)", offset);
+    return operand;
+}
+
+// Frame slot of a register
+int x86_slot(struct x86_emitter* em, int r){
+    return -8 * (em->num_saved + r + 1);
+}
+
+// Slot holding the k-th pending argument once its register is overwritten
+int x86_argument_slot(struct x86_emitter* em, int k){
+    return -8 * (em->num_saved + em->function->first_constant + k + 1);
+}
+
+// Where a VM register is
+struct x86_operand x86_reg(struct x86_emitter* em, int r){
+    struct vm_function* function = em->function;
+    struct x86_operand operand;
+    if (r >= function->first_constant) {
+        int k = r - function->first_constant;
+        if (em->types[r] == 0) {
+            operand.kind = X86_IN_MEMORY;
+            snprintf(operand.text, sizeof(operand.text), ".LC%d_%d(%%rip)", em->f, k);
+        }
+        else {
+            operand.kind = X86_IMMEDIATE;
+            snprintf(operand.text, sizeof(operand.text), "$%d", function->constants[k].i);
+        }
+        return operand;
+    }
+    if (em->homes[r] >= 0) {
+        return x86_fixed((em->types[r] == 1) ? x86_int_homes[em->homes[r]] : x86_double_homes[em->homes[r]]);
+    }
+    return x86_memory(x86_slot(em, r));
+}
+
+// Scratch register of a type
+struct x86_operand x86_scratch(int type){
+    return x86_fixed((type == 1) ? "%eax" : "%xmm0");
+}
+
+int x86_same(struct x86_operand a, struct x86_operand b){
+    return compare_strings(a.text, b.text) == 0;
+}
+
+// Copies a value of a type, through the scratch register when both ends are in memory
+void x86_move(struct x86_emitter* em, int type, struct x86_operand from, struct x86_operand to){
+    const char* move = (type == 1) ? "movl" : "movsd";
+    if (x86_same(from, to)) {
+        return;
+    }
+    if (from.kind != X86_IN_REGISTER && to.kind == X86_IN_MEMORY && !(type == 1 && from.kind == X86_IMMEDIATE)) {
+        struct x86_operand scratch = x86_scratch(type);
+        fprintf(em->out, "    %s %s, %s\n", move, from.text, scratch.text);
+        from = scratch;
+    }
+    // Zeroing a register is shorter than moving 0 into it
+    if (type == 1 && from.kind == X86_IMMEDIATE && compare_strings(from.text, "$0") == 0 && to.kind == X86_IN_REGISTER) {
+        fprintf(em->out, "    xorl %s, %s\n", to.text, to.text);
+        return;
+    }
+    fprintf(em->out, "    %s %s, %s\n", move, from.text, to.text);
+}
+
+// Register to compute a result of a into: its home when other is not in that home too, else the scratch
+struct x86_operand x86_result(struct x86_emitter* em, int type, int a, struct x86_operand other){
+    struct x86_operand dest = x86_reg(em, a);
+    if (dest.kind == X86_IN_REGISTER && !x86_same(dest, other)) {
+        return dest;
+    }
+    return x86_scratch(type);
+}
+
+// Operand a two operand instruction can write or compare against: x itself if it is a register, else the
+// scratch register after loading x into it
+struct x86_operand x86_in_register(struct x86_emitter* em, int type, int x){
+    struct x86_operand operand = x86_reg(em, x);
+    if (operand.kind == X86_IN_REGISTER) {
+        return operand;
+    }
+    struct x86_operand scratch = x86_scratch(type);
+    x86_move(em, type, operand, scratch);
+    return scratch;
+}
+
+/******************************** Calls ********************************/
+// Stores pending arguments that were pushed from register r before r is overwritten
+void x86_before_write(struct x86_emitter* em, int r){
+    for (int k = 0; k < em->num_pending; k++) {
+        struct x86_pending* pending = &em->pending[k];
+        if (pending->reg == r && !pending->saved) {
+            x86_move(em, pending->type, x86_reg(em, r), x86_memory(x86_argument_slot(em, k)));
+            pending->saved = 1;
+        }
+    }
+}
+
+// Value of the k-th pending argument
+struct x86_operand x86_argument(struct x86_emitter* em, int k){
+    struct x86_pending* pending = &em->pending[k];
+    return pending->saved ? x86_memory(x86_argument_slot(em, k)) : x86_reg(em, pending->reg);
+}
+
+// xmm homes are caller saved, calls keep them in their frame slots
+void x86_save_doubles(struct x86_emitter* em, int store){
+    for (int r = 0; r < em->function->first_constant; r++) {
+        if (em->types[r] == 0 && em->homes[r] >= 0) {
+            if (store) {
+                fprintf(em->out, "    movsd %s, %d(%%rbp)\n", x86_double_homes[em->homes[r]], x86_slot(em, r));
+            }
+            else {
+                fprintf(em->out, "    movsd %d(%%rbp), %s\n", x86_slot(em, r), x86_double_homes[em->homes[r]]);
+            }
+        }
+    }
+}
+
+// Params of a callee past the argument registers, which go on the stack
+int x86_stack_params(struct vm_function* callee){
+    int ints = 0;
+    int doubles = 0;
+    int stacked = 0;
+    for (int p = 0; p < callee->num_params; p++) {
+        if (callee->param_types[p] == 1) {
+            stacked += (ints++ >= X86_INT_ARGS);
+        }
+        else {
+            stacked += (doubles++ >= X86_DOUBLE_ARGS);
+        }
+    }
+    return stacked;
+}
+
+// Moves the arguments of the innermost call into the System V argument registers and onto the stack, the last
+// pending argument fills the first param. Returns the bytes pushed.
+int x86_pass_arguments(struct x86_emitter* em, struct vm_function* callee){
+    int first = em->num_pending - callee->num_params;
+    int stacked = x86_stack_params(callee);
+    int bytes = 8 * (stacked + (stacked % 2));
+    if (stacked % 2) {
+        fprintf(em->out, "    subq $8, %%rsp\n");
+    }
+    // Stack params go right to left so the first lands lowest
+    int ints = 0;
+    int doubles = 0;
+    int* places = malloc(sizeof(int) * (callee->num_params + 1));
+    for (int p = 0; p < callee->num_params; p++) {
+        places[p] = (callee->param_types[p] == 1) ? ((ints < X86_INT_ARGS) ? ints : -1) : ((doubles < X86_DOUBLE_ARGS) ? doubles : -1);
+        (callee->param_types[p] == 1) ? ints++ : doubles++;
+    }
+    for (int p = callee->num_params - 1; p >= 0; p--) {
+        if (places[p] >= 0) {
+            continue;
+        }
+        struct x86_operand value = x86_argument(em, first + callee->num_params - 1 - p);
+        if (callee->param_types[p] == 1) {
+            x86_move(em, 1, value, x86_fixed("%eax"));
+            fprintf(em->out, "    pushq %%rax\n");
+        }
+        else {
+            x86_move(em, 0, value, x86_fixed("%xmm0"));
+            fprintf(em->out, "    subq $8, %%rsp\n");
+            fprintf(em->out, "    movsd %%xmm0, (%%rsp)\n");
+        }
+    }
+    for (int p = 0; p < callee->num_params; p++) {
+        if (places[p] >= 0) {
+            struct x86_operand value = x86_argument(em, first + callee->num_params - 1 - p);
+            if (callee->param_types[p] == 1) {
+                x86_move(em, 1, value, x86_fixed(x86_int_args[places[p]]));
+            }
+            else {
+                x86_move(em, 0, value, x86_fixed(x86_double_args[places[p]]));
+            }
+        }
+    }
+    free(places);
+    em->num_pending = first;
+    return bytes;
+}
+
+// Symbol of a function, prefixed so programs can name functions like the C library does
+void x86_symbol(struct vm_program* vm, int f, char* text, int size){
+    if (f == vm->main) {
+        snprintf(text, size, "main");
+    }
+    else {
+        snprintf(text, size, "cp_%s", vm->functions[f].name);
+    }
+}
+
+// Pops the frame, leaving the stack as the caller left it
+void x86_leave(struct x86_emitter* em){
+    if (em->num_saved > 0) {
+        fprintf(em->out, "    leaq %d(%%rbp), %%rsp\n", -8 * em->num_saved);
+    }
+    else {
+        fprintf(em->out, "    movq %%rbp, %%rsp\n");
+    }
+    for (int s = em->num_saved - 1; s >= 0; s--) {
+        fprintf(em->out, "    popq %s\n", x86_saved_homes[s]);
+    }
+    fprintf(em->out, "    popq %%rbp\n");
+}
+
+/******************************** Code Generation ********************************/
+void x86_int_binary(struct x86_emitter* em, const char* mnemonic, struct vm_instr* instr){
+    struct x86_operand c = x86_reg(em, instr->c);
+    struct x86_operand dest = x86_result(em, 1, instr->a, c);
+    x86_move(em, 1, x86_reg(em, instr->b), dest);
+    fprintf(em->out, "    %s %s, %s\n", mnemonic, c.text, dest.text);
+    x86_move(em, 1, dest, x86_reg(em, instr->a));
+}
+
+void x86_double_binary(struct x86_emitter* em, const char* mnemonic, struct vm_instr* instr){
+    struct x86_operand c = x86_reg(em, instr->c);
+    struct x86_operand dest = x86_result(em, 0, instr->a, c);
+    x86_move(em, 0, x86_reg(em, instr->b), dest);
+    fprintf(em->out, "    %s %s, %s\n", mnemonic, c.text, dest.text);
+    x86_move(em, 0, dest, x86_reg(em, instr->a));
+}
+
+// Integer / and %: zero stops the program, -1 negates or gives 0 so the smallest int wraps like on the VM
+void x86_divide(struct x86_emitter* em, struct vm_instr* instr){
+    int modulo = (instr->op == VM_MOD_I);
+    struct x86_operand divisor = x86_reg(em, instr->c);
+    const char* result = modulo ? "%edx" : "%eax";
+    em->errors |= modulo ? X86_MODULO : X86_DIVISION;
+    if (divisor.kind == X86_IMMEDIATE && compare_strings(divisor.text, "$0") != 0 && compare_strings(divisor.text, "$-1") != 0) {
+        x86_move(em, 1, x86_reg(em, instr->b), x86_fixed("%eax"));
+        fprintf(em->out, "    movl %s, %%ecx\n", divisor.text);
+        fprintf(em->out, "    cltd\n");
+        fprintf(em->out, "    idivl %%ecx\n");
+    }
+    else {
+        fprintf(em->out, "    movl %s, %%ecx\n", divisor.text);
+        fprintf(em->out, "    testl %%ecx, %%ecx\n");
+        fprintf(em->out, "    je .L%d_%s\n", em->f, modulo ? "modulo" : "division");
+        x86_move(em, 1, x86_reg(em, instr->b), x86_fixed("%eax"));
+        fprintf(em->out, "    cmpl $-1, %%ecx\n");
+        fprintf(em->out, "    jne 1f\n");
+        if (modulo) {
+            fprintf(em->out, "    xorl %%edx, %%edx\n");
+        }
+        else {
+            fprintf(em->out, "    negl %%eax\n");
+        }
+        fprintf(em->out, "    jmp 2f\n");
+        fprintf(em->out, "1:\n");
+        fprintf(em->out, "    cltd\n");
+        fprintf(em->out, "    idivl %%ecx\n");
+        fprintf(em->out, "2:\n");
+    }
+    x86_move(em, 1, x86_fixed(result), x86_reg(em, instr->a));
+}
+
+// Sets the flags for x against y, as cmpl for ints and ucomisd for doubles
+void x86_compare(struct x86_emitter* em, int type, int x, int y){
+    struct x86_operand left = x86_in_register(em, type, x);
+    fprintf(em->out, "    %s %s, %s\n", (type == 1) ? "cmpl" : "ucomisd", x86_reg(em, y).text, left.text);
+}
+
+// Writes the truth of the flags into a. Double relop follows TAC_LT to TAC_NE: < and <= compare the operands
+// the other way round, since only the above conditions are false on NaN.
+void x86_set(struct x86_emitter* em, int relop, int type, int a){
+    if (type == 1) {
+        fprintf(em->out, "    set%s %%al\n", x86_int_conditions[relop - TAC_LT]);
+    }
+    else if (relop == TAC_EQ) {
+        fprintf(em->out, "    sete %%al\n");
+        fprintf(em->out, "    setnp %%cl\n");
+        fprintf(em->out, "    andb %%cl, %%al\n");
+    }
+    else if (relop == TAC_NE) {
+        fprintf(em->out, "    setne %%al\n");
+        fprintf(em->out, "    setp %%cl\n");
+        fprintf(em->out, "    orb %%cl, %%al\n");
+    }
+    else {
+        fprintf(em->out, "    set%s %%al\n", (relop == TAC_LT || relop == TAC_GT) ? "a" : "ae");
+    }
+    struct x86_operand dest = x86_reg(em, a);
+    if (dest.kind == X86_IN_REGISTER) {
+        fprintf(em->out, "    movzbl %%al, %s\n", dest.text);
+    }
+    else {
+        fprintf(em->out, "    movzbl %%al, %%eax\n");
+        x86_move(em, 1, x86_fixed("%eax"), dest);
+    }
+}
+
+// Compares b with c, or c with b for double < and <=
+void x86_compare_relop(struct x86_emitter* em, int relop, int type, int b, int c){
+    if (type == 0 && (relop == TAC_LT || relop == TAC_LE)) {
+        x86_compare(em, 0, c, b);
+    }
+    else {
+        x86_compare(em, type, b, c);
+    }
+}
+
+// Jumps to target when the flags hold relop
+void x86_jump(struct x86_emitter* em, int relop, int type, int target){
+    if (type == 1) {
+        fprintf(em->out, "    j%s .L%d_%d\n", x86_int_conditions[relop - TAC_LT], em->f, target);
+    }
+    else if (relop == TAC_EQ) {
+        fprintf(em->out, "    jp 1f\n");
+        fprintf(em->out, "    je .L%d_%d\n", em->f, target);
+        fprintf(em->out, "1:\n");
+    }
+    else if (relop == TAC_NE) {
+        fprintf(em->out, "    jp .L%d_%d\n", em->f, target);
+        fprintf(em->out, "    jne .L%d_%d\n", em->f, target);
+    }
+    else {
+        fprintf(em->out, "    j%s .L%d_%d\n", (relop == TAC_LT || relop == TAC_GT) ? "a" : "ae", em->f, target);
+    }
+}
+
+// Prints through printf in the formats of the VM
+void x86_print(struct x86_emitter* em, int type, int a){
+    x86_save_doubles(em, 1);
+    if (type == 1) {
+        x86_move(em, 1, x86_reg(em, a), x86_fixed("%esi"));
+        fprintf(em->out, "    leaq .Lprint_int(%%rip), %%rdi\n");
+        fprintf(em->out, "    xorl %%eax, %%eax\n");
+    }
+    else {
+        x86_move(em, 0, x86_reg(em, a), x86_fixed("%xmm0"));
+        fprintf(em->out, "    leaq .Lprint_double(%%rip), %%rdi\n");
+        fprintf(em->out, "    movl $1, %%eax\n");
+    }
+    fprintf(em->out, "    call printf@PLT\n");
+    x86_save_doubles(em, 0);
+}
+
+// Calls callee with the innermost pending arguments, leaving its result in %eax or %xmm0
+void x86_call(struct x86_emitter* em, int callee){
+    char symbol[160];
+    x86_symbol(em->vm, callee, symbol, sizeof(symbol));
+    x86_save_doubles(em, 1);
+    int bytes = x86_pass_arguments(em, &em->vm->functions[callee]);
+    fprintf(em->out, "    call %s\n", symbol);
+    if (bytes > 0) {
+        fprintf(em->out, "    addq $%d, %%rsp\n", bytes);
+    }
+    x86_save_doubles(em, 0);
+}
+
+void x86_prologue(struct x86_emitter* em){
+    struct vm_function* function = em->function;
+    fprintf(em->out, "    pushq %%rbp\n");
+    fprintf(em->out, "    movq %%rsp, %%rbp\n");
+    for (int s = 0; s < em->num_saved; s++) {
+        fprintf(em->out, "    pushq %s\n", x86_saved_homes[s]);
+    }
+    if (em->frame_size > 0) {
+        fprintf(em->out, "    subq $%d, %%rsp\n", em->frame_size);
+    }
+    if (em->f == em->vm->main) {
+        // Main starts from zeroed variables like on the VM, and sets the depth calls may reach
+        fprintf(em->out, "    leaq -%d(%%rsp), %%rax\n", X86_STACK_BUDGET);
+        fprintf(em->out, "    movq %%rax, .Lstack_limit(%%rip)\n");
+        for (int r = 0; r < function->first_constant; r++) {
+            if (em->homes[r] >= 0 && em->types[r] == 1) {
+                fprintf(em->out, "    xorl %s, %s\n", x86_int_homes[em->homes[r]], x86_int_homes[em->homes[r]]);
+            }
+            else if (em->homes[r] >= 0) {
+                fprintf(em->out, "    xorpd %s, %s\n", x86_double_homes[em->homes[r]], x86_double_homes[em->homes[r]]);
+            }
+            else if (em->types[r] >= 0) {
+                fprintf(em->out, "    movq $0, %d(%%rbp)\n", x86_slot(em, r));
+            }
+        }
+        return;
+    }
+    fprintf(em->out, "    cmpq .Lstack_limit(%%rip), %%rsp\n");
+    fprintf(em->out, "    jb .L%d_overflow\n", em->f);
+    em->errors |= X86_OVERFLOW;
+
+    // Register params first, the stack ones move through the scratch registers
+    int ints = 0;
+    int doubles = 0;
+    int stacked = 0;
+    for (int p = 0; p < function->num_params; p++) {
+        int type = function->param_types[p];
+        if (type == 1 && ints < X86_INT_ARGS) {
+            x86_move(em, 1, x86_fixed(x86_int_args[ints++]), x86_reg(em, p));
+        }
+        else if (type == 0 && doubles < X86_DOUBLE_ARGS) {
+            x86_move(em, 0, x86_fixed(x86_double_args[doubles++]), x86_reg(em, p));
+        }
+    }
+    ints = 0;
+    doubles = 0;
+    for (int p = 0; p < function->num_params; p++) {
+        int type = function->param_types[p];
+        int in_register = (type == 1) ? (ints++ < X86_INT_ARGS) : (doubles++ < X86_DOUBLE_ARGS);
+        if (!in_register) {
+            x86_move(em, type, x86_memory(16 + 8 * stacked++), x86_reg(em, p));
+        }
+    }
+}
+
+// Writes the allocation of a function as a comment
+void x86_describe(struct x86_emitter* em){
+    struct vm_function* function = em->function;
+    fprintf(em->out, "# %s: %d registers, frame %d bytes", function->name, function->first_constant,
+            8 * em->num_saved + em->frame_size);
+    for (int r = 0; r < function->first_constant; r++) {
+        if (em->homes[r] >= 0) {
+            const char* home = (em->types[r] == 1) ? x86_int_homes[em->homes[r]] : x86_double_homes[em->homes[r]];
+            if (r < function->num_vars) {
+                fprintf(em->out, ", %s in %s", function->vars[r], home);
+            }
+            else {
+                fprintf(em->out, ", r%d in %s", r, home);
+            }
+        }
+    }
+    fprintf(em->out, "\n");
+}
+
+// Writes one function, returns 0 on success or 1 after writing an error
+int x86_emit_function(struct vm_program* vm, int f, FILE* out){
+    struct x86_emitter em = {out, vm, f, &vm->functions[f], NULL, NULL, NULL, NULL, 0, 0, 0, 0, NULL, 0, 0};
+    struct vm_function* function = em.function;
+    if (x86_plan_frame(&em)) {
+        free(em.types);
+        free(em.homes);
+        free(em.push_types);
+        free(em.targets);
+        return 1;
+    }
+    em.pending = malloc(sizeof(struct x86_pending) * (em.max_pending + 1));
+
+    char symbol[160];
+    x86_symbol(vm, f, symbol, sizeof(symbol));
+    fprintf(out, "\n");
+    x86_describe(&em);
+    if (f == vm->main) {
+        fprintf(out, "    .globl main\n");
+    }
+    fprintf(out, "    .type %s, @function\n", symbol);
+    fprintf(out, "%s:\n", symbol);
+    x86_prologue(&em);
+
+    int error = 0;
+    for (int pc = 0; pc < function->num_code && !error; pc++) {
+        struct vm_instr* instr = &function->code[pc];
+        if (em.targets[pc]) {
+            fprintf(out, ".L%d_%d:\n", f, pc);
+        }
+        if (x86_writes(instr->op)) {
+            x86_before_write(&em, instr->a);
+        }
+        int op = instr->op;
+        switch (op) {
+            case VM_MOV:
+                x86_move(&em, instr->c, x86_reg(&em, instr->b), x86_reg(&em, instr->a));
+                break;
+            case VM_I2D:
+            case VM_D2I: {
+                struct x86_operand from = x86_reg(&em, instr->b);
+                if (from.kind == X86_IMMEDIATE) {
+                    from = x86_in_register(&em, 1, instr->b);
+                }
+                struct x86_operand dest = x86_result(&em, op == VM_D2I, instr->a, from);
+                fprintf(out, "    %s %s, %s\n", (op == VM_I2D) ? "cvtsi2sdl" : "cvttsd2si", from.text, dest.text);
+                x86_move(&em, op == VM_D2I, dest, x86_reg(&em, instr->a));
+                break;
+            }
+            case VM_ADD_I:
+                x86_int_binary(&em, "addl", instr);
+                break;
+            case VM_SUB_I:
+                x86_int_binary(&em, "subl", instr);
+                break;
+            case VM_MUL_I:
+                x86_int_binary(&em, "imull", instr);
+                break;
+            case VM_DIV_I:
+            case VM_MOD_I:
+                x86_divide(&em, instr);
+                break;
+            case VM_ADD_D:
+                x86_double_binary(&em, "addsd", instr);
+                break;
+            case VM_SUB_D:
+                x86_double_binary(&em, "subsd", instr);
+                break;
+            case VM_MUL_D:
+                x86_double_binary(&em, "mulsd", instr);
+                break;
+            case VM_DIV_D:
+                x86_double_binary(&em, "divsd", instr);
+                break;
+            case VM_LT_I: case VM_GT_I: case VM_EQ_I: case VM_LE_I: case VM_GE_I: case VM_NE_I:
+                x86_compare(&em, 1, instr->b, instr->c);
+                x86_set(&em, TAC_LT + (op - VM_LT_I), 1, instr->a);
+                break;
+            case VM_LT_D: case VM_GT_D: case VM_EQ_D: case VM_LE_D: case VM_GE_D: case VM_NE_D:
+                x86_compare_relop(&em, TAC_LT + (op - VM_LT_D), 0, instr->b, instr->c);
+                x86_set(&em, TAC_LT + (op - VM_LT_D), 0, instr->a);
+                break;
+            case VM_NOT_I: {
+                struct x86_operand value = x86_in_register(&em, 1, instr->b);
+                fprintf(out, "    testl %s, %s\n", value.text, value.text);
+                x86_set(&em, TAC_EQ, 1, instr->a);
+                break;
+            }
+            case VM_OR_I:
+                x86_move(&em, 1, x86_reg(&em, instr->b), x86_fixed("%eax"));
+                fprintf(out, "    orl %s, %%eax\n", x86_reg(&em, instr->c).text);
+                x86_set(&em, TAC_NE, 1, instr->a);
+                break;
+            case VM_JMP:
+                fprintf(out, "    jmp .L%d_%d\n", f, instr->c);
+                break;
+            case VM_JZ_I: {
+                struct x86_operand value = x86_in_register(&em, 1, instr->b);
+                fprintf(out, "    testl %s, %s\n", value.text, value.text);
+                x86_jump(&em, TAC_EQ, 1, instr->c);
+                break;
+            }
+            case VM_JZ_D:
+                fprintf(out, "    xorpd %%xmm1, %%xmm1\n");
+                fprintf(out, "    ucomisd %s, %%xmm1\n", x86_reg(&em, instr->b).text);
+                x86_jump(&em, TAC_EQ, 0, instr->c);
+                break;
+            case VM_JLT_I: case VM_JGT_I: case VM_JEQ_I: case VM_JLE_I: case VM_JGE_I: case VM_JNE_I:
+                x86_compare(&em, 1, instr->a, instr->b);
+                x86_jump(&em, TAC_LT + (op - VM_JLT_I), 1, instr->c);
+                break;
+            case VM_JLT_D: case VM_JGT_D: case VM_JEQ_D: case VM_JLE_D: case VM_JGE_D: case VM_JNE_D:
+                x86_compare_relop(&em, TAC_LT + (op - VM_JLT_D), 0, instr->a, instr->b);
+                x86_jump(&em, TAC_LT + (op - VM_JLT_D), 0, instr->c);
+                break;
+            case VM_PRINT_I:
+            case VM_PRINT_D:
+                x86_print(&em, op == VM_PRINT_I, instr->a);
+                break;
+            case VM_PUSH: {
+                struct x86_pending pending = {instr->a, em.push_types[pc], 0};
+                em.pending[em.num_pending++] = pending;
+                break;
+            }
+            case VM_CALL: {
+                int type = vm->functions[instr->b].return_type;
+                x86_call(&em, instr->b);
+                x86_move(&em, type, x86_scratch(type), x86_reg(&em, instr->a));
+                break;
+            }
+            case VM_TAILCALL: {
+                // Params past the registers live in the caller's frame, so only register-only calls become jumps
+                struct vm_function* callee = &vm->functions[instr->b];
+                if (x86_stack_params(callee) > 0) {
+                    x86_call(&em, instr->b);
+                    x86_leave(&em);
+                    fprintf(out, "    ret\n");
+                    break;
+                }
+                x86_pass_arguments(&em, callee);
+                x86_symbol(vm, instr->b, symbol, sizeof(symbol));
+                x86_leave(&em);
+                fprintf(out, "    jmp %s\n", symbol);
+                break;
+            }
+            case VM_RET:
+                x86_move(&em, function->return_type, x86_reg(&em, instr->a), x86_scratch(function->return_type));
+                x86_leave(&em);
+                fprintf(out, "    ret\n");
+                break;
+            case VM_HALT:
+                fprintf(out, "    xorl %%eax, %%eax\n");
+                x86_leave(&em);
+                fprintf(out, "    ret\n");
+                break;
+            default:
+                fprintf(stderr, "x86 error: %s has opcode %s, which has no native code\n", function->name, vm_op_names[op]);
+                error = 1;
+                break;
+        }
+    }
+
+    // Error stubs, then the double constants of the function and its name for runtime errors
+    const char* stubs[3] = {"division", "modulo", "overflow"};
+    for (int s = 0; s < 3; s++) {
+        if (em.errors & (1 << s)) {
+            fprintf(out, ".L%d_%s:\n", f, stubs[s]);
+            fprintf(out, "    leaq .Lname%d(%%rip), %%rsi\n", f);
+            fprintf(out, "    leaq .Lerror_%s(%%rip), %%rdx\n", stubs[s]);
+            fprintf(out, "    jmp .Lruntime_error\n");
+        }
+    }
+    fprintf(out, "    .size %s, .-%s\n", symbol, symbol);
+    fprintf(out, "    .section .rodata\n");
+    fprintf(out, ".Lname%d:\n", f);
+    fprintf(out, "    .string \"%s\"\n", function->name);
+    fprintf(out, "    .align 8\n");
+    for (int k = 0; k < function->num_constants; k++) {
+        if (em.types[function->first_constant + k] == 0) {
+            union {
+                double d;
+                unsigned long long bits;
+            } value = {function->constants[k].d};
+            fprintf(out, ".LC%d_%d:\n", f, k);
+            fprintf(out, "    .quad 0x%llx\n", value.bits);
+        }
+    }
+    fprintf(out, "    .text\n");
+
+    free(em.types);
+    free(em.homes);
+    free(em.push_types);
+    free(em.targets);
+    free(em.pending);
+    return error;
+}
+
+/******************************** Driver ********************************/
+// Writes the program as x86-64 assembly, returns 0 on success or 1 after writing an error
+int x86_write_program(struct tac_program* program, FILE* out){
+    struct vm_program vm;
+    if (vm_lower_program(program, &vm)) {
+        free_vm_program(&vm);
+        return 1;
+    }
+    fprintf(out, "# Generated from the three address code, System V x86-64\n");
+    fprintf(out, "    .text\n");
+    int error = 0;
+    for (int f = 0; f < vm.num_functions && !error; f++) {
+        vm_rotate_loops(&vm.functions[f]);
+        error = x86_emit_function(&vm, f, out);
+    }
+
+    // Runtime errors flush the prints before them, report like the VM and exit with 1. The stubs jump here with
+    // the function name in %rsi and the message in %rdx.
+    fprintf(out, "\n.Lruntime_error:\n");
+    fprintf(out, "    andq $-16, %%rsp\n");
+    fprintf(out, "    movq %%rsi, %%rbx\n");
+    fprintf(out, "    movq %%rdx, %%r12\n");
+    fprintf(out, "    xorl %%edi, %%edi\n");
+    fprintf(out, "    call fflush@PLT\n");
+    fprintf(out, "    movq stderr@GOTPCREL(%%rip), %%rax\n");
+    fprintf(out, "    movq (%%rax), %%rdi\n");
+    fprintf(out, "    leaq .Lruntime_format(%%rip), %%rsi\n");
+    fprintf(out, "    movq %%rbx, %%rdx\n");
+    fprintf(out, "    movq %%r12, %%rcx\n");
+    fprintf(out, "    xorl %%eax, %%eax\n");
+    fprintf(out, "    call fprintf@PLT\n");
+    fprintf(out, "    movl $1, %%edi\n");
+    fprintf(out, "    call exit@PLT\n");
+    fprintf(out, "    .section .rodata\n");
+    fprintf(out, ".Lprint_int:\n    .string \"%%d\\n\"\n");
+    fprintf(out, ".Lprint_double:\n    .string \"%%f\\n\"\n");
+    fprintf(out, ".Lruntime_format:\n    .string \"Runtime error in %%s: %%s\\n\"\n");
+    fprintf(out, ".Lerror_division:\n    .string \"division by zero\"\n");
+    fprintf(out, ".Lerror_modulo:\n    .string \"modulo by zero\"\n");
+    fprintf(out, ".Lerror_overflow:\n    .string \"stack overflow\"\n");
+    fprintf(out, "    .bss\n");
+    fprintf(out, "    .align 8\n");
+    fprintf(out, ".Lstack_limit:\n    .zero 8\n");
+    fprintf(out, "    .section .note.GNU-stack,\"\",@progbits\n");
+    free_vm_program(&vm);
+    return error;
+}
+
+// Assembles and links the assembly into an executable with the system compiler driver, returns 0 on success
+int x86_link(const char* assembly, const char* executable){
+    char command[512];
+    snprintf(command, sizeof(command), "%s -o %s %s", X86_CC, executable, assembly);
+    if (system(command) != 0) {
+        fprintf(stderr, "x86 error: %s failed\n", command);
+        return 1;
+    }
+    return 0;
+}
+
+#endif // X86_H